@@ -29,9 +29,13 @@
     #include <io.h>
 #else
     #include <sys/time.h>
+    #include <sys/mman.h>
     #include <unistd.h>
     #include <dirent.h>
     #include <libgen.h>
+    #if defined(__GLIBC__)
+        #include <malloc.h>
+    #endif
 #endif
 
 
@@ -52,6 +56,18 @@
     #define NEON_UNLIKELY(x) (x)
 #endif
 
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    #include <arm_neon.h>
+#endif
+
+/* the AVX2 search kernel is compiled for AVX2 on its own, and only used if the CPU has it; see Util::findBytes() */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #include <immintrin.h>
+    #define NEON_SEARCH_HAVEAVX2
+#endif
+
 #include "optparse.h"
 #include "lino.h"
 #include "allocator.h"
@@ -71,6 +87,71 @@
 /* global debug mode flag */
 #define NEON_CONFIG_DEBUGGC 0
 
+/*
+* if enabled, Value is stored as a single NaN-boxed 64bit word (8 bytes) instead of
+* a tagged union (16 bytes). set to 0 to use the tagged union, which is easier to inspect in a debugger.
+* can be overriden from the command line, i.e., -DNEON_CONFIG_USENANTAGGING=0
+*/
+#if !defined(NEON_CONFIG_USENANTAGGING)
+    #define NEON_CONFIG_USENANTAGGING 1
+#endif
+
+/*
+* if enabled, common instruction sequences are fused into superinstructions after compiling
+* (see AstParser::fusesuperinstructions).
+*/
+#if !defined(NEON_CONFIG_USESUPERINSTRUCTIONS)
+    #define NEON_CONFIG_USESUPERINSTRUCTIONS 1
+#endif
+
+/*
+* if enabled, generic arithmetic instructions rewrite themselves into type-specialized variants
+* once the types of their operands are known (see Instruction::OPC_PRIMADDNUM).
+*/
+#if !defined(NEON_CONFIG_USEQUICKENING)
+    #define NEON_CONFIG_USEQUICKENING 1
+#endif
+
+/*
+* if enabled, the '--jit' flag compiles hot functions to native code (see JitCompiler).
+* only available for x86-64 on linux, and only with NaN-boxed values, since the generated code
+* manipulates Values as plain 64bit words.
+*/
+#if !defined(NEON_CONFIG_USEJIT)
+    #if defined(__x86_64__) && defined(__linux__) && (defined(__GNUC__) || defined(__clang__)) && (NEON_CONFIG_USENANTAGGING == 1)
+        #define NEON_CONFIG_USEJIT 1
+    #else
+        #define NEON_CONFIG_USEJIT 0
+    #endif
+#endif
+
+/*
+* if enabled, unreachable objects are freed on a helper thread (see BackgroundSweeper) while the VM goes on.
+* this needs a thread-safe allocator, so it is not available with NEON_CONF_MEMUSEALLOCATOR.
+*/
+#if !defined(NEON_CONFIG_USEBACKGROUNDSWEEP)
+    #if (NEON_CONF_MEMUSEALLOCATOR == 0)
+        #define NEON_CONFIG_USEBACKGROUNDSWEEP 1
+    #else
+        #define NEON_CONFIG_USEBACKGROUNDSWEEP 0
+    #endif
+#endif
+
+/*
+* if enabled, full collections of large heaps trace the heap on several threads (see ParallelMarker).
+* the number of threads is set with --gc-mark-threads.
+*/
+#if !defined(NEON_CONFIG_USEPARALLELMARK)
+    #define NEON_CONFIG_USEPARALLELMARK 1
+#endif
+
+#if (defined(NEON_CONFIG_USEBACKGROUNDSWEEP) && (NEON_CONFIG_USEBACKGROUNDSWEEP == 1)) || (defined(NEON_CONFIG_USEPARALLELMARK) && (NEON_CONFIG_USEPARALLELMARK == 1))
+    #include <atomic>
+    #include <thread>
+    #include <mutex>
+    #include <condition_variable>
+#endif
+
 #define NEON_INFO_COPYRIGHT "based on the Blade Language, Copyright (c) 2021 - 2023 Ore Richard Muyiwa"
 
 #if !defined(S_IFLNK)
@@ -224,6 +305,7 @@ namespace neon
     class /**/ Switch;
     class /**/ Dict;
     class /**/ Range;
+    class /**/ Shape;
     class /**/ FuncContext;
     class ArgCheck;
 
@@ -252,6 +334,7 @@ namespace neon
     void setupModulePaths();
     void installObjNumber();
     void installModMath();
+    void installModGC();
     void installObjObject();
     void installObjProcess();
     void installObjRange();
@@ -347,6 +430,14 @@ namespace neon
                 #endif
             }
 
+            /*
+            * for the buffers of ValList, StrBufBasic and HashTable. the change in size is counted in
+            * SharedState::m_gcstate.bytesallocated, so that growing a buffer brings the next collection
+            * closer, just like making an object does. defined after SharedState.
+            */
+            static void* gcRealloc(void* ptr, size_t oldsize, size_t newsize);
+            static void gcFree(void* ptr, size_t size);
+
             template<typename ClassT, typename... ArgsT>
             static inline ClassT* make(ArgsT&&... args)
             {
@@ -612,6 +703,8 @@ namespace neon
         };
 
         static int osfn_gettimeofday(struct timeval* tp, void* tzp);
+        static int64_t osfn_monotonicmicros();
+        static int64_t osfn_cgroupmemlimit();
 
         size_t roundUpToPowe64(uint64_t x)
         {
@@ -652,782 +745,1609 @@ namespace neon
             return hashBits(bits.bits);
         }
 
+        /* the 128bit product of $a and $b; the low half goes to $a, the high half to $b */
+        NEON_INLINE void hashMultiply(uint64_t* a, uint64_t* b)
+        {
+        #if defined(__SIZEOF_INT128__)
+            __uint128_t r;
+            r = *a;
+            r *= *b;
+            *a = (uint64_t)r;
+            *b = (uint64_t)(r >> 64);
+        #else
+            uint64_t ha;
+            uint64_t hb;
+            uint64_t la;
+            uint64_t lb;
+            uint64_t rh;
+            uint64_t rm0;
+            uint64_t rm1;
+            uint64_t rl;
+            uint64_t t;
+            uint64_t lo;
+            ha = *a >> 32;
+            hb = *b >> 32;
+            la = (uint32_t)*a;
+            lb = (uint32_t)*b;
+            rh = ha * hb;
+            rm0 = ha * lb;
+            rm1 = hb * la;
+            rl = la * lb;
+            t = rl + (rm0 << 32);
+            lo = t + (rm1 << 32);
+            rh += (rm0 >> 32) + (rm1 >> 32) + (uint64_t)(t < rl) + (uint64_t)(lo < t);
+            *a = lo;
+            *b = rh;
+        #endif
+        }
+
+        NEON_INLINE uint64_t hashMix(uint64_t a, uint64_t b)
+        {
+            hashMultiply(&a, &b);
+            return a ^ b;
+        }
+
+        NEON_INLINE uint64_t hashRead8(const uint8_t* p)
+        {
+            uint64_t v;
+            memcpy(&v, p, 8);
+            return v;
+        }
+
+        NEON_INLINE uint64_t hashRead4(const uint8_t* p)
+        {
+            uint32_t v;
+            memcpy(&v, p, 4);
+            return v;
+        }
+
+        /*
+        * hashes $length bytes of $str. this is wyhash (by Wang Yi; public domain): 16 bytes per
+        * 64x64->128bit multiplication, and three independent lanes for inputs over 48 bytes, so it
+        * runs at several bytes per cycle with plain integer instructions.
+        * never returns 0, which String uses for a hash that was not computed yet.
+        */
         NEON_INLINE uint32_t hashString(const char* str, size_t length)
         {
-            /* Source: https://stackoverflow.com/a/21001712 */
-            size_t ci;
-            unsigned int byte;
-            unsigned int crc;
-            unsigned int mask;
-            int i = 0;
-            int j;
-            crc = 0xFFFFFFFF;
-            ci = 0;
-            while(ci < length)
+            size_t i;
+            uint64_t a;
+            uint64_t b;
+            uint64_t seed;
+            uint64_t see1;
+            uint64_t see2;
+            uint64_t hs;
+            const uint8_t* p;
+            static const uint64_t secret[4] = { 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull };
+            p = (const uint8_t*)str;
+            seed = hashMix(secret[0], secret[1]);
+            if(NEON_LIKELY(length <= 16))
+            {
+                if(NEON_LIKELY(length >= 4))
+                {
+                    a = (hashRead4(p) << 32) | hashRead4(p + ((length >> 3) << 2));
+                    b = (hashRead4(p + length - 4) << 32) | hashRead4(p + length - 4 - ((length >> 3) << 2));
+                }
+                else if(length > 0)
+                {
+                    a = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+                    b = 0;
+                }
+                else
+                {
+                    a = 0;
+                    b = 0;
+                }
+            }
+            else
             {
-                byte = str[i];
-                crc = crc ^ byte;
-                for(j = 7; j >= 0; j--)
+                i = length;
+                if(NEON_UNLIKELY(i > 48))
+                {
+                    see1 = seed;
+                    see2 = seed;
+                    do
+                    {
+                        seed = hashMix(hashRead8(p) ^ secret[1], hashRead8(p + 8) ^ seed);
+                        see1 = hashMix(hashRead8(p + 16) ^ secret[2], hashRead8(p + 24) ^ see1);
+                        see2 = hashMix(hashRead8(p + 32) ^ secret[3], hashRead8(p + 40) ^ see2);
+                        p += 48;
+                        i -= 48;
+                    } while(NEON_LIKELY(i > 48));
+                    seed ^= see1 ^ see2;
+                }
+                while(i > 16)
                 {
-                    mask = -(crc & 1);
-                    crc = (crc >> 1) ^ (0xEDB88320 & mask);
+                    seed = hashMix(hashRead8(p) ^ secret[1], hashRead8(p + 8) ^ seed);
+                    i -= 16;
+                    p += 16;
                 }
-                i = i + 1;
-                ci++;
+                a = hashRead8(p + i - 16);
+                b = hashRead8(p + i - 8);
+            }
+            a ^= secret[1];
+            b ^= seed;
+            hashMultiply(&a, &b);
+            hs = hashMix(a ^ secret[0] ^ length, b ^ secret[1]);
+            hs ^= (hs >> 32);
+            if((uint32_t)hs == 0)
+            {
+                return 1;
             }
-            return ~crc;
+            return (uint32_t)hs;
         }
 
-        /* returns the number of bytes contained in a unicode character */
-        int utf8NumBytes(int value)
+        /* whether the $length bytes at $a and $b are the same; compares 16 bytes at a time where SIMD is available */
+        NEON_INLINE bool bytesEqual(const char* a, const char* b, size_t length)
         {
-            if(value < 0)
+            size_t i;
+            uint64_t wa;
+            uint64_t wb;
+            i = 0;
+        #if defined(__SSE2__)
+            while((i + 16) <= length)
             {
-                return -1;
+                __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+                __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+                if(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xFFFF)
+                {
+                    return false;
+                }
+                i += 16;
             }
-            if(value <= 0x7f)
+        #elif defined(__aarch64__) && defined(__ARM_NEON)
+            while((i + 16) <= length)
             {
-                return 1;
+                uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t*)(a + i)), vld1q_u8((const uint8_t*)(b + i)));
+                if(vminvq_u8(eq) != 0xFF)
+                {
+                    return false;
+                }
+                i += 16;
             }
-            if(value <= 0x7ff)
+        #endif
+            while((i + 8) <= length)
             {
-                return 2;
+                memcpy(&wa, a + i, 8);
+                memcpy(&wb, b + i, 8);
+                if(wa != wb)
+                {
+                    return false;
+                }
+                i += 8;
             }
-            if(value <= 0xffff)
+            while(i < length)
             {
-                return 3;
+                if(a[i] != b[i])
+                {
+                    return false;
+                }
+                i++;
             }
-            if(value <= 0x10ffff)
+            return true;
+        }
+
+        /*
+        * substring search, for indexOf(), count(), split() and replace().
+        * needles of up to CONF_SEARCHSHORTNEEDLE bytes are found by looking for the positions where both the
+        * first and the last byte of the needle match, and comparing the rest only there. the SSE2 and AVX2
+        * kernels test 32 or 64 positions at once; the portable one finds candidates with memchr(), by the byte
+        * of the needle that is least common in text (see searchByteRank()).
+        * longer needles are found by CONF_SEARCHSHORTNEEDLE bytes of theirs the same way, picked so that the
+        * bytes at both ends are uncommon, and when that yields too many false candidates, by the Two-Way
+        * algorithm of Crochemore and Perrin, which takes linear time whatever the needle, and skips ahead by
+        * the last two bytes of the window, like Horspool does.
+        */
+        enum
+        {
+            CONF_SEARCHSHORTNEEDLE = 32,
+            /* see findShortByte() */
+            CONF_SEARCHBYTEGAP = 64,
+        };
+
+        /*
+        * finds a needle of 2 to CONF_SEARCHSHORTNEEDLE bytes, in a haystack at least as long. $rarest is the
+        * offset of its least common byte, which the kernels that use memchr() look for.
+        */
+        typedef const char* (*FindShortFn)(const char* hay, size_t haylen, const char* needle, size_t needlelen, size_t rarest);
+
+        /* what a search works out about its needle once, so that count(), split() and replace() need not redo it at every match */
+        struct SearchNeedle
+        {
+            const char* data;
+            size_t length;
+            /* the offset of the least common byte, by searchByteRank() */
+            size_t rarest;
+            /* for needles longer than CONF_SEARCHSHORTNEEDLE: where the bytes that findLong() looks for start, and their least common one */
+            size_t window;
+            size_t windowrarest;
+        };
+
+        static NEON_INLINE int searchLowestBit(uint32_t mask)
+        {
+        #if defined(__GNUC__) || defined(__clang__)
+            return __builtin_ctz(mask);
+        #else
+            int i;
+            i = 0;
+            while((mask & 1) == 0)
             {
-                return 4;
+                mask >>= 1;
+                i++;
             }
-            return 0;
+            return i;
+        #endif
         }
 
-        char* utf8Encode(unsigned int code, size_t* dlen)
+        /* how common every byte is in text, roughly, from the lowercase letters and the space */
+        struct SearchRanks
         {
-            int count;
-            char* chars;
-            *dlen = 0;
-            count = utf8NumBytes((int)code);
-            if(NEON_LIKELY(count > 0))
+            unsigned char ranks[256];
+
+            constexpr SearchRanks() : ranks()
             {
-                *dlen = count;
-                chars = (char*)Memory::sysMalloc(sizeof(char) * ((size_t)count + 1));
-                if(chars != nullptr)
+                size_t i;
+                const char common[] = "zqjxkvbpygfwmucldrhsnioate ";
+                for(i = 0; i < (sizeof(common) - 1); i++)
                 {
-                    if(code <= 0x7F)
-                    {
-                        chars[0] = (char)(code & 0x7F);
-                        chars[1] = '\0';
-                    }
-                    else if(code <= 0x7FF)
-                    {
-                        /* one continuation byte */
-                        chars[1] = (char)(0x80 | (code & 0x3F));
-                        code = (code >> 6);
-                        chars[0] = (char)(0xC0 | (code & 0x1F));
-                    }
-                    else if(code <= 0xFFFF)
-                    {
-                        /* two continuation bytes */
-                        chars[2] = (char)(0x80 | (code & 0x3F));
-                        code = (code >> 6);
-                        chars[1] = (char)(0x80 | (code & 0x3F));
-                        code = (code >> 6);
-                        chars[0] = (char)(0xE0 | (code & 0xF));
-                    }
-                    else if(code <= 0x10FFFF)
-                    {
-                        /* three continuation bytes */
-                        chars[3] = (char)(0x80 | (code & 0x3F));
-                        code = (code >> 6);
-                        chars[2] = (char)(0x80 | (code & 0x3F));
-                        code = (code >> 6);
-                        chars[1] = (char)(0x80 | (code & 0x3F));
-                        code = (code >> 6);
-                        chars[0] = (char)(0xF0 | (code & 0x7));
-                    }
-                    else
-                    {
-                        /* unicode replacement character */
-                        chars[2] = (char)0xEF;
-                        chars[1] = (char)0xBF;
-                        chars[0] = (char)0xBD;
-                    }
-                    return chars;
+                    ranks[(unsigned char)common[i]] = i + 1;
                 }
             }
-            return nullptr;
+        };
+
+        static constexpr SearchRanks g_searchranks;
+
+        /*
+        * how common $c is in text, roughly; 0 for bytes that are not among the common ones. a filter that
+        * looks for the rarer bytes of a needle turns up fewer false candidates.
+        */
+        static NEON_INLINE int searchByteRank(unsigned char c)
+        {
+            return g_searchranks.ranks[c];
         }
 
-        int utf8Decode(const uint8_t* bytes, uint32_t length)
+        /* the offset of the least common byte of $needle, by searchByteRank() */
+        static size_t searchRarestByte(const char* needle, size_t needlelen)
         {
-            int value;
-            uint32_t remainingbytes;
-            /* Single byte (i.e. fits in ASCII). */
-            if(*bytes <= 0x7f)
-            {
-                return *bytes;
-            }
-            if((*bytes & 0xe0) == 0xc0)
-            {
-                /* Two byte sequence: 110xxxxx 10xxxxxx. */
-                value = *bytes & 0x1f;
-                remainingbytes = 1;
-            }
-            else if((*bytes & 0xf0) == 0xe0)
+            size_t i;
+            size_t k;
+            int rank;
+            int bestrank;
+            k = 0;
+            bestrank = searchByteRank(needle[0]);
+            for(i = 1; (i < needlelen) && (bestrank > 0); i++)
             {
-                /* Three byte sequence: 1110xxxx	 10xxxxxx 10xxxxxx. */
-                value = *bytes & 0x0f;
-                remainingbytes = 2;
+                rank = searchByteRank(needle[i]);
+                if(rank < bestrank)
+                {
+                    k = i;
+                    bestrank = rank;
+                }
             }
-            else if((*bytes & 0xf8) == 0xf0)
+            return k;
+        }
+
+        /*
+        * fills in $sn for $needle. the window of a long needle is the one whose first and last bytes are least
+        * common, since those are what the SIMD kernels filter on; a prefix would do badly on needles that start
+        * like much of the text does.
+        */
+        void searchPrepare(SearchNeedle* sn, const char* needle, size_t needlelen)
+        {
+            size_t i;
+            int rank;
+            int bestrank;
+            sn->data = needle;
+            sn->length = needlelen;
+            sn->rarest = 0;
+            sn->window = 0;
+            sn->windowrarest = 0;
+            if(needlelen < 2)
             {
-                /* Four byte sequence: 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx. */
-                value = *bytes & 0x07;
-                remainingbytes = 3;
+                return;
             }
-            else
+            if(needlelen <= CONF_SEARCHSHORTNEEDLE)
             {
-                /* Invalid UTF-8 sequence. */
-                return -1;
+                sn->rarest = searchRarestByte(needle, needlelen);
+                return;
             }
-            /* Don't read past the end of the buffer on truncated UTF-8. */
-            if(remainingbytes > length - 1)
+            bestrank = searchByteRank(needle[0]) + searchByteRank(needle[CONF_SEARCHSHORTNEEDLE - 1]);
+            for(i = 1; ((i + CONF_SEARCHSHORTNEEDLE) <= needlelen) && (bestrank > 0); i++)
             {
-                return -1;
+                rank = searchByteRank(needle[i]) + searchByteRank(needle[i + CONF_SEARCHSHORTNEEDLE - 1]);
+                if(rank < bestrank)
+                {
+                    sn->window = i;
+                    bestrank = rank;
+                }
             }
-            while(remainingbytes > 0)
+            sn->windowrarest = searchRarestByte(needle + sn->window, CONF_SEARCHSHORTNEEDLE);
+        }
+
+        /*
+        * finds candidates with memchr(), by the byte of the needle at offset $k. given a $fallback, the rest of
+        * $hay is left to it once there is more than one false candidate in every CONF_SEARCHBYTEGAP bytes, since
+        * memchr() does not get far between candidates that common.
+        */
+        const char* findShortByte(const char* hay, size_t haylen, const char* needle, size_t needlelen, size_t k, FindShortFn fallback)
+        {
+            size_t misses;
+            const char* at;
+            const char* last;
+            misses = 0;
+            at = hay + k;
+            last = hay + (haylen - needlelen) + k;
+            while(at <= last)
             {
-                bytes++;
-                remainingbytes--;
-                /* Remaining bytes must be of form 10xxxxxx. */
-                if((*bytes & 0xc0) != 0x80)
+                at = (const char*)memchr(at, needle[k], (last - at) + 1);
+                if(at == nullptr)
                 {
-                    return -1;
+                    return nullptr;
+                }
+                if(memcmp(at - k, needle, needlelen) == 0)
+                {
+                    return at - k;
+                }
+                at++;
+                misses++;
+                if((fallback != nullptr) && (at <= last) && ((misses * CONF_SEARCHBYTEGAP) > (size_t)(at - hay) + (8 * CONF_SEARCHBYTEGAP)))
+                {
+                    return fallback(at - k, haylen - ((at - k) - hay), needle, needlelen, k);
                 }
-                value = value << 6 | (*bytes & 0x3f);
             }
-            return value;
+            return nullptr;
         }
 
-        char* utf8Codepoint(const char* str, char* outcodepoint)
+        const char* findShortScalar(const char* hay, size_t haylen, const char* needle, size_t needlelen, size_t rarest)
         {
-            if(0xf0 == (0xf8 & str[0]))
-            {
-                /* 4 byte utf8 codepoint */
-                *outcodepoint = (((0x07 & str[0]) << 18) | ((0x3f & str[1]) << 12) | ((0x3f & str[2]) << 6) | (0x3f & str[3]));
-                str += 4;
+            return findShortByte(hay, haylen, needle, needlelen, rarest, nullptr);
+        }
+
+    #if defined(__SSE2__)
+        const char* findShortSSE2(const char* hay, size_t haylen, const char* needle, size_t needlelen, size_t rarest)
+        {
+            size_t i;
+            uint32_t mask;
+            __m128i eqa;
+            __m128i eqb;
+            __m128i first;
+            __m128i last;
+            first = _mm_set1_epi8(needle[0]);
+            last = _mm_set1_epi8(needle[needlelen - 1]);
+            i = 0;
+            /* the window at $i covers the first bytes of 16 candidates, the one at $i + $needlelen - 1 their last bytes */
+            while((i + needlelen + 15) <= haylen)
+            {
+                eqa = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(hay + i)), first),
+                    _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(hay + i + needlelen - 1)), last));
+                /* as in findShortAVX2(), two windows are tested at once where there is room */
+                if((i + needlelen + 31) <= haylen)
+                {
+                    eqb = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(hay + i + 16)), first),
+                        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(hay + i + needlelen + 15)), last));
+                    if(_mm_movemask_epi8(_mm_or_si128(eqa, eqb)) == 0)
+                    {
+                        i += 32;
+                        continue;
+                    }
+                }
+                mask = _mm_movemask_epi8(eqa);
+                while(mask != 0)
+                {
+                    if(memcmp(hay + i + searchLowestBit(mask) + 1, needle + 1, needlelen - 2) == 0)
+                    {
+                        return hay + i + searchLowestBit(mask);
+                    }
+                    mask &= (mask - 1);
+                }
+                i += 16;
             }
-            else if(0xe0 == (0xf0 & str[0]))
+            if((i + needlelen) > haylen)
             {
-                /* 3 byte utf8 codepoint */
-                *outcodepoint = (((0x0f & str[0]) << 12) | ((0x3f & str[1]) << 6) | (0x3f & str[2]));
-                str += 3;
-            }
-            else if(0xc0 == (0xe0 & str[0]))
-            {
-                /* 2 byte utf8 codepoint */
-                *outcodepoint = (((0x1f & str[0]) << 6) | (0x3f & str[1]));
-                str += 2;
-            }
-            else
-            {
-                /* 1 byte utf8 codepoint otherwise */
-                *outcodepoint = str[0];
-                str += 1;
+                return nullptr;
             }
-            return (char*)str;
+            return findShortScalar(hay + i, haylen - i, needle, needlelen, rarest);
         }
+    #endif
 
-        char* utf8Strstr(const char* haystack, const char* needle)
+    #if defined(NEON_SEARCH_HAVEAVX2)
+        __attribute__((target("avx2"))) const char* findShortAVX2(const char* hay, size_t haylen, const char* needle, size_t needlelen, size_t rarest)
         {
-            char throwawaycodepoint;
-            const char* n;
-            const char* maybematch;
-            throwawaycodepoint = 0;
-            /* if needle has no utf8 codepoints before the null terminating
-             * byte then return haystack */
-            if('\0' == *needle)
-            {
-                return (char*)haystack;
-            }
-            while('\0' != *haystack)
-            {
-                maybematch = haystack;
-                n = needle;
-                while(*haystack == *n && (*haystack != '\0' && *n != '\0'))
-                {
-                    n++;
-                    haystack++;
-                }
-                if('\0' == *n)
-                {
-                    /* we found the whole utf8 string for needle in haystack at
-                     * maybematch, so return it */
-                    return (char*)maybematch;
+            size_t i;
+            uint32_t mask;
+            __m256i eqa;
+            __m256i eqb;
+            __m256i first;
+            __m256i last;
+            first = _mm256_set1_epi8(needle[0]);
+            last = _mm256_set1_epi8(needle[needlelen - 1]);
+            i = 0;
+            while((i + needlelen + 31) <= haylen)
+            {
+                eqa = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(hay + i)), first),
+                    _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(hay + i + needlelen - 1)), last));
+                /* most windows have no candidate at all, so two are tested at once where there is room */
+                if((i + needlelen + 63) <= haylen)
+                {
+                    eqb = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(hay + i + 32)), first),
+                        _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(hay + i + needlelen + 31)), last));
+                    if(_mm256_testz_si256(_mm256_or_si256(eqa, eqb), _mm256_or_si256(eqa, eqb)))
+                    {
+                        i += 64;
+                        continue;
+                    }
                 }
-                else
+                mask = (uint32_t)_mm256_movemask_epi8(eqa);
+                while(mask != 0)
                 {
-                    /* h could be in the middle of an unmatching utf8 codepoint,
-                     * so we need to march it on to the next character beginning
-                     * starting from the current character */
-                    haystack = utf8Codepoint(maybematch, &throwawaycodepoint);
+                    if(memcmp(hay + i + searchLowestBit(mask) + 1, needle + 1, needlelen - 2) == 0)
+                    {
+                        return hay + i + searchLowestBit(mask);
+                    }
+                    mask &= (mask - 1);
                 }
+                i += 32;
             }
-            /* no match */
-            return nullptr;
+            if((i + needlelen) > haylen)
+            {
+                return nullptr;
+            }
+            return findShortScalar(hay + i, haylen - i, needle, needlelen, rarest);
         }
+    #endif
+
+        const char* findShortDetect(const char* hay, size_t haylen, const char* needle, size_t needlelen, size_t rarest);
+
+        /* starts out as findShortDetect(), which replaces itself with the best kernel the CPU has */
+        static FindShortFn g_findshort = findShortDetect;
+
+        /* the best vector kernel the CPU has, which findShortAuto() falls back to */
+        static FindShortFn g_findvector = findShortScalar;
 
         /*
-        // returns a pointer to the beginning of the pos'th utf8 codepoint
-        // in the buffer at s
+        * memchr() is faster than the vector kernels, as long as the byte it looks for is rare in $hay; so it
+        * goes first if the needle has a byte that is not among the common ones in text, and leaves the rest
+        * to the vector kernel if that byte turns out to be common in $hay after all. needles of common bytes
+        * only go to the vector kernel, since count(), split() and replace() start a search at every match,
+        * which would start memchr() over on its many false candidates each time.
         */
-        char* utf8Index(char* s, int pos)
+        const char* findShortAuto(const char* hay, size_t haylen, const char* needle, size_t needlelen, size_t rarest)
         {
-            ++pos;
-            for(; *s; ++s)
+            if(searchByteRank(needle[rarest]) >= searchByteRank('m'))
             {
-                if((*s & 0xC0) != 0x80)
-                {
-                    --pos;
-                }
-                if(pos == 0)
-                {
-                    return s;
-                }
+                return g_findvector(hay, haylen, needle, needlelen, rarest);
             }
-            return nullptr;
+            return findShortByte(hay, haylen, needle, needlelen, rarest, g_findvector);
+        }
+
+        /* the names that setSearchKernel() takes here */
+        static const char* searchKernelNames()
+        {
+        #if defined(NEON_SEARCH_HAVEAVX2)
+            if(__builtin_cpu_supports("avx2"))
+            {
+                return "auto, avx2, sse2, scalar";
+            }
+        #endif
+        #if defined(__SSE2__)
+            return "auto, sse2, scalar";
+        #else
+            return "auto, scalar";
+        #endif
         }
 
         /*
-        // converts codepoint indexes start and end to byte offsets in the buffer at s
+        * picks the kernel for short needles, by name; returns false if this build or CPU does not have it.
+        * "auto" is findShortAuto(), on top of the best vector kernel there is.
         */
-        void utf8Slice(char* s, int* start, int* end)
+        bool setSearchKernel(const char* name)
         {
-            char* p;
-            p = utf8Index(s, *start);
-            if(p != nullptr)
+            bool isauto;
+            isauto = (strcmp(name, "auto") == 0);
+            g_findvector = findShortScalar;
+        #if defined(__SSE2__)
+            g_findvector = findShortSSE2;
+        #endif
+        #if defined(NEON_SEARCH_HAVEAVX2)
+            if(__builtin_cpu_supports("avx2"))
             {
-                *start = (int)(p - s);
+                g_findvector = findShortAVX2;
             }
-            else
+            if((strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2"))
             {
-                *start = -1;
+                g_findshort = findShortAVX2;
+                return true;
             }
-            p = utf8Index(s, *end);
-            if(p != nullptr)
+        #endif
+        #if defined(__SSE2__)
+            if(strcmp(name, "sse2") == 0)
             {
-                *end = (int)(p - s);
+                g_findshort = findShortSSE2;
+                return true;
             }
-            else
+        #endif
+            if(isauto)
             {
-                *end = (int)strlen(s);
+                g_findshort = findShortAuto;
+                return true;
             }
-        }
-
-        char* stringDup(const char* src, size_t len)
-        {
-            char* buf;
-            buf = (char*)Memory::sysMalloc(sizeof(char) * (len + 1));
-            if(buf == nullptr)
+            if(strcmp(name, "scalar") == 0)
             {
-                return nullptr;
+                g_findshort = findShortScalar;
+                return true;
             }
-            memset(buf, 0, len + 1);
-            memcpy(buf, src, len);
-            return buf;
+            return false;
         }
 
-        char* stringDup(const char* src)
+        const char* findShortDetect(const char* hay, size_t haylen, const char* needle, size_t needlelen, size_t rarest)
         {
-            return stringDup(src, strlen(src));
+            setSearchKernel("auto");
+            return g_findshort(hay, haylen, needle, needlelen, rarest);
         }
 
-        void mtrandSeed(uint32_t seed, uint32_t* binst, uint32_t* index)
+        NEON_INLINE size_t searchPairHash(unsigned char a, unsigned char b)
         {
-            uint32_t i;
-            binst[0] = seed;
-            for(i = 1; i < CONF_MERSENNESTATESIZE; i++)
-            {
-                binst[i] = (uint32_t)(1812433253UL * (binst[i - 1] ^ (binst[i - 1] >> 30)) + i);
-            }
-            *index = CONF_MERSENNESTATESIZE;
+            return ((a << 3) ^ b) & 255;
         }
 
-        uint32_t mtrandGenerate(uint32_t* binst, uint32_t* index)
+        const char* findTwoWay(const char* hay, size_t haylen, const char* needle, size_t needlelen)
         {
-            uint32_t i;
-            uint32_t y;
-            if(*index >= CONF_MERSENNESTATESIZE)
+            size_t i;
+            size_t k;
+            size_t p;
+            size_t p0;
+            size_t ip;
+            size_t jp;
+            size_t ms;
+            size_t at;
+            size_t mem;
+            size_t mem0;
+            size_t shift[256];
+            const unsigned char* h;
+            const unsigned char* n;
+            h = (const unsigned char*)hay;
+            n = (const unsigned char*)needle;
+            /*
+            * the last position of every pair of bytes in the needle, by a hash of the pair; 0 for pairs that are
+            * not in it. the pair at the end of the window skips much further than a single byte would, since
+            * text is made of few distinct bytes but many distinct pairs. pairs that share a hash keep the
+            * later position, which only makes the skip shorter.
+            */
+            memset(shift, 0, sizeof(shift));
+            for(i = 1; i < needlelen; i++)
             {
-                for(i = 0; i < CONF_MERSENNESTATESIZE - 397; i++)
+                shift[searchPairHash(n[i - 1], n[i])] = i;
+            }
+            /* the critical factorization: the larger of the maximal suffixes for both orders of the alphabet */
+            ip = (size_t)-1;
+            jp = 0;
+            k = 1;
+            p = 1;
+            while((jp + k) < needlelen)
+            {
+                if(n[ip + k] == n[jp + k])
                 {
-                    y = (binst[i] & 0x80000000) | (binst[i + 1] & 0x7fffffff);
-                    binst[i] = binst[i + 397] ^ (y >> 1) ^ ((y & 1) * 0x9908b0df);
+                    if(k == p)
+                    {
+                        jp += p;
+                        k = 1;
+                    }
+                    else
+                    {
+                        k++;
+                    }
                 }
-                for(; i < CONF_MERSENNESTATESIZE - 1; i++)
+                else if(n[ip + k] > n[jp + k])
                 {
-                    y = (binst[i] & 0x80000000) | (binst[i + 1] & 0x7fffffff);
-                    binst[i] = binst[i + (397 - CONF_MERSENNESTATESIZE)] ^ (y >> 1) ^ ((y & 1) * 0x9908b0df);
+                    jp += k;
+                    k = 1;
+                    p = jp - ip;
+                }
+                else
+                {
+                    ip = jp++;
+                    k = 1;
+                    p = 1;
                 }
-                y = (binst[CONF_MERSENNESTATESIZE - 1] & 0x80000000) | (binst[0] & 0x7fffffff);
-                binst[CONF_MERSENNESTATESIZE - 1] = binst[396] ^ (y >> 1) ^ ((y & 1) * 0x9908b0df);
-                *index = 0;
             }
-            y = binst[*index];
-            *index = *index + 1;
-            y = y ^ (y >> 11);
-            y = y ^ ((y << 7) & 0x9d2c5680);
-            y = y ^ ((y << 15) & 0xefc60000);
-            y = y ^ (y >> 18);
-            return y;
+            ms = ip;
+            p0 = p;
+            ip = (size_t)-1;
+            jp = 0;
+            k = 1;
+            p = 1;
+            while((jp + k) < needlelen)
+            {
+                if(n[ip + k] == n[jp + k])
+                {
+                    if(k == p)
+                    {
+                        jp += p;
+                        k = 1;
+                    }
+                    else
+                    {
+                        k++;
+                    }
+                }
+                else if(n[ip + k] < n[jp + k])
+                {
+                    jp += k;
+                    k = 1;
+                    p = jp - ip;
+                }
+                else
+                {
+                    ip = jp++;
+                    k = 1;
+                    p = 1;
+                }
+            }
+            if((ip + 1) > (ms + 1))
+            {
+                ms = ip;
+            }
+            else
+            {
+                p = p0;
+            }
+            /* a periodic needle remembers how much of it matched after a shift by the period */
+            if(memcmp(n, n + p, ms + 1) != 0)
+            {
+                mem0 = 0;
+                p = std::max(ms, needlelen - ms - 1) + 1;
+            }
+            else
+            {
+                mem0 = needlelen - p;
+            }
+            mem = 0;
+            at = 0;
+            while((at + needlelen) <= haylen)
+            {
+                /* skipping by the pair is only done when nothing is remembered, which keeps the worst case linear */
+                if(mem == 0)
+                {
+                    k = needlelen - 1 - shift[searchPairHash(h[at + needlelen - 2], h[at + needlelen - 1])];
+                    if(k != 0)
+                    {
+                        at += k;
+                        continue;
+                    }
+                }
+                /* the right half, from the factorization on */
+                k = std::max(ms + 1, mem);
+                while((k < needlelen) && (n[k] == h[at + k]))
+                {
+                    k++;
+                }
+                if(k < needlelen)
+                {
+                    at += k - ms;
+                    mem = 0;
+                    continue;
+                }
+                /* then the left half, backwards */
+                k = ms + 1;
+                while((k > mem) && (n[k - 1] == h[at + k - 1]))
+                {
+                    k--;
+                }
+                if(k <= mem)
+                {
+                    return hay + at;
+                }
+                at += p;
+                mem = mem0;
+            }
+            return nullptr;
         }
 
-        double mtrandRandom(double lowerlimit, double upperlimit)
-        {
-            double randnum;
-            uint32_t randval;
-            struct timeval tv;
-            static uint32_t mtstate[CONF_MERSENNESTATESIZE];
-            static uint32_t mtindex = CONF_MERSENNESTATESIZE + 1;
-            if(mtindex >= CONF_MERSENNESTATESIZE)
-            {
-                osfn_gettimeofday(&tv, nullptr);
-                mtrandSeed((uint32_t)(1000000 * tv.tv_sec + tv.tv_usec), mtstate, &mtindex);
+        /*
+        * needles longer than the short kernels take are found by the window of CONF_SEARCHSHORTNEEDLE bytes that
+        * searchPrepare() picked, with the short kernel, and compared in full at each candidate. once those
+        * comparisons cost more than an eighth of what was scanned, the rest of $hay is left to Two-Way, which is
+        * faster when candidates are that common, and which keeps the worst case linear.
+        */
+        const char* findLong(const char* hay, size_t haylen, const SearchNeedle* sn)
+        {
+            size_t at;
+            size_t win;
+            size_t tail;
+            size_t work;
+            const char* cand;
+            const char* needle;
+            needle = sn->data;
+            win = sn->window;
+            tail = sn->length - win - CONF_SEARCHSHORTNEEDLE;
+            at = 0;
+            work = 0;
+            while((at + sn->length) <= haylen)
+            {
+                cand = g_findshort(hay + at + win, haylen - at - win - tail, needle + win, CONF_SEARCHSHORTNEEDLE, sn->windowrarest);
+                if(cand == nullptr)
+                {
+                    return nullptr;
+                }
+                cand -= win;
+                if((memcmp(cand, needle, win) == 0) && (memcmp(cand + win + CONF_SEARCHSHORTNEEDLE, needle + win + CONF_SEARCHSHORTNEEDLE, tail) == 0))
+                {
+                    return cand;
+                }
+                at = (cand - hay) + 1;
+                work += sn->length;
+                if(work > ((at + sn->length) / 8))
+                {
+                    return findTwoWay(hay + at, haylen - at, needle, sn->length);
+                }
             }
-            randval = mtrandGenerate(mtstate, &mtindex);
-            randnum = lowerlimit + ((double)randval / UINT32_MAX) * (upperlimit - lowerlimit);
-            return randnum;
+            return nullptr;
         }
 
-        char* stringToUpper(char* str, size_t length)
+        /* the first occurrence of the needle of $sn in $hay, or nullptr */
+        const char* findPrepared(const char* hay, size_t haylen, const SearchNeedle* sn)
         {
-            int c;
-            size_t i;
-            for(i = 0; i < length; i++)
+            if(sn->length == 0)
             {
-                c = str[i];
-                str[i] = toupper(c);
+                return hay;
             }
-            return str;
+            if(sn->length > haylen)
+            {
+                return nullptr;
+            }
+            if(sn->length == 1)
+            {
+                return (const char*)memchr(hay, sn->data[0], haylen);
+            }
+            if(sn->length <= CONF_SEARCHSHORTNEEDLE)
+            {
+                return g_findshort(hay, haylen, sn->data, sn->length, sn->rarest);
+            }
+            return findLong(hay, haylen, sn);
         }
 
-        char* stringToLower(char* str, size_t length)
+        /* the first occurrence of $needle in $hay, or nullptr; like memmem() */
+        const char* findBytes(const char* hay, size_t haylen, const char* needle, size_t needlelen)
         {
-            int c;
-            size_t i;
-            for(i = 0; i < length; i++)
+            SearchNeedle sn;
+            searchPrepare(&sn, needle, needlelen);
+            return findPrepared(hay, haylen, &sn);
+        }
+
+        /*
+        * finds every occurrence of $needle in $hay that does not overlap an earlier one, and stores their
+        * offsets in *$positions, which the caller frees with Memory::sysFree(). returns how many there are.
+        * split() and replace() use this to make their result at its final size.
+        */
+        size_t findAllBytes(const char* hay, size_t haylen, const char* needle, size_t needlelen, size_t** positions)
+        {
+            size_t at;
+            size_t count;
+            size_t capacity;
+            const char* found;
+            SearchNeedle sn;
+            *positions = nullptr;
+            count = 0;
+            capacity = 0;
+            at = 0;
+            if(needlelen == 0)
             {
-                c = str[i];
-                str[i] = toupper(c);
+                return 0;
             }
-            return str;
+            searchPrepare(&sn, needle, needlelen);
+            while((found = findPrepared(hay + at, haylen - at, &sn)) != nullptr)
+            {
+                if(count == capacity)
+                {
+                    capacity = Memory::getNextCapacity(capacity);
+                    *positions = (size_t*)Memory::sysRealloc(*positions, sizeof(size_t) * capacity);
+                }
+                at = found - hay;
+                (*positions)[count] = at;
+                count++;
+                at += needlelen;
+            }
+            return count;
         }
 
-        int osfn_chmod(const char* path, int mode)
+        /* returns the number of bytes contained in a unicode character */
+        int utf8NumBytes(int value)
         {
-            #if defined(NEON_PLAT_ISLINUX)
-                return chmod(path, mode);
-            #else
+            if(value < 0)
+            {
                 return -1;
-            #endif
-        }
-
-        char* osfn_realpath(const char* path, char* respath)
-        {
-            char* copy;
-            #if defined(NEON_PLAT_ISLINUX)
-                char* rt;
-                rt = realpath(path, respath);
-                if(rt != NULL)
-                {
-                    copy = Util::stringDup(rt);
-                    free(rt);
-                    return copy;
-                }
-            #else
-            #endif
-            copy = Util::stringDup(path);
-            respath = copy;
-            return copy;
-
+            }
+            if(value <= 0x7f)
+            {
+                return 1;
+            }
+            if(value <= 0x7ff)
+            {
+                return 2;
+            }
+            if(value <= 0xffff)
+            {
+                return 3;
+            }
+            if(value <= 0x10ffff)
+            {
+                return 4;
+            }
+            return 0;
         }
 
-        char* osfn_dirname(const char *fname)
+        char* utf8Encode(unsigned int code, size_t* dlen)
         {
-            size_t dirlen;
-            char * dirpart;
-            const char *p;
-            const char *slash;
-            p = fname;
-            slash = NULL;
-            if(fname)
+            int count;
+            char* chars;
+            *dlen = 0;
+            count = utf8NumBytes((int)code);
+            if(NEON_LIKELY(count > 0))
             {
-                if(*fname && fname[1] == ':')
-                {
-                    slash = fname + 1;
-                    p += 2;
-                }
-                /* Find the rightmost slash.  */
-                while (*p)
+                *dlen = count;
+                chars = (char*)Memory::sysMalloc(sizeof(char) * ((size_t)count + 1));
+                if(chars != nullptr)
                 {
-                    if (*p == '/' || *p == '\\')
+                    if(code <= 0x7F)
                     {
-                        slash = p;
+                        chars[0] = (char)(code & 0x7F);
+                        chars[1] = '\0';
                     }
-                    p++;
-                }
-                if(slash == NULL)
-                {
-                    fname = ".";
-                    dirlen = 1;
-                }
-                else
-                {
-                    /* Remove any trailing slashes.  */
-                    while(slash > fname && (slash[-1] == '/' || slash[-1] == '\\'))
+                    else if(code <= 0x7FF)
                     {
-                        slash--;
+                        /* one continuation byte */
+                        chars[1] = (char)(0x80 | (code & 0x3F));
+                        code = (code >> 6);
+                        chars[0] = (char)(0xC0 | (code & 0x1F));
                     }
-                    /* How long is the directory we will return?  */
-                    dirlen = slash - fname + (slash == fname || slash[-1] == ':');
-                    if (*slash == ':' && dirlen == 1)
+                    else if(code <= 0xFFFF)
                     {
-                        dirlen += 2;
+                        /* two continuation bytes */
+                        chars[2] = (char)(0x80 | (code & 0x3F));
+                        code = (code >> 6);
+                        chars[1] = (char)(0x80 | (code & 0x3F));
+                        code = (code >> 6);
+                        chars[0] = (char)(0xE0 | (code & 0xF));
                     }
-                }
-                dirpart = (char *)Memory::sysMalloc(dirlen + 1);
-                if(dirpart != NULL)
-                {
-                    strncpy(dirpart, fname, dirlen);
-                    if (slash && *slash == ':' && dirlen == 3)
+                    else if(code <= 0x10FFFF)
                     {
-                        dirpart[2] = '.';	/* for "x:foo" return "x:." */
+                        /* three continuation bytes */
+                        chars[3] = (char)(0x80 | (code & 0x3F));
+                        code = (code >> 6);
+                        chars[2] = (char)(0x80 | (code & 0x3F));
+                        code = (code >> 6);
+                        chars[1] = (char)(0x80 | (code & 0x3F));
+                        code = (code >> 6);
+                        chars[0] = (char)(0xF0 | (code & 0x7));
                     }
-                    dirpart[dirlen] = '\0';
+                    else
+                    {
+                        /* unicode replacement character */
+                        chars[2] = (char)0xEF;
+                        chars[1] = (char)0xBF;
+                        chars[0] = (char)0xBD;
+                    }
+                    return chars;
                 }
-                return dirpart;
             }
-            return NULL;
+            return nullptr;
         }
 
-        char* osfn_fallbackbasename(const char* opath)
+        int utf8Decode(const uint8_t* bytes, uint32_t length)
         {
-            char* strbeg;
-            char* strend;
-            char* cpath;
-            strend = cpath = (char*)opath;
-            while(*strend)
+            int value;
+            uint32_t remainingbytes;
+            /* Single byte (i.e. fits in ASCII). */
+            if(*bytes <= 0x7f)
             {
-                strend++;
+                return *bytes;
             }
-            while(strend > cpath && strend[-1] == '/')
+            if((*bytes & 0xe0) == 0xc0)
             {
-                strend--;
+                /* Two byte sequence: 110xxxxx 10xxxxxx. */
+                value = *bytes & 0x1f;
+                remainingbytes = 1;
             }
-            strbeg = strend;
-            while(strbeg > cpath && strbeg[-1] != '/')
+            else if((*bytes & 0xf0) == 0xe0)
             {
-                strbeg--;
+                /* Three byte sequence: 1110xxxx	 10xxxxxx 10xxxxxx. */
+                value = *bytes & 0x0f;
+                remainingbytes = 2;
             }
-            /* len = (strend - strbeg) */
-            cpath = strbeg;
-            cpath[(strend - strbeg)] = 0;
-            return strbeg;
-        }
-
-        char* osfn_basename(const char* path)
-        {
-            #if defined(NEON_PLAT_ISLINUX)
-                char* rt;
-                rt = basename((char*)path);
-                if(rt != NULL)
+            else if((*bytes & 0xf8) == 0xf0)
+            {
+                /* Four byte sequence: 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx. */
+                value = *bytes & 0x07;
+                remainingbytes = 3;
+            }
+            else
+            {
+                /* Invalid UTF-8 sequence. */
+                return -1;
+            }
+            /* Don't read past the end of the buffer on truncated UTF-8. */
+            if(remainingbytes > length - 1)
+            {
+                return -1;
+            }
+            while(remainingbytes > 0)
+            {
+                bytes++;
+                remainingbytes--;
+                /* Remaining bytes must be of form 10xxxxxx. */
+                if((*bytes & 0xc0) != 0x80)
                 {
-                    return rt;
+                    return -1;
                 }
-            #else
-            #endif
-            return osfn_fallbackbasename(path);
-        }
-
-        int osfn_isatty(int fd)
-        {
-            #if defined(NEON_PLAT_ISLINUX)
-                return isatty(fd);
-            #else
-                return 0;
-            #endif
-        }
-
-        int osfn_symlink(const char* path1, const char* path2)
-        {
-            #if defined(NEON_PLAT_ISLINUX)
-                return symlink(path1, path2);
-            #else
-                return -1;
-            #endif
+                value = value << 6 | (*bytes & 0x3f);
+            }
+            return value;
         }
 
-        int osfn_symlinkat(const char* path1, int fd, const char* path2)
+        char* utf8Codepoint(const char* str, char* outcodepoint)
         {
-            #if defined(NEON_PLAT_ISLINUX)
-                return symlinkat(path1, fd, path2);
-            #else
-                return -1;
-            #endif
+            if(0xf0 == (0xf8 & str[0]))
+            {
+                /* 4 byte utf8 codepoint */
+                *outcodepoint = (((0x07 & str[0]) << 18) | ((0x3f & str[1]) << 12) | ((0x3f & str[2]) << 6) | (0x3f & str[3]));
+                str += 4;
+            }
+            else if(0xe0 == (0xf0 & str[0]))
+            {
+                /* 3 byte utf8 codepoint */
+                *outcodepoint = (((0x0f & str[0]) << 12) | ((0x3f & str[1]) << 6) | (0x3f & str[2]));
+                str += 3;
+            }
+            else if(0xc0 == (0xe0 & str[0]))
+            {
+                /* 2 byte utf8 codepoint */
+                *outcodepoint = (((0x1f & str[0]) << 6) | (0x3f & str[1]));
+                str += 2;
+            }
+            else
+            {
+                /* 1 byte utf8 codepoint otherwise */
+                *outcodepoint = str[0];
+                str += 1;
+            }
+            return (char*)str;
         }
 
-        char* osfn_getcwd(char* buf, size_t size)
+        char* utf8Strstr(const char* haystack, const char* needle)
         {
-            #if defined(NEON_PLAT_ISLINUX)
-                return getcwd(buf, size);
-            #else
-                #if defined(NEON_PLAT_ISWINDOWS)
-                    GetCurrentDirectory(size, buf);
-                    return buf;
-                #endif
-            #endif
-            return NULL;
-
-        }
-
-        int osfn_lstat(const char* path, struct stat* buf)
-        {
-            #if defined(NEON_PLAT_ISLINUX)
-                return lstat(path, buf);
-            #else
-                return stat(path, buf);
-            #endif
+            char throwawaycodepoint;
+            const char* n;
+            const char* maybematch;
+            throwawaycodepoint = 0;
+            /* if needle has no utf8 codepoints before the null terminating
+             * byte then return haystack */
+            if('\0' == *needle)
+            {
+                return (char*)haystack;
+            }
+            while('\0' != *haystack)
+            {
+                maybematch = haystack;
+                n = needle;
+                while(*haystack == *n && (*haystack != '\0' && *n != '\0'))
+                {
+                    n++;
+                    haystack++;
+                }
+                if('\0' == *n)
+                {
+                    /* we found the whole utf8 string for needle in haystack at
+                     * maybematch, so return it */
+                    return (char*)maybematch;
+                }
+                else
+                {
+                    /* h could be in the middle of an unmatching utf8 codepoint,
+                     * so we need to march it on to the next character beginning
+                     * starting from the current character */
+                    haystack = utf8Codepoint(maybematch, &throwawaycodepoint);
+                }
+            }
+            /* no match */
+            return nullptr;
         }
 
-        int osfn_gettimeofday(struct timeval* tp, void* tzp)
+        /*
+        // returns a pointer to the beginning of the pos'th utf8 codepoint
+        // in the buffer at s
+        */
+        char* utf8Index(char* s, int pos)
         {
-            #if defined(NEON_PLAT_ISLINUX)
-                return gettimeofday(tp, tzp);
-            #else
-                return 0;
-            #endif
+            ++pos;
+            for(; *s; ++s)
+            {
+                if((*s & 0xC0) != 0x80)
+                {
+                    --pos;
+                }
+                if(pos == 0)
+                {
+                    return s;
+                }
+            }
+            return nullptr;
         }
 
-        int osfn_mkdir(const char* path, size_t mode)
+        /*
+        // converts codepoint indexes start and end to byte offsets in the buffer at s
+        */
+        void utf8Slice(char* s, int* start, int* end)
         {
-            #if defined(NEON_PLAT_ISLINUX)
-                return mkdir(path, mode);
-            #else
-                return -1;
-            #endif
+            char* p;
+            p = utf8Index(s, *start);
+            if(p != nullptr)
+            {
+                *start = (int)(p - s);
+            }
+            else
+            {
+                *start = -1;
+            }
+            p = utf8Index(s, *end);
+            if(p != nullptr)
+            {
+                *end = (int)(p - s);
+            }
+            else
+            {
+                *end = (int)strlen(s);
+            }
         }
 
-        int osfn_rmdir(const char* path)
+        char* stringDup(const char* src, size_t len)
         {
-            #if defined(NEON_PLAT_ISLINUX)
-                return rmdir(path);
-            #else
-                return -1;
-            #endif
+            char* buf;
+            buf = (char*)Memory::sysMalloc(sizeof(char) * (len + 1));
+            if(buf == nullptr)
+            {
+                return nullptr;
+            }
+            memset(buf, 0, len + 1);
+            memcpy(buf, src, len);
+            return buf;
         }
 
-        int osfn_unlink(const char* path)
+        char* stringDup(const char* src)
         {
-            #if defined(NEON_PLAT_ISLINUX)
-                return unlink(path);
-            #else
-                return -1;
-            #endif
+            return stringDup(src, strlen(src));
         }
 
-        const char* osfn_getenv(const char* key)
+        void mtrandSeed(uint32_t seed, uint32_t* binst, uint32_t* index)
         {
-            return getenv(key);
+            uint32_t i;
+            binst[0] = seed;
+            for(i = 1; i < CONF_MERSENNESTATESIZE; i++)
+            {
+                binst[i] = (uint32_t)(1812433253UL * (binst[i - 1] ^ (binst[i - 1] >> 30)) + i);
+            }
+            *index = CONF_MERSENNESTATESIZE;
         }
 
-        bool osfn_setenv(const char* key, const char* value, bool replace)
+        uint32_t mtrandGenerate(uint32_t* binst, uint32_t* index)
         {
-            #if defined(NEON_PLAT_ISLINUX)
-                return (setenv(key, value, replace) == 0);
-            #else
-                int errcode;
-                size_t envsize;
-                errcode = 0;
-                if(!replace)
+            uint32_t i;
+            uint32_t y;
+            if(*index >= CONF_MERSENNESTATESIZE)
+            {
+                for(i = 0; i < CONF_MERSENNESTATESIZE - 397; i++)
                 {
-                    envsize = 0;
-                    errcode = getenv_s(&envsize, NULL, 0, key);
-                    if(errcode || envsize) return errcode;
+                    y = (binst[i] & 0x80000000) | (binst[i + 1] & 0x7fffffff);
+                    binst[i] = binst[i + 397] ^ (y >> 1) ^ ((y & 1) * 0x9908b0df);
                 }
-                if(_putenv_s(key, value) == -1)
+                for(; i < CONF_MERSENNESTATESIZE - 1; i++)
                 {
-                    return false;
+                    y = (binst[i] & 0x80000000) | (binst[i + 1] & 0x7fffffff);
+                    binst[i] = binst[i + (397 - CONF_MERSENNESTATESIZE)] ^ (y >> 1) ^ ((y & 1) * 0x9908b0df);
                 }
-                return true;
-            #endif
+                y = (binst[CONF_MERSENNESTATESIZE - 1] & 0x80000000) | (binst[0] & 0x7fffffff);
+                binst[CONF_MERSENNESTATESIZE - 1] = binst[396] ^ (y >> 1) ^ ((y & 1) * 0x9908b0df);
+                *index = 0;
+            }
+            y = binst[*index];
+            *index = *index + 1;
+            y = y ^ (y >> 11);
+            y = y ^ ((y << 7) & 0x9d2c5680);
+            y = y ^ ((y << 15) & 0xefc60000);
+            y = y ^ (y >> 18);
+            return y;
         }
 
-        int osfn_chdir(const char* path)
+        double mtrandRandom(double lowerlimit, double upperlimit)
         {
-            #if defined(NEON_PLAT_ISLINUX)
-                return chdir(path);
-            #else
-                return -1;
-            #endif
+            double randnum;
+            uint32_t randval;
+            struct timeval tv;
+            static uint32_t mtstate[CONF_MERSENNESTATESIZE];
+            static uint32_t mtindex = CONF_MERSENNESTATESIZE + 1;
+            if(mtindex >= CONF_MERSENNESTATESIZE)
+            {
+                osfn_gettimeofday(&tv, nullptr);
+                mtrandSeed((uint32_t)(1000000 * tv.tv_sec + tv.tv_usec), mtstate, &mtindex);
+            }
+            randval = mtrandGenerate(mtstate, &mtindex);
+            randnum = lowerlimit + ((double)randval / UINT32_MAX) * (upperlimit - lowerlimit);
+            return randnum;
         }
 
-        int osfn_getpid()
+        char* stringToUpper(char* str, size_t length)
         {
-            #if defined(NEON_PLAT_ISLINUX)
-                return getpid();
-            #endif
-            return -1;
+            int c;
+            size_t i;
+            for(i = 0; i < length; i++)
+            {
+                c = str[i];
+                str[i] = toupper(c);
+            }
+            return str;
         }
 
-        int osfn_kill(int pid, int code)
+        char* stringToLower(char* str, size_t length)
+        {
+            int c;
+            size_t i;
+            for(i = 0; i < length; i++)
+            {
+                c = str[i];
+                str[i] = toupper(c);
+            }
+            return str;
+        }
+
+        int osfn_chmod(const char* path, int mode)
         {
             #if defined(NEON_PLAT_ISLINUX)
-                return kill(pid, code);
+                return chmod(path, mode);
             #else
                 return -1;
             #endif
         }
 
-        bool nn_util_fsfileexists(const char* filepath)
+        char* osfn_realpath(const char* path, char* respath)
         {
-            #if !defined(NEON_PLAT_ISWINDOWS)
-                return access(filepath, F_OK) == 0;
-            #else
-                struct stat st;
-                if(stat(filepath, &st) == -1)
+            char* copy;
+            #if defined(NEON_PLAT_ISLINUX)
+                char* rt;
+                rt = realpath(path, respath);
+                if(rt != NULL)
                 {
-                    return false;
+                    copy = Util::stringDup(rt);
+                    free(rt);
+                    return copy;
                 }
-                return true;
+            #else
             #endif
+            copy = Util::stringDup(path);
+            respath = copy;
+            return copy;
+
         }
 
-        bool nn_util_fsfileistype(const char* filepath, int typ)
+        char* osfn_dirname(const char *fname)
         {
-            struct stat st;
-            (void)filepath;
-            if(stat(filepath, &st) == -1)
+            size_t dirlen;
+            char * dirpart;
+            const char *p;
+            const char *slash;
+            p = fname;
+            slash = NULL;
+            if(fname)
             {
-                return false;
+                if(*fname && fname[1] == ':')
+                {
+                    slash = fname + 1;
+                    p += 2;
+                }
+                /* Find the rightmost slash.  */
+                while (*p)
+                {
+                    if (*p == '/' || *p == '\\')
+                    {
+                        slash = p;
+                    }
+                    p++;
+                }
+                if(slash == NULL)
+                {
+                    fname = ".";
+                    dirlen = 1;
+                }
+                else
+                {
+                    /* Remove any trailing slashes.  */
+                    while(slash > fname && (slash[-1] == '/' || slash[-1] == '\\'))
+                    {
+                        slash--;
+                    }
+                    /* How long is the directory we will return?  */
+                    dirlen = slash - fname + (slash == fname || slash[-1] == ':');
+                    if (*slash == ':' && dirlen == 1)
+                    {
+                        dirlen += 2;
+                    }
+                }
+                dirpart = (char *)Memory::sysMalloc(dirlen + 1);
+                if(dirpart != NULL)
+                {
+                    strncpy(dirpart, fname, dirlen);
+                    if (slash && *slash == ':' && dirlen == 3)
+                    {
+                        dirpart[2] = '.';	/* for "x:foo" return "x:." */
+                    }
+                    dirpart[dirlen] = '\0';
+                }
+                return dirpart;
             }
-            if(typ == 'f')
+            return NULL;
+        }
+
+        char* osfn_fallbackbasename(const char* opath)
+        {
+            char* strbeg;
+            char* strend;
+            char* cpath;
+            strend = cpath = (char*)opath;
+            while(*strend)
             {
-                return S_ISREG(st.st_mode);
+                strend++;
             }
-            else if(typ == 'd')
+            while(strend > cpath && strend[-1] == '/')
             {
-                return S_ISDIR(st.st_mode);
+                strend--;
             }
-            return false;
+            strbeg = strend;
+            while(strbeg > cpath && strbeg[-1] != '/')
+            {
+                strbeg--;
+            }
+            /* len = (strend - strbeg) */
+            cpath = strbeg;
+            cpath[(strend - strbeg)] = 0;
+            return strbeg;
         }
 
-        bool nn_util_fsfileisfile(const char* filepath)
+        char* osfn_basename(const char* path)
         {
-            return nn_util_fsfileistype(filepath, 'f');
+            #if defined(NEON_PLAT_ISLINUX)
+                char* rt;
+                rt = basename((char*)path);
+                if(rt != NULL)
+                {
+                    return rt;
+                }
+            #else
+            #endif
+            return osfn_fallbackbasename(path);
         }
 
-        bool nn_util_fsfileisdirectory(const char* filepath)
+        int osfn_isatty(int fd)
         {
-            return nn_util_fsfileistype(filepath, 'd');
+            #if defined(NEON_PLAT_ISLINUX)
+                return isatty(fd);
+            #else
+                return 0;
+            #endif
         }
 
-        char* nn_util_fsgetbasename(const char* path)
+        int osfn_symlink(const char* path1, const char* path2)
         {
-            return osfn_basename(path);
+            #if defined(NEON_PLAT_ISLINUX)
+                return symlink(path1, path2);
+            #else
+                return -1;
+            #endif
         }
 
-        const char* filestat_ctimetostring(const time_t *timep)
+        int osfn_symlinkat(const char* path1, int fd, const char* path2)
         {
-            size_t len;
-            char* r;
-            r = ctime(timep);
-            len = strlen(r);
-            if(r[len - 1] == '\n')
-            {
-                r[len - 1] = 0;
-            }
-            return r;
+            #if defined(NEON_PLAT_ISLINUX)
+                return symlinkat(path1, fd, path2);
+            #else
+                return -1;
+            #endif
         }
 
-        static int g_neon_ttycheck = -1;
+        char* osfn_getcwd(char* buf, size_t size)
+        {
+            #if defined(NEON_PLAT_ISLINUX)
+                return getcwd(buf, size);
+            #else
+                #if defined(NEON_PLAT_ISWINDOWS)
+                    GetCurrentDirectory(size, buf);
+                    return buf;
+                #endif
+            #endif
+            return NULL;
 
-        const char* termColor(Color tc)
+        }
+
+        int osfn_lstat(const char* path, struct stat* buf)
         {
-        #if !defined(NEON_CONFIG_FORCEDISABLECOLOR)
-            int fdstdout;
-            int fdstderr;
-            if(g_neon_ttycheck == -1)
-            {
-                fdstdout = fileno(stdout);
-                fdstderr = fileno(stderr);
-                g_neon_ttycheck = (osfn_isatty(fdstderr) && osfn_isatty(fdstdout));
-            }
-            if(g_neon_ttycheck)
-            {
-                switch(tc)
-                {
-                    case NEON_COLOR_RESET:
-                        return "\x1B[0m";
-                    case NEON_COLOR_RED:
-                        return "\x1B[31m";
-                    case NEON_COLOR_GREEN:
-                        return "\x1B[32m";
-                    case NEON_COLOR_YELLOW:
-                        return "\x1B[33m";
-                    case NEON_COLOR_BLUE:
-                        return "\x1B[34m";
-                    case NEON_COLOR_MAGENTA:
-                        return "\x1B[35m";
-                    case NEON_COLOR_CYAN:
-                        return "\x1B[36m";
-                }
-            }
-        #else
-            (void)tc;
-        #endif
-            return "";
+            #if defined(NEON_PLAT_ISLINUX)
+                return lstat(path, buf);
+            #else
+                return stat(path, buf);
+            #endif
         }
-    }
 
-    class Wrappers
-    {
-        public:
-            static String* wrapClassGetName(Class* cl);
-            static uint32_t wrapStrGetHash(String* os);
-            static const char* wrapStrGetData(String* os);
-            static size_t wrapStrGetLength(String* os);
-            static String* wrapMakeFromStrBuf(const StrBuffer& buf, uint32_t hsv, size_t length);
-            static String* wrapStringCopy(const char* data, size_t len);
-            static String* wrapStringCopy(const char* str);
-            static String* wrapStringIntern(const char* data, size_t len);
-            static String* wrapStringIntern(const char* str);
+        int osfn_gettimeofday(struct timeval* tp, void* tzp)
+        {
+            #if defined(NEON_PLAT_ISLINUX)
+                return gettimeofday(tp, tzp);
+            #else
+                return 0;
+            #endif
+        }
 
-            static Blob* wrapGetBlobOfClosure(Function* fn);
-            static size_t wrapGetArityOfClosure(Function* ofn);
-            static size_t wrapGetArityOfFuncScript(Function* ofn);
-            static size_t wrapGetBlobcountOfFuncScript(Function* ofn);
-            static const char* wrapGetInstanceName(Instance* inst);
-    };
+        /* microseconds from some fixed point in the past; unaffected by changes of the system time */
+        int64_t osfn_monotonicmicros()
+        {
+            #if defined(NEON_PLAT_ISLINUX)
+                struct timespec ts;
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                return ((int64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+            #else
+                return (int64_t)(((double)clock() / CLOCKS_PER_SEC) * 1000000.0);
+            #endif
+        }
 
-    class utf8iterator_t
-    {
-        public:
-            /*input string pointer */
-            const char* m_plainstr;
+        /*
+        * the memory limit of the cgroup this process runs in, in bytes, or 0 if there is none.
+        * cgroup v2 keeps it in memory.max ("max" for no limit); v1 in memory/memory.limit_in_bytes,
+        * where no limit reads as a huge number.
+        */
+        int64_t osfn_cgroupmemlimit()
+        {
+            #if defined(NEON_PLAT_ISLINUX)
+                size_t i;
+                long long val;
+                FILE* fh;
+                char buf[64];
+                static const char* paths[] = { "/sys/fs/cgroup/memory.max", "/sys/fs/cgroup/memory/memory.limit_in_bytes" };
+                for(i = 0; i < (sizeof(paths) / sizeof(paths[0])); i++)
+                {
+                    fh = fopen(paths[i], "rb");
+                    if(fh == nullptr)
+                    {
+                        continue;
+                    }
+                    val = 0;
+                    if(fgets(buf, sizeof(buf), fh) != nullptr)
+                    {
+                        val = atoll(buf);
+                    }
+                    fclose(fh);
+                    if((val <= 0) || (val >= (1LL << 60)))
+                    {
+                        return 0;
+                    }
+                    return val;
+                }
+            #endif
+            return 0;
+        }
 
-            /* input string length */
-            uint32_t m_plainlen;
+        int osfn_mkdir(const char* path, size_t mode)
+        {
+            #if defined(NEON_PLAT_ISLINUX)
+                return mkdir(path, mode);
+            #else
+                return -1;
+            #endif
+        }
 
-            /* the codepoint, or char */
-            uint32_t m_codepoint;
+        int osfn_rmdir(const char* path)
+        {
+            #if defined(NEON_PLAT_ISLINUX)
+                return rmdir(path);
+            #else
+                return -1;
+            #endif
+        }
 
-            /* character size in bytes */
-            uint16_t m_charsize;
+        int osfn_unlink(const char* path)
+        {
+            #if defined(NEON_PLAT_ISLINUX)
+                return unlink(path);
+            #else
+                return -1;
+            #endif
+        }
 
-            /* current character position */
+        const char* osfn_getenv(const char* key)
+        {
+            return getenv(key);
+        }
+
+        bool osfn_setenv(const char* key, const char* value, bool replace)
+        {
+            #if defined(NEON_PLAT_ISLINUX)
+                return (setenv(key, value, replace) == 0);
+            #else
+                int errcode;
+                size_t envsize;
+                errcode = 0;
+                if(!replace)
+                {
+                    envsize = 0;
+                    errcode = getenv_s(&envsize, NULL, 0, key);
+                    if(errcode || envsize) return errcode;
+                }
+                if(_putenv_s(key, value) == -1)
+                {
+                    return false;
+                }
+                return true;
+            #endif
+        }
+
+        int osfn_chdir(const char* path)
+        {
+            #if defined(NEON_PLAT_ISLINUX)
+                return chdir(path);
+            #else
+                return -1;
+            #endif
+        }
+
+        int osfn_getpid()
+        {
+            #if defined(NEON_PLAT_ISLINUX)
+                return getpid();
+            #endif
+            return -1;
+        }
+
+        int osfn_kill(int pid, int code)
+        {
+            #if defined(NEON_PLAT_ISLINUX)
+                return kill(pid, code);
+            #else
+                return -1;
+            #endif
+        }
+
+        bool nn_util_fsfileexists(const char* filepath)
+        {
+            #if !defined(NEON_PLAT_ISWINDOWS)
+                return access(filepath, F_OK) == 0;
+            #else
+                struct stat st;
+                if(stat(filepath, &st) == -1)
+                {
+                    return false;
+                }
+                return true;
+            #endif
+        }
+
+        bool nn_util_fsfileistype(const char* filepath, int typ)
+        {
+            struct stat st;
+            (void)filepath;
+            if(stat(filepath, &st) == -1)
+            {
+                return false;
+            }
+            if(typ == 'f')
+            {
+                return S_ISREG(st.st_mode);
+            }
+            else if(typ == 'd')
+            {
+                return S_ISDIR(st.st_mode);
+            }
+            return false;
+        }
+
+        bool nn_util_fsfileisfile(const char* filepath)
+        {
+            return nn_util_fsfileistype(filepath, 'f');
+        }
+
+        bool nn_util_fsfileisdirectory(const char* filepath)
+        {
+            return nn_util_fsfileistype(filepath, 'd');
+        }
+
+        char* nn_util_fsgetbasename(const char* path)
+        {
+            return osfn_basename(path);
+        }
+
+        const char* filestat_ctimetostring(const time_t *timep)
+        {
+            size_t len;
+            char* r;
+            r = ctime(timep);
+            len = strlen(r);
+            if(r[len - 1] == '\n')
+            {
+                r[len - 1] = 0;
+            }
+            return r;
+        }
+
+        static int g_neon_ttycheck = -1;
+
+        const char* termColor(Color tc)
+        {
+        #if !defined(NEON_CONFIG_FORCEDISABLECOLOR)
+            int fdstdout;
+            int fdstderr;
+            if(g_neon_ttycheck == -1)
+            {
+                fdstdout = fileno(stdout);
+                fdstderr = fileno(stderr);
+                g_neon_ttycheck = (osfn_isatty(fdstderr) && osfn_isatty(fdstdout));
+            }
+            if(g_neon_ttycheck)
+            {
+                switch(tc)
+                {
+                    case NEON_COLOR_RESET:
+                        return "\x1B[0m";
+                    case NEON_COLOR_RED:
+                        return "\x1B[31m";
+                    case NEON_COLOR_GREEN:
+                        return "\x1B[32m";
+                    case NEON_COLOR_YELLOW:
+                        return "\x1B[33m";
+                    case NEON_COLOR_BLUE:
+                        return "\x1B[34m";
+                    case NEON_COLOR_MAGENTA:
+                        return "\x1B[35m";
+                    case NEON_COLOR_CYAN:
+                        return "\x1B[36m";
+                }
+            }
+        #else
+            (void)tc;
+        #endif
+            return "";
+        }
+    }
+
+    class Wrappers
+    {
+        public:
+            static String* wrapClassGetName(Class* cl);
+            static uint32_t wrapStrGetHash(String* os);
+            static const char* wrapStrGetData(String* os);
+            static size_t wrapStrGetLength(String* os);
+            static String* wrapMakeFromStrBuf(StrBuffer& buf, uint32_t hsv, size_t length);
+            static String* wrapStringCopy(const char* data, size_t len);
+            static String* wrapStringCopy(const char* str);
+            static String* wrapStringIntern(const char* data, size_t len);
+            static String* wrapStringIntern(const char* str);
+
+            static Blob* wrapGetBlobOfClosure(Function* fn);
+            static size_t wrapGetArityOfClosure(Function* ofn);
+            static size_t wrapGetArityOfFuncScript(Function* ofn);
+            static size_t wrapGetBlobcountOfFuncScript(Function* ofn);
+            static const char* wrapGetInstanceName(Instance* inst);
+            static void wrapGCWriteBarrier(Object* owner, Value val);
+    };
+
+    class utf8iterator_t
+    {
+        public:
+            /*input string pointer */
+            const char* m_plainstr;
+
+            /* input string length */
+            uint32_t m_plainlen;
+
+            /* the codepoint, or char */
+            uint32_t m_codepoint;
+
+            /* character size in bytes */
+            uint16_t m_charsize;
+
+            /* current character position */
             uint32_t m_currpos;
 
             /* next character position */
@@ -1591,7 +2511,7 @@ namespace neon
                 if(len > 0)
                 {
                     sbuf->m_capacity = Util::roundUpToPowe64(len + 1);
-                    sbuf->m_data = (CharT*)Memory::sysMalloc(sbuf->m_capacity);
+                    sbuf->m_data = (CharT*)Memory::gcRealloc(nullptr, 0, sbuf->m_capacity * sizeof(CharT));
                     if(!sbuf->m_data)
                     {
                         return NULL;
@@ -1645,11 +2565,13 @@ namespace neon
             {
                 /* for nul byte */
                 len++;
+                size_t oldsize;
                 if(*sizeptr < len)
                 {
+                    oldsize = *sizeptr;
                     *sizeptr = Util::roundUpToPowe64(len);
                     /* fprintf(stderr, "sizeptr=%ld\n", *sizeptr); */
-                    if((*buf = (CharT*)Memory::sysRealloc(*buf, ((*sizeptr) * sizeof(CharT)))) == NULL)
+                    if((*buf = (CharT*)Memory::gcRealloc(*buf, oldsize * sizeof(CharT), ((*sizeptr) * sizeof(CharT)))) == NULL)
                     {
                         fprintf(stderr, "[%s:%i] Out of memory\n", __FILE__, __LINE__);
                         abort();
@@ -1775,7 +2697,7 @@ namespace neon
             {
                 if((m_data != nullptr) && (m_isintern == false))
                 {
-                    Memory::sysFree(m_data);
+                    Memory::gcFree(m_data, m_capacity * sizeof(CharT));
                 }
                 return true;
             }
@@ -1796,7 +2718,14 @@ namespace neon
                 m_isintern = other->m_isintern;
                 if(actuallycopydata && !other->m_isintern)
                 {
-                    m_data = Util::stringDup(other->m_data, other->m_length);
+                    /* the copy is only as large as the data; claiming the capacity of $other would let appends overrun it */
+                    m_capacity = m_length + 1;
+                    m_data = (CharT*)Memory::gcRealloc(nullptr, 0, m_capacity * sizeof(CharT));
+                    if(m_length > 0)
+                    {
+                        memcpy(m_data, other->m_data, m_length * sizeof(CharT));
+                    }
+                    m_data[m_length] = 0;
                 }
                 else
                 {
@@ -1893,25 +2822,25 @@ namespace neon
             NEON_INLINE bool replace(StrBufBasic* targetbuf, const CharT* findmestr, size_t findmelen, const CharT* repwithstr, size_t repwithlen)
             {
                 size_t i;
-                if((length() == 0 && findmelen == 0) || length() == 0 || findmelen == 0)
+                size_t at;
+                size_t count;
+                size_t* positions;
+                if((length() == 0) || (findmelen == 0))
                 {
                     return false;
                 }
-                for(i = 0; i < length(); i++)
+                /* one search finds every match, so that $targetbuf can be made large enough up front */
+                count = Util::findAllBytes(m_data, m_length, findmestr, findmelen, &positions);
+                targetbuf->ensureCapacity((m_length - (count * findmelen)) + (count * repwithlen));
+                at = 0;
+                for(i = 0; i < count; i++)
                 {
-                    if(memcmp(data() + i, findmestr, findmelen) == 0)
-                    {
-                        if(findmelen > 0)
-                        {
-                            targetbuf->append(repwithstr, repwithlen);
-                        }
-                        i += findmelen - 1;
-                    }
-                    else
-                    {
-                        targetbuf->append(get(i));
-                    }
+                    targetbuf->append(m_data + at, positions[i] - at);
+                    targetbuf->append(repwithstr, repwithlen);
+                    at = positions[i] + findmelen;
                 }
+                targetbuf->append(m_data + at, m_length - at);
+                Memory::sysFree(positions);
                 return true;
             }
 
@@ -1935,7 +2864,7 @@ namespace neon
                 size_t cap;
                 CharT* newbuf;
                 cap = Util::roundUpToPowe64(newlen + 1);
-                newbuf = (CharT*)Memory::sysRealloc(m_data, cap * sizeof(CharT));
+                newbuf = (CharT*)Memory::gcRealloc(m_data, m_capacity * sizeof(CharT), cap * sizeof(CharT));
                 if(newbuf == NULL)
                 {
                     return false;
@@ -1966,6 +2895,14 @@ namespace neon
                 m_data = (CharT*)str;
             }
 
+            /* takes over the data of $other, which is left empty */
+            NEON_INLINE void takeFrom(StrBufBasic* other)
+            {
+                destroyFromPtr();
+                copyFrom(other, false);
+                other->initBlank();
+            }
+
             void setLength(size_t sz)
             {
                 m_length = sz;
@@ -3905,7 +4842,7 @@ namespace neon
                 size_t xlen;
                 String* os;
                 xlen = m_strbuf.length();
-                os = Wrappers::wrapMakeFromStrBuf(m_strbuf, Util::hashString(m_strbuf.data(), xlen), xlen);
+                os = Wrappers::wrapMakeFromStrBuf(m_strbuf, 0, xlen);
                 m_stringtaken = true;
                 return os;
             }
@@ -4108,10 +5045,52 @@ namespace neon
             static void blackenObject(Object* object);
 
             static void destroyObject(Object* object);
+            static size_t objectSize(Object* object);
+            static bool finalizesOnMainThread(Object* object);
+
+            /* short name of $type, as used by the GC statistics */
+            static const char* typeName(Type type)
+            {
+                switch(type)
+                {
+                    case OTYP_STRING:
+                        return "string";
+                    case OTYP_RANGE:
+                        return "range";
+                    case OTYP_ARRAY:
+                        return "array";
+                    case OTYP_DICT:
+                        return "dict";
+                    case OTYP_FILE:
+                        return "file";
+                    case OTYP_UPVALUE:
+                        return "upvalue";
+                    case OTYP_FUNCBOUND:
+                        return "funcbound";
+                    case OTYP_FUNCCLOSURE:
+                        return "funcclosure";
+                    case OTYP_FUNCSCRIPT:
+                        return "funcscript";
+                    case OTYP_INSTANCE:
+                        return "instance";
+                    case OTYP_FUNCNATIVE:
+                        return "funcnative";
+                    case OTYP_CLASS:
+                        return "class";
+                    case OTYP_MODULE:
+                        return "module";
+                    case OTYP_SWITCH:
+                        return "switch";
+                    case OTYP_USERDATA:
+                        return "userdata";
+                    default:
+                        break;
+                }
+                return "invalid";
+            }
 
         public:
             Type m_objtype = OTYP_INVALID;
-            bool m_objmark = false;
             /*
             // when an object is marked as stale, it means that the
             // GC will never collect this object. This can be useful
@@ -4120,7 +5099,13 @@ namespace neon
             // them yet, so it's best for them to be kept stale.
             */
             bool m_objstale = false;
-            Object* m_objnext = nullptr;
+            /*
+            // set once the object survived a collection, and left the nursery (SharedState::m_gcstate.young).
+            // minor collections never trace, nor free old objects.
+            */
+            bool m_objold = false;
+            /* whether this (old) object is in the remembered set; see SharedState::gcWriteBarrier */
+            bool m_objremembered = false;
 
         public:
             Object()
@@ -4264,11 +5249,20 @@ namespace neon
                     }
                     return 0;
                 }
-                return v.asNumber();
+                if(v.isInt())
+                {
+                    return (uint32_t)v.asInt();
+                }
+                /* through int64_t, so that negative numbers wrap around the same way integers do */
+                return (uint32_t)(int64_t)v.asNumber();
             }
 
             static NEON_INLINE long valToInt(Value v)
             {
+                if(v.isInt())
+                {
+                    return v.asInt();
+                }
                 return (long)valToNumber(v);
             }
 
@@ -4414,56 +5408,173 @@ namespace neon
                 return "?unknown?";
             }
 
+        #if defined(NEON_CONFIG_USENANTAGGING) && (NEON_CONFIG_USENANTAGGING == 1)
         public:
-            Type m_valtype;
-            union
-            {
-                uint8_t vbool;
-                double vfltnum;
-                Object* vobjpointer;
-            } m_valunion;
+            /*
+            * NaN-boxing layout (offset encoding):
+            * - doubles are stored with NANBOX_DOUBLEOFFSET added to their bits, so that every
+            *   encoded number has at least one of the top 15 bits set. NaNs are canonicalized first,
+            *   so that no encoded double can ever reach the 0xFFFE/0xFFFF prefixes.
+            * - integers in [-2^47, 2^47) are stored as a 48-bit payload under the 0xFFFF prefix. they count as numbers
+            *   (isNumber() is true, and asNumber() converts them), but integer code can use isInt()/asInt() to stay off the FPU.
+            *   the same number may be stored either way, so anything comparing or hashing numbers must go through asNumber().
+            * - anything else has the top 15 bits cleared:
+            *   null is all-zero bits (so that a zero-initialized Value is null, which HashTable relies on),
+            *   booleans are 0x06/0x07, and objects are stored as their plain pointer, which are at least 8-byte aligned.
+            */
+            static constexpr uint64_t NANBOX_DOUBLEOFFSET = (uint64_t(1) << 49);
+            static constexpr uint64_t NANBOX_NUMBERTAG = 0xFFFE000000000000ull;
+            static constexpr uint64_t NANBOX_INTTAG = 0xFFFF000000000000ull;
+            static constexpr int64_t NANBOX_INTMIN = -(int64_t(1) << 47);
+            static constexpr int64_t NANBOX_INTMAX = (int64_t(1) << 47) - 1;
+            static constexpr uint64_t NANBOX_OTHERTAG = 0x02;
+            static constexpr uint64_t NANBOX_BOOLTAG = 0x04;
+            static constexpr uint64_t NANBOX_NOTOBJECTMASK = (NANBOX_NUMBERTAG | NANBOX_OTHERTAG);
+            static constexpr uint64_t NANBOX_VALNULL = 0x00;
+            static constexpr uint64_t NANBOX_VALFALSE = (NANBOX_OTHERTAG | NANBOX_BOOLTAG | 0);
+            static constexpr uint64_t NANBOX_VALTRUE = (NANBOX_OTHERTAG | NANBOX_BOOLTAG | 1);
+
+        public:
+            uint64_t m_valbits;
 
         public:
             static String* toString(Value value);
 
-            static NEON_INLINE Value makeTypedValue(Type type)
+            static NEON_INLINE Value fromBits(uint64_t bits)
             {
                 Value v;
-                memset(&v, 0, sizeof(Value));
-                v.m_valtype = type;
+                v.m_valbits = bits;
                 return v;
             }
 
             template<typename InputT>
             static NEON_INLINE Value fromObject(InputT* obj)
             {
-                Value v;
-                v = makeTypedValue(VT_OBJ);
-                v.m_valunion.vobjpointer = obj;
-                return v;
+                return fromBits((uint64_t)(uintptr_t)((Object*)obj));
             }
 
             static NEON_INLINE Value makeNull()
             {
-                Value v;
-                v = makeTypedValue(VT_NULL);
-                return v;
+                return fromBits(NANBOX_VALNULL);
             }
 
             static NEON_INLINE Value makeBool(bool b)
             {
-                Value v;
-                v = makeTypedValue(VT_BOOL);
-                v.m_valunion.vbool = b;
-                return v;
+                return fromBits(b ? NANBOX_VALTRUE : NANBOX_VALFALSE);
             }
 
             static NEON_INLINE Value makeNumber(double d)
             {
-                Value v;
-                v = makeTypedValue(VT_NUMBER);
-                v.m_valunion.vfltnum = d;
-                return v;
+                uint64_t bits;
+                if(NEON_UNLIKELY(d != d))
+                {
+                    /* canonicalize NaN, so it cannot collide with the tag space. the sign is kept, since it is printed */
+                    d = (std::signbit(d) ? -NAN : NAN);
+                }
+                memcpy(&bits, &d, sizeof(double));
+                return fromBits(bits + NANBOX_DOUBLEOFFSET);
+            }
+
+            /* $i must satisfy fitsInt() */
+            static NEON_INLINE Value makeInt(int64_t i)
+            {
+                return fromBits(NANBOX_INTTAG | ((uint64_t)i & ~NANBOX_INTTAG));
+            }
+
+            static NEON_INLINE bool fitsInt(int64_t i)
+            {
+                return ((i >= NANBOX_INTMIN) && (i <= NANBOX_INTMAX));
+            }
+
+        #else
+        public:
+            Type m_valtype;
+            union
+            {
+                uint8_t vbool;
+                double vfltnum;
+                Object* vobjpointer;
+            } m_valunion;
+
+        public:
+            static String* toString(Value value);
+
+            static NEON_INLINE Value makeTypedValue(Type type)
+            {
+                Value v;
+                memset(&v, 0, sizeof(Value));
+                v.m_valtype = type;
+                return v;
+            }
+
+            template<typename InputT>
+            static NEON_INLINE Value fromObject(InputT* obj)
+            {
+                Value v;
+                v = makeTypedValue(VT_OBJ);
+                v.m_valunion.vobjpointer = obj;
+                return v;
+            }
+
+            static NEON_INLINE Value makeNull()
+            {
+                Value v;
+                v = makeTypedValue(VT_NULL);
+                return v;
+            }
+
+            static NEON_INLINE Value makeBool(bool b)
+            {
+                Value v;
+                v = makeTypedValue(VT_BOOL);
+                v.m_valunion.vbool = b;
+                return v;
+            }
+
+            static NEON_INLINE Value makeNumber(double d)
+            {
+                Value v;
+                v = makeTypedValue(VT_NUMBER);
+                v.m_valunion.vfltnum = d;
+                return v;
+            }
+
+            /* without NaN tagging there is no separate integer representation */
+            static NEON_INLINE Value makeInt(int64_t i)
+            {
+                return makeNumber(i);
+            }
+
+            static NEON_INLINE bool fitsInt(int64_t i)
+            {
+                (void)i;
+                return false;
+            }
+        #endif
+
+            /* stores $i as an integer if it fits, and as a double otherwise */
+            static NEON_INLINE Value makeNumberFromInt(int64_t i)
+            {
+                if(fitsInt(i))
+                {
+                    return makeInt(i);
+                }
+                return makeNumber(i);
+            }
+
+            /* integral doubles (except -0) that fit are stored as integers; used for literals */
+            static NEON_INLINE Value makeNumberOrInt(double d)
+            {
+                int64_t i;
+                if((d >= (double)INT64_MIN) && (d < (double)INT64_MAX))
+                {
+                    i = (int64_t)d;
+                    if(((double)i == d) && fitsInt(i) && ((i != 0) || !signbit(d)))
+                    {
+                        return makeInt(i);
+                    }
+                }
+                return makeNumber(d);
             }
 
         public:
@@ -4514,19 +5625,40 @@ namespace neon
                 return ((Range*)asObject());
             }
 
+        #if defined(NEON_CONFIG_USENANTAGGING) && (NEON_CONFIG_USENANTAGGING == 1)
             NEON_INLINE bool isNull() const
             {
-                return (m_valtype == VT_NULL);
+                return (m_valbits == NANBOX_VALNULL);
             }
 
             NEON_INLINE bool isObject() const
             {
-                return (m_valtype == VT_OBJ);
+                return (((m_valbits & NANBOX_NOTOBJECTMASK) == 0) && (m_valbits != NANBOX_VALNULL));
             }
 
-            NEON_INLINE bool isObjtype(Object::Type t) const
+            NEON_INLINE bool isBool() const
             {
-                return isObject() && (asObject()->m_objtype == t);
+                return ((m_valbits & ~uint64_t(1)) == NANBOX_VALFALSE);
+            }
+
+            NEON_INLINE bool isNumber() const
+            {
+                return ((m_valbits & NANBOX_NUMBERTAG) != 0);
+            }
+
+            NEON_INLINE bool isInt() const
+            {
+                return (m_valbits >= NANBOX_INTTAG);
+            }
+        #else
+            NEON_INLINE bool isNull() const
+            {
+                return (m_valtype == VT_NULL);
+            }
+
+            NEON_INLINE bool isObject() const
+            {
+                return (m_valtype == VT_OBJ);
             }
 
             NEON_INLINE bool isBool() const
@@ -4539,6 +5671,17 @@ namespace neon
                 return (m_valtype == VT_NUMBER);
             }
 
+            NEON_INLINE bool isInt() const
+            {
+                return false;
+            }
+        #endif
+
+            NEON_INLINE bool isObjtype(Object::Type t) const
+            {
+                return isObject() && (asObject()->m_objtype == t);
+            }
+
             NEON_INLINE bool isString() const
             {
                 return isObjtype(Object::OTYP_STRING);
@@ -4604,6 +5747,40 @@ namespace neon
                 return (isClass() || isFuncscript() || isFuncclosure() || isFuncbound() || isFuncnative());
             }
 
+        #if defined(NEON_CONFIG_USENANTAGGING) && (NEON_CONFIG_USENANTAGGING == 1)
+            NEON_INLINE Object* asObject() const
+            {
+                return (Object*)(uintptr_t)m_valbits;
+            }
+
+            NEON_INLINE double asNumber() const
+            {
+                double d;
+                uint64_t bits;
+                if(isInt())
+                {
+                    return (double)asInt();
+                }
+                bits = m_valbits - NANBOX_DOUBLEOFFSET;
+                memcpy(&d, &bits, sizeof(double));
+                return d;
+            }
+
+            /* sign-extends the 48-bit payload */
+            NEON_INLINE int64_t asInt() const
+            {
+                return ((int64_t)(m_valbits << 16)) >> 16;
+            }
+
+            NEON_INLINE bool asBool() const
+            {
+                if(isNumber())
+                {
+                    return asNumber();
+                }
+                return (m_valbits == NANBOX_VALTRUE);
+            }
+        #else
             NEON_INLINE Object* asObject() const
             {
                 return (m_valunion.vobjpointer);
@@ -4614,6 +5791,11 @@ namespace neon
                 return (m_valunion.vfltnum);
             }
 
+            NEON_INLINE int64_t asInt() const
+            {
+                return (int64_t)(m_valunion.vfltnum);
+            }
+
             NEON_INLINE bool asBool() const
             {
                 if(isNumber())
@@ -4622,6 +5804,7 @@ namespace neon
                 }
                 return (m_valunion.vbool);
             }
+        #endif
 
             NEON_INLINE String* asString() const
             {
@@ -4741,12 +5924,12 @@ namespace neon
                     m_listcapacity = ncap;
                     if(m_listitems == nullptr)
                     {
-                        m_listitems = (StoredTyp*)Memory::sysMalloc(sizeof(StoredTyp) * ncap);
+                        m_listitems = (StoredTyp*)Memory::gcRealloc(nullptr, 0, sizeof(StoredTyp) * ncap);
                         initItems(m_listitems, 0, ncap);
                     }
                     else
                     {
-                        m_listitems = (StoredTyp*)Memory::sysRealloc(m_listitems, sizeof(StoredTyp) * ncap);
+                        m_listitems = (StoredTyp*)Memory::gcRealloc(m_listitems, sizeof(StoredTyp) * oldcap, sizeof(StoredTyp) * ncap);
                         initItems(m_listitems, oldcap, ncap);
                     }
 
@@ -4757,7 +5940,7 @@ namespace neon
             {
                 if(m_listitems != nullptr)
                 {
-                    Memory::sysFree(m_listitems);
+                    Memory::gcFree(m_listitems, sizeof(StoredTyp) * m_listcapacity);
                 }
                 //m_listitems = nullptr;
                 m_listcount = 0;
@@ -4784,6 +5967,12 @@ namespace neon
                 return m_listitems;
             }
 
+            /* where data() is stored; used by JitCompiler, whose code re-reads it after the list may have grown */
+            NEON_INLINE StoredTyp* const* dataAddress() const
+            {
+                return &m_listitems;
+            }
+
             NEON_INLINE StoredTyp& get(size_t idx) const
             {
                 return m_listitems[idx];
@@ -4960,6 +6149,8 @@ namespace neon
             int m_htcount;
             int m_htcapacity;
             Entry* m_htentries;
+            /* the object this table is part of, if any. stores into it go through the write barrier */
+            Object* m_htowner;
 
         public:
             static uint64_t getNextCapacity(uint64_t capacity)
@@ -4971,17 +6162,18 @@ namespace neon
                 return Util::roundUpToPowe64(capacity + 1);
             }
 
-            void initTable()
+            void initTable(Object* owner = nullptr)
             {
                 m_htactive = true;
                 m_htcount = 0;
                 m_htcapacity = 0;
                 m_htentries = nullptr;
+                m_htowner = owner;
             }
 
             void deInit()
             {
-                Memory::sysFree(m_htentries);
+                Memory::gcFree(m_htentries, sizeof(Entry) * m_htcapacity);
             }
 
             NEON_INLINE size_t count() const
@@ -5088,7 +6280,7 @@ namespace neon
                         entoskey = entry->key.asString();
                         if(Wrappers::wrapStrGetLength(entoskey) == klen)
                         {
-                            if(memcmp(kstr, Wrappers::wrapStrGetData(entoskey), klen) == 0)
+                            if(Util::bytesEqual(kstr, Wrappers::wrapStrGetData(entoskey), klen))
                             {
                                 return entry;
                             }
@@ -5164,7 +6356,7 @@ namespace neon
                 Entry* entry;
                 Entry* entries;
                 sz = sizeof(Entry) * capacity;
-                entries = (Entry*)Memory::sysMalloc(sz);
+                entries = (Entry*)Memory::gcRealloc(nullptr, 0, sz);
                 if(entries == nullptr)
                 {
                     fprintf(stderr, "hashtab:adjustcapacity: failed to allocate %zd bytes\n", sz);
@@ -5189,7 +6381,7 @@ namespace neon
                     dest->value = entry->value;
                     m_htcount++;
                 }
-                Memory::sysFree(m_htentries);
+                Memory::gcFree(m_htentries, sizeof(Entry) * m_htcapacity);
                 m_htentries = entries;
                 m_htcapacity = capacity;
                 return true;
@@ -5218,6 +6410,11 @@ namespace neon
                 /* overwrites existing entries. */
                 entry->key = key;
                 entry->value = Property::make(value, ftyp);
+                if(m_htowner != nullptr)
+                {
+                    Wrappers::wrapGCWriteBarrier(m_htowner, key);
+                    Wrappers::wrapGCWriteBarrier(m_htowner, value);
+                }
                 return isnew;
             }
 
@@ -5395,43 +6592,228 @@ namespace neon
                 OPC_TYPEOF,
                 OPC_OPINSTANCEOF,
                 OPC_HALT,
+                /*
+                * register instructions; these are never emitted by the compiler, only by the
+                * lowering pass (see AstParser::lowerregisters), and only live in Blob::m_regcode.
+                * operands address stack slots of the current frame directly.
+                */
+                OPC_REGMOVE,
+                OPC_REGADD,
+                OPC_REGSUBTRACT,
+                OPC_REGMULTIPLY,
+                OPC_REGDIVIDE,
+                OPC_REGJUMPIFNOTLESS,
+                OPC_REGJUMPIFNOTGREATER,
+                /*
+                * superinstructions; never emitted by the compiler, only written over the first opcode of a
+                * sequence by AstParser::fusesuperinstructions. the rest of the sequence is left as it is, so
+                * jumps into the middle of it still work, and a superinstruction can always fall back to
+                * executing only the first instruction. their operands are those of the first instruction.
+                */
+                /* LOCALGET|FUNCARGGET a; LOCALGET|FUNCARGGET b; PRIMADD */
+                OPC_SUPLOCALLOCALADD,
+                /* PUSHCONSTANT k; PRIMLESSTHAN; JUMPIFFALSE x */
+                OPC_SUPCONSTLESSJUMP,
+                /* LOCALGET|FUNCARGGET a; PROPERTYGET name, cache */
+                OPC_SUPLOCALPROPERTYGET,
+                /*
+                * quickened instructions; written over a generic instruction at runtime, once it has seen
+                * operands of the matching types. on a mismatch, they are rewritten back to the generic instruction.
+                */
+                OPC_PRIMADDNUM,
+                OPC_PRIMADDSTR,
+                OPC_PRIMSUBTRACTNUM,
+                OPC_PRIMLESSTHANNUM,
                 OPC_BREAK_PL
             };
 
+            /*
+            * kinds of source operands of register instructions, stored in the low nibble
+            * of the info byte (2 bits per operand). the high nibble holds the number of padding bytes
+            * that follow the instruction, so that offsets in m_regcode match those in m_instrucs.
+            */
+            enum RegOperand
+            {
+                /* stack slot, relative to the frame (like OPC_LOCALGET) */
+                REGOPND_SLOT = 0,
+                /* index into the constant table; always a number */
+                REGOPND_CONST = 1,
+                /* the number 1 (like OPC_PUSHONE); index is unused */
+                REGOPND_ONE = 2,
+            };
+    };
+
+    /*
+    * per call-site cache for property and method lookups.
+    * OPC_PROPERTYGET, OPC_PROPERTYGETSELF, OPC_PROPERTYSET, OPC_CALLMETHOD and OPC_CLASSINVOKETHIS carry
+    * the index of their cache (in Blob::m_inlinecaches) as last operand.
+    * entries are keyed on the shape of instance receivers, and on the class of other receivers.
+    * a site starts out monomorphic, and holds up to CONF_MAXENTRIES keys; after that, entries are replaced round-robin.
+    */
+    class InlineCache
+    {
         public:
-            /**
-             * helper for Class::makeExceptionClass.
-             */
-            static Instruction make(bool isop, uint16_t code, int srcline)
+            enum
+            {
+                CONF_MAXENTRIES = 4,
+            };
+
+            struct Entry
+            {
+                /*
+                * what the entry was made for: the Shape of an instance receiver, or the Class of any other receiver.
+                * entries are only valid as long as epoch matches SharedState's cacheepoch.
+                */
+                const void* key;
+                uint32_t epoch;
+                /* property sites: index of the property in Instance::m_slots */
+                int slot;
+                /* property set sites that add a property: the shape after adding it (at $slot) */
+                Shape* nextshape;
+                /* method sites: the resolved method */
+                Value method;
+            };
+
+        public:
+            int m_count;
+            int m_nextreplace;
+            Entry m_entries[CONF_MAXENTRIES];
+
+        public:
+            void init()
+            {
+                m_count = 0;
+                m_nextreplace = 0;
+            }
+
+            NEON_INLINE Entry* find(const void* key)
+            {
+                int i;
+                for(i = 0; i < m_count; i++)
+                {
+                    if(m_entries[i].key == key)
+                    {
+                        return &m_entries[i];
+                    }
+                }
+                return nullptr;
+            }
+
+            Entry* add(const void* key)
+            {
+                Entry* ent;
+                if(m_count < CONF_MAXENTRIES)
+                {
+                    ent = &m_entries[m_count++];
+                }
+                else
+                {
+                    ent = &m_entries[m_nextreplace];
+                    m_nextreplace = (m_nextreplace + 1) % CONF_MAXENTRIES;
+                }
+                ent->key = key;
+                ent->slot = -1;
+                ent->nextshape = nullptr;
+                ent->epoch = 0;
+                ent->method = Value::makeNull();
+                return ent;
+            }
+    };
+
+#if defined(NEON_CONFIG_USEJIT) && (NEON_CONFIG_USEJIT == 1)
+    /*
+    * native code of a single Blob, as produced by JitCompiler.
+    * m_entries maps every offset of the blob to an offset into m_code (or -1, if the offset is inside
+    * an instruction), so that the interpreter can hand over at any instruction boundary.
+    */
+    class JitCode
+    {
+        public:
+            /* what the native code returns to SharedState::vmJitMaybeRun */
+            enum
             {
-                Instruction inst;
-                inst.isop = isop;
-                inst.code = code;
-                inst.fromsourceline = srcline;
-                return inst;
+                /* continue interpreting at currentframe->inscode */
+                EXIT_INTERPRET = 0,
+                /* an error was raised, and not handled */
+                EXIT_FAILED = 1,
+                /* frames were pushed or popped; the new current frame may have native code of its own */
+                EXIT_FRAMECHANGED = 2,
+            };
+
+            /* the code at m_code[0]: takes the SharedState, and the address to continue at */
+            using EnterFN = int (*)(void*, void*);
+
+        public:
+            static void destroy(JitCode* jc)
+            {
+                if(jc != nullptr)
+                {
+                    munmap(jc->m_code, jc->m_mapsize);
+                    Memory::sysFree(jc->m_entries);
+                    Memory::sysFree(jc);
+                }
             }
 
         public:
-            /* opcode or value */
-            uint16_t code;
-            /* is this instruction an opcode? */
-            uint8_t isop : 1;
-            /* line corresponding to where this instruction was emitted */
-            uint8_t fromsourceline;
+            uint8_t* m_code;
+            size_t m_mapsize;
+            int32_t* m_entries;
+            int m_entrycount;
+
+        public:
+            NEON_INLINE void* entryFor(int offset) const
+            {
+                if((offset < 0) || (offset >= m_entrycount) || (m_entries[offset] < 0))
+                {
+                    return nullptr;
+                }
+                return m_code + m_entries[offset];
+            }
+
+            NEON_INLINE int enter(void* state, void* address) const
+            {
+                return ((EnterFN)m_code)(state, address);
+            }
     };
+#endif
 
+    /*
+    * bytecode is a dense stream of bytes: one byte per opcode, followed by its operands inline.
+    * 8bit operands take one byte, 16bit operands take two bytes (big endian).
+    * source lines are not stored per byte, but in a separate run-length table (m_linetable).
+    */
     class Blob
     {
+        public:
+            struct LineRun
+            {
+                /* offset of the first byte emitted for this line */
+                int startoffset;
+                int line;
+            };
+
         public:
             static void init(Blob* blob)
             {
                 blob->m_count = 0;
                 blob->m_capacity = 0;
+            #if defined(NEON_CONFIG_USEJIT) && (NEON_CONFIG_USEJIT == 1)
+                blob->m_jitcode = nullptr;
+                blob->m_jithotness = 0;
+                blob->m_jitfailed = false;
+            #endif
             }
 
             static void destroy(Blob* blob)
             {
+            #if defined(NEON_CONFIG_USEJIT) && (NEON_CONFIG_USEJIT == 1)
+                JitCode::destroy(blob->m_jitcode);
+                blob->m_jitcode = nullptr;
+            #endif
                 blob->m_instrucs.deInit();
+                blob->m_regcode.deInit();
+                blob->m_inlinecaches.deInit();
+                blob->m_linetable.deInit();
                 blob->m_constants.deInit();
                 blob->m_argdefvals.deInit();
             }
@@ -5439,9 +6821,26 @@ namespace neon
         public:
             int m_count;
             int m_capacity;
-            ValList<Instruction> m_instrucs;
+            ValList<uint8_t> m_instrucs;
+            /*
+            * register form of m_instrucs, produced by AstParser::lowerregisters when the register VM is enabled.
+            * it has the same length and layout as m_instrucs; fused sequences are padded, so that every offset
+            * that is not inside a fused sequence is valid in both, and the VM can fall back to m_instrucs at any time.
+            * empty if the function was not lowered.
+            */
+            ValList<uint8_t> m_regcode;
+            ValList<LineRun> m_linetable;
+            /* see InlineCache; most functions have none, so nothing is allocated up front */
+            ValList<InlineCache> m_inlinecaches{0};
             ValList<Value> m_constants;
             ValList<Value> m_argdefvals;
+        #if defined(NEON_CONFIG_USEJIT) && (NEON_CONFIG_USEJIT == 1)
+            /* native code of m_instrucs; compiled once m_jithotness (calls and loop iterations) reaches the threshold */
+            JitCode* m_jitcode;
+            int64_t m_jithotness;
+            /* set if JitCompiler refused this blob; it is then never tried again */
+            bool m_jitfailed;
+        #endif
 
         public:
             Blob()
@@ -5449,17 +6848,74 @@ namespace neon
                 init(this);
             }
 
-            void push(Instruction ins)
+            void push(uint8_t byte, int line)
             {
-                m_instrucs.push(ins);
+                size_t lcnt;
+                LineRun run;
+                lcnt = m_linetable.count();
+                if((lcnt == 0) || (m_linetable[lcnt - 1].line != line))
+                {
+                    run.startoffset = m_count;
+                    run.line = line;
+                    m_linetable.push(run);
+                }
+                m_instrucs.push(byte);
                 m_count++;
             }
 
+            /* returns the source line for the byte at offset */
+            int getLine(int offset)
+            {
+                size_t lo;
+                size_t hi;
+                size_t mid;
+                lo = 0;
+                hi = m_linetable.count();
+                if(hi == 0)
+                {
+                    return 0;
+                }
+                /* find the last run that starts at or before offset */
+                while((hi - lo) > 1)
+                {
+                    mid = lo + ((hi - lo) / 2);
+                    if(m_linetable[mid].startoffset <= offset)
+                    {
+                        lo = mid;
+                    }
+                    else
+                    {
+                        hi = mid;
+                    }
+                }
+                return m_linetable[lo].line;
+            }
+
+            /* returns the offset of ip, which may point into either m_instrucs or m_regcode */
+            int codeOffset(const uint8_t* ip)
+            {
+                const uint8_t* rbegin;
+                rbegin = m_regcode.data();
+                if((rbegin != nullptr) && (ip >= rbegin) && (ip <= (rbegin + m_regcode.count())))
+                {
+                    return (int)(ip - rbegin);
+                }
+                return (int)(ip - m_instrucs.data());
+            }
+
             int addConstant(Value value)
             {
                 m_constants.push(value);
                 return m_constants.count() - 1;
             }
+
+            int addInlineCache()
+            {
+                InlineCache ic;
+                ic.init();
+                m_inlinecaches.push(ic);
+                return m_inlinecaches.count() - 1;
+            }
     };
 
     class CallFrame
@@ -5475,13 +6931,15 @@ namespace neon
             {
                 uint16_t address = 0;
                 uint16_t finallyaddress = 0;
+                /* m_vmstate.stackidx when the try block was entered; the stack is cut back to it when catching */
+                int64_t stackdepth = 0;
             };
 
         public:
             int m_handlercount = 0;
             int gcprotcount = 0;
             int stackslotpos = 0;
-            Instruction* inscode = nullptr;
+            uint8_t* inscode = nullptr;
             Function* closure = nullptr;
             /* TODO: should be dynamically allocated */
             ExceptionInfo handlers[CONF_MAXEXCEPTHANDLERS];
@@ -5500,3929 +6958,6937 @@ namespace neon
             File* filestdin;
     };
 
-    class SharedState
+    /*
+    * GC objects live in pages of CONF_PAGESIZE bytes, aligned to their size, so that the page of an object
+    * is found by masking its address. a page is cut into cells of one size class; which cells hold an
+    * object is kept in a bitmap in the page header, so that sweeping scans pages linearly instead of
+    * chasing a list through every object.
+    * mark bits are kept in a second bitmap, so marking does not write to the objects, and sweeping
+    * finds the dead objects of 64 cells at once (allocated, and not marked).
+    * between collections, no object is marked.
+    */
+    class HeapPage
     {
         public:
-            /*
-            * (1024*1024) * 1 = 1mb
-            *             * 2 = 2mb
-            * et cetera
-            */
-            static constexpr auto CONF_DEFAULTGCSTART = ((1024 * 1024) * 1);
-
-            /* growth factor for GC heap objects */
-            static constexpr auto CONF_GCHEAPGROWTHFACTOR = 1.25;
-
-            /* maximum number of syntax errors to show before bailing out */
-            static constexpr auto CONF_MAXSYNTAXERRORS = 10;
-
-            class ISTabOld
+            enum
             {
-                public:
-                    HashTable<Value, Value> m_htab;
-
-                public:
-                    ISTabOld()
-                    {
-                        m_htab.initTable();
-                    }
-
-                    void deInit()
-                    {
-                        m_htab.deInit();
-                    }
-
-                    void store(String* os)
-                    {
-                        m_htab.set(Value::fromObject(os), Value::makeNull());
-                    }
-
-                    String* findstring(const char* findstr, size_t findlen, uint32_t findhash)
-                    {
-                        size_t slen;
-                        uint32_t index;
-                        const char* sdata;
-                        String* string;
-                        (void)findstr;
-                        (void)sdata;
-                        NN_NULLPTRCHECK_RETURNVALUE(m_htab, nullptr);
-                        if(m_htab.m_htcount == 0)
-                        {
-                            return nullptr;
-                        }
-                        index = findhash & (m_htab.m_htcapacity - 1);
-                        while(true)
-                        {
-                            auto entry = &m_htab.m_htentries[index];
-                            if(entry->key.isNull())
-                            {
-                                /*
-                                // stop if we find an empty non-tombstone entry
-                                //if (entry->value.isNull())
-                                */
-                                {
-                                    return nullptr;
-                                }
-                            }
-                            string = entry->key.asString();
-                            slen = Wrappers::wrapStrGetLength(string);
-                            sdata = Wrappers::wrapStrGetData(string);
-                            if((slen == findlen) && (Wrappers::wrapStrGetHash(string) == findhash))
-                            {
-                                //if(memcmp(sdata, findstr, findlen) == 0)
-                                {
-                                    /* we found it */
-                                    return string;
-                                }
-                            }
-                            index = (index + 1) & (m_htab.m_htcapacity - 1);
-                        }
-                        return nullptr;
-                    }
+                CONF_PAGESIZE = (64 * 1024),
+                CONF_CELLALIGN = 16,
+                CONF_MAXCELLS = (CONF_PAGESIZE / CONF_CELLALIGN),
+                CONF_BITMAPWORDS = (CONF_MAXCELLS / 64),
             };
 
         public:
-            static SharedState* m_myself;
-
-            struct
+            static NEON_INLINE HeapPage* pageOf(const void* ptr)
             {
-                /* for switching through the command line args... */
-                bool enablewarnings;
-                bool dumpbytecode;
-                bool exitafterbytecode;
-                bool shoulddumpstack;
-                bool enablestrictmode;
-                bool showfullstack;
-                bool enableapidebug;
-                int maxsyntaxerrors;
-            } m_conf;
+                return (HeapPage*)((uintptr_t)ptr & ~(uintptr_t)(CONF_PAGESIZE - 1));
+            }
 
-            struct
+            static NEON_INLINE bool isMarked(const Object* object)
             {
-                int64_t graycount;
-                int64_t graycapacity;
-                int64_t bytesallocated;
-                int64_t nextgc;
-                Object** graystack;
-            } m_gcstate;
+                size_t idx;
+                HeapPage* page;
+                page = pageOf(object);
+                idx = page->indexOf(object);
+                return ((page->m_markbits[idx / 64] >> (idx % 64)) & 1) != 0;
+            }
 
-            struct
+            static NEON_INLINE void setMarked(const Object* object)
             {
-                bool m_unhandledexceptionstate;
-                int64_t stackidx;
-                int64_t stackcapacity;
-                int64_t framecapacity;
-                int64_t framecount;
-                Instruction currentinstr;
-                CallFrame* currentframe;
-                Upvalue* openupvalues;
-                ValList<CallFrame> framevalues;
-                ValList<Value> stackvalues;
-            } m_vmstate;
+                size_t idx;
+                HeapPage* page;
+                page = pageOf(object);
+                idx = page->indexOf(object);
+                page->m_markbits[idx / 64] |= (uint64_t(1) << (idx % 64));
+            }
 
-            struct
+        #if defined(NEON_CONFIG_USEPARALLELMARK) && (NEON_CONFIG_USEPARALLELMARK == 1)
+            /* marks $object, unless another thread got there first; returns whether this call marked it */
+            static NEON_INLINE bool trySetMarkedAtomic(const Object* object)
             {
-                Class* stdexception;
-                Class* syntaxerror;
-                Class* asserterror;
-                Class* ioerror;
-                Class* oserror;
-                Class* argumenterror;
-                Class* regexerror;
-                Class* importerror;
-            } m_exceptions;
+                size_t idx;
+                uint64_t bit;
+                HeapPage* page;
+                page = pageOf(object);
+                idx = page->indexOf(object);
+                bit = (uint64_t(1) << (idx % 64));
+                std::atomic_ref<uint64_t> word(page->m_markbits[idx / 64]);
+                if((word.load(std::memory_order_relaxed) & bit) != 0)
+                {
+                    return false;
+                }
+                return ((word.fetch_or(bit, std::memory_order_relaxed) & bit) == 0);
+            }
+        #endif
 
-            struct
+            static NEON_INLINE void clearMarked(const Object* object)
             {
-                /* __indexget__ */
-                String* nmindexget;
-                /* __indexset__ */
-                String* nmindexset;
-                /* __add__ */
-                String* nmadd;
-                /* __sub__ */
-                String* nmsub;
-                /* __div__ */
-                String* nmdiv;
-                /* __mul__ */
-                String* nmmul;
-                /* __band__ */
-                String* nmband;
-                /* __bor__ */
-                String* nmbor;
-                /* __bxor__ */
-                String* nmbxor;
-
-                String* nmconstructor;
-            } m_defaultstrings;
+                size_t idx;
+                HeapPage* page;
+                page = pageOf(object);
+                idx = page->indexOf(object);
+                page->m_markbits[idx / 64] &= ~(uint64_t(1) << (idx % 64));
+            }
 
-            Object* linkedobjects;
-            bool markvalue;
-            #if 1
-                ISTabOld m_allocatedstrings;
+            /* index of the lowest set bit of $word, which must not be 0 */
+            static NEON_INLINE int lowestBit(uint64_t word)
+            {
+            #if defined(__GNUC__) || defined(__clang__)
+                return __builtin_ctzll(word);
             #else
-                ISTabNew m_allocatedstrings;
+                int i;
+                i = 0;
+                while((word & 1) == 0)
+                {
+                    word >>= 1;
+                    i++;
+                }
+                return i;
             #endif
-            HashTable<Value, Value> m_openedmodules;
-            HashTable<Value, Value> m_declaredglobals;
-
-            /*
-             * these classes are used for runtime objects, specifically in getClassFor.
-             * every other global class needed (as created by Class::makeScriptClass) need NOT be declared here.
-             * simply put, these classes are primitive types.
-             */
-            /* the class from which every other class derives */
-            Class* m_classprimobject;
-            /**/
-            Class* m_classprimclass;
-            /* class for numbers, et al */
-            Class* m_classprimnumber;
-            /* class for strings */
-            Class* m_classprimstring;
-            /* class for arrays */
-            Class* m_classprimarray;
-            /* class for dictionaries */
-            Class* m_classprimdict;
-            /* class for I/O file objects */
-            Class* m_classprimfile;
-            Class* m_classprimdirectory;
-            /* class for range constructs */
-            Class* m_classprimrange;
-            /* class for anything callable: functions, lambdas, constructors ... */
-            Class* m_classprimcallable;
-            Class* m_classprimprocess;
-
-            bool m_isrepl;
-            ProcessInfo* m_processinfo;
+            }
 
-            /* miscellaneous */
-            IOStream* m_stdoutprinter;
-            IOStream* m_stderrprinter;
-            IOStream* m_debugwriter;
-            const char* m_rootphysfile;
-            Dict* m_envdict;
-            ValList<Value> m_importpath;
+        public:
+            HeapPage* m_nextpage;
+            char* m_cells;
+            /* 2^40 / m_cellsize, rounded up; turns the division in indexOf() into a multiplication */
+            uint64_t m_cellrecip;
+            uint32_t m_cellsize;
+            uint32_t m_cellcount;
+            uint32_t m_sizeclass;
+            uint32_t m_livecount;
+            /* set for every page when an incremental collection starts sweeping; cleared once this page is swept */
+            bool m_needsweep;
+            uint64_t m_allocbits[CONF_BITMAPWORDS];
+            uint64_t m_markbits[CONF_BITMAPWORDS];
 
-            Value m_lastreplvalue;
-            void* m_memuserptr;
-            Module* m_topmodule;
+        public:
+            NEON_INLINE size_t bitmapWords() const
+            {
+                return (m_cellcount + 63) / 64;
+            }
 
-        private:
-            static bool defVarsFor(SharedState* gcs)
+            /* exact, since cells are at multiples of m_cellsize, and a page has far fewer than 2^20 cells */
+            NEON_INLINE size_t indexOf(const void* ptr) const
             {
-                gcs->markvalue = true;
-                gcs->m_gcstate.bytesallocated = 0;
-                /* default is 1mb. Can be modified via the -g flag. */
-                gcs->m_gcstate.nextgc = CONF_DEFAULTGCSTART;
-                gcs->m_gcstate.graycount = 0;
-                gcs->m_gcstate.graycapacity = 0;
-                gcs->m_gcstate.graystack = nullptr;
-                return true;
+                return (size_t)((uint64_t((const char*)ptr - m_cells) * m_cellrecip) >> 40);
             }
 
-        public:
-            static bool init()
+            NEON_INLINE Object* cellAt(size_t idx) const
             {
-                SharedState::m_myself = Memory::make<SharedState>();
-                return defVarsFor(SharedState::m_myself);
+                return (Object*)(m_cells + (idx * m_cellsize));
             }
 
-            static void destroy()
+            NEON_INLINE void setAllocated(size_t idx)
             {
-                Memory::destroy(SharedState::m_myself);
+                m_allocbits[idx / 64] |= (uint64_t(1) << (idx % 64));
+                m_livecount++;
             }
 
-            static NEON_INLINE SharedState* get()
+            NEON_INLINE void clearAllocated(size_t idx)
             {
-                return SharedState::m_myself;
+                m_allocbits[idx / 64] &= ~(uint64_t(1) << (idx % 64));
+                m_livecount--;
             }
+    };
 
-            template<typename... ArgsT>
-            static void raiseWarning(const char* fmt, ArgsT&&... args)
+    /*
+    * the pages of every size class, and a free list of cells per size class.
+    * only the main thread allocates, and touches the bitmaps; the sweeper thread hands freed cells
+    * back through $m_returned, which is moved to the free lists once one of them runs dry.
+    * empty pages are given back to the OS by trim(), and kept in $m_spare to be reused by newPage().
+    */
+    class ObjectHeap
+    {
+        public:
+            enum
             {
-                auto gcs = SharedState::get();
-                if(gcs->m_conf.enablewarnings)
+                CONF_MAXCELLSIZE = 1024,
+                CONF_SIZECLASSES = (CONF_MAXCELLSIZE / HeapPage::CONF_CELLALIGN) + 1,
+            };
+
+            struct FreeCell
+            {
+                FreeCell* next;
+            };
+
+        public:
+            HeapPage* m_pages;
+            size_t m_pagecount;
+            /* pages whose memory was given back to the OS by trim(); their contents are gone, headers included */
+            HeapPage** m_spare;
+            size_t m_sparecount;
+            size_t m_sparecapacity;
+            FreeCell* m_freelists[CONF_SIZECLASSES];
+            FreeCell* m_returned;
+        #if defined(NEON_CONFIG_USEBACKGROUNDSWEEP) && (NEON_CONFIG_USEBACKGROUNDSWEEP == 1)
+            std::mutex m_returnlock;
+        #endif
+
+        private:
+            static void* allocPage()
+            {
+                void* ptr;
+            #if defined(NEON_PLAT_ISWINDOWS)
+                ptr = _aligned_malloc(HeapPage::CONF_PAGESIZE, HeapPage::CONF_PAGESIZE);
+            #else
+                if(posix_memalign(&ptr, HeapPage::CONF_PAGESIZE, HeapPage::CONF_PAGESIZE) != 0)
                 {
-                    fprintf(stderr, "WARNING: ");
-                    fprintf(stderr, fmt, args...);
-                    fprintf(stderr, "\n");
+                    ptr = nullptr;
                 }
+            #endif
+                return ptr;
             }
 
-            static void* gcAllocObj(size_t newsize, size_t amount, bool retain)
+            static void freePage(void* ptr)
             {
-                size_t oldsize;
-                void* result;
-                auto gcs = SharedState::get();
-                oldsize = 0;
-                if(!retain)
+            #if defined(NEON_PLAT_ISWINDOWS)
+                _aligned_free(ptr);
+            #else
+                free(ptr);
+            #endif
+            }
+
+            /*
+            * gives the memory of an empty page back to the OS. where madvise() is available, the address
+            * range is kept, and reads as zeroes once touched again; otherwise the page is freed.
+            */
+            void retirePage(HeapPage* page)
+            {
+            #if defined(NEON_PLAT_ISLINUX)
+                if(madvise(page, HeapPage::CONF_PAGESIZE, MADV_DONTNEED) == 0)
                 {
-                    gcs->gcMaybeCollect(newsize - oldsize, newsize > oldsize);
+                    if(m_sparecount == m_sparecapacity)
+                    {
+                        m_sparecapacity = Memory::getNextCapacity(m_sparecapacity);
+                        m_spare = (HeapPage**)Memory::sysRealloc(m_spare, sizeof(HeapPage*) * m_sparecapacity);
+                    }
+                    m_spare[m_sparecount] = page;
+                    m_sparecount++;
+                    return;
                 }
-                result = Memory::sysMalloc(newsize * amount);
-                /*
-                // just in case reallocation fails... computers ain't infinite!
-                */
-                if(result == nullptr)
+            #endif
+                freePage(page);
+            }
+
+            /* puts the free cells of $page on the free list of its size class, lowest address first */
+            void pushFreeCells(HeapPage* page)
+            {
+                size_t i;
+                FreeCell* cell;
+                i = page->m_cellcount;
+                while(i > 0)
                 {
-                    fprintf(stderr, "fatal error: failed to allocate %zd bytes\n", newsize);
-                    abort();
+                    i--;
+                    if(((page->m_allocbits[i / 64] >> (i % 64)) & 1) == 0)
+                    {
+                        cell = (FreeCell*)page->cellAt(i);
+                        cell->next = m_freelists[page->m_sizeclass];
+                        m_freelists[page->m_sizeclass] = cell;
+                    }
                 }
-                return result;
             }
 
-            template<typename InputT>
-            static InputT* gcMakeObject(Object::Type type, bool retain)
+            /* makes a new page for $sizeclass, and puts its cells on the free list, lowest address first */
+            bool newPage(size_t sizeclass)
             {
-                static_assert((std::is_base_of<Object, InputT>::value));
-                size_t size = sizeof(InputT);
-                auto gcs = SharedState::get();
-                auto temp = (InputT*)SharedState::gcAllocObj(size, 1, retain);
-                auto object = new(temp) InputT();
-                object->m_objtype = type;
-                object->m_objmark = !gcs->markvalue;
-                object->m_objstale = false;
-                object->m_objnext = gcs->linkedobjects;
-                gcs->linkedobjects = object;
-                return object;
-            }
-
-            template<typename InputT>
-            void gcReleaseObj(InputT* pointer, size_t oldsize)
-            {
-                static_assert((std::is_base_of<Object, InputT>::value));
-                gcMaybeCollect(-oldsize, false);
-                if(oldsize > 0)
+                size_t i;
+                size_t hdrsize;
+                HeapPage* page;
+                FreeCell* cell;
+                if(m_sparecount > 0)
                 {
-                    #if 0
-                    memset(pointer, 0, oldsize);
-                    #endif
+                    m_sparecount--;
+                    page = m_spare[m_sparecount];
                 }
-                // N.B.: Memory::destroy() MIGHT call InputT::destroy() if InputT defines such a function,
-                // which would lead to illegal double-frees!
-                Memory::sysFree(pointer);
-                pointer = nullptr;
+                else
+                {
+                    page = (HeapPage*)allocPage();
+                }
+                if(page == nullptr)
+                {
+                    return false;
+                }
+                hdrsize = (sizeof(HeapPage) + HeapPage::CONF_CELLALIGN - 1) & ~(size_t)(HeapPage::CONF_CELLALIGN - 1);
+                page->m_cells = (char*)page + hdrsize;
+                page->m_cellsize = sizeclass * HeapPage::CONF_CELLALIGN;
+                page->m_cellrecip = ((uint64_t(1) << 40) + page->m_cellsize - 1) / page->m_cellsize;
+                page->m_cellcount = (HeapPage::CONF_PAGESIZE - hdrsize) / page->m_cellsize;
+                page->m_sizeclass = sizeclass;
+                page->m_livecount = 0;
+                page->m_needsweep = false;
+                memset(page->m_allocbits, 0, sizeof(page->m_allocbits));
+                memset(page->m_markbits, 0, sizeof(page->m_markbits));
+                i = page->m_cellcount;
+                while(i > 0)
+                {
+                    i--;
+                    cell = (FreeCell*)page->cellAt(i);
+                    cell->next = m_freelists[sizeclass];
+                    m_freelists[sizeclass] = cell;
+                }
+                page->m_nextpage = m_pages;
+                m_pages = page;
+                m_pagecount++;
+                return true;
             }
 
-            template<typename InputT>
-            void gcReleaseObj(InputT* pointer)
+            /* moves the cells freed by the sweeper thread to the free lists */
+            bool reclaimReturned()
             {
-                gcReleaseObj(pointer, sizeof(InputT));
+                FreeCell* next;
+                FreeCell* cell;
+                HeapPage* page;
+            #if defined(NEON_CONFIG_USEBACKGROUNDSWEEP) && (NEON_CONFIG_USEBACKGROUNDSWEEP == 1)
+                {
+                    std::lock_guard<std::mutex> lk(m_returnlock);
+                    cell = m_returned;
+                    m_returned = nullptr;
+                }
+            #else
+                cell = m_returned;
+                m_returned = nullptr;
+            #endif
+                if(cell == nullptr)
+                {
+                    return false;
+                }
+                while(cell != nullptr)
+                {
+                    next = cell->next;
+                    page = HeapPage::pageOf(cell);
+                    cell->next = m_freelists[page->m_sizeclass];
+                    m_freelists[page->m_sizeclass] = cell;
+                    cell = next;
+                }
+                return true;
             }
 
-
-            /*
-            // NOTE:
-            // 1. Any call to SharedState::gcProtect() within a function/block must be accompanied by
-            // at least one call to SharedState::clearGCProtect() before exiting the function/block
-            // otherwise, expect unexpected behavior
-            // 2. The call to SharedState::clearGCProtect() will be automatic for native functions.
-            // 3. $thisval must be retrieved before any call to SharedState::gcProtect in a
-            // native function.
-            */
-            template<typename InputT>
-            static InputT* gcProtect(InputT* object)
+        public:
+            void init()
             {
-                size_t frpos;
-                auto gcs = SharedState::get();
-                gcs->vmStackPush(Value::fromObject(object));
-                frpos = 0;
-                if(gcs->m_vmstate.framecount > 0)
+                size_t i;
+                m_pages = nullptr;
+                m_pagecount = 0;
+                m_spare = nullptr;
+                m_sparecount = 0;
+                m_sparecapacity = 0;
+                m_returned = nullptr;
+                for(i = 0; i < CONF_SIZECLASSES; i++)
                 {
-                    frpos = gcs->m_vmstate.framecount - 1;
+                    m_freelists[i] = nullptr;
                 }
-                gcs->m_vmstate.framevalues[frpos].gcprotcount++;
-                return object;
             }
 
-            static NEON_INLINE void clearGCProtect()
+            void* allocate(size_t size)
             {
-                size_t frpos;
-                CallFrame* frame;
-                frpos = 0;
-                auto gcs = SharedState::get();
-                if(gcs->m_vmstate.framecount > 0)
+                size_t sizeclass;
+                FreeCell* cell;
+                HeapPage* page;
+                sizeclass = (size + HeapPage::CONF_CELLALIGN - 1) / HeapPage::CONF_CELLALIGN;
+                if((sizeclass == 0) || (sizeclass >= CONF_SIZECLASSES))
                 {
-                    frpos = gcs->m_vmstate.framecount - 1;
+                    return nullptr;
                 }
-                frame = &gcs->m_vmstate.framevalues[frpos];
-                if(frame->gcprotcount > 0)
+                if(m_freelists[sizeclass] == nullptr)
                 {
-                    if(frame->gcprotcount > 0)
+                    if(!reclaimReturned() || (m_freelists[sizeclass] == nullptr))
                     {
-                        gcs->m_vmstate.stackidx -= frame->gcprotcount;
+                        if(!newPage(sizeclass))
+                        {
+                            return nullptr;
+                        }
                     }
-                    frame->gcprotcount = 0;
                 }
+                cell = m_freelists[sizeclass];
+                m_freelists[sizeclass] = cell->next;
+                page = HeapPage::pageOf(cell);
+                page->setAllocated(page->indexOf(cell));
+                return cell;
             }
 
-            static void markValue(Value value)
+            /* takes the cell of an object out of the heap, without making it available yet */
+            void detach(void* ptr)
             {
-                if(value.isObject())
-                {
-                    Object::markObject(value.asObject());
-                }
+                HeapPage* page;
+                page = HeapPage::pageOf(ptr);
+                page->clearAllocated(page->indexOf(ptr));
             }
 
-            void gcMarkRoots();
+            void release(void* ptr)
+            {
+                HeapPage* page;
+                FreeCell* cell;
+                page = HeapPage::pageOf(ptr);
+                page->clearAllocated(page->indexOf(ptr));
+                cell = (FreeCell*)ptr;
+                cell->next = m_freelists[page->m_sizeclass];
+                m_freelists[page->m_sizeclass] = cell;
+            }
 
-            void gcTraceRefs()
+            /* gives back a cell that was detach()ed; may be called from the sweeper thread */
+            void releaseDetached(void* ptr)
             {
-                Object* object;
-                while(m_gcstate.graycount > 0)
+                FreeCell* cell;
+                cell = (FreeCell*)ptr;
+            #if defined(NEON_CONFIG_USEBACKGROUNDSWEEP) && (NEON_CONFIG_USEBACKGROUNDSWEEP == 1)
+                std::lock_guard<std::mutex> lk(m_returnlock);
+            #endif
+                cell->next = m_returned;
+                m_returned = cell;
+            }
+
+            /* empty pages: their objects were all freed */
+            size_t emptyPages() const
+            {
+                size_t count;
+                HeapPage* page;
+                count = 0;
+                for(page = m_pages; page != nullptr; page = page->m_nextpage)
                 {
-                    m_gcstate.graycount--;
-                    object = m_gcstate.graystack[m_gcstate.graycount];
-                    Object::blackenObject(object);
+                    if(page->m_livecount == 0)
+                    {
+                        count++;
+                    }
                 }
+                return count;
             }
 
-            void gcSweep()
+            /*
+            * gives every empty page but the first $keep back to the OS, and returns how many were.
+            * the cells of those pages are spread over the free lists, which are rebuilt from the bitmaps
+            * for the size classes that lost a page. cells detach()ed but not released yet would be lost
+            * from the free lists, so the sweeper thread must be idle.
+            */
+            size_t trim(size_t keep)
             {
-                Object* object;
-                Object* previous;
-                Object* unreached;
-                previous = nullptr;
-                object = linkedobjects;
-                while(object != nullptr)
+                size_t i;
+                size_t kept;
+                size_t count;
+                HeapPage* page;
+                HeapPage** link;
+                bool affected[CONF_SIZECLASSES];
+                reclaimReturned();
+                memset(affected, 0, sizeof(affected));
+                kept = 0;
+                count = 0;
+                link = &m_pages;
+                while((page = *link) != nullptr)
                 {
-                    if(object->m_objmark == markvalue)
+                    if((page->m_livecount == 0) && (kept++ >= keep))
                     {
-                        previous = object;
-                        object = object->m_objnext;
+                        *link = page->m_nextpage;
+                        affected[page->m_sizeclass] = true;
+                        retirePage(page);
+                        m_pagecount--;
+                        count++;
+                        continue;
                     }
-                    else
+                    link = &page->m_nextpage;
+                }
+                if(count == 0)
+                {
+                    return 0;
+                }
+                for(i = 0; i < CONF_SIZECLASSES; i++)
+                {
+                    if(affected[i])
                     {
-                        unreached = object;
-                        object = object->m_objnext;
-                        if(previous != nullptr)
-                        {
-                            previous->m_objnext = object;
-                        }
-                        else
-                        {
-                            linkedobjects = object;
-                        }
-                        Object::destroyObject(unreached);
+                        m_freelists[i] = nullptr;
                     }
                 }
-            }
-
-            void gcLinkedObjectsDestroy()
-            {
-                Object* next;
-                Object* object;
-                object = linkedobjects;
-                while(object != nullptr)
+                for(page = m_pages; page != nullptr; page = page->m_nextpage)
                 {
-                    next = object->m_objnext;
-                    Object::destroyObject(object);
-                    object = next;
+                    if(affected[page->m_sizeclass])
+                    {
+                        pushFreeCells(page);
+                    }
                 }
-                Memory::sysFree(m_gcstate.graystack);
-                m_gcstate.graystack = nullptr;
+                return count;
             }
 
-            void gcMarkCompilerRoots()
+            void destroy()
             {
-                /*
-                FuncCompiler* fnc;
-                fnc = ->fnc;
-                while(fnc != nullptr)
+                size_t i;
+                HeapPage* next;
+                HeapPage* page;
+                page = m_pages;
+                while(page != nullptr)
                 {
-                    Object::markObject((Object*)fnc->m_targetfunc);
-                    fnc = fnc->m_enclosing;
+                    next = page->m_nextpage;
+                    freePage(page);
+                    page = next;
                 }
-                */
+                for(i = 0; i < m_sparecount; i++)
+                {
+                    freePage(m_spare[i]);
+                }
+                Memory::sysFree(m_spare);
+                init();
             }
+    };
 
-            void gcCollectGarbage()
-            {
-                size_t before;
-                (void)before;
-                /*
-                //  REMOVE THE NEXT LINE TO DISABLE NESTED gcCollectGarbage() POSSIBILITY!
-                */
-                m_gcstate.nextgc = m_gcstate.bytesallocated;
-                gcMarkRoots();
-                gcTraceRefs();
-                Value::valtabRemoveWhites(&m_allocatedstrings.m_htab);
-                Value::valtabRemoveWhites(&m_openedmodules);
-                gcSweep();
-                m_gcstate.nextgc = m_gcstate.bytesallocated * CONF_GCHEAPGROWTHFACTOR;
-                markvalue = !markvalue;
-            }
+#if defined(NEON_CONFIG_USEBACKGROUNDSWEEP) && (NEON_CONFIG_USEBACKGROUNDSWEEP == 1)
+    /*
+    * frees unreachable objects on a helper thread.
+    * the collector finds dead objects on the main thread, detaches their cells from the heap, and hands
+    * them over in batches. objects whose finalizer must run on the main thread (see
+    * Object::finalizesOnMainThread) are never handed over. the thread is started on the first batch.
+    */
+    class BackgroundSweeper
+    {
+        public:
+            static inline thread_local bool t_onsweeper = false;
 
-            void gcMaybeCollect(int addsize, bool wasnew)
+        public:
+            std::thread m_thread;
+            std::mutex m_lock;
+            std::condition_variable m_wakeup;
+            std::condition_variable m_idle;
+            /* dead objects not yet picked up by the thread */
+            Object** m_pending;
+            size_t m_pendingcount;
+            size_t m_pendingcapacity;
+            bool m_busy;
+            bool m_running;
+            bool m_quit;
+
+        private:
+            void run()
             {
-                m_gcstate.bytesallocated += addsize;
-                if(m_gcstate.nextgc > 0)
+                size_t i;
+                size_t count;
+                size_t capacity;
+                Object** items;
+                std::unique_lock<std::mutex> lk(m_lock);
+                t_onsweeper = true;
+                items = nullptr;
+                capacity = 0;
+                while(true)
                 {
-                    if(wasnew && m_gcstate.bytesallocated > m_gcstate.nextgc)
+                    m_wakeup.wait(lk, [this]{ return (m_pendingcount > 0) || m_quit; });
+                    if(m_pendingcount == 0)
                     {
-                        if(m_vmstate.currentframe && m_vmstate.currentframe->gcprotcount == 0)
-                        {
-                            gcCollectGarbage();
-                        }
+                        break;
                     }
+                    /* take the batch, and leave the array of the previous one for the collector to fill */
+                    std::swap(items, m_pending);
+                    std::swap(capacity, m_pendingcapacity);
+                    count = m_pendingcount;
+                    m_pendingcount = 0;
+                    m_busy = true;
+                    lk.unlock();
+                    for(i = 0; i < count; i++)
+                    {
+                        Object::destroyObject(items[i]);
+                    }
+                    lk.lock();
+                    m_busy = false;
+                    m_idle.notify_all();
                 }
+                Memory::sysFree(items);
             }
 
-            Function* compileSourceToFunction(Module* module, bool fromeval, const char* source, bool toplevel);
-            Status execSource(Module* module, const char* source, const char* filename, Value* dest);
-            Value evalSource(const char* source);
-
-            bool vmExceptionPushHandler(Class* type, int address, int finallyaddress);
-            Value vmExceptionGetStackTrace();
-            bool vmExceptionPropagate();
-
-            /**
-             * grows m_vmstate.(stack|frame)values, respectively.
-             * currently it works fine with mob.js (man-or-boy test), although
-             * there are still some invalid reads regarding the closure;
-             * almost definitely because the pointer address changes.
-             *
-             * currently, the implementation really does just increase the
-             * memory block available:
-             * i.e., [Value x 32] -> [Value x <newsize>], without
-             * copying anything beyond primitive values.
-             */
-            NEON_INLINE bool resizeStack(size_t needed)
+        public:
+            static NEON_INLINE bool onSweeperThread()
             {
-                size_t oldsz;
-                size_t newsz;
-                size_t nforvals;
-                nforvals = (needed * 2);
-                oldsz = m_vmstate.stackcapacity;
-                newsz = oldsz + nforvals;
-                m_vmstate.stackvalues.ensureCapacity(newsz);
-                m_vmstate.stackcapacity = m_vmstate.stackvalues.capacity();
-                return true;
+                return t_onsweeper;
             }
 
-            NEON_INLINE bool resizeFrames(size_t needed)
+            void init()
             {
-                size_t oldsz;
-                size_t newsz;
-                int oldhandlercnt;
-                Instruction* oldip;
-                Function* oldclosure;
-                oldclosure = m_vmstate.currentframe->closure;
-                oldip = m_vmstate.currentframe->inscode;
-                oldhandlercnt = m_vmstate.currentframe->m_handlercount;
-                oldsz = m_vmstate.framecapacity;
-                newsz = oldsz + needed;
-
-                m_vmstate.framevalues.ensureCapacity(newsz);
-                m_vmstate.framecapacity = m_vmstate.framevalues.capacity();
-
-                /*
-                 * this bit is crucial: realloc changes pointer addresses, and to keep the
-                 * current frame, re-read it from the new address.
-                 */
-                m_vmstate.currentframe = &m_vmstate.framevalues[m_vmstate.framecount - 1];
-                m_vmstate.currentframe->m_handlercount = oldhandlercnt;
-                m_vmstate.currentframe->inscode = oldip;
-                m_vmstate.currentframe->closure = oldclosure;
-                return true;
+                m_pending = nullptr;
+                m_pendingcount = 0;
+                m_pendingcapacity = 0;
+                m_busy = false;
+                m_running = false;
+                m_quit = false;
             }
 
-            NEON_INLINE bool checkMaybeResizeStack()
+            void push(Object** items, size_t count)
             {
-                if((m_vmstate.stackidx + 1) >= m_vmstate.stackcapacity)
+                if(!m_running)
                 {
-                    if(!resizeStack((m_vmstate.stackidx + 1)))
+                    m_quit = false;
+                    m_thread = std::thread(&BackgroundSweeper::run, this);
+                    m_running = true;
+                }
+                {
+                    std::lock_guard<std::mutex> lk(m_lock);
+                    if(m_pendingcapacity < (m_pendingcount + count))
                     {
-                        fprintf(stderr, "failed to resize stack due to overflow");
-                        return false;
+                        m_pendingcapacity = Memory::getNextCapacity(m_pendingcount + count);
+                        m_pending = (Object**)Memory::sysRealloc(m_pending, sizeof(Object*) * m_pendingcapacity);
                     }
-                    return true;
+                    memcpy(m_pending + m_pendingcount, items, sizeof(Object*) * count);
+                    m_pendingcount += count;
                 }
-                return false;
+                m_wakeup.notify_one();
             }
 
-            NEON_INLINE bool checkMaybeResizeFrames()
+            /* waits until everything handed over so far is freed */
+            void drain()
             {
-                //fprintf(stderr, "checking if frames need resizing...\n");
-                if(m_vmstate.framecount >= m_vmstate.framecapacity)
+                if(m_running)
+                {
+                    std::unique_lock<std::mutex> lk(m_lock);
+                    m_idle.wait(lk, [this]{ return (m_pendingcount == 0) && !m_busy; });
+                }
+            }
+
+            /* frees what is left, and ends the thread */
+            void stop()
+            {
+                if(m_running)
                 {
-                    if(!resizeFrames((m_vmstate.framecapacity + 1)))
                     {
-                        fprintf(stderr, "failed to resize frames due to overflow");
-                        return false;
+                        std::lock_guard<std::mutex> lk(m_lock);
+                        m_quit = true;
                     }
-                    return true;
+                    m_wakeup.notify_one();
+                    m_thread.join();
+                    m_running = false;
                 }
-                return false;
+                Memory::sysFree(m_pending);
+                m_pending = nullptr;
+                m_pendingcapacity = 0;
             }
+    };
+#endif
 
-            /* initial amount of frames (will grow dynamically if needed) */
-            #define NEON_CONFIG_INITFRAMECOUNT (16)
+#if defined(NEON_CONFIG_USEPARALLELMARK) && (NEON_CONFIG_USEPARALLELMARK == 1)
+    /*
+    * traces the heap on several threads. the calling thread is one of them.
+    * every thread has a grey stack of its own, which Object::markObject() pushes to while $t_worker is set;
+    * mark bits are set atomically, so that every object is blackened once.
+    * a thread that runs dry steals from the others: a busy thread moves the oldest half of its stack to its
+    * shared queue whenever another thread is idle, and idle threads take half of such a queue.
+    * marking is done once every thread is idle, since a shared queue is only filled by its owner, and
+    * an owner only goes idle with an empty queue.
+    */
+    class ParallelMarker
+    {
+        public:
+            enum
+            {
+                CONF_MAXTHREADS = 64,
+                /* a thread keeps this many grey objects to itself */
+                CONF_SHAREMIN = 32,
+            };
 
-            /* initial amount of stack values (will grow dynamically if needed) */
-            #define NEON_CONFIG_INITSTACKCOUNT (4 * 1)
+            struct Worker
+            {
+                Object** items;
+                int64_t count;
+                int64_t capacity;
+                std::mutex lock;
+                Object** shared;
+                int64_t sharedcount;
+                int64_t sharedcapacity;
+                /* $sharedcount, for peeking without the lock */
+                std::atomic<int64_t> sharedavail;
+            };
 
-            void resetVMState()
+        public:
+            static inline thread_local Worker* t_worker = nullptr;
+
+        public:
+            Worker m_workers[CONF_MAXTHREADS];
+            int m_count;
+            std::atomic<int> m_idle;
+
+        private:
+            static void reserve(Object*** items, int64_t* capacity, int64_t needed)
             {
-                m_vmstate.framecount = 0;
-                m_vmstate.stackidx = 0;
-                m_vmstate.openupvalues = nullptr;
+                if(*capacity < needed)
+                {
+                    *capacity = Memory::getNextCapacity(needed);
+                    *items = (Object**)Memory::sysRealloc(*items, sizeof(Object*) * (*capacity));
+                    if(*items == nullptr)
+                    {
+                        fflush(stdout);
+                        fprintf(stderr, "GC encountered an error");
+                        abort();
+                    }
+                }
             }
 
-            void initVMState()
+            static void share(Worker* w)
             {
-                linkedobjects = nullptr;
-                m_vmstate.m_unhandledexceptionstate = false;
-                m_vmstate.currentframe = nullptr;
+                int64_t half;
+                half = w->count / 2;
+                std::lock_guard<std::mutex> lk(w->lock);
+                reserve(&w->shared, &w->sharedcapacity, w->sharedcount + half);
+                memcpy(w->shared + w->sharedcount, w->items, sizeof(Object*) * half);
+                w->sharedcount += half;
+                memmove(w->items, w->items + half, sizeof(Object*) * (w->count - half));
+                w->count -= half;
+                w->sharedavail.store(w->sharedcount, std::memory_order_relaxed);
+            }
+
+            /* moves half of the shared queue of $victim (all of it, if it is $w's own) to the stack of $w */
+            static bool take(Worker* w, Worker* victim)
+            {
+                int64_t n;
+                std::lock_guard<std::mutex> lk(victim->lock);
+                if(victim->sharedcount == 0)
                 {
-                    m_vmstate.stackcapacity = NEON_CONFIG_INITSTACKCOUNT;
-                    m_vmstate.stackvalues.ensureCapacity(NEON_CONFIG_INITSTACKCOUNT);
+                    return false;
                 }
+                n = victim->sharedcount;
+                if(victim != w)
                 {
-                    m_vmstate.framecapacity = NEON_CONFIG_INITFRAMECOUNT;
-                    m_vmstate.framevalues.ensureCapacity(NEON_CONFIG_INITFRAMECOUNT);
+                    n = (n + 1) / 2;
                 }
+                reserve(&w->items, &w->capacity, w->count + n);
+                victim->sharedcount -= n;
+                memcpy(w->items + w->count, victim->shared + victim->sharedcount, sizeof(Object*) * n);
+                w->count += n;
+                victim->sharedavail.store(victim->sharedcount, std::memory_order_relaxed);
+                return true;
             }
 
-            /*
-             * don't try to further optimize vmbits functions, unless you *really* know what you are doing.
-             * they were initially macros; but for better debugging, and better type-enforcement, they
-             * are now inlined functions.
-             */
-
-            NEON_INLINE uint16_t vmReadByte()
+            Worker* findVictim(Worker* w)
             {
-                uint16_t r;
-                r = m_vmstate.currentframe->inscode->code;
-                m_vmstate.currentframe->inscode++;
-                return r;
+                int i;
+                for(i = 0; i < m_count; i++)
+                {
+                    if((&m_workers[i] != w) && (m_workers[i].sharedavail.load(std::memory_order_relaxed) > 0))
+                    {
+                        return &m_workers[i];
+                    }
+                }
+                return nullptr;
             }
 
-            NEON_INLINE Instruction vmReadInstruction()
+            void run(Worker* w)
             {
-                Instruction r;
-                r = *m_vmstate.currentframe->inscode;
-                m_vmstate.currentframe->inscode++;
-                return r;
+                Object* object;
+                Worker* victim;
+                t_worker = w;
+                while(true)
+                {
+                    while(w->count > 0)
+                    {
+                        w->count--;
+                        object = w->items[w->count];
+                        Object::blackenObject(object);
+                        if((w->count > CONF_SHAREMIN) && (m_idle.load(std::memory_order_relaxed) > 0) && (w->sharedavail.load(std::memory_order_relaxed) == 0))
+                        {
+                            share(w);
+                        }
+                    }
+                    if(take(w, w))
+                    {
+                        continue;
+                    }
+                    m_idle.fetch_add(1);
+                    while(true)
+                    {
+                        if(m_idle.load() == m_count)
+                        {
+                            t_worker = nullptr;
+                            return;
+                        }
+                        victim = findVictim(w);
+                        if(victim != nullptr)
+                        {
+                            /* no longer idle before taking anything, so that nobody sees everybody idle meanwhile */
+                            m_idle.fetch_sub(1);
+                            if(take(w, victim))
+                            {
+                                break;
+                            }
+                            m_idle.fetch_add(1);
+                        }
+                        else
+                        {
+                            std::this_thread::yield();
+                        }
+                    }
+                }
             }
 
-            NEON_INLINE uint16_t vmReadShort()
+        public:
+            static NEON_INLINE void push(Worker* w, Object* object)
             {
-                uint16_t b;
-                uint16_t a;
-                a = m_vmstate.currentframe->inscode[0].code;
-                b = m_vmstate.currentframe->inscode[1].code;
-                m_vmstate.currentframe->inscode += 2;
-                return (uint16_t)((a << 8) | b);
+                if(w->capacity < (w->count + 1))
+                {
+                    reserve(&w->items, &w->capacity, w->count + 1);
+                }
+                w->items[w->count++] = object;
             }
 
-            Value vmReadConst()
+            void init()
             {
-                uint16_t idx;
-                idx = vmReadShort();
-                auto blob = Wrappers::wrapGetBlobOfClosure(m_vmstate.currentframe->closure);
-                return blob->m_constants.get(idx);
+                int i;
+                m_count = 0;
+                for(i = 0; i < CONF_MAXTHREADS; i++)
+                {
+                    m_workers[i].items = nullptr;
+                    m_workers[i].count = 0;
+                    m_workers[i].capacity = 0;
+                    m_workers[i].shared = nullptr;
+                    m_workers[i].sharedcount = 0;
+                    m_workers[i].sharedcapacity = 0;
+                    m_workers[i].sharedavail.store(0);
+                }
             }
 
-            NEON_INLINE String* vmReadString()
+            /* blackens the $count objects of $grey, and whatever they reach, on $nthreads threads */
+            void trace(Object** grey, int64_t count, int nthreads)
             {
-                return vmReadConst().asString();
+                int i;
+                std::thread threads[CONF_MAXTHREADS];
+                m_count = nthreads;
+                m_idle.store(0);
+                reserve(&m_workers[0].items, &m_workers[0].capacity, count);
+                memcpy(m_workers[0].items, grey, sizeof(Object*) * count);
+                m_workers[0].count = count;
+                for(i = 1; i < nthreads; i++)
+                {
+                    threads[i] = std::thread(&ParallelMarker::run, this, &m_workers[i]);
+                }
+                run(&m_workers[0]);
+                for(i = 1; i < nthreads; i++)
+                {
+                    threads[i].join();
+                }
             }
 
-            NEON_INLINE Value vmStackPeek(int distance)
+            void destroy()
             {
-                Value v;
-                v = m_vmstate.stackvalues[m_vmstate.stackidx + (-1 - distance)];
-                return v;
+                int i;
+                for(i = 0; i < CONF_MAXTHREADS; i++)
+                {
+                    Memory::sysFree(m_workers[i].items);
+                    Memory::sysFree(m_workers[i].shared);
+                }
+                init();
             }
+    };
+#endif
 
-            NEON_INLINE void vmStackPush(Value value)
+    /*
+    * histogram of GC pauses, in microseconds.
+    * values below 8 get a bucket each; above that, every power of two is split into 8 buckets,
+    * so that a percentile is off by at most 12.5%.
+    */
+    class PauseHistogram
+    {
+        public:
+            enum
             {
-                checkMaybeResizeStack();
-                m_vmstate.stackvalues[m_vmstate.stackidx] = value;
-                m_vmstate.stackidx++;
-            }
+                CONF_SUBBUCKETS = 8,
+                CONF_BUCKETCOUNT = (64 * CONF_SUBBUCKETS),
+            };
 
-            NEON_INLINE auto vmStackPop()
+        public:
+            static int bucketFor(int64_t us)
             {
-                m_vmstate.stackidx--;
-                if(m_vmstate.stackidx < 0)
+                int msb;
+                if(us < CONF_SUBBUCKETS)
                 {
-                    m_vmstate.stackidx = 0;
+                    return (us < 0) ? 0 : us;
                 }
-                return m_vmstate.stackvalues[m_vmstate.stackidx];
+                msb = 0;
+                while((us >> (msb + 1)) != 0)
+                {
+                    msb++;
+                }
+                return ((msb - 2) * CONF_SUBBUCKETS) + ((us >> (msb - 3)) & (CONF_SUBBUCKETS - 1));
             }
 
-            NEON_INLINE auto vmStackPop(int n)
+            /* the smallest value that falls into bucket */
+            static int64_t bucketLow(int bucket)
             {
-                m_vmstate.stackidx -= n;
-                if(m_vmstate.stackidx < 0)
+                int msb;
+                if(bucket < (2 * CONF_SUBBUCKETS))
                 {
-                    m_vmstate.stackidx = 0;
+                    return bucket;
                 }
-                return m_vmstate.stackvalues[m_vmstate.stackidx];
+                msb = (bucket / CONF_SUBBUCKETS) + 2;
+                return ((int64_t)(CONF_SUBBUCKETS + (bucket % CONF_SUBBUCKETS))) << (msb - 3);
             }
 
-            Status runVM(int exitframe, Value* rv);
-            NEON_INLINE bool vmDoBinaryFunc(const char* opname, BinOpFuncFN opfn);
-            NEON_INLINE bool vmDoMakeDict();
-            NEON_INLINE bool vmDoMakeArray();
-            NEON_INLINE bool vmDoMakeClosure();
-            NEON_INLINE bool vmDoBinaryDirect();
-            NEON_INLINE bool vmDoGlobalDefine();
-            NEON_INLINE bool vmDoGlobalGet();
-            NEON_INLINE bool vmDoGlobalSet();
-            NEON_INLINE bool vmDoLocalGet();
-            NEON_INLINE bool vmDoLocalSet();
-            NEON_INLINE bool vmDoFuncArgOptional();
-            NEON_INLINE bool vmDoFuncArgGet();
-            NEON_INLINE bool vmDoFuncArgSet();
-            NEON_INLINE bool vmUtilBindMethod(Class* klass, String* name);
-            NEON_INLINE Property* vmUtilGetProperty(Value peeked, String* name);
-            NEON_INLINE bool vmDoPropertyGetNormal();
-            NEON_INLINE bool vmDoPropertyGetSelf();
-            NEON_INLINE bool vmDoPropertySet();
-            NEON_INLINE bool vmDoIndexGet();
-            NEON_INLINE bool vmUtilConcatenate();
-            NEON_INLINE bool vmDoIndexSet();
-            NEON_INLINE bool vmUtilDoSetIndexString(String* os, Value index, Value value);
-            NEON_INLINE bool vmUtilDoSetIndexArray(Array* list, Value index, Value value);
-            NEON_INLINE bool vmUtilDoSetIndexModule(Module* module, Value index, Value value);
-            NEON_INLINE bool vmUtilDoSetIndexDict(Dict* dict, Value index, Value value);
-
-            bool vmDoCallClosure(Function* closure, Value thisval, size_t argcount, bool fromoperator);
-            NEON_INLINE bool vmDoCallNative(Function* native, Value thisval, size_t argcount);
-            bool vmCallWithObject(Value callable, Value thisval, size_t argcount, bool fromoper);
-            bool vmCallValue(Value callable, Value thisval, size_t argcount, bool fromoperator);
-
-            Class* getClassFor(Value receiver);
+        public:
+            int64_t m_counts[CONF_BUCKETCOUNT];
+            int64_t m_total;
+            int64_t m_sum;
+            int64_t m_max;
 
-            NEON_INLINE bool vmUtilInvokeMethodFromClass(Class* klass, String* name, size_t argcount);
-            NEON_INLINE bool vmUtilInvokeMethodSelf(String* name, size_t argcount);
-            NEON_INLINE bool vmUtilInvokeMethodNormal(String* name, size_t argcount);
-            NEON_INLINE Upvalue* vmUtilUpvaluesCapture(Value* local, int stackpos);
-            NEON_INLINE void vmUtilUpvaluesClose(const Value* last);
-            NEON_INLINE void vmUtilDefineMethod(String* name);
-            NEON_INLINE void vmUtilDefineProperty(String* name, bool isstatic);
-            NEON_INLINE String* vmUtilMultString(String* str, double number);
-            NEON_INLINE Array* vmUtilCombineArrays(Array* a, Array* b);
-            NEON_INLINE void vmUtilMultArray(Array* from, Array* newlist, size_t times);
-            NEON_INLINE bool vmUtilDoGetRangedIndexOfArray(Array* list, bool willassign);
-            NEON_INLINE bool vmUtilDoGetRangedIndexOfString(String* string, bool willassign);
-            NEON_INLINE bool vmDoGetRangedIndex();
-            NEON_INLINE bool vmUtilDoIndexGetDict(Dict* dict, bool willassign);
-            NEON_INLINE bool vmUtilDoIndexGetModule(Module* module, bool willassign);
-            NEON_INLINE bool vmUtilDoIndexGetString(String* string, bool willassign);
-            NEON_INLINE bool vmUtilDoIndexGetArray(Array* list, bool willassign);
-            Property* vmUtilCheckOverloadRequirements(const char* ccallername, Value target, String* name);
-            NEON_INLINE bool vmUtilTryOverloadBasic(String* name, Value target, Value firstargvval, Value setvalue, bool willassign);
-            NEON_INLINE bool vmUtilTryOverloadMath(String* name, Value target, Value right, bool willassign);
-            NEON_INLINE bool vmUtilTryOverloadGeneric(String* name, Value target, bool willassign);
-            NEON_INLINE Property* vmUtilGetClassProperty(Class* klass, String* name, bool alsothrow);
+        public:
+            void reset()
+            {
+                memset(m_counts, 0, sizeof(m_counts));
+                m_total = 0;
+                m_sum = 0;
+                m_max = 0;
+            }
 
-            int vmNestCallPrepare(Value callable, Value mthobj, Value* callarr, int maxcallarr)
+            void record(int64_t us)
             {
-                int arity;
-                Function* ofn;
-                (void)maxcallarr;
-                arity = 0;
-                ofn = callable.asFunction();
-                if(callable.isFuncclosure())
-                {
-                    arity = Wrappers::wrapGetArityOfClosure(ofn);
-                }
-                else if(callable.isFuncscript())
-                {
-                    arity = Wrappers::wrapGetArityOfFuncScript(ofn);
-                }
-                else if(callable.isFuncnative())
-                {
-            #if 0
-                        arity = ofn;
-            #endif
-                }
-                if(arity > 0)
+                m_counts[bucketFor(us)]++;
+                m_total++;
+                m_sum += us;
+                if(us > m_max)
                 {
-                    callarr[0] = Value::makeNull();
-                    if(arity > 1)
-                    {
-                        callarr[1] = Value::makeNull();
-                        if(arity > 2)
-                        {
-                            callarr[2] = mthobj;
-                        }
-                    }
+                    m_max = us;
                 }
-                return arity;
             }
 
-            /* helper function to access call outside the file. */
-            bool vmNestCallFunction(Value callable, Value thisval, Value* argv, size_t argc, Value* dest, bool fromoper)
+            /* upper bound of the pause that fraction (0 to 1) of all pauses do not exceed */
+            int64_t percentile(double fraction) const
             {
-                bool needvm;
-                size_t i;
-                int64_t pidx;
-                Status status;
-                Value rtv;
-                pidx = m_vmstate.stackidx;
-                /* set the closure before the args */
-                vmStackPush(callable);
-                if((argv != nullptr) && (argc > 0))
-                {
-                    for(i = 0; i < argc; i++)
-                    {
-                        vmStackPush(argv[i]);
-                    }
-                }
-                if(!vmCallWithObject(callable, thisval, argc, fromoper))
+                int i;
+                int64_t seen;
+                int64_t want;
+                int64_t high;
+                if(m_total == 0)
                 {
-                    fprintf(stderr, "nestcall: vmCallValue() failed\n");
-                    abort();
+                    return 0;
                 }
-                needvm = true;
-                if(callable.isFuncnative())
+                want = (int64_t)ceil(fraction * m_total);
+                if(want < 1)
                 {
-                    needvm = false;
+                    want = 1;
                 }
-                if(needvm)
+                seen = 0;
+                for(i = 0; i < CONF_BUCKETCOUNT; i++)
                 {
-                    status = runVM(m_vmstate.framecount - 1, nullptr);
-                    if(status != Status::Ok)
+                    seen += m_counts[i];
+                    if(seen >= want)
                     {
-                        fprintf(stderr, "nestcall: call to runvm failed\n");
-                        abort();
+                        high = bucketLow(i + 1) - 1;
+                        return (high < m_max) ? high : m_max;
                     }
                 }
-                rtv = m_vmstate.stackvalues[m_vmstate.stackidx - 1];
-                *dest = rtv;
-                vmStackPop(argc + 0);
-                m_vmstate.stackidx = pidx;
-                return true;
+                return m_max;
             }
-
     };
 
-    SharedState* SharedState::m_myself = nullptr;
-
-    class Array : public Object
+    /*
+    * writes every live object, what it refers to, and the roots, to a file that tools/heapanalyze.cpp reads.
+    * references are found by running Object::blackenObject() and SharedState::gcMarkRoots() while
+    * $s_active is set, which makes Object::markObject() record its argument instead of marking it.
+    *
+    * file layout, all integers in host byte order:
+    *   "NEONHEAP", u32 version, u32 0, u64 objectcount, u64 rootcount
+    *   u64 root addresses
+    *   per object: u64 address, u8 type, u32 size, u16 namelen, name, u16 previewlen, preview,
+    *               u32 refcount, u64 addresses of referenced objects
+    */
+    class HeapSnapshot
     {
         public:
-            ValList<Value> m_objvarray;
-
-        public:
-            static Array* makeFilled(size_t cnt, Value filler)
-            {
-                size_t i;
-                Array* list;
-                list = SharedState::gcMakeObject<Array>(Object::OTYP_ARRAY, false);
-                if(cnt > 0)
-                {
-                    for(i = 0; i < cnt; i++)
-                    {
-                        list->push(filler);
-                    }
-                }
-                return list;
-            }
-
-            static Array* make()
+            enum
             {
-                return makeFilled(0, Value::makeNull());
-            }
+                CONF_VERSION = 1,
+                CONF_PREVIEWLENGTH = 64,
+            };
 
-            NEON_INLINE void push(Value value)
-            {
-                auto gcs = SharedState::get();
-                (void)gcs;
-                /*gcs->vmStackPush(value);*/
-                m_objvarray.push(value);
-                /*gcs->vmStackPop(); */
-            }
+            static inline HeapSnapshot* s_active = nullptr;
 
-            NEON_INLINE size_t count() const
-            {
-                return m_objvarray.count();
-            }
+        public:
+            static int64_t write(const char* path);
 
-            NEON_INLINE Value* data() const
-            {
-                return (Value*)m_objvarray.data();
-            }
+        public:
+            FILE* m_handle;
+            ValList<Object*> m_refs;
 
-            NEON_INLINE bool pop(Value* dest)
+        public:
+            NEON_INLINE void addRef(Object* object)
             {
-                return m_objvarray.pop(dest);
+                m_refs.push(object);
             }
 
-            NEON_INLINE bool set(size_t idx, Value val)
+            void putBytes(const void* ptr, size_t len)
             {
-                return m_objvarray.set(idx, val);
+                fwrite(ptr, 1, len, m_handle);
             }
 
-            NEON_INLINE bool get(size_t idx, Value* vdest) const
+            template<typename IntT>
+            void putInt(IntT val)
             {
-                size_t vc;
-                vc = count();
-                if((vc > 0) && (idx < vc))
-                {
-                    *vdest = m_objvarray.get(idx);
-                    return true;
-                }
-                return false;
+                putBytes(&val, sizeof(IntT));
             }
 
-            NEON_INLINE Value get(size_t idx) const
+            void putString(const char* str, size_t len)
             {
-                Value vd;
-                if(get(idx, &vd))
+                if(len > 0xFFFF)
                 {
-                    return vd;
+                    len = 0xFFFF;
                 }
-                return Value::makeNull();
+                putInt<uint16_t>(len);
+                putBytes(str, len);
             }
 
-            NEON_INLINE Array* copy(long start, long length)
+            void putRefs()
             {
                 size_t i;
-                Array* newlist;
-                newlist = Array::make();
-                if(start == -1)
-                {
-                    start = 0;
-                }
-                if(length == -1)
-                {
-                    length = count() - start;
-                }
-                for(i = start; i < (size_t)(start + length); i++)
+                putInt<uint32_t>(m_refs.count());
+                for(i = 0; i < m_refs.count(); i++)
                 {
-                    newlist->push(get(i));
+                    putInt<uint64_t>((uintptr_t)m_refs.get(i));
                 }
-                return newlist;
             }
+
+            void putObject(Object* object);
     };
 
-    class Dict : public Object
+    class SharedState
     {
         public:
-            ValList<Value> m_htkeys;
-            HashTable<Value, Value> m_htvalues;
+            /*
+            * (1024*1024) * 1 = 1mb
+            *             * 2 = 2mb
+            * et cetera
+            */
+            static constexpr auto CONF_DEFAULTGCSTART = ((1024 * 1024) * 1);
 
-        public:
-            static Dict* make()
-            {
-                Dict* dict;
-                dict = SharedState::gcMakeObject<Dict>(Object::OTYP_DICT, false);
-                dict->m_htvalues.initTable();
-                return dict;
-            }
+            /* default growth factor for GC heap objects. can be modified with gc.setGrowthFactor() */
+            static constexpr auto CONF_GCHEAPGROWTHFACTOR = 1.25;
 
-            static void destroy(Dict* dict)
-            {
-                dict->m_htkeys.deInit();
-                dict->m_htvalues.deInit();
-            }
+            /* bounds of the growth factor when it is adapted to --gc-cpu-target */
+            static constexpr auto CONF_GCMINGROWTHFACTOR = 1.1;
+            static constexpr auto CONF_GCMAXGROWTHFACTOR = 8.0;
 
-            bool set(Value key, Value value)
-            {
-                Value tempvalue;
-                if(!m_htvalues.get(key, &tempvalue))
-                {
-                    /* add key if it doesn't exist. */
-                    m_htkeys.push(key);
-                }
-                return m_htvalues.set(key, value);
-            }
+            /* share of the cgroup memory limit that the heap is paced to stay under; the rest is for everything else */
+            static constexpr auto CONF_GCCGROUPSHARE = 0.75;
 
-            void add(Value key, Value value)
+            /* share of --max-heap that the heap is paced to stay under, so that collections start before MemoryError does */
+            static constexpr auto CONF_GCMAXHEAPSHARE = 0.9;
+
+            /* share of --max-heap that the heap may grow beyond it once MemoryError was raised, so that the handler can run */
+            static constexpr auto CONF_GCMAXHEAPHEADROOM = 0.125;
+
+            /* after a collection, empty pages are given back to the OS once there are this many, and they are a quarter of the heap */
+            static constexpr auto CONF_GCTRIMMINPAGES = 32;
+
+            /* empty pages that are kept when trimming, so that the next allocations need not fault them in again */
+            static constexpr auto CONF_GCTRIMKEEPPAGES = 8;
+
+            /* number of Object::Type values */
+            static constexpr auto CONF_OBJTYPECOUNT = (Object::OTYP_USERDATA + 1);
+
+            /* bytes of new objects after which a minor collection runs. Can be modified via the -N flag. */
+            static constexpr auto CONF_DEFAULTNURSERYSIZE = (256 * 1024);
+
+            /* in incremental mode, a slice of GC work is done whenever this many bytes were allocated */
+            static constexpr auto CONF_GCSLICEBYTES = (32 * 1024);
+
+            /* in incremental mode, how often marking and sweeping look at the clock, in objects */
+            static constexpr auto CONF_GCCLOCKINTERVAL = 64;
+
+            /* in incremental mode, arrays and dicts with at least this many values are marked over several slices; see gcDeferLargeObject() */
+            static constexpr auto CONF_GCDEFERVALUES = 1024;
+
+            /* threads that trace the heap in a full collection, unless the machine has fewer cores */
+            static constexpr auto CONF_DEFAULTMARKTHREADS = 4;
+
+            /* heaps with fewer pages than this are traced on one thread, since starting threads costs more */
+            static constexpr auto CONF_PARALLELMARKMINPAGES = 256;
+
+            /* what gc.stats() and --gc-stats report. times are in microseconds */
+            struct GCStats
             {
-                set(key, value);
-            }
+                int64_t fullcollections;
+                int64_t minorcollections;
+                int64_t incrementalcollections;
+                int64_t marktime;
+                int64_t sweeptime;
+                /* time spent removing unmarked keys from the string table and the module table, and unsharing slices */
+                int64_t prunetime;
+                /* pages given back to the OS after collections */
+                int64_t trimmedpages;
+                /* slices that were given a copy of their bytes, since their parent was found dead */
+                int64_t unsharedslices;
+                int64_t allocbytes[CONF_OBJTYPECOUNT];
+                int64_t freedbytes[CONF_OBJTYPECOUNT];
+                int64_t alloccount[CONF_OBJTYPECOUNT];
+                int64_t freedcount[CONF_OBJTYPECOUNT];
+            };
 
-            void addStr(String* key, Value value)
+            /* a table that the slices of GCP_MARK go through an entry at a time; see gcDeferLargeObject() */
+            struct GCTableScan
             {
-                add(Value::fromObject(key), value);
-            }
+                HashTable<Value, Value>* table;
+                /* what the table held when the scan (re)started; if it was resized since, it starts over */
+                HashTable<Value, Value>::Entry* entries;
+                int capacity;
+                int next;
+            };
 
-            Property* get(Value key)
+            enum GCPhase
             {
-                return m_htvalues.getfield(key);
-            }
+                /* no collection in progress */
+                GCP_IDLE,
+                /* an incremental collection is marking */
+                GCP_MARK,
+                /* an incremental collection is done marking, and drops what it found dead from the tables that refer to it */
+                GCP_PRUNE,
+                /* an incremental collection is sweeping */
+                GCP_SWEEP,
+            };
 
-            Dict* copy()
+            /* what the slices of GCP_PRUNE go through, in this order; see gcIncrementalPrune() */
+            enum GCPruneStep
             {
-                size_t i;
-                size_t dsz;
-                Value key;
-                Property* field;
-                Dict* ndict;
-                ndict = Dict::make();
-                /*
-                // @TODO: Figure out how to handle dictionary values correctly
-                // remember that copying keys is redundant and unnecessary
-                */
-                dsz = m_htkeys.count();
-                for(i = 0; i < dsz; i++)
-                {
-                    key = m_htkeys.get(i);
-                    field = m_htvalues.getfield(m_htkeys.get(i));
-                    ndict->m_htkeys.push(key);
-                    ndict->m_htvalues.setwithtype(key, field->value, field->m_fieldtype, key.isString());
-                }
-                return ndict;
-            }
-    };
+                GCPS_YOUNG,
+                GCPS_REMEMBERED,
+                GCPS_STRINGS,
+                GCPS_SLICES,
+            };
 
-    class String : public Object
-    {
-        public:
-            static String* utilNumberToBinString(long n)
+            /* maximum number of syntax errors to show before bailing out */
+            static constexpr auto CONF_MAXSYNTAXERRORS = 10;
+
+            /* calls plus loop iterations after which a function is compiled when '--jit' is given */
+            static constexpr auto CONF_DEFAULTJITTHRESHOLD = 1000;
+
+            /*
+            * the intern table: at most one string per contents, for the strings that are interned (see
+            * String::shouldIntern). it does not keep its strings alive; unmarked ones are removed after marking.
+            * open addressing with linear probing; every slot keeps the hash and length of its string, so that
+            * a probe only touches the string itself once both match. removal shifts the rest of the cluster
+            * back, so there are no tombstones.
+            */
+            class StringTable
             {
-                int i;
-                int rem;
-                int count;
-                int length;
-                long j;
-                /* assume maximum of 1024 bits */
-                char str[1024];
-                char newstr[1027];
-                count = 0;
-                j = n;
-                if(j == 0)
-                {
-                    str[count++] = '0';
-                }
-                while(j != 0)
-                {
-                    rem = abs((int)(j % 2));
-                    j /= 2;
-                    if(rem == 1)
+                public:
+                    struct Slot
                     {
-                        str[count] = '1';
+                        String* string;
+                        uint32_t hash;
+                        uint32_t length;
+                    };
+
+                public:
+                    Slot* m_slots;
+                    size_t m_capacity;
+                    size_t m_count;
+
+                private:
+                    void insert(String* os, uint32_t hsv, size_t length)
+                    {
+                        size_t i;
+                        size_t mask;
+                        mask = m_capacity - 1;
+                        i = hsv & mask;
+                        while(m_slots[i].string != nullptr)
+                        {
+                            i = (i + 1) & mask;
+                        }
+                        m_slots[i].string = os;
+                        m_slots[i].hash = hsv;
+                        m_slots[i].length = length;
+                        m_count++;
+                    }
+
+                    void resize(size_t capacity)
+                    {
+                        size_t i;
+                        size_t oldcapacity;
+                        Slot* oldslots;
+                        oldslots = m_slots;
+                        oldcapacity = m_capacity;
+                        m_slots = (Slot*)Memory::gcRealloc(nullptr, 0, sizeof(Slot) * capacity);
+                        memset(m_slots, 0, sizeof(Slot) * capacity);
+                        m_capacity = capacity;
+                        m_count = 0;
+                        for(i = 0; i < oldcapacity; i++)
+                        {
+                            if(oldslots[i].string != nullptr)
+                            {
+                                insert(oldslots[i].string, oldslots[i].hash, oldslots[i].length);
+                            }
+                        }
+                        Memory::gcFree(oldslots, sizeof(Slot) * oldcapacity);
                     }
-                    else
+
+                    /* empties slot $i, and moves later entries of its cluster back, unless that would put them before their home slot */
+                    void removeAt(size_t i)
                     {
-                        str[count] = '0';
+                        size_t j;
+                        size_t home;
+                        size_t mask;
+                        mask = m_capacity - 1;
+                        j = i;
+                        while(true)
+                        {
+                            j = (j + 1) & mask;
+                            if(m_slots[j].string == nullptr)
+                            {
+                                break;
+                            }
+                            home = m_slots[j].hash & mask;
+                            if(((j - home) & mask) >= ((j - i) & mask))
+                            {
+                                m_slots[i] = m_slots[j];
+                                i = j;
+                            }
+                        }
+                        m_slots[i].string = nullptr;
+                        m_count--;
                     }
-                    count++;
-                }
-                /* assume maximum of 1024 bits + 0b (indicator) + sign (-). */
-                length = 0;
-                if(n < 0)
-                {
-                    newstr[length++] = '-';
-                }
-                newstr[length++] = '0';
-                newstr[length++] = 'b';
-                for(i = count - 1; i >= 0; i--)
-                {
-                    newstr[length++] = str[i];
-                }
-                newstr[length++] = 0;
-                return String::copy(newstr, length);
-                /*
-                //  // To store the binary number
-                //  int64_t number = 0;
-                //  int cnt = 0;
-                //  while (n != 0) {
-                //    int64_t rem = n % 2;
-                //    int64_t c = (int64_t) pow(10, cnt);
-                //    number += rem * c;
-                //    n /= 2;
-                //
-                //    // Count used to store exponent value
-                //    cnt++;
-                //  }
-                //
-                //  char str[67]; // assume maximum of 64 bits + 2 binary indicators (0b)
-                //  int length = sprintf(str, "0b%lld", number);
-                //
-                //  return String::copy(str, length);
-                */
-            }
 
-            static String* utilNumberToOctString(int64_t n, bool numeric)
-            {
-                int length;
-                /* assume maximum of 64 bits + 2 octal indicators (0c) */
-                char str[66];
-                length = sprintf(str, numeric ? "0c%lo" : "%lo", n);
-                return String::copy(str, length);
-            }
+                public:
+                    StringTable()
+                    {
+                        m_slots = nullptr;
+                        m_capacity = 0;
+                        m_count = 0;
+                    }
 
-            static String* utilNumberToHexString(int64_t n, bool numeric)
-            {
-                int length;
-                /* assume maximum of 64 bits + 2 hex indicators (0x) */
-                char str[66];
-                length = sprintf(str, numeric ? "0x%lx" : "%lx", n);
-                return String::copy(str, length);
-            }
+                    void deInit()
+                    {
+                        Memory::gcFree(m_slots, sizeof(Slot) * m_capacity);
+                        m_slots = nullptr;
+                        m_capacity = 0;
+                        m_count = 0;
+                    }
 
-            static Value regexMatch(String* string, String* pattern, bool capture)
-            {
-                enum
-                {
-                    matchMaxTokens = 128 * 4,
-                    matchMaxCaptures = 128,
-                };
-                int prc;
-                int64_t i;
-                int64_t mtstart;
-                int64_t mtlength;
-                int64_t actualmaxcaptures;
-                int64_t cpres;
-                int16_t restokens;
-                int64_t capstarts[matchMaxCaptures + 1];
-                int64_t caplengths[matchMaxCaptures + 1];
-                RegexContext::Token tokens[matchMaxTokens + 1];
-                auto gcs = SharedState::get();
-                memset(tokens, 0, (matchMaxTokens + 1) * sizeof(RegexContext::Token));
-                memset(caplengths, 0, (matchMaxCaptures + 1) * sizeof(int64_t));
-                memset(capstarts, 0, (matchMaxCaptures + 1) * sizeof(int64_t));
-                const char* strstart;
-                String* rstr;
-                Array* oa;
-                Dict* dm;
-                restokens = matchMaxTokens;
-                actualmaxcaptures = 0;
-                RegexContext pctx(tokens, restokens);
-                if(capture)
-                {
-                    actualmaxcaptures = matchMaxCaptures;
-                }
-                prc = pctx.parse(pattern->data(), 0);
-                if(prc == 0)
-                {
-                    cpres = pctx.match(string->data(), 0, actualmaxcaptures, capstarts, caplengths);
-                    if(cpres > 0)
+                    /* $os must not be in the table yet */
+                    void store(String* os)
                     {
-                        if(capture)
+                        if(((m_count + 1) * 4) > (m_capacity * 3))
                         {
-                            oa = Array::make();
-                            for(i = 0; i < cpres; i++)
+                            resize((m_capacity == 0) ? 64 : (m_capacity * 2));
+                        }
+                        insert(os, Wrappers::wrapStrGetHash(os), Wrappers::wrapStrGetLength(os));
+                    }
+
+                    String* findstring(const char* findstr, size_t findlen, uint32_t findhash) const
+                    {
+                        size_t i;
+                        size_t mask;
+                        const Slot* slot;
+                        if(m_count == 0)
+                        {
+                            return nullptr;
+                        }
+                        mask = m_capacity - 1;
+                        i = findhash & mask;
+                        while(true)
+                        {
+                            slot = &m_slots[i];
+                            if(slot->string == nullptr)
                             {
-                                mtstart = capstarts[i];
-                                mtlength = caplengths[i];
-                                if(mtlength > 0)
+                                return nullptr;
+                            }
+                            if((slot->hash == findhash) && (slot->length == findlen))
+                            {
+                                if(Util::bytesEqual(Wrappers::wrapStrGetData(slot->string), findstr, findlen))
                                 {
-                                    strstart = &string->data()[mtstart];
-                                    rstr = String::copy(strstart, mtlength);
-                                    dm = Dict::make();
-                                    dm->addStr(String::intern("string"), Value::fromObject(rstr));
-                                    dm->addStr(String::intern("start"), Value::makeNumber(mtstart));
-                                    dm->addStr(String::intern("length"), Value::makeNumber(mtlength));
-                                    oa->push(Value::fromObject(dm));
+                                    return slot->string;
                                 }
                             }
-                            return Value::fromObject(oa);
-                        }
-                        else
-                        {
-                            return Value::makeBool(true);
+                            i = (i + 1) & mask;
                         }
+                        return nullptr;
                     }
-                }
-                else
-                {
-                    NEON_THROWCLASSWITHSOURCEINFO(gcs->m_exceptions.regexerror, pctx.m_errorbuf);
-                }
-                RegexContext::destroy(&pctx);
-                if(capture)
-                {
-                    return Value::makeNull();
-                }
-                return Value::makeBool(false);
-            }
-
-            static void strtabStore(String* os)
-            {
-                auto gcs = SharedState::get();
-                gcs->m_allocatedstrings.store(os);
-            }
-
-            static String* strTabFind(const char* str, size_t len, uint32_t hsv)
-            {
-                String* rs;
-                auto gcs = SharedState::get();
-                rs = gcs->m_allocatedstrings.findstring(str, len, hsv);
-                return rs;
-            }
 
-            static String* makeFromStrbuf(const StrBuffer& buf, uint32_t hsv, size_t length)
-            {
-                String* rs;
-                rs = SharedState::gcMakeObject<String>(Object::OTYP_STRING, false);
-                rs->m_sbuf = buf;
-                rs->m_hashvalue = hsv;
-                if(length > 0)
-                {
-                    strtabStore(rs);
-                }
-                return rs;
-            }
+                    /*
+                    * removes the strings that were not marked. a removal can move an entry of a later slot into
+                    * slot $i, so $i is looked at again; entries that wrap around to the start were looked at already.
+                    */
+                    void removeWhites();
 
-            static void destroy(String* str)
-            {
-                StrBuffer::destroyFromPtr(&str->m_sbuf);
-            }
+                    /* removes the unmarked strings in slot $i, and those that removal moves there */
+                    void removeWhitesAt(size_t i);
+            };
 
-            static String* intern(const char* strdata, int length)
-            {
-                uint32_t hsv;
-                String* rs;
-                hsv = Util::hashString(strdata, length);
-                rs = strTabFind(strdata, length, hsv);
-                if(rs != nullptr)
-                {
-                    return rs;
-                }
-                StrBuffer buf(0);
-                buf.m_isintern = true;
-                buf.setData(strdata);
-                buf.setLength(length);
-                return makeFromStrbuf(buf, hsv, length);
-            }
+        public:
+            static SharedState* m_myself;
 
-            static String* intern(const char* strdata)
+            struct
             {
-                return intern(strdata, strlen(strdata));
-            }
+                /* for switching through the command line args... */
+                bool enablewarnings;
+                bool dumpbytecode;
+                bool exitafterbytecode;
+                /* disassemble every function of the script after running it (see Debug::disasmFunctionTree) */
+                bool dumpquickened;
+                bool shoulddumpstack;
+                bool enablestrictmode;
+                bool showfullstack;
+                bool enableapidebug;
+                /* lower compiled functions to register form (see AstParser::lowerregisters) */
+                bool useregistervm;
+                /* compile hot functions to native code (see JitCompiler) */
+                bool usejit;
+                /* print GC statistics at exit */
+                bool printgcstats;
+                /* bytes that m_gcstate.bytesallocated may not exceed, or MemoryError is raised; 0 for no limit. set by --max-heap */
+                int64_t maxheap;
+                /* how hot (calls plus loop iterations) a function must get before it is compiled; 0 compiles on first use */
+                int64_t jitthreshold;
+                int maxsyntaxerrors;
+            } m_conf;
 
-            static String* take(char* strdata, int length)
+            struct
             {
-                uint32_t hsv;
-                String* rs;
-                hsv = Util::hashString(strdata, length);
-                rs = strTabFind(strdata, length, hsv);
-                if(rs != nullptr)
-                {
-                    Memory::sysFree(strdata);
-                    return rs;
-                }
-                StrBuffer buf(0);
-                buf.setData(strdata);
-                buf.setLength(length);
-                return makeFromStrbuf(buf, hsv, length);
-            }
+                /* set while a minor collection runs; old objects count as marked then */
+                bool inminor;
+                /* no collection happens while this is nonzero */
+                int blockcount;
+                GCPhase phase;
+                /* microseconds a slice of an incremental collection may take; 0 collects all at once. set by --gc-pause-us */
+                int64_t pausebudget;
+                /* bytes allocated since the last slice */
+                int64_t slicebytes;
+                /* whether objects made while marking are grey; see gcIncrementalRemark() */
+                bool graynew;
+                int64_t graycount;
+                int64_t graycapacity;
+                int64_t bytesallocated;
+                int64_t nextgc;
+                /* bytes allocated since the last collection; reaching nurserysize starts a minor collection */
+                int64_t youngbytes;
+                int64_t nurserysize;
+                int64_t remcount;
+                int64_t remcapacity;
+                Object** graystack;
+                /* old objects that were written to since the last collection, and may refer to young objects */
+                Object** remembered;
+                /* the nursery: every object allocated since the last collection */
+                Object** young;
+                int64_t youngcount;
+                int64_t youngcapacity;
+                /* page to be swept next while $phase is GCP_SWEEP */
+                HeapPage* sweeppage;
+                /* where the slices of GCP_PRUNE are: the step, the index into what it goes through, and the intern table size it started with */
+                GCPruneStep prunestep;
+                int64_t prunecursor;
+                size_t prunecapacity;
+                /* values of large arrays, and of the roots, that the slices of GCP_MARK have yet to mark; see gcDeferValues() */
+                Value* markvalues;
+                int64_t markvaluecount;
+                int64_t markvaluecapacity;
+                /* tables of large dicts that the slices of GCP_MARK are going through */
+                GCTableScan* tablescans;
+                int64_t tablescancount;
+                int64_t tablescancapacity;
+                /* the slices of incremental collections, which --gc-pause-us bounds */
+                PauseHistogram pauses;
+                /* the pauses that it does not bound: full and minor collections, and the start and the root scans of incremental ones */
+                PauseHistogram atomicpauses;
+                /* objects found dead by the current sweep, not yet handed over to $sweeper */
+                Object** dead;
+                int64_t deadcount;
+                int64_t deadcapacity;
+                /* strings that borrow the buffer of another one; see String::slice() */
+                String** slices;
+                int64_t slicecount;
+                int64_t slicecapacity;
+                /* $slices up to here are old, and so are their parents; a minor collection leaves them be */
+                int64_t oldslicecount;
+                ObjectHeap heap;
+            #if defined(NEON_CONFIG_USEPARALLELMARK) && (NEON_CONFIG_USEPARALLELMARK == 1)
+                ParallelMarker marker;
+            #endif
+                /* threads that trace the heap in a full collection. set by --gc-mark-threads */
+                int markthreads;
+                /* nextgc is set to this times the bytes that survived a collection */
+                double growthfactor;
+                /* share of the time the collector should take, from 0 to 1; 0 leaves growthfactor alone. set by --gc-cpu-target */
+                double cputarget;
+                /* bytes that nextgc stays under, unless the live data alone gets close; 0 for none. see gcSetSoftLimit() */
+                int64_t softlimit;
+                /* when the last collection cycle ended, and the sum of GC pauses by then */
+                int64_t cycleendus;
+                int64_t cyclepausesum;
+                /* set once bytesallocated went past gcHeapLimit(); see gcEnforceHeapLimit() */
+                bool overlimit;
+                /* bytes above m_conf.maxheap allowed since MemoryError was raised; 0 once the heap is back under the limit */
+                int64_t headroom;
+                GCStats stats;
+            #if defined(NEON_CONFIG_USEBACKGROUNDSWEEP) && (NEON_CONFIG_USEBACKGROUNDSWEEP == 1)
+                BackgroundSweeper sweeper;
+                /* size changes of buffers made on the sweeper thread, not yet added to bytesallocated */
+                std::atomic<int64_t> sweptbytes;
+            #endif
+            } m_gcstate;
 
-            static String* take(char* strdata)
+            struct
             {
-                return take(strdata, strlen(strdata));
-            }
+                bool m_unhandledexceptionstate;
+                int64_t stackidx;
+                int64_t stackcapacity;
+                int64_t framecapacity;
+                int64_t framecount;
+                uint8_t currentinstr;
+                CallFrame* currentframe;
+                /*
+                * once an unhandled exception has unwound every frame, currentframe points here.
+                * its code is a single OPC_HALT, so the interpreter leaves on its own without
+                * having to check framecount before every instruction.
+                */
+                CallFrame haltframe;
+                Upvalue* openupvalues;
+                /* bumped by invalidateInlineCaches(); entries of an InlineCache are only valid for the epoch they were made in */
+                uint32_t cacheepoch;
+                /* bumped whenever vmExceptionPropagate() jumps to a catch block */
+                int64_t unwindcount;
+                ValList<CallFrame> framevalues;
+                ValList<Value> stackvalues;
+            } m_vmstate;
 
-            static String* copy(const char* strdata, int length)
+            struct
             {
-                uint32_t hsv;
-                String* rs;
-                hsv = Util::hashString(strdata, length);
-                if(length == 0)
-                {
-                    return intern(strdata, length);
-                }
-                {
-                    rs = strTabFind(strdata, length, hsv);
-                    if(rs != nullptr)
-                    {
-                        return rs;
-                    }
-                }
-                StrBuffer sb(length);
-                sb.append(strdata, length);
-                rs = makeFromStrbuf(sb, hsv, length);
-                return rs;
-            }
+                Class* stdexception;
+                Class* syntaxerror;
+                Class* asserterror;
+                Class* ioerror;
+                Class* oserror;
+                Class* argumenterror;
+                Class* regexerror;
+                Class* importerror;
+                Class* memoryerror;
+            } m_exceptions;
 
-            static String* copy(const char* strdata)
+            struct
             {
-                return copy(strdata, strlen(strdata));
-            }
+                /* __indexget__ */
+                String* nmindexget;
+                /* __indexset__ */
+                String* nmindexset;
+                /* __add__ */
+                String* nmadd;
+                /* __sub__ */
+                String* nmsub;
+                /* __div__ */
+                String* nmdiv;
+                /* __mul__ */
+                String* nmmul;
+                /* __band__ */
+                String* nmband;
+                /* __bor__ */
+                String* nmbor;
+                /* __bxor__ */
+                String* nmbxor;
 
-            static String* copyObject(String* origos)
-            {
-                return copy(origos->data(), origos->length());
-            }
+                String* nmconstructor;
+            } m_defaultstrings;
 
-        public:
-            uint32_t m_hashvalue;
-            StrBuffer m_sbuf;
+            StringTable m_allocatedstrings;
+            HashTable<Value, Value> m_openedmodules;
+            HashTable<Value, Value> m_declaredglobals;
 
-        public:
-            const char* data() const
-            {
-                return m_sbuf.data();
-            }
+            /*
+             * these classes are used for runtime objects, specifically in getClassFor.
+             * every other global class needed (as created by Class::makeScriptClass) need NOT be declared here.
+             * simply put, these classes are primitive types.
+             */
+            /* the class from which every other class derives */
+            Class* m_classprimobject;
+            /**/
+            Class* m_classprimclass;
+            /* class for numbers, et al */
+            Class* m_classprimnumber;
+            /* class for strings */
+            Class* m_classprimstring;
+            /* class for arrays */
+            Class* m_classprimarray;
+            /* class for dictionaries */
+            Class* m_classprimdict;
+            /* class for I/O file objects */
+            Class* m_classprimfile;
+            Class* m_classprimdirectory;
+            /* class for range constructs */
+            Class* m_classprimrange;
+            /* class for anything callable: functions, lambdas, constructors ... */
+            Class* m_classprimcallable;
+            Class* m_classprimprocess;
 
-            char* mutdata()
-            {
-                return m_sbuf.data();
-            }
+            bool m_isrepl;
+            ProcessInfo* m_processinfo;
 
-            size_t length() const
-            {
-                return m_sbuf.length();
-            }
+            /* miscellaneous */
+            IOStream* m_stdoutprinter;
+            IOStream* m_stderrprinter;
+            IOStream* m_debugwriter;
+            const char* m_rootphysfile;
+            Dict* m_envdict;
+            ValList<Value> m_importpath;
 
-            bool setLength(size_t nlen)
+            Value m_lastreplvalue;
+            void* m_memuserptr;
+            Module* m_topmodule;
+
+        private:
+            static bool defVarsFor(SharedState* gcs)
             {
-                m_sbuf.setLength(nlen);
+                gcs->m_gcstate.bytesallocated = 0;
+                /* default is 1mb. Can be modified via the -g flag. */
+                gcs->m_gcstate.nextgc = CONF_DEFAULTGCSTART;
+                gcs->m_gcstate.graycount = 0;
+                gcs->m_gcstate.graycapacity = 0;
+                gcs->m_gcstate.graystack = nullptr;
+                gcs->m_gcstate.inminor = false;
+                gcs->m_gcstate.blockcount = 0;
+                gcs->m_gcstate.phase = GCP_IDLE;
+                gcs->m_gcstate.pausebudget = 0;
+                gcs->m_gcstate.slicebytes = 0;
+                gcs->m_gcstate.graynew = false;
+                gcs->m_gcstate.sweeppage = nullptr;
+                gcs->m_gcstate.prunestep = GCPS_YOUNG;
+                gcs->m_gcstate.prunecursor = 0;
+                gcs->m_gcstate.prunecapacity = 0;
+                gcs->m_gcstate.markvalues = nullptr;
+                gcs->m_gcstate.markvaluecount = 0;
+                gcs->m_gcstate.markvaluecapacity = 0;
+                gcs->m_gcstate.tablescans = nullptr;
+                gcs->m_gcstate.tablescancount = 0;
+                gcs->m_gcstate.tablescancapacity = 0;
+                gcs->m_gcstate.pauses.reset();
+                gcs->m_gcstate.atomicpauses.reset();
+                gcs->m_gcstate.young = nullptr;
+                gcs->m_gcstate.youngcount = 0;
+                gcs->m_gcstate.youngcapacity = 0;
+                gcs->m_gcstate.dead = nullptr;
+                gcs->m_gcstate.deadcount = 0;
+                gcs->m_gcstate.deadcapacity = 0;
+                gcs->m_gcstate.slices = nullptr;
+                gcs->m_gcstate.slicecount = 0;
+                gcs->m_gcstate.slicecapacity = 0;
+                gcs->m_gcstate.oldslicecount = 0;
+                gcs->m_gcstate.heap.init();
+                gcs->m_gcstate.growthfactor = CONF_GCHEAPGROWTHFACTOR;
+                gcs->m_gcstate.cputarget = 0;
+                gcs->m_gcstate.softlimit = 0;
+                gcs->m_gcstate.cycleendus = Util::osfn_monotonicmicros();
+                gcs->m_gcstate.cyclepausesum = 0;
+                gcs->m_gcstate.overlimit = false;
+                gcs->m_gcstate.headroom = 0;
+                gcs->m_conf.maxheap = 0;
+                memset(&gcs->m_gcstate.stats, 0, sizeof(gcs->m_gcstate.stats));
+            #if defined(NEON_CONFIG_USEPARALLELMARK) && (NEON_CONFIG_USEPARALLELMARK == 1)
+                gcs->m_gcstate.marker.init();
+                gcs->gcSetMarkThreads(std::min((int)std::thread::hardware_concurrency(), (int)CONF_DEFAULTMARKTHREADS));
+            #else
+                gcs->gcSetMarkThreads(1);
+            #endif
+            #if defined(NEON_CONFIG_USEBACKGROUNDSWEEP) && (NEON_CONFIG_USEBACKGROUNDSWEEP == 1)
+                gcs->m_gcstate.sweeper.init();
+                gcs->m_gcstate.sweptbytes.store(0);
+            #endif
+                gcs->m_gcstate.youngbytes = 0;
+                gcs->m_gcstate.nurserysize = CONF_DEFAULTNURSERYSIZE;
+                gcs->m_gcstate.remcount = 0;
+                gcs->m_gcstate.remcapacity = 0;
+                gcs->m_gcstate.remembered = nullptr;
                 return true;
             }
 
-            bool set(size_t idx, int byte)
+        public:
+            static bool init()
             {
-                m_sbuf.set(idx, byte);
-                return true;
+                SharedState::m_myself = Memory::make<SharedState>();
+                return defVarsFor(SharedState::m_myself);
             }
 
-            int get(size_t idx)
+            static void destroy()
             {
-                return m_sbuf.get(idx);
+                Memory::destroy(SharedState::m_myself);
+                /* buffers freed from here on are not counted anywhere */
+                SharedState::m_myself = nullptr;
             }
 
-            bool append(const char* str, size_t len)
+            static NEON_INLINE SharedState* get()
             {
-                return m_sbuf.append(str, len);
+                return SharedState::m_myself;
             }
 
-            bool append(const char* str)
+            template<typename... ArgsT>
+            static void raiseWarning(const char* fmt, ArgsT&&... args)
             {
-                return append(str, strlen(str));
+                auto gcs = SharedState::get();
+                if(gcs->m_conf.enablewarnings)
+                {
+                    fprintf(stderr, "WARNING: ");
+                    fprintf(stderr, fmt, args...);
+                    fprintf(stderr, "\n");
+                }
             }
 
-            bool appendObject(String* other)
+            static void* gcAllocObj(size_t newsize, size_t amount, bool retain)
             {
-                return append(other->data(), other->length());
+                size_t oldsize;
+                void* result;
+                auto gcs = SharedState::get();
+                oldsize = 0;
+                if(!retain)
+                {
+                    gcs->gcMaybeCollect(newsize - oldsize, newsize > oldsize);
+                }
+                gcs->m_gcstate.youngbytes += newsize * amount;
+                result = gcs->m_gcstate.heap.allocate(newsize * amount);
+                /*
+                // just in case reallocation fails... computers ain't infinite!
+                */
+                if(result == nullptr)
+                {
+                    fprintf(stderr, "fatal error: failed to allocate %zd bytes\n", newsize);
+                    abort();
+                }
+                return result;
             }
 
-            bool appendByte(int ch)
+            template<typename InputT>
+            static InputT* gcMakeObject(Object::Type type, bool retain)
             {
-                char cch = ch;
-                return m_sbuf.append(&cch, 1);
+                static_assert((std::is_base_of<Object, InputT>::value));
+                static_assert((sizeof(InputT) <= ObjectHeap::CONF_MAXCELLSIZE));
+                size_t size = sizeof(InputT);
+                auto gcs = SharedState::get();
+                auto temp = (InputT*)SharedState::gcAllocObj(size, 1, retain);
+                auto object = new(temp) InputT();
+                object->m_objtype = type;
+                object->m_objstale = false;
+                object->m_objold = false;
+                object->m_objremembered = false;
+                /*
+                * once marking has marked the roots again, new objects are grey (see gcIncrementalRemark()).
+                * until sweeping starts, they are old and marked (see gcIncrementalPrune()); pages that a
+                * sweep has yet to get to would take an unmarked object for dead.
+                */
+                if(NEON_UNLIKELY(gcs->m_gcstate.phase != GCP_IDLE))
+                {
+                    if(gcs->m_gcstate.phase == GCP_MARK)
+                    {
+                        if(gcs->m_gcstate.graynew)
+                        {
+                            Object::markObject(object);
+                        }
+                    }
+                    else if(gcs->m_gcstate.phase == GCP_PRUNE)
+                    {
+                        HeapPage::setMarked(object);
+                        object->m_objold = true;
+                    }
+                    else if(HeapPage::pageOf(object)->m_needsweep)
+                    {
+                        HeapPage::setMarked(object);
+                    }
+                }
+                if(!object->m_objold)
+                {
+                    gcs->gcAddYoung(object);
+                }
+                gcs->m_gcstate.stats.allocbytes[type] += size;
+                gcs->m_gcstate.stats.alloccount[type]++;
+                return object;
             }
 
-            template<typename... ArgsT>
-            int appendfmt(const char* fmt, ArgsT&&... args)
+            template<typename InputT>
+            void gcReleaseObj(InputT* pointer, size_t oldsize)
             {
-                return m_sbuf.appendFormat(fmt, args...);
+                static_assert((std::is_base_of<Object, InputT>::value));
+            #if defined(NEON_CONFIG_USEBACKGROUNDSWEEP) && (NEON_CONFIG_USEBACKGROUNDSWEEP == 1)
+                /* objects freed by the sweeper thread were already accounted for, and detached in gcFreeObject() */
+                if(BackgroundSweeper::onSweeperThread())
+                {
+                    m_gcstate.heap.releaseDetached(pointer);
+                    return;
+                }
+            #endif
+                gcMaybeCollect(-oldsize, false);
+                gcCountFreed(pointer->m_objtype, oldsize);
+                if(oldsize > 0)
+                {
+                    #if 0
+                    memset(pointer, 0, oldsize);
+                    #endif
+                }
+                m_gcstate.heap.release(pointer);
             }
 
-            String* substr(size_t start, size_t maxlen)
+            template<typename InputT>
+            void gcReleaseObj(InputT* pointer)
             {
-                char* str;
-                String* rt;
-                str = m_sbuf.substr(start, maxlen);
-                rt = take(str, maxlen);
-                return rt;
+                gcReleaseObj(pointer, sizeof(InputT));
             }
 
-            String* substring(size_t start, size_t end, bool likejs)
+
+            /*
+            // NOTE:
+            // 1. Any call to SharedState::gcProtect() within a function/block must be accompanied by
+            // at least one call to SharedState::clearGCProtect() before exiting the function/block
+            // otherwise, expect unexpected behavior
+            // 2. The call to SharedState::clearGCProtect() will be automatic for native functions.
+            // 3. $thisval must be retrieved before any call to SharedState::gcProtect in a
+            // native function.
+            */
+            template<typename InputT>
+            static InputT* gcProtect(InputT* object)
             {
-                size_t asz;
-                size_t len;
-                size_t tmp;
-                size_t maxlen;
-                char* raw;
-                (void)likejs;
-                maxlen = length();
-                len = maxlen;
-                if(end > maxlen)
+                size_t frpos;
+                auto gcs = SharedState::get();
+                gcs->vmStackPush(Value::fromObject(object));
+                frpos = 0;
+                if(gcs->m_vmstate.framecount > 0)
                 {
-                    tmp = start;
-                    start = end;
-                    end = tmp;
-                    len = maxlen;
+                    frpos = gcs->m_vmstate.framecount - 1;
                 }
-                if(end < start)
+                gcs->m_vmstate.framevalues[frpos].gcprotcount++;
+                return object;
+            }
+
+            static NEON_INLINE void clearGCProtect()
+            {
+                size_t frpos;
+                CallFrame* frame;
+                frpos = 0;
+                auto gcs = SharedState::get();
+                if(gcs->m_vmstate.framecount > 0)
                 {
-                    tmp = end;
-                    end = start;
-                    start = tmp;
-                    len = end;
+                    frpos = gcs->m_vmstate.framecount - 1;
                 }
-                len = (end - start);
-                if(len > maxlen)
+                frame = &gcs->m_vmstate.framevalues[frpos];
+                if(frame->gcprotcount > 0)
                 {
-                    len = maxlen;
+                    if(frame->gcprotcount > 0)
+                    {
+                        gcs->m_vmstate.stackidx -= frame->gcprotcount;
+                    }
+                    frame->gcprotcount = 0;
                 }
-                asz = ((end + 1) * sizeof(char));
-                raw = (char*)Memory::sysMalloc(sizeof(char) * asz);
-                memset(raw, 0, asz);
-                memcpy(raw, data() + start, len);
-                return String::take(raw, len);
             }
 
-            String* substr(size_t start)
+            static void markValue(Value value)
             {
-                return substr(start, length());
+                if(value.isObject())
+                {
+                    Object::markObject(value.asObject());
+                }
             }
-    };
 
-    class Upvalue : public Object
-    {
-        public:
-            static Upvalue* make(Value* slot, int stackpos)
+            /*
+            * whether object survives the collection in progress.
+            * a minor collection only looks at the nursery, so anything old is taken to be alive.
+            */
+            NEON_INLINE bool gcIsMarked(Object* object) const
             {
-                Upvalue* upvalue;
-                upvalue = SharedState::gcMakeObject<Upvalue>(Object::OTYP_UPVALUE, false);
-                upvalue->m_closed = Value::makeNull();
-                upvalue->m_location = *slot;
-                upvalue->m_next = nullptr;
-                upvalue->m_stackpos = stackpos;
-                return upvalue;
+                if(m_gcstate.inminor && object->m_objold)
+                {
+                    return true;
+                }
+                return HeapPage::isMarked(object);
             }
 
-        public:
-            int m_stackpos;
-            Value m_closed;
-            Value m_location;
-            Upvalue* m_next;
+            /*
+            * must be called whenever val is stored into owner after owner was made, unless that store
+            * cannot have been preceded by a collection (i.e., no allocation happened since owner was made).
+            * if an old object gets a reference to a young one, the old object is remembered, and
+            * traced by the next minor collection, since nothing else would keep the young object alive.
+            * while an incremental collection is marking, val is marked if owner already is, since owner
+            * may have been traced already.
+            */
+            static NEON_INLINE void gcWriteBarrier(Object* owner, Value val)
+            {
+                if(val.isObject())
+                {
+                    gcWriteBarrier(owner, val.asObject());
+                }
+            }
 
-    };
+            static NEON_INLINE void gcWriteBarrier(Object* owner, Object* val)
+            {
+                SharedState* gcs;
+                if(val == nullptr)
+                {
+                    return;
+                }
+                gcs = SharedState::get();
+                if(owner->m_objold && !owner->m_objremembered && !val->m_objold)
+                {
+                    gcs->gcRemember(owner);
+                }
+                if(NEON_UNLIKELY(gcs->m_gcstate.phase == GCP_MARK) && HeapPage::isMarked(owner))
+                {
+                    Object::markObject(val);
+                }
+            }
 
-    class Function : public Object
-    {
-        public:
-            enum ContextType
+            void gcRemember(Object* object)
             {
-                CTXTYPE_ANONYMOUS,
-                CTXTYPE_FUNCTION,
-                CTXTYPE_METHOD,
-                CTXTYPE_INITIALIZER,
-                CTXTYPE_PRIVATE,
-                CTXTYPE_STATIC,
-                CTXTYPE_SCRIPT
-            };
+                if(m_gcstate.remcapacity < m_gcstate.remcount + 1)
+                {
+                    m_gcstate.remcapacity = Memory::getNextCapacity(m_gcstate.remcapacity);
+                    m_gcstate.remembered = (Object**)Memory::sysRealloc(m_gcstate.remembered, sizeof(Object*) * m_gcstate.remcapacity);
+                    if(m_gcstate.remembered == nullptr)
+                    {
+                        fflush(stdout);
+                        fprintf(stderr, "GC encountered an error");
+                        abort();
+                    }
+                }
+                object->m_objremembered = true;
+                m_gcstate.remembered[m_gcstate.remcount++] = object;
+            }
 
-        public:
-            static NEON_INLINE Function::ContextType getMethodType(Value method)
+            void gcAddYoung(Object* object)
             {
-                Function* ofn;
-                ofn = method.asFunction();
-                switch(method.objType())
+                if(m_gcstate.youngcapacity < m_gcstate.youngcount + 1)
                 {
-                    case Object::OTYP_FUNCNATIVE:
-                        return ofn->m_contexttype;
-                    case Object::OTYP_FUNCCLOSURE:
-                        return ofn->m_fnvals.fnclosure.scriptfunc->m_contexttype;
-                    default:
-                        break;
+                    m_gcstate.youngcapacity = Memory::getNextCapacity(m_gcstate.youngcapacity);
+                    m_gcstate.young = (Object**)Memory::sysRealloc(m_gcstate.young, sizeof(Object*) * m_gcstate.youngcapacity);
+                    if(m_gcstate.young == nullptr)
+                    {
+                        fflush(stdout);
+                        fprintf(stderr, "GC encountered an error");
+                        abort();
+                    }
                 }
-                return Function::CTXTYPE_FUNCTION;
+                m_gcstate.young[m_gcstate.youngcount++] = object;
             }
 
-        public:
-            ContextType m_contexttype;
-            String* m_funcname;
-            int m_upvalcount;
-            Value m_clsthisval;
-            union FuncUnion
+            /* marks the young objects that remembered objects refer to, and empties the remembered set */
+            void gcTraceRemembered()
             {
-                struct FNDataClosure
-                {
-                    Function* scriptfunc;
-                    Upvalue** m_upvalues;
-                } fnclosure;
-                struct FNDataScriptFunc
-                {
-                    int arity;
-                    bool isvariadic;
-                    Blob* blob;
-                    Module* module;
-                } fnscriptfunc;
-                struct FNDataNativeFunc
+                int64_t i;
+                Object* object;
+                for(i = 0; i < m_gcstate.remcount; i++)
                 {
-                    NativeFN natfunc;
-                    void* userptr;
-                } fnnativefunc;
-                struct FNDataMethod
+                    object = m_gcstate.remembered[i];
+                    object->m_objremembered = false;
+                    if(m_gcstate.inminor)
+                    {
+                        Object::blackenObject(object);
+                    }
+                }
+                m_gcstate.remcount = 0;
+            }
+
+            void gcMarkRoots(bool defer = false);
+
+            /* adds $count values to what the slices of an incremental collection have yet to mark */
+            void gcDeferValues(const Value* values, int64_t count)
+            {
+                if(m_gcstate.markvaluecapacity < m_gcstate.markvaluecount + count)
                 {
-                    Value receiver;
-                    Function* method;
-                } fnmethod;
-            } m_fnvals;
+                    m_gcstate.markvaluecapacity = std::max((int64_t)Memory::getNextCapacity(m_gcstate.markvaluecapacity), m_gcstate.markvaluecount + count);
+                    m_gcstate.markvalues = (Value*)Memory::sysRealloc(m_gcstate.markvalues, sizeof(Value) * m_gcstate.markvaluecapacity);
+                    if(m_gcstate.markvalues == nullptr)
+                    {
+                        fflush(stdout);
+                        fprintf(stderr, "GC encountered an error");
+                        abort();
+                    }
+                }
+                memcpy(m_gcstate.markvalues + m_gcstate.markvaluecount, values, sizeof(Value) * count);
+                m_gcstate.markvaluecount += count;
+            }
 
-        public:
-            static Function* makeFuncGeneric(String* name, Object::Type fntype, Value thisval)
+            /* has the slices of an incremental collection go through $table; see gcScanTableStep() */
+            void gcDeferTable(HashTable<Value, Value>* table);
+
+            /*
+            * instead of marking what a large array or dict holds all at once, a slice leaves that to the
+            * following slices. whatever is stored into the object meanwhile is marked by gcWriteBarrier(),
+            * so what matters is that no value it held at this point is missed:
+            *   - the values of an array are copied with gcDeferValues(), since an array can be sorted,
+            *     reversed or shifted in between, and a value moved to where marking was. the copy is done
+            *     at once, so a slice can take as long as it takes to copy the largest array.
+            *   - the table of a dict is gone through an entry at a time (see gcScanTableStep()), since
+            *     its entries only move when it is resized, and then it is gone through again. its list
+            *     of keys holds the same keys as the table.
+            * returns false if $object is to be blackened as usual.
+            */
+            NEON_INLINE bool gcDeferLargeObject(Object* object);
+
+            /*
+            * marks the next CONF_GCCLOCKINTERVAL entries of the table that gcDeferTable() took last, and drops
+            * the table once it is done. returns the number of entries looked at.
+            */
+            int64_t gcScanTableStep()
             {
-                Function* ofn;
-                ofn = SharedState::gcMakeObject<Function>(fntype, false);
-                ofn->m_clsthisval = thisval;
-                ofn->m_funcname = name;
-                return ofn;
+                int64_t n;
+                GCTableScan* scan;
+                HashTable<Value, Value>* table;
+                scan = &m_gcstate.tablescans[m_gcstate.tablescancount - 1];
+                table = scan->table;
+                if((table->m_htentries != scan->entries) || (table->m_htcapacity != scan->capacity))
+                {
+                    scan->entries = table->m_htentries;
+                    scan->capacity = table->m_htcapacity;
+                    scan->next = 0;
+                }
+                if(scan->next >= scan->capacity)
+                {
+                    m_gcstate.tablescancount--;
+                    return 1;
+                }
+                for(n = 0; (n < CONF_GCCLOCKINTERVAL) && (scan->next < scan->capacity); n++)
+                {
+                    auto entry = &scan->entries[scan->next++];
+                    if(!entry->key.isNull())
+                    {
+                        SharedState::markValue(entry->key);
+                        SharedState::markValue(entry->value.value);
+                    }
+                }
+                return n;
             }
 
-            static Function* makeFuncBound(Value receiver, Function* method)
+            void gcTraceRefs()
             {
-                Function* ofn;
-                ofn = makeFuncGeneric(method->m_funcname, Object::OTYP_FUNCBOUND, Value::makeNull());
-                ofn->m_fnvals.fnmethod.receiver = receiver;
-                ofn->m_fnvals.fnmethod.method = method;
-                return ofn;
+                Object* object;
+                while(m_gcstate.graycount > 0)
+                {
+                    m_gcstate.graycount--;
+                    object = m_gcstate.graystack[m_gcstate.graycount];
+                    Object::blackenObject(object);
+                }
             }
 
-            static Function* makeFuncScript(Module* module, int type)
+            void gcSetMarkThreads(int count)
             {
-                Function* ofn;
-                ofn = makeFuncGeneric(String::intern("<script>"), Object::OTYP_FUNCSCRIPT, Value::makeNull());
-                ofn->m_fnvals.fnscriptfunc.arity = 0;
-                ofn->m_upvalcount = 0;
-                ofn->m_fnvals.fnscriptfunc.isvariadic = false;
-                ofn->m_funcname = nullptr;
-                ofn->m_contexttype = (Function::ContextType)type;
-                ofn->m_fnvals.fnscriptfunc.module = module;
-                ofn->m_fnvals.fnscriptfunc.blob = Memory::make<Blob>();
-                return ofn;
+                if(count < 1)
+                {
+                    count = 1;
+                }
+            #if defined(NEON_CONFIG_USEPARALLELMARK) && (NEON_CONFIG_USEPARALLELMARK == 1)
+                if(count > ParallelMarker::CONF_MAXTHREADS)
+                {
+                    count = ParallelMarker::CONF_MAXTHREADS;
+                }
+            #else
+                count = 1;
+            #endif
+                m_gcstate.markthreads = count;
             }
 
-            static Function* makeFuncNative(NativeFN natfn, String* name, void* uptr)
+            /* like gcTraceRefs(), but on m_gcstate.markthreads threads if the heap is large enough */
+            void gcTraceRefsParallel()
             {
-                Function* ofn;
-                ofn = makeFuncGeneric(name, Object::OTYP_FUNCNATIVE, Value::makeNull());
-                ofn->m_fnvals.fnnativefunc.natfunc = natfn;
-                ofn->m_contexttype = Function::CTXTYPE_FUNCTION;
-                ofn->m_fnvals.fnnativefunc.userptr = uptr;
-                return ofn;
+            #if defined(NEON_CONFIG_USEPARALLELMARK) && (NEON_CONFIG_USEPARALLELMARK == 1)
+                if((m_gcstate.markthreads > 1) && (m_gcstate.heap.m_pagecount >= CONF_PARALLELMARKMINPAGES))
+                {
+                    m_gcstate.marker.trace(m_gcstate.graystack, m_gcstate.graycount, m_gcstate.markthreads);
+                    m_gcstate.graycount = 0;
+                    return;
+                }
+            #endif
+                gcTraceRefs();
             }
 
-            static Function* makeFuncClosure(Function* innerfn, Value thisval)
+            /*
+            * frees an object that the sweep found unreachable.
+            * unless it must be finalized on the main thread, its cell is only detached from the heap, and
+            * the object is handed over to the sweeper thread by gcFlushDead().
+            */
+            void gcFreeObject(Object* object)
             {
-                int i;
-                Upvalue** upvals;
-                Function* ofn;
-                upvals = nullptr;
-                if(innerfn->m_upvalcount > 0)
+                if(object->m_objstale)
                 {
-                    upvals = (Upvalue**)Memory::sysMalloc(sizeof(Upvalue*) * (innerfn->m_upvalcount + 1));
-                    for(i = 0; i < innerfn->m_upvalcount; i++)
+                    return;
+                }
+            #if defined(NEON_CONFIG_USEBACKGROUNDSWEEP) && (NEON_CONFIG_USEBACKGROUNDSWEEP == 1)
+                if(!Object::finalizesOnMainThread(object))
+                {
+                    m_gcstate.bytesallocated -= Object::objectSize(object);
+                    gcCountFreed(object->m_objtype, Object::objectSize(object));
+                    m_gcstate.heap.detach(object);
+                    if(m_gcstate.deadcapacity < m_gcstate.deadcount + 1)
                     {
-                        upvals[i] = nullptr;
+                        m_gcstate.deadcapacity = Memory::getNextCapacity(m_gcstate.deadcapacity);
+                        m_gcstate.dead = (Object**)Memory::sysRealloc(m_gcstate.dead, sizeof(Object*) * m_gcstate.deadcapacity);
+                        if(m_gcstate.dead == nullptr)
+                        {
+                            fflush(stdout);
+                            fprintf(stderr, "GC encountered an error");
+                            abort();
+                        }
                     }
+                    m_gcstate.dead[m_gcstate.deadcount++] = object;
+                    return;
                 }
-                ofn = makeFuncGeneric(innerfn->m_funcname, Object::OTYP_FUNCCLOSURE, thisval);
-                ofn->m_fnvals.fnclosure.scriptfunc = innerfn;
-                ofn->m_fnvals.fnclosure.m_upvalues = upvals;
-                ofn->m_upvalcount = innerfn->m_upvalcount;
-                return ofn;
+            #endif
+                Object::destroyObject(object);
             }
 
-            static void destroy(Function* ofn)
+            NEON_INLINE void gcCountFreed(Object::Type type, size_t size)
             {
-                Blob::destroy(ofn->m_fnvals.fnscriptfunc.blob);
-                Memory::sysFree(ofn->m_fnvals.fnscriptfunc.blob);
+                m_gcstate.stats.freedbytes[type] += size;
+                m_gcstate.stats.freedcount[type]++;
             }
 
-        public:
-
-    };
-
-
-    /**
-     * TODO: use a different table implementation to avoid allocating so many strings...
-     */
-    class Class : public Object
-    {
-        public:
-            class ConstItem
-            {
-                public:
-                    const char* m_constclassmthname;
-                    NativeFN fn;
-            };
-
-            static bool methodNameIsPrivate(String* name)
+            void gcFlushDead()
             {
-                return name->length() > 0 && name->data()[0] == '_';
+                if(m_gcstate.deadcount > 0)
+                {
+                #if defined(NEON_CONFIG_USEBACKGROUNDSWEEP) && (NEON_CONFIG_USEBACKGROUNDSWEEP == 1)
+                    m_gcstate.sweeper.push(m_gcstate.dead, m_gcstate.deadcount);
+                #endif
+                    m_gcstate.deadcount = 0;
+                }
             }
 
-            /*
-             * TODO: this is somewhat basic instanceof checking;
-             * it does not account for namespacing, which could spell issues in the future.
-             * maybe classes should be given a distinct, unique, internal name, which would
-             * incidentally remove the need to walk namespaces.
-             * something like `class Foo{...}` -> 'Foo@<filename>:<lineno>', i.e., "Foo.class@path/to/somefile.nn:42".
-             */
-            static bool isInstanceOf(Class* klass1, Class* expected)
+            /* frees the objects of $page that are not marked, and unmarks the rest */
+            void gcSweepPage(HeapPage* page)
             {
-                size_t klen;
-                size_t elen;
-                const char* kname;
-                const char* ename;
-                while(klass1 != nullptr)
+                size_t w;
+                size_t nwords;
+                uint64_t dead;
+                nwords = page->bitmapWords();
+                for(w = 0; w < nwords; w++)
                 {
-                    elen = expected->m_classname->length();
-                    klen = klass1->m_classname->length();
-                    ename = expected->m_classname->data();
-                    kname = klass1->m_classname->data();
-                    if(elen == klen && memcmp(kname, ename, klen) == 0)
+                    dead = page->m_allocbits[w] & ~page->m_markbits[w];
+                    page->m_markbits[w] = 0;
+                    while(dead != 0)
                     {
-                        return true;
+                        gcFreeObject(page->cellAt((w * 64) + HeapPage::lowestBit(dead)));
+                        dead &= (dead - 1);
                     }
-                    klass1 = klass1->m_superclass;
                 }
-                return false;
+                page->m_needsweep = false;
             }
 
-            /**
-             * generate bytecode for a nativee exception class.
-             * script-side it is enough to just derive from Exception, of course.
-             */
-            static Class* makeExceptionClass(Class* baseclass, Module* module, String* classname)
+            void gcSweep()
             {
-                int messageconst;
-                Class* klass;
-                Function* function;
-                Function* closure;
-                auto gcs = SharedState::get();
-                gcs->vmStackPush(Value::fromObject(classname));
-                klass = Class::make(classname, baseclass);
-                gcs->vmStackPop();
-                gcs->vmStackPush(Value::fromObject(klass));
-                function = Function::makeFuncScript(module, Function::CTXTYPE_METHOD);
-                function->m_fnvals.fnscriptfunc.arity = 1;
-                function->m_fnvals.fnscriptfunc.isvariadic = false;
-                gcs->vmStackPush(Value::fromObject(function));
+                HeapPage* page;
+                for(page = m_gcstate.heap.m_pages; page != nullptr; page = page->m_nextpage)
                 {
-                    /* g_loc 0 */
-                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::make(true, Instruction::OPC_LOCALGET, 0));
-                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::make(false, (0 >> 8) & 0xff, 0));
-                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::make(false, 0 & 0xff, 0));
+                    gcSweepPage(page);
                 }
+            }
+
+            /*
+            * frees the unmarked objects of the nursery, and promotes the rest to the old generation.
+            * a minor collection unmarks the survivors right away, since it does not sweep the pages.
+            */
+            void gcSweepYoung(bool unmark)
+            {
+                int64_t i;
+                Object* object;
+                for(i = 0; i < m_gcstate.youngcount; i++)
                 {
-                    /* g_loc 1 */
-                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::make(true, Instruction::OPC_LOCALGET, 0));
-                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::make(false, (1 >> 8) & 0xff, 0));
-                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::make(false, 1 & 0xff, 0));
+                    object = m_gcstate.young[i];
+                    if(HeapPage::isMarked(object))
+                    {
+                        if(unmark)
+                        {
+                            HeapPage::clearMarked(object);
+                        }
+                        object->m_objold = true;
+                    }
+                    else
+                    {
+                        gcFreeObject(object);
+                    }
                 }
+                m_gcstate.youngcount = 0;
+                m_gcstate.youngbytes = 0;
+            }
+
+            void gcLinkedObjectsDestroy()
+            {
+                size_t w;
+                size_t nwords;
+                uint64_t bits;
+                HeapPage* page;
+            #if defined(NEON_CONFIG_USEBACKGROUNDSWEEP) && (NEON_CONFIG_USEBACKGROUNDSWEEP == 1)
+                m_gcstate.sweeper.stop();
+            #endif
+                for(page = m_gcstate.heap.m_pages; page != nullptr; page = page->m_nextpage)
                 {
-                    messageconst = function->m_fnvals.fnscriptfunc.blob->addConstant(Value::fromObject(String::intern("message")));
-                    /* s_prop 0 */
-                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::make(true, Instruction::OPC_PROPERTYSET, 0));
-                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::make(false, (messageconst >> 8) & 0xff, 0));
-                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::make(false, messageconst & 0xff, 0));
+                    nwords = page->bitmapWords();
+                    for(w = 0; w < nwords; w++)
+                    {
+                        bits = page->m_allocbits[w];
+                        while(bits != 0)
+                        {
+                            Object::destroyObject(page->cellAt((w * 64) + HeapPage::lowestBit(bits)));
+                            bits &= (bits - 1);
+                        }
+                    }
                 }
-                {
-                    /* pop */
-                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::make(true, Instruction::OPC_POPONE, 0));
-                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::make(true, Instruction::OPC_POPONE, 0));
-                }
-                {
-                    /* g_loc 0 */
-                    /*
-                    //  function->m_fnvals.fnscriptfunc.blob->push(Instruction::make(true, Instruction::OPC_LOCALGET, 0));
-                    //  function->m_fnvals.fnscriptfunc.blob->push(Instruction::make(false, (0 >> 8) & 0xff, 0));
-                    //  function->m_fnvals.fnscriptfunc.blob->push(Instruction::make(false, 0 & 0xff, 0));
-                    */
-                }
-                {
-                    /* ret */
-                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::make(true, Instruction::OPC_RETURN, 0));
-                }
-                closure = Function::makeFuncClosure(function, Value::makeNull());
-                gcs->vmStackPop();
-                /* set class constructor */
-                gcs->vmStackPush(Value::fromObject(closure));
-                klass->m_instmethods.set(Value::fromObject(classname), Value::fromObject(closure));
-                klass->m_constructor = Value::fromObject(closure);
-                /* set class properties */
-                klass->defProperty(String::intern("message"), Value::makeNull());
-                klass->defProperty(String::intern("stacktrace"), Value::makeNull());
-                klass->defProperty(String::intern("srcfile"), Value::makeNull());
-                klass->defProperty(String::intern("srcline"), Value::makeNull());
-                klass->defProperty(String::intern("class"), Value::fromObject(klass));
-                gcs->m_declaredglobals.set(Value::fromObject(classname), Value::fromObject(klass));
-                /* for class */
-                gcs->vmStackPop();
-                gcs->vmStackPop();
-                /* assert error name */
-                /* gcs->vmStackPop(); */
-                return klass;
-            }
-
-        public:
-            /*
-             * the constructor, if any. defaults to <empty>, and if not <empty>, expects to be
-             * some callable value.
-             */
-            Value m_constructor;
-            Value m_destructor;
-
-            /*
-             * when declaring a class, $instproperties (their names, and initial values) are
-             * copied to Instance::properties.
-             * so `$instproperties["something"] = somefunction;` remains untouched *until* an
-             * instance of this class is created.
-             */
-            HashTable<Value, Value> m_instproperties;
-
-            /*
-             * static, unchangeable(-ish) values. intended for values that are not unique, but shared
-             * across classes, without being copied.
-             */
-            HashTable<Value, Value> m_staticproperties;
-
-            /*
-             * method table; they are currently not unique when instantiated; instead, they are
-             * read from $methods as-is. this includes adding methods!
-             * TODO: introduce a new hashtable field for Instance for unique methods, perhaps?
-             * right now, this method just prevents unnecessary copying.
-             */
-            HashTable<Value, Value> m_instmethods;
-            HashTable<Value, Value> m_staticmethods;
-            String* m_classname;
-            Class* m_superclass;
-
-        public:
-            static Class* make(String* name, Class* parent)
-            {
-                Class* klass;
-                klass = SharedState::gcMakeObject<Class>(Object::OTYP_CLASS, false);
-                klass->m_classname = name;
-                klass->m_instproperties.initTable();
-                klass->m_staticproperties.initTable();
-                klass->m_instmethods.initTable();
-                klass->m_staticmethods.initTable();
-                klass->m_constructor = Value::makeNull();
-                klass->m_destructor = Value::makeNull();
-                klass->m_superclass = parent;
-                return klass;
-            }
-
-            static void destroy(Class* klass)
-            {
-                auto gcs = SharedState::get();
-                klass->m_instmethods.deInit();
-                klass->m_staticmethods.deInit();
-                klass->m_instproperties.deInit();
-                klass->m_staticproperties.deInit();
-                gcs->gcReleaseObj(klass);
-            }
-
-            static Class* makeScriptClass(String* name, Class* parent)
-            {
-                Class* cl;
-                auto gcs = SharedState::get();
-                cl = Class::make(name, parent);
-                gcs->m_declaredglobals.set(Value::fromObject(name), Value::fromObject(cl));
-                return cl;
+                m_gcstate.heap.destroy();
+            #if defined(NEON_CONFIG_USEPARALLELMARK) && (NEON_CONFIG_USEPARALLELMARK == 1)
+                m_gcstate.marker.destroy();
+            #endif
+                Memory::sysFree(m_gcstate.young);
+                m_gcstate.young = nullptr;
+                m_gcstate.youngcount = 0;
+                Memory::sysFree(m_gcstate.dead);
+                m_gcstate.dead = nullptr;
+                m_gcstate.deadcount = 0;
+                Memory::sysFree(m_gcstate.slices);
+                m_gcstate.slices = nullptr;
+                m_gcstate.slicecount = 0;
+                m_gcstate.oldslicecount = 0;
+                Memory::sysFree(m_gcstate.graystack);
+                m_gcstate.graystack = nullptr;
+                Memory::sysFree(m_gcstate.markvalues);
+                m_gcstate.markvalues = nullptr;
+                m_gcstate.markvaluecount = 0;
+                Memory::sysFree(m_gcstate.tablescans);
+                m_gcstate.tablescans = nullptr;
+                m_gcstate.tablescancount = 0;
+                Memory::sysFree(m_gcstate.remembered);
+                m_gcstate.remembered = nullptr;
             }
 
-            bool inheritFrom(Class* superclass)
+            void gcMarkCompilerRoots()
             {
-                int failcnt;
-                failcnt = 0;
-                if(!superclass->m_instproperties.copyTo(&m_instproperties, true))
-                {
-                    failcnt++;
-                }
-                if(!superclass->m_instmethods.copyTo(&m_instmethods, true))
-                {
-                    failcnt++;
-                }
-                m_superclass = superclass;
-                if(failcnt == 0)
+                /*
+                FuncCompiler* fnc;
+                fnc = ->fnc;
+                while(fnc != nullptr)
                 {
-                    return true;
+                    Object::markObject((Object*)fnc->m_targetfunc);
+                    fnc = fnc->m_enclosing;
                 }
-                return false;
-            }
-
-            bool defProperty(String* cstrname, Value val)
-            {
-                return m_instproperties.set(Value::fromObject(cstrname), val);
-            }
-
-            bool defCallableFieldPtr(String* name, NativeFN function, void* uptr)
-            {
-                Function* ofn;
-                ofn = Function::makeFuncNative(function, name, uptr);
-                return m_instproperties.setwithtype(Value::fromObject(name), Value::fromObject(ofn), Property::FTYP_FUNCTION, true);
-            }
-
-            bool defCallableField(String* name, NativeFN function)
-            {
-                return defCallableFieldPtr(name, function, nullptr);
-            }
-
-            bool defStaticCallableFieldPtr(String* name, NativeFN function, void* uptr)
-            {
-                Function* ofn;
-                ofn = Function::makeFuncNative(function, name, uptr);
-                return m_staticproperties.setwithtype(Value::fromObject(name), Value::fromObject(ofn), Property::FTYP_FUNCTION, true);
+                */
             }
 
-            bool defStaticCallableField(String* name, NativeFN function)
+            /* a slice of an incremental collection */
+            void gcRecordPause(int64_t startus)
             {
-                return defStaticCallableFieldPtr(name, function, nullptr);
+                m_gcstate.pauses.record(Util::osfn_monotonicmicros() - startus);
             }
 
-            bool setStaticProperty(String* name, Value val)
+            /* any other pause; see m_gcstate.atomicpauses */
+            void gcRecordAtomicPause(int64_t startus)
             {
-                return m_staticproperties.set(Value::fromObject(name), val);
+                m_gcstate.atomicpauses.record(Util::osfn_monotonicmicros() - startus);
             }
 
-            bool defNativeConstructorPtr(NativeFN function, void* uptr)
+            /* all that the collector kept the mutator waiting, in microseconds */
+            NEON_INLINE int64_t gcPauseSum() const
             {
-                Function* ofn;
-                auto cname = String::intern("constructor");
-                ofn = Function::makeFuncNative(function, cname, uptr);
-                m_constructor = Value::fromObject(ofn);
-                return true;
+                return m_gcstate.pauses.m_sum + m_gcstate.atomicpauses.m_sum;
             }
 
-            bool defNativeConstructor(NativeFN function)
+            void gcPrintPauses(FILE* out) const
             {
-                return defNativeConstructorPtr(function, nullptr);
+                int i;
+                const PauseHistogram* ph;
+                const PauseHistogram* all[2] = { &m_gcstate.pauses, &m_gcstate.atomicpauses };
+                const char* names[2] = { "GC slice pauses", "GC unbounded pauses" };
+                for(i = 0; i < 2; i++)
+                {
+                    ph = all[i];
+                    fprintf(out, "%s: count=%lld total=%lldus p50=%lldus p99=%lldus max=%lldus\n", names[i],
+                        (long long)ph->m_total, (long long)ph->m_sum,
+                        (long long)ph->percentile(0.5), (long long)ph->percentile(0.99), (long long)ph->m_max);
+                }
             }
 
-            bool defMethod(String* name, Value val)
+            void gcAddSlice(String* slice)
             {
-                return m_instmethods.set(Value::fromObject(name), val);
+                if(m_gcstate.slicecount == m_gcstate.slicecapacity)
+                {
+                    m_gcstate.slicecapacity = Memory::getNextCapacity(m_gcstate.slicecapacity);
+                    m_gcstate.slices = (String**)Memory::sysRealloc(m_gcstate.slices, sizeof(String*) * m_gcstate.slicecapacity);
+                }
+                m_gcstate.slices[m_gcstate.slicecount++] = slice;
             }
 
-            bool defNativeMethodPtr(String* name, NativeFN function, void* ptr)
-            {
-                Function* ofn;
-                ofn = Function::makeFuncNative(function, name, ptr);
-                return defMethod(name, Value::fromObject(ofn));
-            }
+            void gcUnshareSlicesOf(String* parent);
+            bool gcPruneSlice(String* slice);
+            void gcPruneSlices();
 
-            bool defNativeMethod(String* name, NativeFN function)
+            /* removes unmarked keys from the tables that do not keep their keys alive */
+            void gcPruneWeakTables()
             {
-                return defNativeMethodPtr(name, function, nullptr);
+                int64_t startus;
+                startus = Util::osfn_monotonicmicros();
+                m_allocatedstrings.removeWhites();
+                gcPruneSlices();
+                Value::valtabRemoveWhites(&m_openedmodules);
+                m_gcstate.stats.prunetime += Util::osfn_monotonicmicros() - startus;
             }
 
-            bool defStaticNativeMethodPtr(String* name, NativeFN function, void* uptr)
+            /* live objects of $type: made, and not freed yet */
+            NEON_INLINE int64_t gcLiveCount(int type) const
             {
-                Function* ofn;
-                ofn = Function::makeFuncNative(function, name, uptr);
-                return m_staticmethods.set(Value::fromObject(name), Value::fromObject(ofn));
+                return m_gcstate.stats.alloccount[type] - m_gcstate.stats.freedcount[type];
             }
 
-            bool defStaticNativeMethod(String* name, NativeFN function)
+            void gcPrintStats(FILE* out) const
             {
-                return defStaticNativeMethodPtr(name, function, nullptr);
+                int i;
+                const GCStats* st;
+                st = &m_gcstate.stats;
+                fprintf(out, "GC stats: collections=%lld minor=%lld incremental=%lld mark=%lldus sweep=%lldus prune=%lldus unsharedslices=%lld\n",
+                    (long long)st->fullcollections, (long long)st->minorcollections, (long long)st->incrementalcollections,
+                    (long long)st->marktime, (long long)st->sweeptime, (long long)st->prunetime, (long long)st->unsharedslices);
+                fprintf(out, "GC heap: bytesallocated=%lld nextgc=%lld growthfactor=%g softlimit=%lld pages=%zu trimmedpages=%lld\n",
+                    (long long)m_gcstate.bytesallocated, (long long)m_gcstate.nextgc, m_gcstate.growthfactor,
+                    (long long)m_gcstate.softlimit, m_gcstate.heap.m_pagecount, (long long)st->trimmedpages);
+                fprintf(out, "%-12s %14s %14s %10s\n", "type", "allocbytes", "freedbytes", "live");
+                for(i = 0; i < CONF_OBJTYPECOUNT; i++)
+                {
+                    if(st->alloccount[i] == 0)
+                    {
+                        continue;
+                    }
+                    fprintf(out, "%-12s %14lld %14lld %10lld\n", Object::typeName((Object::Type)i),
+                        (long long)st->allocbytes[i], (long long)st->freedbytes[i], (long long)gcLiveCount(i));
+                }
             }
 
-            Property* getMethodField(String* name)
+            /*
+            * after a collection that left many pages empty, gives them back to the OS, and lets the C
+            * library do the same with the buffers that were freed along with their objects.
+            * as many empty pages are kept as the heap may fill before the next collection, so that a
+            * program that keeps making and dropping the same amount does not fault them in every cycle.
+            * this waits for the sweeper thread, but only after a collection that freed a lot.
+            */
+            void gcTrimHeap()
             {
-                Property* field;
-                field = m_instmethods.getfield(Value::fromObject(name));
-                if(field != nullptr)
+                size_t keep;
+                size_t empty;
+                size_t trimmed;
+                keep = std::max((int64_t)CONF_GCTRIMKEEPPAGES, (m_gcstate.nextgc - m_gcstate.bytesallocated) / HeapPage::CONF_PAGESIZE);
+                empty = m_gcstate.heap.emptyPages();
+                if((empty < (keep + CONF_GCTRIMMINPAGES)) || ((empty * 4) < m_gcstate.heap.m_pagecount))
                 {
-                    return field;
+                    return;
                 }
-                if(m_superclass != nullptr)
+                gcWaitForSweeper();
+                trimmed = m_gcstate.heap.trim(keep);
+                m_gcstate.stats.trimmedpages += trimmed;
+            #if defined(__GLIBC__)
+                if(trimmed > 0)
                 {
-                    return m_superclass->getMethodField(name);
+                    malloc_trim(0);
                 }
-                return nullptr;
+            #endif
             }
 
-            Property* getPropertyField(String* name)
+            /*
+            * sets the point of the next collection, once a collection cycle is done; $startus is when its last pause began.
+            * with a CPU target (--gc-cpu-target), the growth factor is adapted first: if the collector took
+            * more than its share of the time since the previous cycle, the heap may grow more before the next
+            * one, and less if it took less. the step is bounded, so that one odd cycle does not swing it far.
+            * nextgc stays under the soft limit, unless the live data is close to it already; then the heap
+            * grows by the smallest factor, rather than collecting all the time.
+            */
+            void gcCycleDone(int64_t startus)
             {
-                Property* field;
-                field = m_instproperties.getfield(Value::fromObject(name));
-            #if 0
-                if(field == nullptr)
+                int64_t nowus;
+                int64_t elapsed;
+                int64_t gctime;
+                double ratio;
+                double nextgc;
+                nowus = Util::osfn_monotonicmicros();
+                elapsed = nowus - m_gcstate.cycleendus;
+                /* the pause that ends the cycle is not recorded yet */
+                gctime = (gcPauseSum() - m_gcstate.cyclepausesum) + (nowus - startus);
+                if((m_gcstate.cputarget > 0) && (elapsed > 0))
                 {
-                    if(m_superclass != nullptr)
-                    {
-                        return m_superclass->getPropertyField(name);
-                    }
+                    ratio = ((double)gctime / (double)elapsed) / m_gcstate.cputarget;
+                    ratio = std::min(std::max(ratio, 0.5), 2.0);
+                    m_gcstate.growthfactor = 1.0 + ((m_gcstate.growthfactor - 1.0) * ratio);
+                    m_gcstate.growthfactor = std::min(std::max(m_gcstate.growthfactor, (double)CONF_GCMINGROWTHFACTOR), (double)CONF_GCMAXGROWTHFACTOR);
                 }
-            #endif
-                return field;
-            }
-
-            Property* getStaticProperty(String* name)
-            {
-                Property* np;
-                np = m_staticproperties.getfieldbyostr(name);
-                if(np != nullptr)
+                m_gcstate.cycleendus = nowus;
+                m_gcstate.cyclepausesum = gcPauseSum() + (nowus - startus);
+                if(m_gcstate.bytesallocated <= m_conf.maxheap)
                 {
-                    return np;
+                    m_gcstate.headroom = 0;
                 }
-                if(m_superclass != nullptr)
+                nextgc = m_gcstate.bytesallocated * m_gcstate.growthfactor;
+                if((m_gcstate.softlimit > 0) && (nextgc > m_gcstate.softlimit))
                 {
-                    return m_superclass->getStaticProperty(name);
+                    nextgc = std::max((double)m_gcstate.softlimit, m_gcstate.bytesallocated * CONF_GCMINGROWTHFACTOR);
                 }
-                return nullptr;
+                m_gcstate.nextgc = nextgc;
             }
 
-            Property* getStaticMethodField(String* name)
+            /*
+            * the soft limit is the smaller of a share of the cgroup memory limit, if the process runs in one,
+            * and a share of --max-heap. it only affects when collections happen; see gcCycleDone().
+            */
+            void gcSetSoftLimit()
             {
-                Property* field;
-                field = m_staticmethods.getfield(Value::fromObject(name));
-                return field;
+                int64_t limit;
+                int64_t cglimit;
+                limit = 0;
+                cglimit = Util::osfn_cgroupmemlimit();
+                if(cglimit > 0)
+                {
+                    limit = cglimit * CONF_GCCGROUPSHARE;
+                }
+                if((m_conf.maxheap > 0) && ((limit == 0) || ((m_conf.maxheap * CONF_GCMAXHEAPSHARE) < limit)))
+                {
+                    limit = m_conf.maxheap * CONF_GCMAXHEAPSHARE;
+                }
+                m_gcstate.softlimit = limit;
+                if((limit > 0) && (m_gcstate.nextgc > limit))
+                {
+                    m_gcstate.nextgc = limit;
+                }
             }
 
-            void installMethods(ConstItem* listmethods)
+            void gcCollectGarbage()
             {
-                int i;
-                const char* rawname;
-                NativeFN rawfn;
-                String* osname;
-                for(i = 0; listmethods[i].m_constclassmthname != nullptr; i++)
+                int64_t startus;
+                int64_t phaseus;
+                startus = Util::osfn_monotonicmicros();
+                if(m_gcstate.phase != GCP_IDLE)
                 {
-                    rawname = listmethods[i].m_constclassmthname;
-                    rawfn = listmethods[i].fn;
-                    osname = String::intern(rawname);
-                    defNativeMethod(osname, rawfn);
+                    /* finish what an incremental collection started */
+                    gcIncrementalStep(-1);
                 }
+                /*
+                //  REMOVE THE NEXT LINE TO DISABLE NESTED gcCollectGarbage() POSSIBILITY!
+                */
+                m_gcstate.nextgc = m_gcstate.bytesallocated;
+                phaseus = Util::osfn_monotonicmicros();
+                gcMarkRoots();
+                gcTraceRefsParallel();
+                m_gcstate.stats.marktime += Util::osfn_monotonicmicros() - phaseus;
+                gcPruneWeakTables();
+                /* everything is traced from the roots, so the remembered set is of no use anymore */
+                gcTraceRemembered();
+                phaseus = Util::osfn_monotonicmicros();
+                /* the nursery goes first, since gcSweep() would free dead young objects that it still points to */
+                gcSweepYoung(false);
+                gcSweep();
+                gcFlushDead();
+                m_gcstate.stats.sweeptime += Util::osfn_monotonicmicros() - phaseus;
+                m_gcstate.stats.fullcollections++;
+                gcCycleDone(startus);
+                gcTrimHeap();
+                gcRecordAtomicPause(startus);
             }
-    };
 
-    class Instance : public Object
-    {
-        public:
-            template<typename InputT>
-            static Instance* makeInstanceOfSize(Class* klass)
+            /*
+            * incremental collection: copies the roots for the slices to mark, and leaves the rest to gcIncrementalStep().
+            * the mutator runs between the slices; gcWriteBarrier() keeps marking correct meanwhile.
+            * minor collections wait until the cycle is done, so the nursery is collected along with it, and the
+            * remembered set is left as it is until marking is done.
+            */
+            void gcIncrementalStart()
             {
-                Instance* oinst;
-                Instance* instance;
-                oinst = nullptr;
-                instance = (Instance*)SharedState::gcMakeObject<InputT>(Object::OTYP_INSTANCE, false);
-                instance->m_instactive = true;
-                instance->m_instanceclass = klass;
-                instance->m_instancesuperinstance = nullptr;
-                instance->m_instanceprops.initTable();
-                if(klass->m_instproperties.count() > 0)
-                {
-                    klass->m_instproperties.copy(&instance->m_instanceprops);
-                }
-                if(klass->m_superclass != nullptr)
-                {
-                    oinst = make(klass->m_superclass);
-                    instance->m_instancesuperinstance = oinst;
-                }
-                return instance;
+                int64_t startus;
+                startus = Util::osfn_monotonicmicros();
+                m_gcstate.nextgc = m_gcstate.bytesallocated;
+                m_gcstate.phase = GCP_MARK;
+                m_gcstate.slicebytes = 0;
+                m_gcstate.graynew = false;
+                gcMarkRoots(true);
+                m_gcstate.stats.marktime += Util::osfn_monotonicmicros() - startus;
+                gcRecordAtomicPause(startus);
             }
 
-            static Instance* make(Class* klass)
+            /*
+            * marks grey objects, and what gcDeferLargeObject() and gcMarkRoots() left, until there is nothing
+            * left, which returns true, or until $deadline, which returns false. a negative budget has no deadline.
+            */
+            bool gcIncrementalMark(int64_t budgetus, int64_t deadline)
             {
-                return makeInstanceOfSize<Instance>(klass);
+                int64_t n;
+                int64_t work;
+                int64_t nextcheck;
+                Object* object;
+                work = 0;
+                nextcheck = CONF_GCCLOCKINTERVAL;
+                while(true)
+                {
+                    if(m_gcstate.graycount > 0)
+                    {
+                        m_gcstate.graycount--;
+                        object = m_gcstate.graystack[m_gcstate.graycount];
+                        if(((object->m_objtype != Object::OTYP_ARRAY) && (object->m_objtype != Object::OTYP_DICT)) || !gcDeferLargeObject(object))
+                        {
+                            Object::blackenObject(object);
+                        }
+                        work++;
+                    }
+                    else if(m_gcstate.tablescancount > 0)
+                    {
+                        work += gcScanTableStep();
+                    }
+                    else if(m_gcstate.markvaluecount > 0)
+                    {
+                        for(n = 0; (n < CONF_GCCLOCKINTERVAL) && (m_gcstate.markvaluecount > 0); n++)
+                        {
+                            m_gcstate.markvaluecount--;
+                            SharedState::markValue(m_gcstate.markvalues[m_gcstate.markvaluecount]);
+                        }
+                        work += n;
+                    }
+                    else
+                    {
+                        return true;
+                    }
+                    if((budgetus >= 0) && (work >= nextcheck))
+                    {
+                        nextcheck = work + CONF_GCCLOCKINTERVAL;
+                        if(Util::osfn_monotonicmicros() >= deadline)
+                        {
+                            return false;
+                        }
+                    }
+                }
             }
 
-            static void mark(Instance* instance)
+            /*
+            * roots are not watched by the write barrier, so once there is nothing left to mark, they are
+            * marked again. this is not bounded by the budget: it takes as long as the stack and the tables
+            * of globals and modules are large. it does not trace anything, though; whatever it finds that
+            * is not marked yet is left to the following slices, after which the roots are marked again.
+            * objects made from the first time on are grey, so that this comes to an end; before that,
+            * they are white, so that those that die while marking do not have to wait for the next cycle.
+            * once the roots hold nothing new, pruning starts.
+            */
+            void gcIncrementalRemark()
             {
-                if(instance->m_instactive == false)
+                gcMarkRoots();
+                m_gcstate.graynew = true;
+                if(m_gcstate.graycount > 0)
                 {
-                    // raiseWarning("trying to mark inactive instance <%p>!", instance);
                     return;
                 }
-                Value::markValTable(&instance->m_instanceprops);
-                Object::markObject((Object*)instance->m_instanceclass);
+                m_gcstate.prunestep = GCPS_YOUNG;
+                m_gcstate.prunecursor = 0;
+                m_gcstate.phase = GCP_PRUNE;
             }
 
-            static void destroy(Instance* instance)
+            /*
+            * after marking, a slice at a time:
+            *   - the nursery becomes old, since it is swept along with the old generation. objects made from
+            *     now until sweeping starts are old (and marked) right away, so that none are young while the
+            *     nursery is only partly promoted, which the write barrier could not tell apart.
+            *   - the remembered set is emptied, since nothing is young anymore.
+            *   - unmarked strings are removed from the intern table; strTabFind() marks those it hands out
+            *     before that. if the table was resized meanwhile, it is gone through again.
+            *   - slices whose parent was not marked get a copy of their bytes; see gcPruneSlice().
+            * returns true once sweeping starts, or false at $deadline. a negative budget has no deadline.
+            */
+            bool gcIncrementalPrune(int64_t budgetus, int64_t deadline)
             {
-                auto gcs = SharedState::get();
-                if(!instance->m_instanceclass->m_destructor.isNull())
+                int64_t work;
+                HeapPage* page;
+                work = 0;
+                while(true)
                 {
-                    // if(!vmCallWithObject(instance->klass->m_destructor, Value::fromObject(instance), 0, false))
+                    switch(m_gcstate.prunestep)
+                    {
+                        case GCPS_YOUNG:
+                            {
+                                if(m_gcstate.prunecursor < m_gcstate.youngcount)
+                                {
+                                    m_gcstate.young[m_gcstate.prunecursor++]->m_objold = true;
+                                    break;
+                                }
+                                m_gcstate.youngcount = 0;
+                                m_gcstate.youngbytes = 0;
+                                m_gcstate.prunestep = GCPS_REMEMBERED;
+                                m_gcstate.prunecursor = 0;
+                            }
+                            break;
+                        case GCPS_REMEMBERED:
+                            {
+                                if(m_gcstate.prunecursor < m_gcstate.remcount)
+                                {
+                                    m_gcstate.remembered[m_gcstate.prunecursor++]->m_objremembered = false;
+                                    break;
+                                }
+                                m_gcstate.remcount = 0;
+                                m_gcstate.prunestep = GCPS_STRINGS;
+                                m_gcstate.prunecursor = 0;
+                                m_gcstate.prunecapacity = m_allocatedstrings.m_capacity;
+                            }
+                            break;
+                        case GCPS_STRINGS:
+                            {
+                                if(m_gcstate.prunecapacity != m_allocatedstrings.m_capacity)
+                                {
+                                    m_gcstate.prunecursor = 0;
+                                    m_gcstate.prunecapacity = m_allocatedstrings.m_capacity;
+                                }
+                                if(m_gcstate.prunecursor < (int64_t)m_gcstate.prunecapacity)
+                                {
+                                    m_allocatedstrings.removeWhitesAt(m_gcstate.prunecursor++);
+                                    break;
+                                }
+                                m_gcstate.prunestep = GCPS_SLICES;
+                                m_gcstate.prunecursor = 0;
+                            }
+                            break;
+                        case GCPS_SLICES:
+                            {
+                                /* a dropped slice is replaced by the last one, so that gcUnshareSlicesOf() never sees a gap */
+                                if(m_gcstate.prunecursor < m_gcstate.slicecount)
+                                {
+                                    if(gcPruneSlice(m_gcstate.slices[m_gcstate.prunecursor]))
+                                    {
+                                        m_gcstate.prunecursor++;
+                                    }
+                                    else
+                                    {
+                                        m_gcstate.slicecount--;
+                                        m_gcstate.slices[m_gcstate.prunecursor] = m_gcstate.slices[m_gcstate.slicecount];
+                                    }
+                                    break;
+                                }
+                                m_gcstate.oldslicecount = m_gcstate.slicecount;
+                                Value::valtabRemoveWhites(&m_openedmodules);
+                                /* pages made from now on are not swept; they only hold new objects */
+                                for(page = m_gcstate.heap.m_pages; page != nullptr; page = page->m_nextpage)
+                                {
+                                    page->m_needsweep = true;
+                                }
+                                m_gcstate.sweeppage = m_gcstate.heap.m_pages;
+                                m_gcstate.phase = GCP_SWEEP;
+                            }
+                            return true;
+                    }
+                    work++;
+                    if((budgetus >= 0) && ((work % CONF_GCCLOCKINTERVAL) == 0) && (Util::osfn_monotonicmicros() >= deadline))
                     {
+                        return false;
                     }
                 }
-                instance->m_instanceprops.deInit();
-                instance->m_instactive = false;
-                gcs->gcReleaseObj(instance);
             }
 
-        public:
             /*
-             * whether this instance is still "active", i.e., not destroyed, deallocated, etc.
-             */
-            bool m_instactive;
-            HashTable<Value, Value> m_instanceprops;
-            Class* m_instanceclass;
-            Instance* m_instancesuperinstance;
-
-        public:
-            bool defProperty(String* name, Value val)
-            {
-                return m_instanceprops.set(Value::fromObject(name), val);
-            }
-
-            Property* getProperty(String* name)
+            * does incremental marking, pruning or sweeping for up to budgetus microseconds. once marking runs
+            * out, the slice ends, and the roots are marked again (see gcIncrementalRemark()), which is
+            * recorded apart from the slices. a negative budget runs the collection to its end, and the
+            * caller records the pause.
+            */
+            void gcIncrementalStep(int64_t budgetus)
             {
-                Property* field;
-                field = m_instanceprops.getfield(Value::fromObject(name));
-                if(field == nullptr)
+                bool done;
+                int64_t nowus;
+                int64_t startus;
+                int64_t deadline;
+                HeapPage* page;
+                startus = Util::osfn_monotonicmicros();
+                deadline = startus + budgetus;
+                while(m_gcstate.phase == GCP_MARK)
                 {
-                    if(m_instancesuperinstance != nullptr)
+                    done = gcIncrementalMark(budgetus, deadline);
+                    if(budgetus < 0)
+                    {
+                        gcIncrementalRemark();
+                        continue;
+                    }
+                    nowus = Util::osfn_monotonicmicros();
+                    m_gcstate.stats.marktime += nowus - startus;
+                    gcRecordPause(startus);
+                    if(done)
                     {
-                        return m_instancesuperinstance->getProperty(name);
+                        /* the slice ends where marking ran out; marking the roots again is a pause of its own */
+                        gcIncrementalRemark();
+                        m_gcstate.stats.marktime += Util::osfn_monotonicmicros() - nowus;
+                        gcRecordAtomicPause(nowus);
                     }
+                    return;
                 }
-                return field;
-            }
-
-            Property* getMethod(String* name)
-            {
-                Property* field;
-                field = m_instanceclass->getMethodField(name);
-                if(field == nullptr)
+                nowus = Util::osfn_monotonicmicros();
+                m_gcstate.stats.marktime += nowus - startus;
+                if(m_gcstate.phase == GCP_PRUNE)
                 {
-                    if(m_instancesuperinstance != nullptr)
+                    done = gcIncrementalPrune(budgetus, deadline);
+                    m_gcstate.stats.prunetime += Util::osfn_monotonicmicros() - nowus;
+                    nowus = Util::osfn_monotonicmicros();
+                    if(!done)
                     {
-                        return m_instancesuperinstance->getMethod(name);
+                        gcRecordPause(startus);
+                        return;
                     }
                 }
-                return field;
+                /* sweeping goes a page at a time */
+                while(m_gcstate.phase == GCP_SWEEP)
+                {
+                    page = m_gcstate.sweeppage;
+                    if(page == nullptr)
+                    {
+                        m_gcstate.phase = GCP_IDLE;
+                        m_gcstate.stats.incrementalcollections++;
+                        break;
+                    }
+                    gcSweepPage(page);
+                    m_gcstate.sweeppage = page->m_nextpage;
+                    if((budgetus >= 0) && (Util::osfn_monotonicmicros() >= deadline))
+                    {
+                        break;
+                    }
+                }
+                gcFlushDead();
+                m_gcstate.stats.sweeptime += Util::osfn_monotonicmicros() - nowus;
+                if(m_gcstate.phase == GCP_IDLE)
+                {
+                    gcCycleDone(startus);
+                    gcTrimHeap();
+                }
+                if(budgetus >= 0)
+                {
+                    gcRecordPause(startus);
+                }
             }
-    };
 
-    class File : public Object
-    {
-        public:
-            static bool fileExists(const char* path)
+            /*
+            * collects the nursery only: the roots and the remembered set are traced without
+            * descending into old objects, so the cost depends on the survivors, not on the heap.
+            */
+            void gcCollectMinor()
             {
-                return Util::nn_util_fsfileexists(path);
+                int64_t startus;
+                int64_t phaseus;
+                startus = Util::osfn_monotonicmicros();
+                m_gcstate.inminor = true;
+                gcMarkRoots();
+                gcTraceRemembered();
+                gcTraceRefs();
+                m_gcstate.stats.marktime += Util::osfn_monotonicmicros() - startus;
+                gcPruneWeakTables();
+                phaseus = Util::osfn_monotonicmicros();
+                gcSweepYoung(true);
+                m_gcstate.inminor = false;
+                gcFlushDead();
+                m_gcstate.stats.sweeptime += Util::osfn_monotonicmicros() - phaseus;
+                m_gcstate.stats.minorcollections++;
+                gcRecordAtomicPause(startus);
             }
 
-            static bool pathIsFile(const char* path)
+            /*
+            * counts $delta bytes of buffers owned by objects or the VM (see Memory::gcRealloc).
+            * nothing is collected here, since the caller may be in the middle of changing an object;
+            * the next object that is made sees the new total.
+            */
+            void gcAccountBuffer(int64_t delta)
             {
-                return Util::nn_util_fsfileisfile(path);
+            #if defined(NEON_CONFIG_USEBACKGROUNDSWEEP) && (NEON_CONFIG_USEBACKGROUNDSWEEP == 1)
+                if(BackgroundSweeper::onSweeperThread())
+                {
+                    m_gcstate.sweptbytes.fetch_add(delta, std::memory_order_relaxed);
+                    return;
+                }
+            #endif
+                m_gcstate.bytesallocated += delta;
+                if((delta > 0) && (m_conf.maxheap > 0) && (m_gcstate.bytesallocated > gcHeapLimit()))
+                {
+                    m_gcstate.overlimit = true;
+                }
             }
 
-            static bool pathIsDirectory(const char* path)
+            /* adds what the sweeper thread freed to bytesallocated */
+            NEON_INLINE void gcTakeSweptBytes()
             {
-                return Util::nn_util_fsfileisdirectory(path);
+            #if defined(NEON_CONFIG_USEBACKGROUNDSWEEP) && (NEON_CONFIG_USEBACKGROUNDSWEEP == 1)
+                if(NEON_UNLIKELY(m_gcstate.sweptbytes.load(std::memory_order_relaxed) != 0))
+                {
+                    m_gcstate.bytesallocated += m_gcstate.sweptbytes.exchange(0, std::memory_order_relaxed);
+                }
+            #endif
             }
 
-            static char* getBasename(const char* path)
+            /* waits for the sweeper thread, so that bytesallocated includes everything freed so far */
+            void gcWaitForSweeper()
             {
-                return Util::nn_util_fsgetbasename(path);
+            #if defined(NEON_CONFIG_USEBACKGROUNDSWEEP) && (NEON_CONFIG_USEBACKGROUNDSWEEP == 1)
+                m_gcstate.sweeper.drain();
+            #endif
+                gcTakeSweptBytes();
             }
 
-            static char* readFromHandle(FILE* hnd, size_t* dlen, bool havemaxsz, size_t maxsize)
+            /* what bytesallocated may grow to before gcEnforceHeapLimit() runs */
+            NEON_INLINE int64_t gcHeapLimit() const
             {
-                long rawtold;
-                /*
-                 * the value returned by ftell() may not necessarily be the same as
-                 * the amount that can be read.
-                 * since we only ever read a maximum of $toldlen, there will
-                 * be no memory trashing.
-                 */
-                size_t toldlen;
-                size_t actuallen;
-                char* buf;
-                if(fseek(hnd, 0, SEEK_END) == -1)
-                {
-                    return nullptr;
-                }
-                if((rawtold = ftell(hnd)) == -1)
-                {
-                    return nullptr;
-                }
-                toldlen = rawtold;
-                if(fseek(hnd, 0, SEEK_SET) == -1)
+                return m_conf.maxheap + m_gcstate.headroom;
+            }
+
+            /*
+            * called by the interpreter between instructions, and by native code at loop back-edges and calls,
+            * once m_gcstate.overlimit is set: runs a full collection, and raises MemoryError if the heap is
+            * still over the limit. after that, the heap may grow by CONF_GCMAXHEAPHEADROOM of the limit
+            * before MemoryError is raised again, since handling it allocates too.
+            * returns false if that MemoryError was not handled.
+            */
+            bool gcEnforceHeapLimit()
+            {
+                if((m_gcstate.blockcount > 0) || (m_vmstate.currentframe == nullptr) || (m_vmstate.currentframe->gcprotcount > 0))
                 {
-                    return nullptr;
+                    return true;
                 }
-                if(havemaxsz)
+                m_gcstate.overlimit = false;
+                gcCollectGarbage();
+                gcWaitForSweeper();
+                if(m_gcstate.bytesallocated <= m_conf.maxheap)
                 {
-                    if(toldlen > maxsize)
-                    {
-                        toldlen = maxsize;
-                    }
+                    m_gcstate.headroom = 0;
+                    return true;
                 }
-                buf = (char*)Memory::sysMalloc(sizeof(char) * (toldlen + 1));
-                memset(buf, 0, toldlen + 1);
-                if(buf != nullptr)
+                if(m_gcstate.bytesallocated <= gcHeapLimit())
                 {
-                    actuallen = fread(buf, sizeof(char), toldlen, hnd);
-                    /*
-                    // optionally, read remainder:
-                    size_t tmplen;
-                    if(actuallen < toldlen)
-                    {
-                        tmplen = actuallen;
-                        actuallen += fread(buf+tmplen, sizeof(char), actuallen-toldlen, hnd);
-                        ...
-                    }
-                    // unlikely to be necessary, so not implemented.
-                    */
-                    if(dlen != nullptr)
-                    {
-                        *dlen = actuallen;
-                    }
-                    return buf;
+                    return true;
                 }
-                return nullptr;
+                m_gcstate.headroom = m_conf.maxheap * CONF_GCMAXHEAPHEADROOM;
+                return NEON_THROWCLASSWITHSOURCEINFO(m_exceptions.memoryerror, "heap limit of %lld bytes exceeded (%lld bytes in use)",
+                    (long long)m_conf.maxheap, (long long)m_gcstate.bytesallocated);
             }
 
-            static char* readFile(const char* filename, size_t* dlen, bool havemaxsz, size_t maxsize)
+            void gcMaybeCollect(int addsize, bool wasnew)
             {
-                char* b;
-                FILE* fh;
-                fh = fopen(filename, "rb");
-                if(fh == nullptr)
+                gcTakeSweptBytes();
+                m_gcstate.bytesallocated += addsize;
+                if((addsize > 0) && (m_conf.maxheap > 0) && (m_gcstate.bytesallocated > gcHeapLimit()))
                 {
-                    return nullptr;
+                    m_gcstate.overlimit = true;
                 }
-            #if defined(NEON_PLAT_ISWINDOWS)
-                _setmode(fileno(fh), _O_BINARY);
-            #endif
-                b = readFromHandle(fh, dlen, havemaxsz, maxsize);
-                fclose(fh);
-                return b;
-            }
-
-            static char* fileHandleGets(char* s, int size, FILE* f, size_t* lendest)
-            {
-                int c;
-                char* p;
-                p = s;
-                (*lendest) = 0;
-                if(size > 0)
+                if(m_gcstate.nextgc > 0)
                 {
-                    while(--size > 0)
+                    if(wasnew && (m_gcstate.blockcount == 0) && m_vmstate.currentframe && m_vmstate.currentframe->gcprotcount == 0)
                     {
-                        if((c = getc(f)) == -1)
+                        if(m_gcstate.phase != GCP_IDLE)
                         {
-                            if(ferror(f) == EINTR)
+                            m_gcstate.slicebytes += addsize;
+                            if(m_gcstate.slicebytes >= CONF_GCSLICEBYTES)
                             {
-                                continue;
+                                m_gcstate.slicebytes = 0;
+                                gcIncrementalStep(m_gcstate.pausebudget);
                             }
-                            break;
                         }
-                        *p++ = c & 0xff;
-                        (*lendest) += 1;
-                        if(c == '\n')
+                        else if(m_gcstate.bytesallocated > m_gcstate.nextgc)
                         {
-                            break;
-                        }
-                    }
-                    *p = '\0';
-                }
-                if(p > s)
-                {
-                    return s;
+                            if(m_gcstate.pausebudget > 0)
+                            {
+                                gcIncrementalStart();
+                            }
+                            else
+                            {
+                                gcCollectGarbage();
+                            }
+                        }
+                        else if((m_gcstate.nurserysize > 0) && (m_gcstate.youngbytes > m_gcstate.nurserysize))
+                        {
+                            gcCollectMinor();
+                        }
+                    }
                 }
-                return nullptr;
             }
 
-            static int readLineFromHandle(char** lineptr, size_t* destlen, FILE* hnd)
+            Function* compileSourceToFunction(Module* module, bool fromeval, const char* source, bool toplevel);
+            Status execSource(Module* module, const char* source, const char* filename, Value* dest);
+            Value evalSource(const char* source);
+
+            bool vmExceptionPushHandler(Class* type, int address, int finallyaddress);
+            Value vmExceptionGetStackTrace();
+            bool vmExceptionPropagate();
+
+            /**
+             * grows m_vmstate.(stack|frame)values, respectively.
+             * currently it works fine with mob.js (man-or-boy test), although
+             * there are still some invalid reads regarding the closure;
+             * almost definitely because the pointer address changes.
+             *
+             * currently, the implementation really does just increase the
+             * memory block available:
+             * i.e., [Value x 32] -> [Value x <newsize>], without
+             * copying anything beyond primitive values.
+             */
+            NEON_INLINE bool resizeStack(size_t needed)
             {
-                enum
-                {
-                    kInitialStrBufSize = 256
-                };
-                static char stackbuf[kInitialStrBufSize];
-                char* heapbuf;
-                size_t getlen;
-                unsigned int linelen;
-                getlen = 0;
-                if(lineptr == nullptr || destlen == nullptr)
-                {
-                    errno = EINVAL;
-                    return -1;
-                }
-                if(ferror(hnd))
-                {
-                    return -1;
-                }
-                if(feof(hnd))
-                {
-                    return -1;
-                }
-                fileHandleGets(stackbuf, kInitialStrBufSize, hnd, &getlen);
-                heapbuf = strchr(stackbuf, '\n');
-                if(heapbuf)
-                {
-                    *heapbuf = '\0';
-                }
-                linelen = getlen;
-                if((linelen + 1) < kInitialStrBufSize)
+                size_t oldsz;
+                size_t newsz;
+                size_t nforvals;
+                nforvals = (needed * 2);
+                oldsz = m_vmstate.stackcapacity;
+                newsz = oldsz + nforvals;
+                m_vmstate.stackvalues.ensureCapacity(newsz);
+                m_vmstate.stackcapacity = m_vmstate.stackvalues.capacity();
+                return true;
+            }
+
+            NEON_INLINE bool resizeFrames(size_t needed)
+            {
+                size_t oldsz;
+                size_t newsz;
+                int oldhandlercnt;
+                uint8_t* oldip;
+                Function* oldclosure;
+                oldclosure = m_vmstate.currentframe->closure;
+                oldip = m_vmstate.currentframe->inscode;
+                oldhandlercnt = m_vmstate.currentframe->m_handlercount;
+                oldsz = m_vmstate.framecapacity;
+                newsz = oldsz + needed;
+
+                m_vmstate.framevalues.ensureCapacity(newsz);
+                m_vmstate.framecapacity = m_vmstate.framevalues.capacity();
+
+                /*
+                 * this bit is crucial: realloc changes pointer addresses, and to keep the
+                 * current frame, re-read it from the new address.
+                 */
+                m_vmstate.currentframe = &m_vmstate.framevalues[m_vmstate.framecount - 1];
+                m_vmstate.currentframe->m_handlercount = oldhandlercnt;
+                m_vmstate.currentframe->inscode = oldip;
+                m_vmstate.currentframe->closure = oldclosure;
+                return true;
+            }
+
+            NEON_INLINE bool checkMaybeResizeStack()
+            {
+                if((m_vmstate.stackidx + 1) >= m_vmstate.stackcapacity)
                 {
-                    heapbuf = (char*)Memory::sysRealloc(*lineptr, kInitialStrBufSize);
-                    if(heapbuf == nullptr)
+                    if(!resizeStack((m_vmstate.stackidx + 1)))
                     {
-                        return -1;
+                        fprintf(stderr, "failed to resize stack due to overflow");
+                        return false;
                     }
-                    *lineptr = heapbuf;
-                    *destlen = kInitialStrBufSize;
+                    return true;
                 }
-                strcpy(*lineptr, stackbuf);
-                *destlen = linelen;
-                return linelen;
+                return false;
             }
 
-        public:
-            static File* make(FILE* handle, bool isstd, const char* path, const char* mode)
+            NEON_INLINE bool checkMaybeResizeFrames()
             {
-                File* file;
-                file = SharedState::gcMakeObject<File>(Object::OTYP_FILE, false);
-                file->m_isopen = false;
-                file->m_mode = String::copy(mode);
-                file->m_path = String::copy(path);
-                file->m_isstd = isstd;
-                file->m_handle = handle;
-                file->m_istty = false;
-                file->m_number = -1;
-                if(file->m_handle != nullptr)
+                //fprintf(stderr, "checking if frames need resizing...\n");
+                if(m_vmstate.framecount >= m_vmstate.framecapacity)
                 {
-                    file->m_isopen = true;
+                    if(!resizeFrames((m_vmstate.framecapacity + 1)))
+                    {
+                        fprintf(stderr, "failed to resize frames due to overflow");
+                        return false;
+                    }
+                    return true;
                 }
-                return file;
+                return false;
             }
 
-            static void destroy(File* file)
+            /* initial amount of frames (will grow dynamically if needed) */
+            #define NEON_CONFIG_INITFRAMECOUNT (16)
+
+            /* initial amount of stack values (will grow dynamically if needed) */
+            #define NEON_CONFIG_INITSTACKCOUNT (4 * 1)
+
+            static uint8_t* haltCode()
             {
-                auto gcs = SharedState::get();
-                file->closeFile();
-                gcs->gcReleaseObj(file);
+                static uint8_t code[] = { Instruction::OPC_HALT };
+                return code;
             }
 
-            static void mark(File* file)
+            void resetVMState()
             {
-                Object::markObject((Object*)file->m_mode);
-                Object::markObject((Object*)file->m_path);
+                m_vmstate.framecount = 0;
+                m_vmstate.stackidx = 0;
+                m_vmstate.openupvalues = nullptr;
             }
 
-        public:
-            bool m_isopen;
-            bool m_isstd;
-            bool m_istty;
-            int m_number;
-            FILE* m_handle;
-            String* m_mode;
-            String* m_path;
-
-        public:
-            bool readData(size_t readhowmuch, IOResult* dest)
+            void initVMState()
             {
-                size_t filesizereal;
-                struct stat stats;
-                filesizereal = -1;
-                dest->success = false;
-                dest->length = 0;
-                dest->data = nullptr;
-                if(!m_isstd)
-                {
-                    if(!File::fileExists(m_path->data()))
-                    {
-                        return false;
-                    }
-                    /* file is in write only mode */
-                    /*
-                    else if(strstr(m_mode->data(), "w") != nullptr && strstr(m_mode->data(), "+") == nullptr)
-                    {
-                        NEON_RETURNERROR(scfn, "Unsupported -> %s" , "cannot read file in write mode");
-                    }
-                    */
-                    if(!m_isopen)
-                    {
-                        /* open the file if it isn't open */
-                        openWithoutParams();
-                    }
-                    else if(m_handle == nullptr)
-                    {
-                        return false;
-                    }
-                    if(Util::osfn_lstat(m_path->data(), &stats) == 0)
-                    {
-                        filesizereal = (size_t)stats.st_size;
-                    }
-                    else
-                    {
-                        /* fallback */
-                        fseek(m_handle, 0L, SEEK_END);
-                        filesizereal = ftell(m_handle);
-                        rewind(m_handle);
-                    }
-                    if(readhowmuch == (size_t)-1 || readhowmuch > filesizereal)
-                    {
-                        readhowmuch = filesizereal;
-                    }
-                }
-                else
-                {
-                    /*
-                    // for non-file objects such as stdin
-                    // minimum read bytes should be 1
-                    */
-                    if(readhowmuch == (size_t)-1)
-                    {
-                        readhowmuch = 1;
-                    }
-                }
-                /* +1 for terminator '\0' */
-                dest->data = (char*)Memory::sysMalloc(sizeof(char) * (readhowmuch + 1));
-                if(dest->data == nullptr && readhowmuch != 0)
-                {
-                    return false;
-                }
-                dest->length = fread(dest->data, sizeof(char), readhowmuch, m_handle);
-                if(dest->length == 0 && readhowmuch != 0 && readhowmuch == filesizereal)
+                m_vmstate.m_unhandledexceptionstate = false;
+                m_vmstate.currentframe = nullptr;
+                m_vmstate.haltframe.inscode = haltCode();
+                m_vmstate.cacheepoch = 1;
+                m_vmstate.unwindcount = 0;
                 {
-                    return false;
+                    m_vmstate.stackcapacity = NEON_CONFIG_INITSTACKCOUNT;
+                    m_vmstate.stackvalues.ensureCapacity(NEON_CONFIG_INITSTACKCOUNT);
                 }
-                /* we made use of +1 so we can terminate the string. */
-                if(dest->data != nullptr)
                 {
-                    dest->data[dest->length] = '\0';
+                    m_vmstate.framecapacity = NEON_CONFIG_INITFRAMECOUNT;
+                    m_vmstate.framevalues.ensureCapacity(NEON_CONFIG_INITFRAMECOUNT);
                 }
-                return true;
             }
 
-            int closeFile()
+            /*
+            * called whenever a method table changes, or a class (and its shapes) is created or destroyed,
+            * since the address of a dead class or shape may be reused.
+            */
+            NEON_INLINE void invalidateInlineCaches()
             {
-                int result;
-                if(m_handle != nullptr && !m_isstd)
-                {
-                    fflush(m_handle);
-                    result = fclose(m_handle);
-                    m_handle = nullptr;
-                    m_isopen = false;
-                    m_number = -1;
-                    m_istty = false;
-                    return result;
-                }
-                return -1;
+                m_vmstate.cacheepoch++;
             }
 
-            bool openWithoutParams()
+            /*
+             * don't try to further optimize vmbits functions, unless you *really* know what you are doing.
+             * they were initially macros; but for better debugging, and better type-enforcement, they
+             * are now inlined functions.
+             */
+
+            NEON_INLINE uint16_t vmReadByte()
             {
-                if(m_handle != nullptr)
-                {
-                    return true;
-                }
-                if(m_handle == nullptr && !m_isstd)
-                {
-                    m_handle = fopen(m_path->data(), m_mode->data());
-                    if(m_handle != nullptr)
-                    {
-                        m_isopen = true;
-                        m_number = fileno(m_handle);
-                        m_istty = Util::osfn_isatty(m_number);
-                        return true;
-                    }
-                    else
-                    {
-                        m_number = -1;
-                        m_istty = false;
-                    }
-                    return false;
-                }
-                return false;
+                uint16_t r;
+                r = *m_vmstate.currentframe->inscode;
+                m_vmstate.currentframe->inscode++;
+                return r;
             }
 
-    };
+            NEON_INLINE uint8_t vmReadInstruction()
+            {
+                uint8_t r;
+                r = *m_vmstate.currentframe->inscode;
+                m_vmstate.currentframe->inscode++;
+                return r;
+            }
 
-    class Module : public Object
-    {
-        public:
-            using ModLoaderFN = void(*)();
+            NEON_INLINE uint16_t vmReadShort()
+            {
+                uint16_t b;
+                uint16_t a;
+                a = m_vmstate.currentframe->inscode[0];
+                b = m_vmstate.currentframe->inscode[1];
+                m_vmstate.currentframe->inscode += 2;
+                return (uint16_t)((a << 8) | b);
+            }
 
-        public:
-            static Module* make(String* name, const char* file, bool imported, bool retain)
+            Value vmReadConst()
             {
-                Module* module;
-                module = SharedState::gcMakeObject<Module>(Object::OTYP_MODULE, retain);
-                module->m_deftable.initTable();
-                module->m_modname = name;
-                module->m_physicalpath = String::copy(file);
-                module->m_fnunloaderptr = nullptr;
-                module->m_fnpreloaderptr = nullptr;
-                module->m_handle = nullptr;
-                module->m_imported = imported;
-                return module;
+                uint16_t idx;
+                idx = vmReadShort();
+                auto blob = Wrappers::wrapGetBlobOfClosure(m_vmstate.currentframe->closure);
+                return blob->m_constants.get(idx);
             }
 
-            static bool addSearchPathObj(String* os)
+            NEON_INLINE String* vmReadString()
             {
-                auto gcs = SharedState::get();
-                gcs->m_importpath.push(Value::fromObject(os));
-                return true;
+                return vmReadConst().asString();
             }
 
-            static void closeImportHandle(void* hnd)
+            NEON_INLINE Value vmStackPeek(int distance)
             {
-                (void)hnd;
+                Value v;
+                v = m_vmstate.stackvalues[m_vmstate.stackidx + (-1 - distance)];
+                return v;
             }
 
-            static bool addSearchPath(const char* path)
+            NEON_INLINE void vmStackPush(Value value)
             {
-                return addSearchPathObj(String::copy(path));
+                checkMaybeResizeStack();
+                m_vmstate.stackvalues[m_vmstate.stackidx] = value;
+                m_vmstate.stackidx++;
             }
 
-            static void destroy(Module* module)
+            NEON_INLINE auto vmStackPop()
             {
-                module->m_deftable.deInit();
-                /*
-                Memory::sysFree(module->m_modname);
-                Memory::sysFree(module->m_physicalpath);
-                */
-                if(module->m_fnunloaderptr != nullptr && module->m_imported)
+                m_vmstate.stackidx--;
+                if(m_vmstate.stackidx < 0)
                 {
-                    auto asfn = module->m_fnunloaderptr;
-                    asfn();
+                    m_vmstate.stackidx = 0;
                 }
-                if(module->m_handle != nullptr)
+                return m_vmstate.stackvalues[m_vmstate.stackidx];
+            }
+
+            NEON_INLINE auto vmStackPop(int n)
+            {
+                m_vmstate.stackidx -= n;
+                if(m_vmstate.stackidx < 0)
                 {
-                    Module::closeImportHandle(module->m_handle);
+                    m_vmstate.stackidx = 0;
                 }
+                return m_vmstate.stackvalues[m_vmstate.stackidx];
             }
 
-            static StrBuffer* resolvePath(String* modulename, const char* currentfile, char* rootfile, bool isrelative)
+            Status runVM(int exitframe, Value* rv, bool singlestep = false);
+            bool vmJitMaybeRun(int64_t weight);
+            NEON_INLINE bool vmDoBinaryFunc(const char* opname, BinOpFuncFN opfn);
+            NEON_INLINE bool vmDoMakeDict();
+            NEON_INLINE bool vmDoMakeArray();
+            NEON_INLINE bool vmDoMakeClosure();
+            NEON_INLINE bool vmDoBinaryDirect();
+            NEON_INLINE bool vmDoBinaryInts(int instruction, Value* top);
+            NEON_INLINE bool vmDoBinaryNumbers(int instruction);
+            NEON_INLINE bool vmDoGlobalDefine();
+            NEON_INLINE bool vmDoGlobalGet();
+            NEON_INLINE bool vmDoGlobalSet();
+            NEON_INLINE bool vmDoLocalGet();
+            NEON_INLINE bool vmDoLocalSet();
+            NEON_INLINE bool vmDoFuncArgOptional();
+            NEON_INLINE bool vmDoFuncArgGet();
+            NEON_INLINE bool vmDoFuncArgSet();
+            NEON_INLINE Value vmReadRegOperand(int kind);
+            NEON_INLINE void vmRegisterDeopt(uint8_t* ip);
+            NEON_INLINE bool vmDoRegisterMove();
+            NEON_INLINE bool vmDoRegisterArith();
+            NEON_INLINE bool vmDoRegisterJumpCompare();
+            NEON_INLINE bool vmDoSuperLocalPropertyGet();
+
+            /* rewrites the instruction that was just read into op (see Instruction::OPC_PRIMADDNUM) */
+            NEON_INLINE void vmQuickenInstruction(uint8_t op)
+            {
+                #if defined(NEON_CONFIG_USEQUICKENING) && (NEON_CONFIG_USEQUICKENING == 1)
+                    m_vmstate.currentframe->inscode[-1] = op;
+                #else
+                    (void)op;
+                #endif
+            }
+
+            /* rewrites the quickened instruction that was just read back into op, and steps back so it is executed next */
+            NEON_INLINE void vmDeoptInstruction(uint8_t op)
             {
-                size_t i;
-                size_t mlen;
-                size_t splen;
-                char* path1;
-                char* path2;
-                const char* cstrpath;
-                struct stat stroot;
-                struct stat stmod;
-                String* pitem;
-                StrBuffer* pathbuf;
-                (void)rootfile;
-                (void)isrelative;
-                (void)stroot;
-                (void)stmod;
-                path1 = nullptr;
-                path2 = nullptr;
-                auto gcs = SharedState::get();
-                // a full path was supplied, i.e., require("some/path.nn")
-                if(File::fileExists(modulename->data()))
+                m_vmstate.currentframe->inscode--;
+                m_vmstate.currentframe->inscode[0] = op;
+            }
+            NEON_INLINE bool vmUtilBindMethod(Class* klass, String* name);
+            NEON_INLINE bool vmUtilGetInstanceMethod(Instance* instance, String* name);
+            NEON_INLINE Property* vmUtilGetProperty(Value peeked, String* name);
+            NEON_INLINE bool vmDoPropertyGetNormal();
+            NEON_INLINE bool vmDoPropertyGetSelf();
+            NEON_INLINE bool vmDoPropertySet();
+            NEON_INLINE bool vmDoIndexGet();
+            NEON_INLINE bool vmUtilConcatenate();
+            NEON_INLINE bool vmDoIndexSet();
+            NEON_INLINE bool vmUtilDoSetIndexString(String* os, Value index, Value value);
+            NEON_INLINE bool vmUtilDoSetIndexArray(Array* list, Value index, Value value);
+            NEON_INLINE bool vmUtilDoSetIndexModule(Module* module, Value index, Value value);
+            NEON_INLINE bool vmUtilDoSetIndexDict(Dict* dict, Value index, Value value);
+
+            bool vmDoCallClosure(Function* closure, Value thisval, size_t argcount, bool fromoperator);
+            NEON_INLINE bool vmDoCallNative(Function* native, Value thisval, size_t argcount);
+            bool vmCallWithObject(Value callable, Value thisval, size_t argcount, bool fromoper);
+            bool vmCallValue(Value callable, Value thisval, size_t argcount, bool fromoperator);
+
+            Class* getClassFor(Value receiver);
+
+            NEON_INLINE bool vmUtilInvokeMethodFromClass(Class* klass, String* name, size_t argcount);
+            NEON_INLINE bool vmUtilInvokeMethodSelf(String* name, size_t argcount, InlineCache* ic);
+            NEON_INLINE bool vmUtilInvokeMethodNormal(String* name, size_t argcount, InlineCache* ic);
+            NEON_INLINE InlineCache* vmReadInlineCache();
+            NEON_INLINE Value* vmUtilCachedInstanceProperty(InlineCache* ic, Instance* instance, String* name, bool allowprivate, Property::FieldType* ftyp);
+            NEON_INLINE void vmUtilAddInstanceProperty(InlineCache* ic, Instance* instance, String* name, Value val);
+            NEON_INLINE bool vmUtilCachedMethod(InlineCache* ic, const void* key, Class* klass, String* name, bool walkchain, bool allowprivate, Value* dest);
+            NEON_INLINE Upvalue* vmUtilUpvaluesCapture(Value* local, int stackpos);
+            NEON_INLINE void vmUtilUpvaluesClose(const Value* last);
+            NEON_INLINE void vmUtilDefineMethod(String* name);
+            NEON_INLINE void vmUtilDefineProperty(String* name, bool isstatic);
+            NEON_INLINE String* vmUtilMultString(String* str, double number);
+            NEON_INLINE Array* vmUtilCombineArrays(Array* a, Array* b);
+            NEON_INLINE void vmUtilMultArray(Array* from, Array* newlist, size_t times);
+            NEON_INLINE bool vmUtilDoGetRangedIndexOfArray(Array* list, bool willassign);
+            NEON_INLINE bool vmUtilDoGetRangedIndexOfString(String* string, bool willassign);
+            NEON_INLINE bool vmDoGetRangedIndex();
+            NEON_INLINE bool vmUtilDoIndexGetDict(Dict* dict, bool willassign);
+            NEON_INLINE bool vmUtilDoIndexGetModule(Module* module, bool willassign);
+            NEON_INLINE bool vmUtilDoIndexGetString(String* string, bool willassign);
+            NEON_INLINE bool vmUtilDoIndexGetArray(Array* list, bool willassign);
+            Property* vmUtilCheckOverloadRequirements(const char* ccallername, Value target, String* name);
+            NEON_INLINE bool vmUtilTryOverloadBasic(String* name, Value target, Value firstargvval, Value setvalue, bool willassign);
+            NEON_INLINE bool vmUtilTryOverloadMath(String* name, Value target, Value right, bool willassign);
+            NEON_INLINE bool vmUtilTryOverloadGeneric(String* name, Value target, bool willassign);
+            NEON_INLINE Property* vmUtilGetClassProperty(Class* klass, String* name, bool alsothrow);
+
+            int vmNestCallPrepare(Value callable, Value mthobj, Value* callarr, int maxcallarr)
+            {
+                int arity;
+                Function* ofn;
+                (void)maxcallarr;
+                arity = 0;
+                ofn = callable.asFunction();
+                if(callable.isFuncclosure())
                 {
-                    pathbuf = Memory::make<StrBuffer>();
-                    pathbuf->append(modulename->data(), modulename->length());
-                    return pathbuf;
+                    arity = Wrappers::wrapGetArityOfClosure(ofn);
                 }
-                mlen = modulename->length();
-                splen = gcs->m_importpath.count();
-                for(i = 0; i < splen; i++)
+                else if(callable.isFuncscript())
                 {
-                    auto pobj = gcs->m_importpath.get(i);
-                    pitem = pobj.asString();
-                    pathbuf = Memory::make<StrBuffer>();
-                    pathbuf->append(pitem->data(), pitem->length());
-                    if(pathbuf->contains('@'))
+                    arity = Wrappers::wrapGetArityOfFuncScript(ofn);
+                }
+                else if(callable.isFuncnative())
+                {
+            #if 0
+                        arity = ofn;
+            #endif
+                }
+                if(arity > 0)
+                {
+                    callarr[0] = Value::makeNull();
+                    if(arity > 1)
                     {
-                        pathbuf->replace('@', modulename->data(), mlen);
+                        callarr[1] = Value::makeNull();
+                        if(arity > 2)
+                        {
+                            callarr[2] = mthobj;
+                        }
                     }
-                    else
+                }
+                return arity;
+            }
+
+            /* helper function to access call outside the file. */
+            bool vmNestCallFunction(Value callable, Value thisval, Value* argv, size_t argc, Value* dest, bool fromoper)
+            {
+                bool needvm;
+                size_t i;
+                int64_t pidx;
+                Status status;
+                Value rtv;
+                pidx = m_vmstate.stackidx;
+                /* set the closure before the args */
+                vmStackPush(callable);
+                if((argv != nullptr) && (argc > 0))
+                {
+                    for(i = 0; i < argc; i++)
                     {
-                        pathbuf->append("/");
-                        pathbuf->append(modulename->data(), modulename->length());
-                        pathbuf->append(NEON_CONFIG_FILEEXT);
+                        vmStackPush(argv[i]);
                     }
-                    cstrpath = pathbuf->data();
-                    fprintf(stderr, "import: trying '%s' ... ", cstrpath);
-                    if(File::fileExists(cstrpath))
-                    {
-                        path1 = Util::osfn_realpath(cstrpath, nullptr);
-                        fprintf(stderr, "found!\n");
-                        /* stop a core library from importing itself */
-                        if(currentfile != nullptr)
-                        {
-                            if(stat(currentfile, &stroot) == -1)
-                            {
-                                fprintf(stderr, "resolvepath: failed to stat current file '%s'\n", currentfile);
-                                return nullptr;
-                            }
-                            if(stat(cstrpath, &stmod) == -1)
-                            {
-                                fprintf(stderr, "resolvepath: failed to stat module file '%s'\n", cstrpath);
-                                return nullptr;
-                            }
-                            if(stroot.st_ino == stmod.st_ino)
-                            {
-                                fprintf(stderr, "resolvepath: refusing to import itself\n");
-                                return nullptr;
-                            }
-                            path2 = Util::osfn_realpath(currentfile, nullptr);
-                            if(path1 != nullptr && path2 != nullptr)
-                            {
-                                if(memcmp(path1, path2, (int)strlen(path2)) == 0)
-                                {
-                                    Memory::sysFree(path1);
-                                    Memory::sysFree(path2);
-                                    path1 = nullptr;
-                                    path2 = nullptr;
-                                    fprintf(stderr, "resolvepath: refusing to import itself\n");
-                                    return nullptr;
-                                }
-                            }
-                        }
-                        if(path2 != nullptr)
-                        {
-                            Memory::sysFree(path2);
-                        }
-                        if(path1 != nullptr)
-                        {
-                            Memory::sysFree(path1);
-                        }
-                        return pathbuf;
-                    }
-                    else
-                    {
-                        fprintf(stderr, "does not exist\n");
-                    }
-                    Memory::destroy(pathbuf);
-                }
-                return nullptr;
-            }
-
-            static Module* loadScriptModule(String* modulename)
-            {
-                fprintf(stderr, "in loadScriptModule(): modulename=%.*s\n", (int)modulename->length(), modulename->data());
-                size_t fsz;
-                char* source;
-                StrBuffer* physpath;
-                Blob blob;
-                Value retv;
-                Value callable;
-                Property* field;
-                String* os;
-                Module* module;
-                Function* closure;
-                Function* function;
-                (void)os;
-                auto gcs = SharedState::get();
-                field = gcs->m_openedmodules.getfieldbyostr(modulename);
-                if(field != nullptr)
-                {
-                    Blob::destroy(&blob);
-                    return field->value.asModule();
                 }
-                physpath = resolvePath(modulename, nullptr, nullptr, false);
-                if(physpath == nullptr)
+                if(!vmCallWithObject(callable, thisval, argc, fromoper))
                 {
-                    Blob::destroy(&blob);
-                    NEON_THROWCLASSWITHSOURCEINFO(gcs->m_exceptions.importerror, "module not found: '%s'", modulename->data());
-                    return nullptr;
+                    fprintf(stderr, "nestcall: vmCallValue() failed\n");
+                    abort();
                 }
-                fprintf(stderr, "loading module from '%s'\n", physpath->data());
-                source = neon::File::readFile(physpath->data(), &fsz, false, 0);
-                if(source == nullptr)
+                needvm = true;
+                if(callable.isFuncnative())
                 {
-                    Memory::destroy(physpath);
-                    NEON_THROWCLASSWITHSOURCEINFO(gcs->m_exceptions.importerror, "could not read import file %s", physpath);
-                    Blob::destroy(&blob);
-                    return nullptr;
+                    needvm = false;
                 }
-                module = Module::make(modulename, physpath->data(), true, true);
-                Memory::destroy(physpath);
-                function = compileSourceIntern(module, source, &blob, false);
-                Memory::sysFree(source);
-                closure = Function::makeFuncClosure(function, Value::makeNull());
-                callable = Value::fromObject(closure);
-                gcs->vmNestCallPrepare(callable, Value::makeNull(), nullptr, 0);
-                if(!gcs->vmNestCallFunction(callable, Value::makeNull(), nullptr, 0, &retv, false))
+                if(needvm)
                 {
-                    Blob::destroy(&blob);
-                    NEON_THROWCLASSWITHSOURCEINFO(gcs->m_exceptions.importerror, "failed to call compiled import closure");
-                    return nullptr;
+                    status = runVM(m_vmstate.framecount - 1, nullptr);
+                    if(status != Status::Ok)
+                    {
+                        fprintf(stderr, "nestcall: call to runvm failed\n");
+                        abort();
+                    }
                 }
-                Blob::destroy(&blob);
-                return module;
+                rtv = m_vmstate.stackvalues[m_vmstate.stackidx - 1];
+                *dest = rtv;
+                vmStackPop(argc + 0);
+                m_vmstate.stackidx = pidx;
+                return true;
             }
 
-        public:
-            /* was this module imported? */
-            bool m_imported;
-            /* named exports */
-            HashTable<Value, Value> m_deftable;
-            /* the name of this module */
-            String* m_modname;
-            /* physsical location of this module, or nullptr if some other non-physical location */
-            String* m_physicalpath;
-            /* callback to call BEFORE this module is loaded */
-            ModLoaderFN m_fnpreloaderptr;
-            /* callbac to call AFTER this module is unloaded */
-            ModLoaderFN m_fnunloaderptr;
-            /* pointer that is based to preloader/unloader */
-            void* m_handle;
-
-        public:
-            void setInternFileField()
-            {
-                return;
-                m_deftable.set(Value::fromObject(String::intern("__file__")), Value::fromObject(String::copyObject(m_physicalpath)));
-            }
     };
 
-    class Range : public Object
+    SharedState* SharedState::m_myself = nullptr;
+
+    void* Memory::gcRealloc(void* ptr, size_t oldsize, size_t newsize)
+    {
+        void* result;
+        SharedState* gcs;
+        result = sysRealloc(ptr, newsize);
+        gcs = SharedState::get();
+        if((result != nullptr) && (gcs != nullptr))
+        {
+            gcs->gcAccountBuffer((int64_t)newsize - (int64_t)oldsize);
+        }
+        return result;
+    }
+
+    void Memory::gcFree(void* ptr, size_t size)
+    {
+        SharedState* gcs;
+        if(ptr == nullptr)
+        {
+            return;
+        }
+        sysFree(ptr);
+        gcs = SharedState::get();
+        if(gcs != nullptr)
+        {
+            gcs->gcAccountBuffer(-(int64_t)size);
+        }
+    }
+
+    class Array : public Object
     {
         public:
-            static Range* make(int lower, int upper)
+            ValList<Value> m_objvarray;
+
+        public:
+            static Array* makeFilled(size_t cnt, Value filler)
             {
-                Range* range;
-                range = SharedState::gcMakeObject<Range>(Object::OTYP_RANGE, false);
-                range->m_lower = lower;
-                range->m_upper = upper;
-                if(upper > lower)
-                {
-                    range->m_range = upper - lower;
-                }
-                else
+                size_t i;
+                Array* list;
+                list = SharedState::gcMakeObject<Array>(Object::OTYP_ARRAY, false);
+                if(cnt > 0)
                 {
-                    range->m_range = lower - upper;
+                    for(i = 0; i < cnt; i++)
+                    {
+                        list->push(filler);
+                    }
                 }
-                return range;
+                return list;
             }
 
-        public:
-            int m_lower;
-            int m_upper;
-            int m_range;
-    };
-
-    class Switch : public Object
-    {
-        public:
-            static Switch* make()
+            static Array* make()
             {
-                Switch* sw;
-                sw = SharedState::gcMakeObject<Switch>(Object::OTYP_SWITCH, false);
-                sw->m_table.initTable();
-                sw->m_defaultjump = -1;
-                sw->m_exitjump = -1;
-                return sw;
+                return makeFilled(0, Value::makeNull());
             }
 
-        public:
-            int m_defaultjump;
-            int m_exitjump;
-            HashTable<Value, Value> m_table;
-    };
+            NEON_INLINE void push(Value value)
+            {
+                auto gcs = SharedState::get();
+                (void)gcs;
+                /*gcs->vmStackPush(value);*/
+                m_objvarray.push(value);
+                /*gcs->vmStackPop(); */
+                SharedState::gcWriteBarrier(this, value);
+            }
 
-    class Userdata : public Object
-    {
-        public:
-            using PtrFreeFN = void(*)(void*);
+            NEON_INLINE size_t count() const
+            {
+                return m_objvarray.count();
+            }
 
-        public:
-            static Userdata* make(void* pointer, const char* name)
+            NEON_INLINE Value* data() const
             {
-                Userdata* ptr;
-                ptr = SharedState::gcMakeObject<Userdata>(Object::OTYP_USERDATA, false);
-                ptr->m_pointer = pointer;
-                ptr->m_udname = Util::stringDup(name);
-                ptr->m_ondestroyfn = nullptr;
-                return ptr;
+                return (Value*)m_objvarray.data();
             }
 
-        public:
-            void* m_pointer;
-            char* m_udname;
-            PtrFreeFN m_ondestroyfn;
-    };
+            NEON_INLINE bool pop(Value* dest)
+            {
+                return m_objvarray.pop(dest);
+            }
 
-    class ValPrinter
-    {
-        public:
-            ValPrinter(IOStream* pr) = delete;
+            NEON_INLINE bool set(size_t idx, Value val)
+            {
+                SharedState::gcWriteBarrier(this, val);
+                return m_objvarray.set(idx, val);
+            }
 
-            static void printValue(IOStream* pr, Value value, bool fixstring, bool invmethod)
+            NEON_INLINE bool get(size_t idx, Value* vdest) const
             {
-                if(value.isNull())
+                size_t vc;
+                vc = count();
+                if((vc > 0) && (idx < vc))
                 {
-                    pr->writeString("null");
+                    *vdest = m_objvarray.get(idx);
+                    return true;
                 }
-                else if(value.isBool())
+                return false;
+            }
+
+            NEON_INLINE Value get(size_t idx) const
+            {
+                Value vd;
+                if(get(idx, &vd))
                 {
-                    pr->writeString(value.asBool() ? "true" : "false");
+                    return vd;
                 }
-                else if(value.isNumber())
+                return Value::makeNull();
+            }
+
+            NEON_INLINE Array* copy(long start, long length)
+            {
+                size_t i;
+                Array* newlist;
+                newlist = Array::make();
+                if(start == -1)
                 {
-                    printNumber(pr, value);
+                    start = 0;
                 }
-                else
+                if(length == -1)
                 {
-                    printObject(pr, value, fixstring, invmethod);
+                    length = count() - start;
+                }
+                for(i = start; i < (size_t)(start + length); i++)
+                {
+                    newlist->push(get(i));
                 }
+                return newlist;
             }
+    };
 
-            static void printObject(IOStream* pr, Value value, bool fixstring, bool invmethod)
+    class Dict : public Object
+    {
+        public:
+            ValList<Value> m_htkeys;
+            HashTable<Value, Value> m_htvalues;
+
+        public:
+            static Dict* make()
             {
-                Object* obj;
-                obj = value.asObject();
-                switch(obj->m_objtype)
-                {
-                    case Object::OTYP_INVALID:
-                        {
-                        }
-                        break;
-                    case Object::OTYP_SWITCH:
-                        {
-                            pr->writeString("<switch>");
-                        }
-                        break;
-                    case Object::OTYP_USERDATA:
-                        {
-                            pr->format("<userdata %s>", value.asUserdata()->m_udname);
-                        }
-                        break;
-                    case Object::OTYP_RANGE:
-                        {
-                            Range* range;
-                            range = value.asRange();
-                            pr->format("<range %d .. %d>", range->m_lower, range->m_upper);
-                        }
-                        break;
-                    case Object::OTYP_FILE:
-                        {
-                            printFile(pr, value.asFile());
-                        }
-                        break;
-                    case Object::OTYP_DICT:
-                        {
-                            printDict(pr, value.asDict());
-                        }
-                        break;
-                    case Object::OTYP_ARRAY:
-                        {
-                            printArray(pr, value.asArray());
-                        }
-                        break;
-                    case Object::OTYP_FUNCBOUND:
-                        {
-                            Function* bn;
-                            bn = value.asFunction();
-                            printFunction(pr, bn->m_fnvals.fnmethod.method->m_fnvals.fnclosure.scriptfunc);
-                        }
-                        break;
-                    case Object::OTYP_MODULE:
-                        {
-                            Module* mod;
-                            mod = value.asModule();
-                            pr->format("<module '%.*s' at '%s'>", (int)mod->m_modname->length(), mod->m_modname->data(), mod->m_physicalpath->data());
-                        }
-                        break;
-                    case Object::OTYP_CLASS:
-                        {
-                            printClass(pr, value, fixstring, invmethod);
-                        }
-                        break;
-                    case Object::OTYP_FUNCCLOSURE:
-                        {
-                            Function* cls;
-                            cls = value.asFunction();
-                            printFunction(pr, cls->m_fnvals.fnclosure.scriptfunc);
-                        }
-                        break;
-                    case Object::OTYP_FUNCSCRIPT:
-                        {
-                            Function* fn;
-                            fn = value.asFunction();
-                            printFunction(pr, fn);
-                        }
-                        break;
-                    case Object::OTYP_INSTANCE:
-                        {
-                            /* @TODO: support the toString() override */
-                            Instance* instance;
-                            instance = value.asInstance();
-                            printInstance(pr, instance, invmethod);
-                        }
-                        break;
-                    case Object::OTYP_FUNCNATIVE:
-                        {
-                            Function* native;
-                            native = value.asFunction();
-                            pr->format("<function %s(native) at %p>", native->m_funcname->data(), (void*)native);
-                        }
-                        break;
-                    case Object::OTYP_UPVALUE:
-                        {
-                            pr->format("<upvalue>");
-                        }
-                        break;
-                    case Object::OTYP_STRING:
-                        {
-                            String* string;
-                            string = value.asString();
-                            if(fixstring)
-                            {
-                                pr->writeQuotedString(string->data(), string->length(), true);
-                            }
-                            else
-                            {
-                                pr->writeString(string->data(), string->length());
-                            }
-                        }
-                        break;
-                }
+                Dict* dict;
+                dict = SharedState::gcMakeObject<Dict>(Object::OTYP_DICT, false);
+                dict->m_htvalues.initTable(dict);
+                return dict;
             }
 
-            static void printNumber(IOStream* pr, Value value)
+            static void destroy(Dict* dict)
             {
-                double dn;
-                dn = value.asNumber();
-                pr->format("%.16g", dn);
+                dict->m_htkeys.deInit();
+                dict->m_htvalues.deInit();
             }
 
-            static void printFunction(IOStream* pr, Function* func)
+            bool set(Value key, Value value)
             {
-                if(func->m_funcname == nullptr)
-                {
-                    pr->format("<script at %p>", (void*)func);
-                }
-                else
+                Value tempvalue;
+                if(!m_htvalues.get(key, &tempvalue))
                 {
-                    if(func->m_fnvals.fnscriptfunc.isvariadic)
-                    {
-                        pr->format("<function %s(%d...) at %p>", func->m_funcname->data(), func->m_fnvals.fnscriptfunc.arity, (void*)func);
-                    }
-                    else
-                    {
-                        pr->format("<function %s(%d) at %p>", func->m_funcname->data(), func->m_fnvals.fnscriptfunc.arity, (void*)func);
-                    }
+                    /* add key if it doesn't exist. */
+                    m_htkeys.push(key);
                 }
+                return m_htvalues.set(key, value);
             }
 
-            static void printArray(IOStream* pr, Array* list)
+            void add(Value key, Value value)
             {
-                size_t i;
-                size_t vsz;
-                bool isrecur;
-                Value val;
-                Array* subarr;
-                vsz = list->count();
-                pr->format("[");
-                for(i = 0; i < vsz; i++)
-                {
-                    isrecur = false;
-                    val = list->get(i);
-                    if(val.isArray())
-                    {
-                        subarr = val.asArray();
-                        if(subarr == list)
-                        {
-                            isrecur = true;
-                        }
-                    }
-                    if(isrecur)
-                    {
-                        pr->format("<recursion>");
-                    }
-                    else
-                    {
-                        printValue(pr, val, true, true);
-                    }
-                    if(i != vsz - 1)
-                    {
-                        pr->format(",");
-                    }
-                    if(pr->m_shortenvalues && (i >= pr->m_maxvallength))
-                    {
-                        pr->format(" [%zd items]", vsz);
-                        break;
-                    }
-                }
-                pr->format("]");
+                set(key, value);
             }
 
-            static void printDict(IOStream* pr, Dict* dict)
+            void addStr(String* key, Value value)
+            {
+                add(Value::fromObject(key), value);
+            }
+
+            Property* get(Value key)
+            {
+                return m_htvalues.getfield(key);
+            }
+
+            Dict* copy()
             {
                 size_t i;
                 size_t dsz;
-                bool keyisrecur;
-                bool valisrecur;
-                Value val;
-                Dict* subdict;
-                dsz = dict->m_htkeys.count();
-                pr->format("{");
+                Value key;
+                Property* field;
+                Dict* ndict;
+                ndict = Dict::make();
+                /*
+                // @TODO: Figure out how to handle dictionary values correctly
+                // remember that copying keys is redundant and unnecessary
+                */
+                dsz = m_htkeys.count();
                 for(i = 0; i < dsz; i++)
                 {
-                    valisrecur = false;
-                    keyisrecur = false;
-                    val = dict->m_htkeys.get(i);
-                    if(val.isDict())
-                    {
-                        subdict = val.asDict();
-                        if(subdict == dict)
-                        {
-                            valisrecur = true;
-                        }
-                    }
-                    if(valisrecur)
+                    key = m_htkeys.get(i);
+                    field = m_htvalues.getfield(m_htkeys.get(i));
+                    ndict->m_htkeys.push(key);
+                    ndict->m_htvalues.setwithtype(key, field->value, field->m_fieldtype, key.isString());
+                }
+                return ndict;
+            }
+    };
+
+    class String : public Object
+    {
+        public:
+            static String* utilNumberToBinString(long n)
+            {
+                int i;
+                int rem;
+                int count;
+                int length;
+                long j;
+                /* assume maximum of 1024 bits */
+                char str[1024];
+                char newstr[1027];
+                count = 0;
+                j = n;
+                if(j == 0)
+                {
+                    str[count++] = '0';
+                }
+                while(j != 0)
+                {
+                    rem = abs((int)(j % 2));
+                    j /= 2;
+                    if(rem == 1)
                     {
-                        pr->format("<recursion>");
+                        str[count] = '1';
                     }
                     else
                     {
-                        printValue(pr, val, true, true);
+                        str[count] = '0';
                     }
-                    pr->format(": ");
-                    auto field = dict->m_htvalues.getfield(dict->m_htkeys.get(i));
-                    if(field != nullptr)
+                    count++;
+                }
+                /* assume maximum of 1024 bits + 0b (indicator) + sign (-). */
+                length = 0;
+                if(n < 0)
+                {
+                    newstr[length++] = '-';
+                }
+                newstr[length++] = '0';
+                newstr[length++] = 'b';
+                for(i = count - 1; i >= 0; i--)
+                {
+                    newstr[length++] = str[i];
+                }
+                newstr[length++] = 0;
+                return String::copy(newstr, length);
+                /*
+                //  // To store the binary number
+                //  int64_t number = 0;
+                //  int cnt = 0;
+                //  while (n != 0) {
+                //    int64_t rem = n % 2;
+                //    int64_t c = (int64_t) pow(10, cnt);
+                //    number += rem * c;
+                //    n /= 2;
+                //
+                //    // Count used to store exponent value
+                //    cnt++;
+                //  }
+                //
+                //  char str[67]; // assume maximum of 64 bits + 2 binary indicators (0b)
+                //  int length = sprintf(str, "0b%lld", number);
+                //
+                //  return String::copy(str, length);
+                */
+            }
+
+            static String* utilNumberToOctString(int64_t n, bool numeric)
+            {
+                int length;
+                /* assume maximum of 64 bits + 2 octal indicators (0c) */
+                char str[66];
+                length = sprintf(str, numeric ? "0c%lo" : "%lo", n);
+                return String::copy(str, length);
+            }
+
+            static String* utilNumberToHexString(int64_t n, bool numeric)
+            {
+                int length;
+                /* assume maximum of 64 bits + 2 hex indicators (0x) */
+                char str[66];
+                length = sprintf(str, numeric ? "0x%lx" : "%lx", n);
+                return String::copy(str, length);
+            }
+
+            static Value regexMatch(String* string, String* pattern, bool capture)
+            {
+                enum
+                {
+                    matchMaxTokens = 128 * 4,
+                    matchMaxCaptures = 128,
+                };
+                int prc;
+                int64_t i;
+                int64_t mtstart;
+                int64_t mtlength;
+                int64_t actualmaxcaptures;
+                int64_t cpres;
+                int16_t restokens;
+                int64_t capstarts[matchMaxCaptures + 1];
+                int64_t caplengths[matchMaxCaptures + 1];
+                RegexContext::Token tokens[matchMaxTokens + 1];
+                auto gcs = SharedState::get();
+                memset(tokens, 0, (matchMaxTokens + 1) * sizeof(RegexContext::Token));
+                memset(caplengths, 0, (matchMaxCaptures + 1) * sizeof(int64_t));
+                memset(capstarts, 0, (matchMaxCaptures + 1) * sizeof(int64_t));
+                const char* strstart;
+                String* rstr;
+                Array* oa;
+                Dict* dm;
+                restokens = matchMaxTokens;
+                actualmaxcaptures = 0;
+                RegexContext pctx(tokens, restokens);
+                if(capture)
+                {
+                    actualmaxcaptures = matchMaxCaptures;
+                }
+                prc = pctx.parse(pattern->data(), 0);
+                if(prc == 0)
+                {
+                    cpres = pctx.match(string->data(), 0, actualmaxcaptures, capstarts, caplengths);
+                    if(cpres > 0)
                     {
-                        if(field->value.isDict())
+                        if(capture)
                         {
-                            subdict = field->value.asDict();
-                            if(subdict == dict)
+                            oa = Array::make();
+                            for(i = 0; i < cpres; i++)
                             {
-                                keyisrecur = true;
+                                mtstart = capstarts[i];
+                                mtlength = caplengths[i];
+                                if(mtlength > 0)
+                                {
+                                    strstart = &string->data()[mtstart];
+                                    rstr = String::copy(strstart, mtlength);
+                                    dm = Dict::make();
+                                    dm->addStr(String::intern("string"), Value::fromObject(rstr));
+                                    dm->addStr(String::intern("start"), Value::makeNumber(mtstart));
+                                    dm->addStr(String::intern("length"), Value::makeNumber(mtlength));
+                                    oa->push(Value::fromObject(dm));
+                                }
                             }
-                        }
-                        if(keyisrecur)
-                        {
-                            pr->format("<recursion>");
+                            return Value::fromObject(oa);
                         }
                         else
                         {
-                            printValue(pr, field->value, true, true);
+                            return Value::makeBool(true);
                         }
                     }
-                    if(i != dsz - 1)
-                    {
-                        pr->format(", ");
-                    }
-                    if(pr->m_shortenvalues && (pr->m_maxvallength >= i))
-                    {
-                        pr->format(" [%zd items]", dsz);
-                        break;
-                    }
                 }
-                pr->format("}");
+                else
+                {
+                    NEON_THROWCLASSWITHSOURCEINFO(gcs->m_exceptions.regexerror, pctx.m_errorbuf);
+                }
+                RegexContext::destroy(&pctx);
+                if(capture)
+                {
+                    return Value::makeNull();
+                }
+                return Value::makeBool(false);
             }
 
-            static void printFile(IOStream* pr, File* file)
+            /* strings up to this long are interned by copy() and take(); see shouldIntern() */
+            static constexpr auto CONF_MAXINTERNLENGTH = 32;
+
+            /* concatenations shorter than this are copied right away; longer ones are made as ropes (see concat()) */
+            static constexpr auto CONF_MINROPELENGTH = 256;
+
+            /* substrings longer than this share the buffer of the string they are taken from (see slice()) */
+            static constexpr auto CONF_MINSLICELENGTH = CONF_MAXINTERNLENGTH;
+
+            /*
+            * interning costs a hash and a probe for every string that is made, and keeps an entry alive until
+            * the next collection; it only pays off for strings that are likely to be made again, and compared
+            * or looked up often. that is names and constants (see internCopy()), and short strings. longer
+            * strings are made as they are, and only hashed once they are used as a key.
+            */
+            static NEON_INLINE bool shouldIntern(size_t length)
             {
-                pr->format("<file at %s in mode %s>", file->m_path->data(), file->m_mode->data());
+                return (length <= CONF_MAXINTERNLENGTH);
             }
 
-            static void printInstance(IOStream* pr, Instance* instance, bool invmethod)
+            static void strtabStore(String* os)
             {
-                (void)invmethod;
-                pr->format("<instance of %s at %p>", instance->m_instanceclass->m_classname->data(), (void*)instance);
+                auto gcs = SharedState::get();
+                gcs->m_allocatedstrings.store(os);
             }
 
-            static void printTable(IOStream* pr, HashTable<Value, Value>* table)
+            static String* strTabFind(const char* str, size_t len, uint32_t hsv)
             {
-                size_t i;
-                size_t hcap;
-                hcap = table->capacity();
-                pr->format("{");
-                for(i = 0; i < (size_t)hcap; i++)
+                String* rs;
+                auto gcs = SharedState::get();
+                rs = gcs->m_allocatedstrings.findstring(str, len, hsv);
+                /* until the intern table is pruned, it may hold strings that marking found dead; the one handed out lives on */
+                if((rs != nullptr) && NEON_UNLIKELY(gcs->m_gcstate.phase == SharedState::GCP_PRUNE))
                 {
-                    auto entry = table->entryatindex(i);
-                    if(entry->key.isNull())
-                    {
-                        continue;
-                    }
-                    printValue(pr, entry->key, true, false);
-                    pr->format(":");
-                    printValue(pr, entry->value.value, true, false);
-                    auto nextentry = table->entryatindex(i + 1);
-                    if((nextentry != nullptr) && !nextentry->key.isNull())
-                    {
-                        if((i + 1) < (size_t)hcap)
-                        {
-                            pr->format(",");
-                        }
-                    }
+                    HeapPage::setMarked(rs);
                 }
-                pr->format("}");
+                return rs;
             }
 
-            static void printClass(IOStream* pr, Value value, bool fixstring, bool invmethod)
+            /*
+            * makes a string that is not interned, and takes over the data of $buf, which is left empty.
+            * $hsv may be 0 when the caller has not hashed the contents; see hash()
+            */
+            static String* makeFromStrbuf(StrBuffer& buf, uint32_t hsv, size_t length)
             {
-                bool oldexp;
-                Class* klass;
-                (void)fixstring;
-                (void)invmethod;
-                klass = value.asClass();
-                if(pr->m_jsonmode)
+                String* rs;
+                (void)length;
+                rs = SharedState::gcMakeObject<String>(Object::OTYP_STRING, false);
+                rs->m_sbuf.takeFrom(&buf);
+                rs->m_hashvalue = hsv;
+                return rs;
+            }
+
+            /* makes a string, and interns it; none with the same contents may be interned yet */
+            static String* makeInterned(StrBuffer& buf, uint32_t hsv, size_t length)
+            {
+                String* rs;
+                rs = makeFromStrbuf(buf, hsv, length);
+                if(length > 0)
                 {
-                    pr->format("{");
+                    strtabStore(rs);
+                }
+                return rs;
+            }
+
+            static String* takeImpl(char* strdata, int length, bool dointern)
+            {
+                uint32_t hsv;
+                String* rs;
+                hsv = 0;
+                if(dointern)
+                {
+                    hsv = Util::hashString(strdata, length);
+                    rs = strTabFind(strdata, length, hsv);
+                    if(rs != nullptr)
                     {
-                        {
-                            pr->format("name: ");
-                            ValPrinter::printValue(pr, Value::fromObject(klass->m_classname), true, false);
-                            pr->format(",");
-                        }
-                        {
-                            pr->format("superclass: ");
-                            oldexp = pr->m_jsonmode;
-                            pr->m_jsonmode = false;
-                            printValue(pr, Value::fromObject(klass->m_superclass), true, false);
-                            pr->m_jsonmode = oldexp;
-                            pr->format(",");
-                        }
-                        {
-                            pr->format("constructor: ");
-                            printValue(pr, klass->m_constructor, true, false);
-                            pr->format(",");
-                        }
-                        {
-                            pr->format("instanceproperties:");
-                            printTable(pr, &klass->m_instproperties);
-                            pr->format(",");
-                        }
-                        {
-                            pr->format("staticproperties:");
-                            printTable(pr, &klass->m_staticproperties);
-                            pr->format(",");
-                        }
-                        {
-                            pr->format("instancemethods:");
-                            printTable(pr, &klass->m_instmethods);
-                            pr->format(",");
-                        }
-                        {
-                            pr->format("staticmethods:");
-                            printTable(pr, &klass->m_staticmethods);
-                        }
+                        Memory::sysFree(strdata);
+                        return rs;
                     }
-                    pr->format("}");
                 }
-                else
+                /* the string owns $strdata from now on, so it counts towards the heap like its own buffers do */
+                StrBuffer buf(0);
+                buf.setData(strdata);
+                buf.setLength(length);
+                buf.m_capacity = length + 1;
+                SharedState::get()->gcAccountBuffer(length + 1);
+                if(dointern)
                 {
-                    pr->format("<class %s at %p>", klass->m_classname->data(), (void*)klass);
+                    return makeInterned(buf, hsv, length);
                 }
+                return makeFromStrbuf(buf, hsv, length);
             }
-    };
 
-    class FormatInfo
-    {
-        public:
-            /* length of the format string */
-            size_t m_fmtlen;
-            /* the actual format string */
-            const char* m_fmtstr;
-            IOStream* m_writer;
+            static String* copyImpl(const char* strdata, int length, bool dointern)
+            {
+                uint32_t hsv;
+                String* rs;
+                if(length == 0)
+                {
+                    return intern(strdata, length);
+                }
+                hsv = 0;
+                if(dointern)
+                {
+                    hsv = Util::hashString(strdata, length);
+                    rs = strTabFind(strdata, length, hsv);
+                    if(rs != nullptr)
+                    {
+                        return rs;
+                    }
+                }
+                StrBuffer sb(length);
+                sb.append(strdata, length);
+                if(dointern)
+                {
+                    return makeInterned(sb, hsv, length);
+                }
+                return makeFromStrbuf(sb, hsv, length);
+            }
 
-        public:
-            FormatInfo(IOStream* writer, const char* fmtstr, size_t fmtlen)
+            static void destroy(String* str)
             {
-                m_fmtstr = fmtstr;
-                m_fmtlen = fmtlen;
-                m_writer = writer;
+                StrBuffer::destroyFromPtr(&str->m_sbuf);
             }
 
-            bool formatWithArgs(size_t argc, size_t argbegin, Value* argv)
+            /*
+            * makes a string of $a followed by $b, which must be reachable from a root.
+            * a long result is made as a rope: a node that only refers to both, and is flattened once its
+            * contents are needed (see ensureFlat()). so building a string by appending pieces in a loop
+            * copies every piece once when the result is used, instead of everything so far on every step.
+            */
+            static String* concat(String* a, String* b)
             {
-                int ch;
-                int ival;
-                int nextch;
-                bool ok;
-                size_t i;
-                size_t argpos;
-                Value cval;
-                i = 0;
-                auto gcs = SharedState::get();
-                argpos = argbegin;
-                ok = true;
-                while(i < m_fmtlen)
+                size_t alen;
+                size_t blen;
+                String* rs;
+                alen = a->length();
+                blen = b->length();
+                if((alen + blen) < CONF_MINROPELENGTH)
                 {
-                    ch = m_fmtstr[i];
-                    nextch = -1;
-                    if((i + 1) < m_fmtlen)
-                    {
-                        nextch = m_fmtstr[i + 1];
-                    }
-                    i++;
-                    if(ch == '%')
+                    StrBuffer sb(alen + blen);
+                    sb.append(a->rawData(), alen);
+                    sb.append(b->rawData(), blen);
+                    return makeFromStrbuf(sb, 0, alen + blen);
+                }
+                rs = SharedState::gcMakeObject<String>(Object::OTYP_STRING, false);
+                rs->m_ropeleft = a;
+                rs->m_roperight = b;
+                rs->m_sbuf.setLength(alen + blen);
+                return rs;
+            }
+
+            /*
+            * makes a string of $length bytes of $parent from $start on, which must be in range.
+            * a long result is made as a slice: it refers to the buffer of $parent instead of copying it.
+            * the reference does not keep $parent alive; if nothing else does, the slice is given a copy
+            * of its own before $parent is freed (see SharedState::gcPruneSlices()), so that a short slice
+            * does not pin a large string. short results are copied, and interned like any short string.
+            */
+            static String* slice(String* parent, size_t start, size_t length)
+            {
+                String* rs;
+                if(length <= CONF_MINSLICELENGTH)
+                {
+                    return copy(parent->rawData() + start, length);
+                }
+                /* made first, since a collection could give a slice $parent a buffer of its own */
+                rs = SharedState::gcMakeObject<String>(Object::OTYP_STRING, false);
+                parent->ensureFlat();
+                if(parent->m_sliceparent != nullptr)
+                {
+                    start += (parent->m_sbuf.data() - parent->m_sliceparent->m_sbuf.data());
+                    parent = parent->m_sliceparent;
+                }
+                rs->m_sbuf.m_isintern = true;
+                rs->m_sbuf.setData(parent->m_sbuf.data() + start);
+                rs->m_sbuf.setLength(length);
+                rs->m_sliceparent = parent;
+                parent->m_hasslices = true;
+                SharedState::get()->gcAddSlice(rs);
+                return rs;
+            }
+
+            static String* intern(const char* strdata, int length)
+            {
+                uint32_t hsv;
+                String* rs;
+                hsv = Util::hashString(strdata, length);
+                rs = strTabFind(strdata, length, hsv);
+                if(rs != nullptr)
+                {
+                    return rs;
+                }
+                StrBuffer buf(0);
+                buf.m_isintern = true;
+                buf.setData(strdata);
+                buf.setLength(length);
+                return makeInterned(buf, hsv, length);
+            }
+
+            static String* intern(const char* strdata)
+            {
+                return intern(strdata, strlen(strdata));
+            }
+
+            static String* take(char* strdata, int length)
+            {
+                return takeImpl(strdata, length, shouldIntern(length));
+            }
+
+            static String* take(char* strdata)
+            {
+                return take(strdata, strlen(strdata));
+            }
+
+            static String* copy(const char* strdata, int length)
+            {
+                return copyImpl(strdata, length, shouldIntern(length));
+            }
+
+            /* like copy() and take(), but interns whatever the length; for names and constants made by the compiler */
+            static String* internCopy(const char* strdata, int length)
+            {
+                return copyImpl(strdata, length, true);
+            }
+
+            static String* internTake(char* strdata, int length)
+            {
+                return takeImpl(strdata, length, true);
+            }
+
+            static String* copy(const char* strdata)
+            {
+                return copy(strdata, strlen(strdata));
+            }
+
+            static String* copyObject(String* origos)
+            {
+                return copy(origos->data(), origos->length());
+            }
+
+        public:
+            /* 0 until hash() is first called, unless the hash was known when the string was made */
+            uint32_t m_hashvalue;
+            /* for a rope, $m_sbuf has no data, only the length of both parts together */
+            StrBuffer m_sbuf;
+            String* m_ropeleft = nullptr;
+            String* m_roperight = nullptr;
+            /* for a slice, the string whose buffer $m_sbuf borrows; see slice() */
+            String* m_sliceparent = nullptr;
+            /* set once a slice was taken from this string; they have to be copied before it is changed */
+            bool m_hasslices = false;
+
+        private:
+            /*
+            * copies the leaves of this rope into one buffer, left to right, and forgets the parts.
+            * parts that are ropes themselves are walked, but left as they are, since they may be
+            * referred to elsewhere. the walk keeps the right parts on a stack of its own, since ropes
+            * built in a loop are as deep as the loop ran.
+            */
+            void flatten()
+            {
+                size_t count;
+                size_t capacity;
+                String* node;
+                String** stack;
+                StrBuffer sb(m_sbuf.length());
+                stack = nullptr;
+                count = 0;
+                capacity = 0;
+                node = this;
+                while(true)
+                {
+                    while(node->m_ropeleft != nullptr)
                     {
-                        if(nextch == '%')
-                        {
-                            m_writer->writeChar('%');
-                        }
-                        else
+                        if(count == capacity)
                         {
-                            i++;
-                            if(argpos > argc)
-                            {
-                                NEON_THROWCLASSWITHSOURCEINFO(gcs->m_exceptions.argumenterror, "too few arguments");
-                                ok = false;
-                                cval = Value::makeNull();
-                            }
-                            else
-                            {
-                                cval = argv[argpos];
-                            }
-                            argpos++;
-                            switch(nextch)
-                            {
-                                case 'q':
-                                case 'p':
-                                {
-                                    ValPrinter::printValue(m_writer, cval, true, true);
-                                }
-                                break;
-                                case 'c':
-                                {
-                                    ival = (int)cval.asNumber();
-                                    m_writer->format("%c", ival);
-                                }
-                                break;
-                                /* TODO: implement actual field formatting */
-                                case 's':
-                                case 'd':
-                                case 'i':
-                                case 'g':
-                                {
-                                    ValPrinter::printValue(m_writer, cval, false, true);
-                                }
-                                break;
-                                default:
-                                {
-                                    NEON_THROWCLASSWITHSOURCEINFO(gcs->m_exceptions.argumenterror, "unknown/invalid format flag '%%c'", nextch);
-                                }
-                                break;
-                            }
+                            capacity = Memory::getNextCapacity(capacity);
+                            stack = (String**)Memory::sysRealloc(stack, sizeof(String*) * capacity);
                         }
+                        stack[count] = node->m_roperight;
+                        count++;
+                        node = node->m_ropeleft;
                     }
-                    else
+                    sb.append(node->m_sbuf.data(), node->m_sbuf.length());
+                    if(count == 0)
                     {
-                        m_writer->writeChar(ch);
+                        break;
                     }
+                    count--;
+                    node = stack[count];
                 }
-                return ok;
+                Memory::sysFree(stack);
+                m_ropeleft = nullptr;
+                m_roperight = nullptr;
+                m_sbuf.takeFrom(&sb);
             }
-    };
 
-    class AstToken
-    {
         public:
-            enum Type
+            NEON_INLINE bool isRope() const
             {
-                T_NEWLINE,
-                T_PARENOPEN,
-                T_PARENCLOSE,
-                T_BRACKETOPEN,
-                T_BRACKETCLOSE,
-                T_BRACEOPEN,
-                T_BRACECLOSE,
-                T_SEMICOLON,
-                T_COMMA,
-                T_BACKSLASH,
-                T_EXCLMARK,
-                T_NOTEQUAL,
-                T_COLON,
-                T_AT,
-                T_DOT,
-                T_DOUBLEDOT,
-                T_TRIPLEDOT,
-                T_PLUS,
-                T_PLUSASSIGN,
-                T_INCREMENT,
-                T_MINUS,
-                T_MINUSASSIGN,
-                T_DECREMENT,
-                T_MULTIPLY,
-                T_MULTASSIGN,
-                T_POWEROF,
-                T_POWASSIGN,
-                T_DIVIDE,
-                T_DIVASSIGN,
-                T_ASSIGN,
-                T_EQUAL,
-                T_LESSTHAN,
-                T_LESSEQUAL,
-                T_LEFTSHIFT,
-                T_LEFTSHIFTASSIGN,
-                T_GREATERTHAN,
-                T_GREATER_EQ,
-                T_RIGHTSHIFT,
-                T_RIGHTSHIFTASSIGN,
-                T_MODULO,
-                T_PERCENT_EQ,
-                T_AMP,
-                T_AMP_EQ,
-                T_BAR,
-                T_BAR_EQ,
-                T_TILDE,
-                T_TILDE_EQ,
-                T_XOR,
-                T_XOR_EQ,
-                T_QUESTION,
-                T_KWAND,
-                T_KWAS,
-                T_KWASSERT,
-                T_KWBREAK,
-                T_KWCATCH,
-                T_KWCLASS,
-                T_KWCONTINUE,
-                T_KWFUNCTION,
-                T_KWDEFAULT,
-                T_KWTHROW,
-                T_KWDO,
-                T_KWECHO,
-                T_KWELSE,
-                T_KWFALSE,
-                T_KWFINALLY,
-                T_KWFOREACH,
-                T_KWIF,
-                T_KWIN,
-                T_KWINSTANCEOF,
-                T_KWFOR,
-                T_KWNULL,
-                T_KWNEW,
-                T_KWOR,
-                T_KWSUPER,
-                T_KWRETURN,
-                T_KWTHIS,
-                T_KWSTATIC,
-                T_KWTRUE,
-                T_KWTRY,
-                T_KWTYPEOF,
-                T_KWSWITCH,
-                T_KWVAR,
-                T_KWCONST,
-                T_KWCASE,
-                T_KWWHILE,
-                T_KWEXTENDS,
-                T_LITERALSTRING,
-                T_LITERALRAWSTRING,
-                T_LITNUMREG,
-                T_LITNUMBIN,
-                T_LITNUMOCT,
-                T_LITNUMHEX,
-                T_IDENTNORMAL,
-                T_DECORATOR,
-                T_INTERPOLATION,
-                T_EOF,
-                T_ERROR,
-                T_KWEMPTY,
-                T_UNDEFINED,
-                T_TOKCOUNT
-            };
+                return (m_ropeleft != nullptr);
+            }
 
-        public:
-            bool isglobal;
-            Type m_toktype;
-            const char* m_start;
-            int length;
-            int m_line;
-    };
+            NEON_INLINE bool isSlice() const
+            {
+                return (m_sliceparent != nullptr);
+            }
 
-    class AstLexer
-    {
-        public:
-            enum
+            /* gives a slice a copy of the bytes it borrows, so that it no longer depends on its parent */
+            void unshare()
             {
-                /* how deep template strings can be nested (i.e., "foo${getBar("quux${getBonk("...")}")}") */
-                MaxStrTplDepth = 8,
-            };
+                size_t length;
+                length = m_sbuf.length();
+                StrBuffer sb(length);
+                sb.append(m_sbuf.data(), length);
+                m_sbuf.takeFrom(&sb);
+                m_sliceparent = nullptr;
+            }
 
-        public:
-            static bool lexUtilIsDigit(char c)
+            /* contents are read and written through $m_sbuf, so a rope is flattened first */
+            NEON_INLINE void ensureFlat()
             {
-                return c >= '0' && c <= '9';
+                if(NEON_UNLIKELY(m_ropeleft != nullptr))
+                {
+                    flatten();
+                }
             }
 
-            static bool lexUtilIsBinary(char c)
+            NEON_INLINE uint32_t hash()
             {
-                return c == '0' || c == '1';
+                if(NEON_UNLIKELY(m_hashvalue == 0))
+                {
+                    ensureFlat();
+                    m_hashvalue = Util::hashString(m_sbuf.data(), m_sbuf.length());
+                }
+                return m_hashvalue;
             }
 
-            static bool lexUtilIsAlpha(char c)
+            /*
+            * the bytes of a slice are followed by the rest of its parent, not by a NUL byte;
+            * unless it ends where its parent does, it is given a copy of its own.
+            */
+            NEON_INLINE void ensureTerminated()
             {
-                return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+                ensureFlat();
+                if(NEON_UNLIKELY(m_sliceparent != nullptr) && (m_sbuf.data()[m_sbuf.length()] != '\0'))
+                {
+                    unshare();
+                }
             }
 
-            static bool lexUtilIsOctal(char c)
+            /* before the contents change, they must not be shared with a parent or with slices */
+            NEON_INLINE void ensureMutable()
             {
-                return c >= '0' && c <= '7';
+                ensureFlat();
+                if(NEON_UNLIKELY(m_sliceparent != nullptr))
+                {
+                    unshare();
+                }
+                if(NEON_UNLIKELY(m_hasslices))
+                {
+                    SharedState::get()->gcUnshareSlicesOf(this);
+                    m_hasslices = false;
+                }
             }
 
-            static bool lexUtilIsHexadecimal(char c)
+            /* the contents as a NUL-terminated string. neither flattening nor unsharing changes them, so this counts as const */
+            const char* data() const
             {
-                return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+                const_cast<String*>(this)->ensureTerminated();
+                return m_sbuf.data();
             }
 
-            static const char* tokTypeToString(int t)
+            /* the contents, which need not be followed by a NUL byte; for callers that go by length() */
+            const char* rawData() const
             {
-                switch(t)
+                const_cast<String*>(this)->ensureFlat();
+                return m_sbuf.data();
+            }
+
+            char* mutdata()
+            {
+                ensureMutable();
+                return m_sbuf.data();
+            }
+
+            size_t length() const
+            {
+                return m_sbuf.length();
+            }
+
+            bool setLength(size_t nlen)
+            {
+                ensureMutable();
+                m_sbuf.setLength(nlen);
+                return true;
+            }
+
+            bool set(size_t idx, int byte)
+            {
+                ensureMutable();
+                m_sbuf.set(idx, byte);
+                return true;
+            }
+
+            int get(size_t idx)
+            {
+                ensureFlat();
+                return m_sbuf.get(idx);
+            }
+
+            bool append(const char* str, size_t len)
+            {
+                ensureMutable();
+                return m_sbuf.append(str, len);
+            }
+
+            bool append(const char* str)
+            {
+                return append(str, strlen(str));
+            }
+
+            bool appendObject(String* other)
+            {
+                return append(other->rawData(), other->length());
+            }
+
+            bool appendByte(int ch)
+            {
+                char cch = ch;
+                ensureMutable();
+                return m_sbuf.append(&cch, 1);
+            }
+
+            template<typename... ArgsT>
+            int appendfmt(const char* fmt, ArgsT&&... args)
+            {
+                ensureMutable();
+                return m_sbuf.appendFormat(fmt, args...);
+            }
+
+            /* at most $maxlen bytes from $start on; see slice() */
+            String* substr(size_t start, size_t maxlen)
+            {
+                size_t len;
+                len = length();
+                if(start > len)
                 {
-                    case AstToken::T_NEWLINE:
-                        return "AstToken::T_NEWLINE";
-                    case AstToken::T_PARENOPEN:
-                        return "AstToken::T_PARENOPEN";
-                    case AstToken::T_PARENCLOSE:
-                        return "AstToken::T_PARENCLOSE";
-                    case AstToken::T_BRACKETOPEN:
-                        return "AstToken::T_BRACKETOPEN";
-                    case AstToken::T_BRACKETCLOSE:
-                        return "AstToken::T_BRACKETCLOSE";
-                    case AstToken::T_BRACEOPEN:
-                        return "AstToken::T_BRACEOPEN";
-                    case AstToken::T_BRACECLOSE:
-                        return "AstToken::T_BRACECLOSE";
-                    case AstToken::T_SEMICOLON:
-                        return "AstToken::T_SEMICOLON";
-                    case AstToken::T_COMMA:
-                        return "AstToken::T_COMMA";
-                    case AstToken::T_BACKSLASH:
-                        return "AstToken::T_BACKSLASH";
-                    case AstToken::T_EXCLMARK:
-                        return "AstToken::T_EXCLMARK";
-                    case AstToken::T_NOTEQUAL:
-                        return "AstToken::T_NOTEQUAL";
-                    case AstToken::T_COLON:
-                        return "AstToken::T_COLON";
-                    case AstToken::T_AT:
-                        return "AstToken::T_AT";
-                    case AstToken::T_DOT:
-                        return "AstToken::T_DOT";
-                    case AstToken::T_DOUBLEDOT:
-                        return "AstToken::T_DOUBLEDOT";
-                    case AstToken::T_TRIPLEDOT:
-                        return "AstToken::T_TRIPLEDOT";
-                    case AstToken::T_PLUS:
-                        return "AstToken::T_PLUS";
-                    case AstToken::T_PLUSASSIGN:
-                        return "AstToken::T_PLUSASSIGN";
-                    case AstToken::T_INCREMENT:
-                        return "AstToken::T_INCREMENT";
-                    case AstToken::T_MINUS:
-                        return "AstToken::T_MINUS";
-                    case AstToken::T_MINUSASSIGN:
-                        return "AstToken::T_MINUSASSIGN";
-                    case AstToken::T_DECREMENT:
-                        return "AstToken::T_DECREMENT";
-                    case AstToken::T_MULTIPLY:
-                        return "AstToken::T_MULTIPLY";
-                    case AstToken::T_MULTASSIGN:
-                        return "AstToken::T_MULTASSIGN";
-                    case AstToken::T_POWEROF:
-                        return "AstToken::T_POWEROF";
-                    case AstToken::T_POWASSIGN:
-                        return "AstToken::T_POWASSIGN";
-                    case AstToken::T_DIVIDE:
-                        return "AstToken::T_DIVIDE";
-                    case AstToken::T_DIVASSIGN:
-                        return "AstToken::T_DIVASSIGN";
-                    case AstToken::T_ASSIGN:
-                        return "AstToken::T_ASSIGN";
-                    case AstToken::T_EQUAL:
-                        return "AstToken::T_EQUAL";
-                    case AstToken::T_LESSTHAN:
-                        return "AstToken::T_LESSTHAN";
-                    case AstToken::T_LESSEQUAL:
-                        return "AstToken::T_LESSEQUAL";
-                    case AstToken::T_LEFTSHIFT:
-                        return "AstToken::T_LEFTSHIFT";
-                    case AstToken::T_LEFTSHIFTASSIGN:
-                        return "AstToken::T_LEFTSHIFTASSIGN";
-                    case AstToken::T_GREATERTHAN:
-                        return "AstToken::T_GREATERTHAN";
-                    case AstToken::T_GREATER_EQ:
-                        return "AstToken::T_GREATER_EQ";
-                    case AstToken::T_RIGHTSHIFT:
-                        return "AstToken::T_RIGHTSHIFT";
-                    case AstToken::T_RIGHTSHIFTASSIGN:
-                        return "AstToken::T_RIGHTSHIFTASSIGN";
-                    case AstToken::T_MODULO:
-                        return "AstToken::T_MODULO";
-                    case AstToken::T_PERCENT_EQ:
-                        return "AstToken::T_PERCENT_EQ";
-                    case AstToken::T_AMP:
-                        return "AstToken::T_AMP";
-                    case AstToken::T_AMP_EQ:
-                        return "AstToken::T_AMP_EQ";
-                    case AstToken::T_BAR:
-                        return "AstToken::T_BAR";
-                    case AstToken::T_BAR_EQ:
-                        return "AstToken::T_BAR_EQ";
-                    case AstToken::T_TILDE:
-                        return "AstToken::T_TILDE";
-                    case AstToken::T_TILDE_EQ:
-                        return "AstToken::T_TILDE_EQ";
-                    case AstToken::T_XOR:
-                        return "AstToken::T_XOR";
-                    case AstToken::T_XOR_EQ:
-                        return "AstToken::T_XOR_EQ";
-                    case AstToken::T_QUESTION:
-                        return "AstToken::T_QUESTION";
-                    case AstToken::T_KWAND:
-                        return "AstToken::T_KWAND";
-                    case AstToken::T_KWAS:
-                        return "AstToken::T_KWAS";
-                    case AstToken::T_KWASSERT:
-                        return "AstToken::T_KWASSERT";
-                    case AstToken::T_KWBREAK:
-                        return "AstToken::T_KWBREAK";
-                    case AstToken::T_KWCATCH:
-                        return "AstToken::T_KWCATCH";
-                    case AstToken::T_KWCLASS:
-                        return "AstToken::T_KWCLASS";
-                    case AstToken::T_KWCONTINUE:
-                        return "AstToken::T_KWCONTINUE";
-                    case AstToken::T_KWFUNCTION:
-                        return "AstToken::T_KWFUNCTION";
-                    case AstToken::T_KWDEFAULT:
-                        return "AstToken::T_KWDEFAULT";
-                    case AstToken::T_KWTHROW:
-                        return "AstToken::T_KWTHROW";
-                    case AstToken::T_KWDO:
-                        return "AstToken::T_KWDO";
-                    case AstToken::T_KWECHO:
-                        return "AstToken::T_KWECHO";
-                    case AstToken::T_KWELSE:
-                        return "AstToken::T_KWELSE";
-                    case AstToken::T_KWFALSE:
-                        return "AstToken::T_KWFALSE";
-                    case AstToken::T_KWFINALLY:
-                        return "AstToken::T_KWFINALLY";
-                    case AstToken::T_KWFOREACH:
-                        return "AstToken::T_KWFOREACH";
-                    case AstToken::T_KWIF:
-                        return "AstToken::T_KWIF";
-                    case AstToken::T_KWIN:
-                        return "AstToken::T_KWIN";
-                    case AstToken::T_KWFOR:
-                        return "AstToken::T_KWFOR";
-                    case AstToken::T_KWNULL:
-                        return "AstToken::T_KWNULL";
-                    case AstToken::T_KWNEW:
-                        return "AstToken::T_KWNEW";
-                    case AstToken::T_KWOR:
-                        return "AstToken::T_KWOR";
-                    case AstToken::T_KWSUPER:
-                        return "AstToken::T_KWSUPER";
-                    case AstToken::T_KWRETURN:
-                        return "AstToken::T_KWRETURN";
-                    case AstToken::T_KWTHIS:
-                        return "AstToken::T_KWTHIS";
-                    case AstToken::T_KWSTATIC:
-                        return "AstToken::T_KWSTATIC";
-                    case AstToken::T_KWTRUE:
-                        return "AstToken::T_KWTRUE";
-                    case AstToken::T_KWTRY:
-                        return "AstToken::T_KWTRY";
-                    case AstToken::T_KWSWITCH:
-                        return "AstToken::T_KWSWITCH";
-                    case AstToken::T_KWVAR:
-                        return "AstToken::T_KWVAR";
-                    case AstToken::T_KWCONST:
-                        return "AstToken::T_KWCONST";
-                    case AstToken::T_KWCASE:
-                        return "AstToken::T_KWCASE";
-                    case AstToken::T_KWWHILE:
-                        return "AstToken::T_KWWHILE";
-                    case AstToken::T_KWINSTANCEOF:
-                        return "AstToken::T_KWINSTANCEOF";
-                    case AstToken::T_KWEXTENDS:
-                        return "AstToken::T_KWEXTENDS";
-                    case AstToken::T_LITERALSTRING:
-                        return "AstToken::T_LITERALSTRING";
-                    case AstToken::T_LITERALRAWSTRING:
-                        return "AstToken::T_LITERALRAWSTRING";
-                    case AstToken::T_LITNUMREG:
-                        return "AstToken::T_LITNUMREG";
-                    case AstToken::T_LITNUMBIN:
-                        return "AstToken::T_LITNUMBIN";
-                    case AstToken::T_LITNUMOCT:
-                        return "AstToken::T_LITNUMOCT";
-                    case AstToken::T_LITNUMHEX:
-                        return "AstToken::T_LITNUMHEX";
-                    case AstToken::T_IDENTNORMAL:
-                        return "AstToken::T_IDENTNORMAL";
-                    case AstToken::T_DECORATOR:
-                        return "AstToken::T_DECORATOR";
-                    case AstToken::T_INTERPOLATION:
-                        return "AstToken::T_INTERPOLATION";
-                    case AstToken::T_EOF:
-                        return "AstToken::T_EOF";
-                    case AstToken::T_ERROR:
-                        return "AstToken::T_ERROR";
-                    case AstToken::T_KWEMPTY:
-                        return "AstToken::T_KWEMPTY";
-                    case AstToken::T_UNDEFINED:
-                        return "AstToken::T_UNDEFINED";
-                    case AstToken::T_TOKCOUNT:
-                        return "AstToken::T_TOKCOUNT";
+                    start = len;
                 }
-                return "?invalid?";
-            }
-
-            static AstLexer* make(const char* source)
-            {
-                AstLexer* lex;
-                lex = Memory::make<AstLexer>();
-                lex->init(source);
-                lex->m_onstack = false;
-                return lex;
+                if(maxlen > (len - start))
+                {
+                    maxlen = len - start;
+                }
+                return slice(this, start, maxlen);
             }
 
-            static void destroy(AstLexer* lex)
+            String* substring(size_t start, size_t end, bool likejs)
             {
-                if(!lex->m_onstack)
+                size_t len;
+                size_t tmp;
+                size_t maxlen;
+                (void)likejs;
+                maxlen = length();
+                if(end > maxlen)
                 {
-                    Memory::sysFree(lex);
+                    tmp = start;
+                    start = end;
+                    end = tmp;
+                }
+                if(end < start)
+                {
+                    tmp = end;
+                    end = start;
+                    start = tmp;
                 }
+                len = (end - start);
+                return substr(start, len);
             }
 
-        public:
-            bool m_onstack;
-            const char* m_start;
-            const char* m_sourceptr;
-            int m_line;
-            int m_tplstringcount;
-            int m_tplstringbuffer[MaxStrTplDepth];
-
-        public:
-            /*
-             * allows for the lexer to created on the stack.
-             */
-            void init(const char* source)
+            String* substr(size_t start)
             {
-                m_sourceptr = source;
-                m_start = source;
-                m_sourceptr = m_start;
-                m_line = 1;
-                m_tplstringcount = -1;
-                m_onstack = true;
+                return substr(start, length());
             }
+    };
 
-            bool isatend()
+    class Upvalue : public Object
+    {
+        public:
+            static Upvalue* make(Value* slot, int stackpos)
             {
-                return *m_sourceptr == '\0';
+                Upvalue* upvalue;
+                upvalue = SharedState::gcMakeObject<Upvalue>(Object::OTYP_UPVALUE, false);
+                upvalue->m_closed = Value::makeNull();
+                upvalue->m_location = *slot;
+                upvalue->m_next = nullptr;
+                upvalue->m_stackpos = stackpos;
+                return upvalue;
             }
 
-            AstToken createtoken(AstToken::Type type)
+        public:
+            int m_stackpos;
+            Value m_closed;
+            Value m_location;
+            Upvalue* m_next;
+
+    };
+
+    class Function : public Object
+    {
+        public:
+            enum ContextType
             {
-                AstToken t;
-                t.isglobal = false;
-                t.m_toktype = type;
-                t.m_start = m_start;
-                t.length = (int)(m_sourceptr - m_start);
-                t.m_line = m_line;
-                return t;
-            }
+                CTXTYPE_ANONYMOUS,
+                CTXTYPE_FUNCTION,
+                CTXTYPE_METHOD,
+                CTXTYPE_INITIALIZER,
+                CTXTYPE_PRIVATE,
+                CTXTYPE_STATIC,
+                CTXTYPE_SCRIPT
+            };
 
-            template<typename... ArgsT>
-            AstToken errortoken(const char* fmt, ArgsT&&... args)
+        public:
+            static NEON_INLINE Function::ContextType getMethodType(Value method)
             {
-                constexpr static auto tmpsprintf = sprintf;
-                int length;
-                char* buf;
-                AstToken t;
-                buf = (char*)Memory::sysMalloc(sizeof(char) * 1024);
-                /* TODO: used to be vasprintf. need to check how much to actually allocate! */
-                length = tmpsprintf(buf, fmt, args...);
-                t.m_toktype = AstToken::T_ERROR;
-                t.m_start = buf;
-                t.isglobal = false;
-                if(buf != nullptr)
-                {
-                    t.length = length;
-                }
-                else
+                Function* ofn;
+                ofn = method.asFunction();
+                switch(method.objType())
                 {
-                    t.length = 0;
+                    case Object::OTYP_FUNCNATIVE:
+                        return ofn->m_contexttype;
+                    case Object::OTYP_FUNCCLOSURE:
+                        return ofn->m_fnvals.fnclosure.scriptfunc->m_contexttype;
+                    default:
+                        break;
                 }
-                t.m_line = m_line;
-                return t;
+                return Function::CTXTYPE_FUNCTION;
             }
 
-            char advance()
-            {
-                m_sourceptr++;
-                if(m_sourceptr[-1] == '\n')
-                {
-                    m_line++;
-                }
-                return m_sourceptr[-1];
-            }
-
-            bool match(char expected)
+        public:
+            ContextType m_contexttype;
+            String* m_funcname;
+            int m_upvalcount;
+            Value m_clsthisval;
+            union FuncUnion
             {
-                if(isatend())
+                struct FNDataClosure
                 {
-                    return false;
-                }
-                if(*m_sourceptr != expected)
+                    Function* scriptfunc;
+                    Upvalue** m_upvalues;
+                } fnclosure;
+                struct FNDataScriptFunc
                 {
-                    return false;
-                }
-                m_sourceptr++;
-                if(m_sourceptr[-1] == '\n')
+                    int arity;
+                    bool isvariadic;
+                    Blob* blob;
+                    Module* module;
+                } fnscriptfunc;
+                struct FNDataNativeFunc
                 {
-                    m_line++;
-                }
-                return true;
+                    NativeFN natfunc;
+                    void* userptr;
+                } fnnativefunc;
+                struct FNDataMethod
+                {
+                    Value receiver;
+                    Function* method;
+                } fnmethod;
+            } m_fnvals;
+
+        public:
+            static Function* makeFuncGeneric(String* name, Object::Type fntype, Value thisval)
+            {
+                Function* ofn;
+                ofn = SharedState::gcMakeObject<Function>(fntype, false);
+                ofn->m_clsthisval = thisval;
+                ofn->m_funcname = name;
+                return ofn;
             }
 
-            char peekcurr()
+            static Function* makeFuncBound(Value receiver, Function* method)
             {
-                return *m_sourceptr;
+                Function* ofn;
+                ofn = makeFuncGeneric(method->m_funcname, Object::OTYP_FUNCBOUND, Value::makeNull());
+                ofn->m_fnvals.fnmethod.receiver = receiver;
+                ofn->m_fnvals.fnmethod.method = method;
+                return ofn;
             }
 
-            char peekprev()
+            static Function* makeFuncScript(Module* module, int type)
             {
-                if(m_sourceptr == m_start)
-                {
-                    return -1;
-                }
-                return m_sourceptr[-1];
+                Function* ofn;
+                ofn = makeFuncGeneric(String::intern("<script>"), Object::OTYP_FUNCSCRIPT, Value::makeNull());
+                ofn->m_fnvals.fnscriptfunc.arity = 0;
+                ofn->m_upvalcount = 0;
+                ofn->m_fnvals.fnscriptfunc.isvariadic = false;
+                ofn->m_funcname = nullptr;
+                ofn->m_contexttype = (Function::ContextType)type;
+                ofn->m_fnvals.fnscriptfunc.module = module;
+                ofn->m_fnvals.fnscriptfunc.blob = Memory::make<Blob>();
+                return ofn;
             }
 
-            char peeknext()
+            static Function* makeFuncNative(NativeFN natfn, String* name, void* uptr)
             {
-                if(isatend())
-                {
-                    return '\0';
-                }
-                return m_sourceptr[1];
+                Function* ofn;
+                ofn = makeFuncGeneric(name, Object::OTYP_FUNCNATIVE, Value::makeNull());
+                ofn->m_fnvals.fnnativefunc.natfunc = natfn;
+                ofn->m_contexttype = Function::CTXTYPE_FUNCTION;
+                ofn->m_fnvals.fnnativefunc.userptr = uptr;
+                return ofn;
             }
 
-            AstToken skipblockcomments()
+            static Function* makeFuncClosure(Function* innerfn, Value thisval)
             {
-                int nesting;
-                nesting = 1;
-                while(nesting > 0)
+                int i;
+                Upvalue** upvals;
+                Function* ofn;
+                upvals = nullptr;
+                if(innerfn->m_upvalcount > 0)
                 {
-                    if(isatend())
-                    {
-                        return errortoken("unclosed block comment");
-                    }
-                    /* internal comment open */
-                    if(peekcurr() == '/' && peeknext() == '*')
-                    {
-                        advance();
-                        advance();
-                        nesting++;
-                        continue;
-                    }
-                    /* comment close */
-                    if(peekcurr() == '*' && peeknext() == '/')
+                    upvals = (Upvalue**)Memory::sysMalloc(sizeof(Upvalue*) * (innerfn->m_upvalcount + 1));
+                    for(i = 0; i < innerfn->m_upvalcount; i++)
                     {
-                        advance();
-                        advance();
-                        nesting--;
-                        continue;
+                        upvals[i] = nullptr;
                     }
-                    /* regular comment body */
-                    advance();
                 }
-                return createtoken(AstToken::T_UNDEFINED);
+                ofn = makeFuncGeneric(innerfn->m_funcname, Object::OTYP_FUNCCLOSURE, thisval);
+                ofn->m_fnvals.fnclosure.scriptfunc = innerfn;
+                ofn->m_fnvals.fnclosure.m_upvalues = upvals;
+                ofn->m_upvalcount = innerfn->m_upvalcount;
+                return ofn;
             }
 
-            AstToken skipspace()
+            static void destroy(Function* ofn)
             {
-                char c;
-                AstToken result;
-                result.isglobal = false;
-                for(;;)
+                Blob::destroy(ofn->m_fnvals.fnscriptfunc.blob);
+                Memory::sysFree(ofn->m_fnvals.fnscriptfunc.blob);
+            }
+
+        public:
+
+    };
+
+
+    /*
+    * hidden class: describes the layout of Instance::m_slots.
+    * every Class has a root shape without properties; adding a property moves an instance to a child shape,
+    * so instances of the same class that got the same properties in the same order share one shape, and
+    * a property access is an indexed load once the shape is known (see InlineCache).
+    * shapes are owned by their class, and destroyed along with it.
+    */
+    class Shape
+    {
+        public:
+            enum
+            {
+                /* instances with more properties than this switch to dictionary mode */
+                CONF_MAXSLOTS = 32,
+                /* a shape with this many transitions sends any further new property to dictionary mode */
+                CONF_MAXTRANSITIONS = 16,
+            };
+
+        public:
+            static Shape* make(Shape* parent, String* name, Property::FieldType ftyp)
+            {
+                int i;
+                int count;
+                Shape* shape;
+                count = 0;
+                if(parent != nullptr)
                 {
-                    c = peekcurr();
-                    switch(c)
+                    count = parent->m_slotcount + 1;
+                }
+                shape = Memory::make<Shape>();
+                shape->m_parent = parent;
+                shape->m_slotcount = count;
+                shape->m_keys = nullptr;
+                shape->m_fieldtypes = nullptr;
+                if(count > 0)
+                {
+                    /* names and field types live in one block */
+                    shape->m_keys = (String**)Memory::sysMalloc((sizeof(String*) + sizeof(uint8_t)) * count);
+                    shape->m_fieldtypes = (uint8_t*)(shape->m_keys + count);
+                    for(i = 0; i < parent->m_slotcount; i++)
                     {
-                        case ' ':
-                        case '\r':
-                        case '\t':
-                            {
-                                advance();
-                            }
-                            break;
-                        case '/':
-                            {
-                                if(peeknext() == '/')
-                                {
-                                    while(peekcurr() != '\n' && !isatend())
-                                    {
-                                        advance();
-                                    }
-                                    return createtoken(AstToken::T_UNDEFINED);
-                                }
-                                else if(peeknext() == '*')
-                                {
-                                    advance();
-                                    advance();
-                                    result = skipblockcomments();
-                                    if(result.m_toktype != AstToken::T_UNDEFINED)
-                                    {
-                                        return result;
-                                    }
-                                    break;
-                                }
-                                else
-                                {
-                                    return createtoken(AstToken::T_UNDEFINED);
-                                }
-                            }
-                            break;
-                        /* exit as soon as we see a non-whitespace... */
-                        default:
-                            goto finished;
-                            break;
+                        shape->m_keys[i] = parent->m_keys[i];
+                        shape->m_fieldtypes[i] = parent->m_fieldtypes[i];
                     }
+                    shape->m_keys[count - 1] = name;
+                    shape->m_fieldtypes[count - 1] = ftyp;
                 }
-            finished:
-                return createtoken(AstToken::T_UNDEFINED);
+                return shape;
             }
 
-            AstToken scanstring(char quote, bool withtemplate, bool permitescapes)
+            /* destroys shape, and every shape reachable through its transitions */
+            static void destroy(Shape* shape)
             {
-                AstToken tkn;
-                while(peekcurr() != quote && !isatend())
+                size_t i;
+                for(i = 0; i < shape->m_transitions.count(); i++)
                 {
-                    if(withtemplate)
-                    {
-                        /* interpolation started */
-                        if(peekcurr() == '$' && peeknext() == '{' && peekprev() != '\\')
-                        {
-                            if(m_tplstringcount - 1 < MaxStrTplDepth)
-                            {
-                                m_tplstringcount++;
-                                m_tplstringbuffer[m_tplstringcount] = (int)quote;
-                                m_sourceptr++;
-                                tkn = createtoken(AstToken::T_INTERPOLATION);
-                                m_sourceptr++;
-                                return tkn;
-                            }
-                            return errortoken("maximum interpolation nesting of %d exceeded by %d", MaxStrTplDepth, MaxStrTplDepth - m_tplstringcount + 1);
-                        }
-                    }
-                    if(peekcurr() == '\\' && (peeknext() == quote || peeknext() == '\\'))
+                    destroy(shape->m_transitions[i]);
+                }
+                shape->m_transitions.deInit();
+                if(shape->m_keys != nullptr)
+                {
+                    Memory::sysFree(shape->m_keys);
+                }
+                Memory::sysFree(shape);
+            }
+
+            static void markTree(Shape* shape)
+            {
+                int i;
+                size_t j;
+                if(shape == nullptr)
+                {
+                    return;
+                }
+                if(shape->m_transitions.count() == 0)
+                {
+                    /* leaves carry the names of their parents as well */
+                    for(i = 0; i < shape->m_slotcount; i++)
                     {
-                        advance();
+                        Object::markObject((Object*)shape->m_keys[i]);
                     }
-                    advance();
                 }
-                if(isatend())
+                for(j = 0; j < shape->m_transitions.count(); j++)
                 {
-                    return errortoken("unterminated string (opening quote not matched)");
+                    markTree(shape->m_transitions[j]);
                 }
-                /* the closing quote */
-                match(quote);
-                if(permitescapes)
+            }
+
+        public:
+            Shape* m_parent;
+            int m_slotcount;
+            /* name and field type of every slot, in slot order */
+            String** m_keys;
+            uint8_t* m_fieldtypes;
+            ValList<Shape*> m_transitions{0};
+
+        public:
+            /* names are usually interned, but not always (see String::makeFromStrbuf) */
+            static NEON_INLINE bool keyEquals(String* a, String* b)
+            {
+                if(a == b)
                 {
-                    return createtoken(AstToken::T_LITERALSTRING);
+                    return true;
                 }
-                return createtoken(AstToken::T_LITERALRAWSTRING);
+                return (
+                    (a->length() == b->length()) &&
+                    (a->hash() == b->hash()) &&
+                    Util::bytesEqual(a->rawData(), b->rawData(), a->length())
+                );
             }
 
-            AstToken scannumber()
+            /* returns the slot of name, or -1 */
+            NEON_INLINE int lookup(String* name) const
             {
-                /* handle binary, octal and hexadecimals */
-                if(peekprev() == '0')
+                int i;
+                for(i = m_slotcount - 1; i >= 0; i--)
                 {
-                    /* binary number */
-                    if(match('b'))
+                    if(m_keys[i] == name)
                     {
-                        while(lexUtilIsBinary(peekcurr()))
-                        {
-                            advance();
-                        }
-                        return createtoken(AstToken::T_LITNUMBIN);
-                    }
-                    else if(match('c'))
-                    {
-                        while(lexUtilIsOctal(peekcurr()))
-                        {
-                            advance();
-                        }
-                        return createtoken(AstToken::T_LITNUMOCT);
-                    }
-                    else if(match('x'))
-                    {
-                        while(lexUtilIsHexadecimal(peekcurr()))
-                        {
-                            advance();
-                        }
-                        return createtoken(AstToken::T_LITNUMHEX);
+                        return i;
                     }
                 }
-                while(lexUtilIsDigit(peekcurr()))
-                {
-                    advance();
-                }
-                /* dots(.) are only valid here when followed by a digit */
-                if(peekcurr() == '.' && lexUtilIsDigit(peeknext()))
+                for(i = m_slotcount - 1; i >= 0; i--)
                 {
-                    advance();
-                    while(lexUtilIsDigit(peekcurr()))
-                    {
-                        advance();
-                    }
-                    /*
-                    // E or e are only valid here when followed by a digit and occurring after a dot
-                    */
-                    if((peekcurr() == 'e' || peekcurr() == 'E') && (peeknext() == '+' || peeknext() == '-'))
+                    if(keyEquals(m_keys[i], name))
                     {
-                        advance();
-                        advance();
-                        while(lexUtilIsDigit(peekcurr()))
-                        {
-                            advance();
-                        }
+                        return i;
                     }
                 }
-                return createtoken(AstToken::T_LITNUMREG);
+                return -1;
             }
 
-            AstToken::Type getidenttype()
+            /* returns the shape that follows from adding name to this one, or nullptr if the limits are exceeded */
+            Shape* transition(String* name, Property::FieldType ftyp)
             {
-                /* clang-format off */
-                static const struct
-                {
-                    const char* str;
-                    int tokid;
-                } keywords[] = {
-                    { "and", AstToken::T_KWAND },
-                    { "assert", AstToken::T_KWASSERT },
-                    { "as", AstToken::T_KWAS },
-                    { "break", AstToken::T_KWBREAK },
-                    { "catch", AstToken::T_KWCATCH },
-                    { "class", AstToken::T_KWCLASS },
-                    { "continue", AstToken::T_KWCONTINUE },
-                    { "default", AstToken::T_KWDEFAULT },
-                    { "def", AstToken::T_KWFUNCTION },
-                    { "function", AstToken::T_KWFUNCTION },
-                    { "throw", AstToken::T_KWTHROW },
-                    { "do", AstToken::T_KWDO },
-                    { "echo", AstToken::T_KWECHO },
-                    { "else", AstToken::T_KWELSE },
-                    { "empty", AstToken::T_KWEMPTY },
-                    { "extends", AstToken::T_KWEXTENDS },
-                    { "false", AstToken::T_KWFALSE },
-                    { "finally", AstToken::T_KWFINALLY },
-                    { "foreach", AstToken::T_KWFOREACH },
-                    { "if", AstToken::T_KWIF },
-                    { "in", AstToken::T_KWIN },
-                    { "instanceof", AstToken::T_KWINSTANCEOF },
-                    { "for", AstToken::T_KWFOR },
-                    { "null", AstToken::T_KWNULL },
-                    { "new", AstToken::T_KWNEW },
-                    { "or", AstToken::T_KWOR },
-                    { "super", AstToken::T_KWSUPER },
-                    { "return", AstToken::T_KWRETURN },
-                    { "this", AstToken::T_KWTHIS },
-                    { "static", AstToken::T_KWSTATIC },
-                    { "true", AstToken::T_KWTRUE },
-                    { "try", AstToken::T_KWTRY },
-                    { "typeof", AstToken::T_KWTYPEOF },
-                    { "switch", AstToken::T_KWSWITCH },
-                    { "case", AstToken::T_KWCASE },
-                    { "var", AstToken::T_KWVAR },
-                    { "let", AstToken::T_KWVAR },
-                    { "const", AstToken::T_KWCONST },
-                    { "while", AstToken::T_KWWHILE },
-                    { nullptr, (AstToken::Type)0 }
-                };
-                /* clang-format on */
                 size_t i;
-                size_t kwlen;
-                size_t ofs;
-                const char* kwtext;
-                for(i = 0; keywords[i].str != nullptr; i++)
+                Shape* child;
+                for(i = 0; i < m_transitions.count(); i++)
                 {
-                    kwtext = keywords[i].str;
-                    kwlen = strlen(kwtext);
-                    ofs = (m_sourceptr - m_start);
-                    if(ofs == kwlen)
+                    child = m_transitions[i];
+                    if(keyEquals(child->m_keys[m_slotcount], name) && (child->m_fieldtypes[m_slotcount] == ftyp))
                     {
-                        if(memcmp(m_start, kwtext, kwlen) == 0)
-                        {
-                            return (AstToken::Type)keywords[i].tokid;
-                        }
+                        return child;
                     }
                 }
-                return AstToken::T_IDENTNORMAL;
+                if((m_slotcount >= CONF_MAXSLOTS) || (m_transitions.count() >= CONF_MAXTRANSITIONS))
+                {
+                    return nullptr;
+                }
+                child = make(this, name, ftyp);
+                m_transitions.push(child);
+                return child;
             }
+    };
 
-            AstToken scanident(bool isdollar)
+    /**
+     * TODO: use a different table implementation to avoid allocating so many strings...
+     */
+    class Class : public Object
+    {
+        public:
+            class ConstItem
             {
-                int cur;
-                AstToken tok;
-                cur = peekcurr();
-                if(cur == '$')
-                {
-                    advance();
-                }
-                while(true)
+                public:
+                    const char* m_constclassmthname;
+                    NativeFN fn;
+            };
+
+            static bool methodNameIsPrivate(String* name)
+            {
+                return name->length() > 0 && name->data()[0] == '_';
+            }
+
+            /*
+             * TODO: this is somewhat basic instanceof checking;
+             * it does not account for namespacing, which could spell issues in the future.
+             * maybe classes should be given a distinct, unique, internal name, which would
+             * incidentally remove the need to walk namespaces.
+             * something like `class Foo{...}` -> 'Foo@<filename>:<lineno>', i.e., "Foo.class@path/to/somefile.nn:42".
+             */
+            static bool isInstanceOf(Class* klass1, Class* expected)
+            {
+                size_t klen;
+                size_t elen;
+                const char* kname;
+                const char* ename;
+                while(klass1 != nullptr)
                 {
-                    cur = peekcurr();
-                    if(lexUtilIsAlpha(cur) || lexUtilIsDigit(cur))
-                    {
-                        advance();
-                    }
-                    else
+                    elen = expected->m_classname->length();
+                    klen = klass1->m_classname->length();
+                    ename = expected->m_classname->data();
+                    kname = klass1->m_classname->data();
+                    if(elen == klen && memcmp(kname, ename, klen) == 0)
                     {
-                        break;
+                        return true;
                     }
+                    klass1 = klass1->m_superclass;
                 }
-                tok = createtoken(getidenttype());
-                tok.isglobal = isdollar;
-                return tok;
+                return false;
             }
 
-            AstToken scandecorator()
+            /**
+             * generate bytecode for a nativee exception class.
+             * script-side it is enough to just derive from Exception, of course.
+             */
+            static Class* makeExceptionClass(Class* baseclass, Module* module, String* classname)
             {
-                while(lexUtilIsAlpha(peekcurr()) || lexUtilIsDigit(peekcurr()))
+                int messageconst;
+                int cacheidx;
+                Class* klass;
+                Function* function;
+                Function* closure;
+                auto gcs = SharedState::get();
+                gcs->vmStackPush(Value::fromObject(classname));
+                klass = Class::make(classname, baseclass);
+                gcs->vmStackPop();
+                gcs->vmStackPush(Value::fromObject(klass));
+                function = Function::makeFuncScript(module, Function::CTXTYPE_METHOD);
+                function->m_fnvals.fnscriptfunc.arity = 1;
+                function->m_fnvals.fnscriptfunc.isvariadic = false;
+                gcs->vmStackPush(Value::fromObject(function));
                 {
-                    advance();
+                    /* g_loc 0 */
+                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::OPC_LOCALGET, 0);
+                    function->m_fnvals.fnscriptfunc.blob->push((0 >> 8) & 0xff, 0);
+                    function->m_fnvals.fnscriptfunc.blob->push(0 & 0xff, 0);
                 }
-                return createtoken(AstToken::T_DECORATOR);
-            }
-
-            AstToken scantoken()
-            {
-                char c;
-                bool isdollar;
-                AstToken tk;
-                AstToken token;
-                tk = skipspace();
-                if(tk.m_toktype != AstToken::T_UNDEFINED)
                 {
-                    return tk;
+                    /* g_loc 1 */
+                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::OPC_LOCALGET, 0);
+                    function->m_fnvals.fnscriptfunc.blob->push((1 >> 8) & 0xff, 0);
+                    function->m_fnvals.fnscriptfunc.blob->push(1 & 0xff, 0);
                 }
-                m_start = m_sourceptr;
-                if(isatend())
                 {
-                    return createtoken(AstToken::T_EOF);
+                    messageconst = function->m_fnvals.fnscriptfunc.blob->addConstant(Value::fromObject(String::intern("message")));
+                    /* s_prop 0 */
+                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::OPC_PROPERTYSET, 0);
+                    function->m_fnvals.fnscriptfunc.blob->push((messageconst >> 8) & 0xff, 0);
+                    function->m_fnvals.fnscriptfunc.blob->push(messageconst & 0xff, 0);
+                    cacheidx = function->m_fnvals.fnscriptfunc.blob->addInlineCache();
+                    function->m_fnvals.fnscriptfunc.blob->push((cacheidx >> 8) & 0xff, 0);
+                    function->m_fnvals.fnscriptfunc.blob->push(cacheidx & 0xff, 0);
                 }
-                c = advance();
-                if(lexUtilIsDigit(c))
                 {
-                    return scannumber();
+                    /* pop */
+                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::OPC_POPONE, 0);
+                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::OPC_POPONE, 0);
                 }
-                else if(lexUtilIsAlpha(c) || (c == '$'))
                 {
-                    isdollar = (c == '$');
-                    return scanident(isdollar);
+                    /* g_loc 0 */
+                    /*
+                    //  function->m_fnvals.fnscriptfunc.blob->push(Instruction::OPC_LOCALGET, 0);
+                    //  function->m_fnvals.fnscriptfunc.blob->push((0 >> 8) & 0xff, 0);
+                    //  function->m_fnvals.fnscriptfunc.blob->push(0 & 0xff, 0);
+                    */
                 }
-                switch(c)
                 {
-                    case '(':
-                        {
-                            return createtoken(AstToken::T_PARENOPEN);
-                        }
-                        break;
-                    case ')':
-                        {
-                            return createtoken(AstToken::T_PARENCLOSE);
-                        }
-                        break;
-                    case '[':
-                        {
-                            return createtoken(AstToken::T_BRACKETOPEN);
-                        }
-                        break;
-                    case ']':
-                        {
-                            return createtoken(AstToken::T_BRACKETCLOSE);
-                        }
-                        break;
-                    case '{':
-                        {
-                            return createtoken(AstToken::T_BRACEOPEN);
-                        }
-                        break;
-                    case '}':
-                        {
-                            if(m_tplstringcount > -1)
-                            {
-                                token = scanstring((char)m_tplstringbuffer[m_tplstringcount], true, true);
-                                m_tplstringcount--;
-                                return token;
-                            }
-                            return createtoken(AstToken::T_BRACECLOSE);
-                        }
-                        break;
-                    case ';':
+                    /* ret */
+                    function->m_fnvals.fnscriptfunc.blob->push(Instruction::OPC_RETURN, 0);
+                }
+                closure = Function::makeFuncClosure(function, Value::makeNull());
+                gcs->vmStackPop();
+                /* set class constructor */
+                gcs->vmStackPush(Value::fromObject(closure));
+                klass->m_instmethods.set(Value::fromObject(classname), Value::fromObject(closure));
+                klass->m_constructor = Value::fromObject(closure);
+                SharedState::gcWriteBarrier(klass, klass->m_constructor);
+                /* set class properties */
+                klass->defProperty(String::intern("message"), Value::makeNull());
+                klass->defProperty(String::intern("stacktrace"), Value::makeNull());
+                klass->defProperty(String::intern("srcfile"), Value::makeNull());
+                klass->defProperty(String::intern("srcline"), Value::makeNull());
+                klass->defProperty(String::intern("class"), Value::fromObject(klass));
+                gcs->m_declaredglobals.set(Value::fromObject(classname), Value::fromObject(klass));
+                /* for class */
+                gcs->vmStackPop();
+                gcs->vmStackPop();
+                /* assert error name */
+                /* gcs->vmStackPop(); */
+                return klass;
+            }
+
+        public:
+            /*
+             * the constructor, if any. defaults to <empty>, and if not <empty>, expects to be
+             * some callable value.
+             */
+            Value m_constructor;
+            Value m_destructor;
+
+            /*
+             * when declaring a class, $instproperties (their names, and initial values) are
+             * copied to Instance::properties.
+             * so `$instproperties["something"] = somefunction;` remains untouched *until* an
+             * instance of this class is created.
+             */
+            HashTable<Value, Value> m_instproperties;
+
+            /*
+             * static, unchangeable(-ish) values. intended for values that are not unique, but shared
+             * across classes, without being copied.
+             */
+            HashTable<Value, Value> m_staticproperties;
+
+            /*
+             * method table; they are currently not unique when instantiated; instead, they are
+             * read from $methods as-is. this includes adding methods!
+             * TODO: introduce a new hashtable field for Instance for unique methods, perhaps?
+             * right now, this method just prevents unnecessary copying.
+             */
+            HashTable<Value, Value> m_instmethods;
+            HashTable<Value, Value> m_staticmethods;
+            String* m_classname;
+            Class* m_superclass;
+
+            /* shape of an instance without properties; see Shape */
+            Shape* m_rootshape;
+
+            /*
+            * shape of a freshly made instance, i.e., with all of $instproperties, in table order.
+            * recomputed when $instproperties changes. nullptr if not computed yet.
+            */
+            Shape* m_initshape;
+
+        public:
+            static Class* make(String* name, Class* parent)
+            {
+                Class* klass;
+                klass = SharedState::gcMakeObject<Class>(Object::OTYP_CLASS, false);
+                klass->m_classname = name;
+                klass->m_instproperties.initTable(klass);
+                klass->m_staticproperties.initTable(klass);
+                klass->m_instmethods.initTable(klass);
+                klass->m_staticmethods.initTable(klass);
+                klass->m_constructor = Value::makeNull();
+                klass->m_destructor = Value::makeNull();
+                klass->m_superclass = parent;
+                klass->m_rootshape = Shape::make(nullptr, nullptr, Property::FTYP_VALUE);
+                klass->m_initshape = nullptr;
+                SharedState::get()->invalidateInlineCaches();
+                return klass;
+            }
+
+            static void destroy(Class* klass)
+            {
+                auto gcs = SharedState::get();
+                klass->m_instmethods.deInit();
+                klass->m_staticmethods.deInit();
+                klass->m_instproperties.deInit();
+                klass->m_staticproperties.deInit();
+                Shape::destroy(klass->m_rootshape);
+                /* inline caches may still point at the shapes */
+                gcs->invalidateInlineCaches();
+                gcs->gcReleaseObj(klass);
+            }
+
+            static Class* makeScriptClass(String* name, Class* parent)
+            {
+                Class* cl;
+                auto gcs = SharedState::get();
+                cl = Class::make(name, parent);
+                gcs->m_declaredglobals.set(Value::fromObject(name), Value::fromObject(cl));
+                return cl;
+            }
+
+            /*
+            * returns the shape of an instance that holds all of $instproperties, in table order.
+            * returns nullptr if that would exceed the limits of Shape; such instances start out in dictionary mode.
+            */
+            Shape* initShape()
+            {
+                int i;
+                Shape* shape;
+                HashTable<Value, Value>::Entry* entry;
+                if(m_initshape != nullptr)
+                {
+                    return m_initshape;
+                }
+                shape = m_rootshape;
+                for(i = 0; i < m_instproperties.m_htcapacity; i++)
+                {
+                    entry = &m_instproperties.m_htentries[i];
+                    if(!entry->key.isNull())
+                    {
+                        shape = shape->transition(entry->key.asString(), entry->value.m_fieldtype);
+                        if(shape == nullptr)
+                        {
+                            return nullptr;
+                        }
+                    }
+                }
+                m_initshape = shape;
+                return shape;
+            }
+
+            bool inheritFrom(Class* superclass)
+            {
+                int failcnt;
+                failcnt = 0;
+                if(!superclass->m_instproperties.copyTo(&m_instproperties, true))
+                {
+                    failcnt++;
+                }
+                if(!superclass->m_instmethods.copyTo(&m_instmethods, true))
+                {
+                    failcnt++;
+                }
+                m_superclass = superclass;
+                SharedState::gcWriteBarrier(this, superclass);
+                m_initshape = nullptr;
+                SharedState::get()->invalidateInlineCaches();
+                if(failcnt == 0)
+                {
+                    return true;
+                }
+                return false;
+            }
+
+            bool defProperty(String* cstrname, Value val)
+            {
+                m_initshape = nullptr;
+                return m_instproperties.set(Value::fromObject(cstrname), val);
+            }
+
+            bool defCallableFieldPtr(String* name, NativeFN function, void* uptr)
+            {
+                Function* ofn;
+                ofn = Function::makeFuncNative(function, name, uptr);
+                m_initshape = nullptr;
+                return m_instproperties.setwithtype(Value::fromObject(name), Value::fromObject(ofn), Property::FTYP_FUNCTION, true);
+            }
+
+            bool defCallableField(String* name, NativeFN function)
+            {
+                return defCallableFieldPtr(name, function, nullptr);
+            }
+
+            bool defStaticCallableFieldPtr(String* name, NativeFN function, void* uptr)
+            {
+                Function* ofn;
+                ofn = Function::makeFuncNative(function, name, uptr);
+                return m_staticproperties.setwithtype(Value::fromObject(name), Value::fromObject(ofn), Property::FTYP_FUNCTION, true);
+            }
+
+            bool defStaticCallableField(String* name, NativeFN function)
+            {
+                return defStaticCallableFieldPtr(name, function, nullptr);
+            }
+
+            bool setStaticProperty(String* name, Value val)
+            {
+                return m_staticproperties.set(Value::fromObject(name), val);
+            }
+
+            bool defNativeConstructorPtr(NativeFN function, void* uptr)
+            {
+                Function* ofn;
+                auto cname = String::intern("constructor");
+                ofn = Function::makeFuncNative(function, cname, uptr);
+                m_constructor = Value::fromObject(ofn);
+                return true;
+            }
+
+            bool defNativeConstructor(NativeFN function)
+            {
+                return defNativeConstructorPtr(function, nullptr);
+            }
+
+            bool defMethod(String* name, Value val)
+            {
+                SharedState::get()->invalidateInlineCaches();
+                return m_instmethods.set(Value::fromObject(name), val);
+            }
+
+            bool defNativeMethodPtr(String* name, NativeFN function, void* ptr)
+            {
+                Function* ofn;
+                ofn = Function::makeFuncNative(function, name, ptr);
+                return defMethod(name, Value::fromObject(ofn));
+            }
+
+            bool defNativeMethod(String* name, NativeFN function)
+            {
+                return defNativeMethodPtr(name, function, nullptr);
+            }
+
+            bool defStaticNativeMethodPtr(String* name, NativeFN function, void* uptr)
+            {
+                Function* ofn;
+                ofn = Function::makeFuncNative(function, name, uptr);
+                return m_staticmethods.set(Value::fromObject(name), Value::fromObject(ofn));
+            }
+
+            bool defStaticNativeMethod(String* name, NativeFN function)
+            {
+                return defStaticNativeMethodPtr(name, function, nullptr);
+            }
+
+            Property* getMethodField(String* name)
+            {
+                Property* field;
+                field = m_instmethods.getfield(Value::fromObject(name));
+                if(field != nullptr)
+                {
+                    return field;
+                }
+                if(m_superclass != nullptr)
+                {
+                    return m_superclass->getMethodField(name);
+                }
+                return nullptr;
+            }
+
+            Property* getPropertyField(String* name)
+            {
+                Property* field;
+                field = m_instproperties.getfield(Value::fromObject(name));
+            #if 0
+                if(field == nullptr)
+                {
+                    if(m_superclass != nullptr)
+                    {
+                        return m_superclass->getPropertyField(name);
+                    }
+                }
+            #endif
+                return field;
+            }
+
+            Property* getStaticProperty(String* name)
+            {
+                Property* np;
+                np = m_staticproperties.getfieldbyostr(name);
+                if(np != nullptr)
+                {
+                    return np;
+                }
+                if(m_superclass != nullptr)
+                {
+                    return m_superclass->getStaticProperty(name);
+                }
+                return nullptr;
+            }
+
+            Property* getStaticMethodField(String* name)
+            {
+                Property* field;
+                field = m_staticmethods.getfield(Value::fromObject(name));
+                return field;
+            }
+
+            void installMethods(ConstItem* listmethods)
+            {
+                int i;
+                const char* rawname;
+                NativeFN rawfn;
+                String* osname;
+                for(i = 0; listmethods[i].m_constclassmthname != nullptr; i++)
+                {
+                    rawname = listmethods[i].m_constclassmthname;
+                    rawfn = listmethods[i].fn;
+                    osname = String::intern(rawname);
+                    defNativeMethod(osname, rawfn);
+                }
+            }
+    };
+
+    /*
+    * properties of an instance are stored in a flat slot array, laid out by its Shape.
+    * instances that get too many properties (or change the field type of one) switch to dictionary mode,
+    * where $shape is nullptr, and the properties live in $dictprops instead.
+    */
+    class Instance : public Object
+    {
+        public:
+            enum
+            {
+                /* slots that are stored inside the instance itself; more than this are allocated separately */
+                CONF_INLINESLOTS = 4,
+            };
+
+        public:
+            template<typename InputT>
+            static Instance* makeInstanceOfSize(Class* klass)
+            {
+                int i;
+                int slot;
+                Shape* shape;
+                Instance* oinst;
+                Instance* instance;
+                HashTable<Value, Value>::Entry* entry;
+                auto gcs = SharedState::get();
+                oinst = nullptr;
+                instance = (Instance*)SharedState::gcMakeObject<InputT>(Object::OTYP_INSTANCE, false);
+                instance->m_instactive = true;
+                instance->m_instanceclass = klass;
+                instance->m_instancesuperinstance = nullptr;
+                instance->m_shape = klass->m_rootshape;
+                instance->m_dictprops = nullptr;
+                instance->m_slotcapacity = CONF_INLINESLOTS;
+                instance->m_slots = instance->m_inlineslots;
+                /* copying values, and making the superinstance may collect; keep instance alive until then */
+                gcs->vmStackPush(Value::fromObject(instance));
+                if(klass->m_instproperties.count() > 0)
+                {
+                    shape = klass->initShape();
+                    if(shape != nullptr)
+                    {
+                        instance->ensureSlots(shape->m_slotcount);
+                        for(i = 0; i < shape->m_slotcount; i++)
+                        {
+                            instance->m_slots[i] = Value::makeNull();
+                        }
+                        instance->m_shape = shape;
+                        slot = 0;
+                        for(i = 0; i < klass->m_instproperties.m_htcapacity; i++)
+                        {
+                            entry = &klass->m_instproperties.m_htentries[i];
+                            if(!entry->key.isNull())
+                            {
+                                instance->m_slots[slot] = Value::copyValue(entry->value.value);
+                                SharedState::gcWriteBarrier(instance, instance->m_slots[slot]);
+                                slot++;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        for(i = 0; i < klass->m_instproperties.m_htcapacity; i++)
+                        {
+                            entry = &klass->m_instproperties.m_htentries[i];
+                            if(!entry->key.isNull())
+                            {
+                                instance->defPropertyWithType(entry->key.asString(), Value::copyValue(entry->value.value), entry->value.m_fieldtype);
+                            }
+                        }
+                    }
+                }
+                if(klass->m_superclass != nullptr)
+                {
+                    oinst = make(klass->m_superclass);
+                    instance->m_instancesuperinstance = oinst;
+                    SharedState::gcWriteBarrier(instance, oinst);
+                }
+                gcs->vmStackPop();
+                return instance;
+            }
+
+            static Instance* make(Class* klass)
+            {
+                return makeInstanceOfSize<Instance>(klass);
+            }
+
+            static void mark(Instance* instance)
+            {
+                int i;
+                if(instance->m_instactive == false)
+                {
+                    // raiseWarning("trying to mark inactive instance <%p>!", instance);
+                    return;
+                }
+                if(instance->m_shape != nullptr)
+                {
+                    for(i = 0; i < instance->m_shape->m_slotcount; i++)
+                    {
+                        SharedState::markValue(instance->m_slots[i]);
+                    }
+                }
+                else
+                {
+                    Value::markValTable(instance->m_dictprops);
+                }
+                Object::markObject((Object*)instance->m_instanceclass);
+                if(instance->m_instancesuperinstance != nullptr)
+                {
+                    Object::markObject((Object*)instance->m_instancesuperinstance);
+                }
+            }
+
+            static void destroy(Instance* instance)
+            {
+                auto gcs = SharedState::get();
+                /*
+                * neither the class nor the shape may be touched here: they may already be gone, or
+                * be destroyed on the main thread while this runs on the sweeper thread.
+                */
+                if(instance->m_slots != instance->m_inlineslots)
+                {
+                    Memory::sysFree(instance->m_slots);
+                }
+                if(instance->m_dictprops != nullptr)
+                {
+                    instance->m_dictprops->deInit();
+                    Memory::sysFree(instance->m_dictprops);
+                }
+                instance->m_instactive = false;
+                gcs->gcReleaseObj(instance);
+            }
+
+        public:
+            /*
+             * whether this instance is still "active", i.e., not destroyed, deallocated, etc.
+             */
+            bool m_instactive;
+            Class* m_instanceclass;
+            Instance* m_instancesuperinstance;
+            /* layout of $slots, or nullptr in dictionary mode */
+            Shape* m_shape;
+            /* only used in dictionary mode */
+            HashTable<Value, Value>* m_dictprops;
+            int m_slotcapacity;
+            /* points to $inlineslots, unless more than CONF_INLINESLOTS are needed */
+            Value* m_slots;
+            Value m_inlineslots[CONF_INLINESLOTS];
+
+        public:
+            void ensureSlots(int count)
+            {
+                int ncap;
+                Value* nslots;
+                if(count <= m_slotcapacity)
+                {
+                    return;
+                }
+                ncap = m_slotcapacity * 2;
+                if(ncap < count)
+                {
+                    ncap = count;
+                }
+                if(m_slots == m_inlineslots)
+                {
+                    nslots = (Value*)Memory::sysMalloc(sizeof(Value) * ncap);
+                    memcpy(nslots, m_inlineslots, sizeof(Value) * m_slotcapacity);
+                }
+                else
+                {
+                    nslots = (Value*)Memory::sysRealloc(m_slots, sizeof(Value) * ncap);
+                }
+                m_slots = nslots;
+                m_slotcapacity = ncap;
+            }
+
+            /* moves all properties into $dictprops. this is one-way; the instance never gets a shape again */
+            void toDictionary()
+            {
+                int i;
+                HashTable<Value, Value>* table;
+                table = Memory::make<HashTable<Value, Value>>();
+                table->initTable(this);
+                for(i = 0; i < m_shape->m_slotcount; i++)
+                {
+                    table->setwithtype(Value::fromObject(m_shape->m_keys[i]), m_slots[i], (Property::FieldType)m_shape->m_fieldtypes[i], true);
+                }
+                m_dictprops = table;
+                m_shape = nullptr;
+                if(m_slots != m_inlineslots)
+                {
+                    Memory::sysFree(m_slots);
+                }
+                m_slots = m_inlineslots;
+                m_slotcapacity = CONF_INLINESLOTS;
+            }
+
+            bool defPropertyWithType(String* name, Value val, Property::FieldType ftyp)
+            {
+                int slot;
+                Shape* next;
+                if(m_shape != nullptr)
+                {
+                    slot = m_shape->lookup(name);
+                    if(slot >= 0)
+                    {
+                        if(m_shape->m_fieldtypes[slot] == ftyp)
+                        {
+                            m_slots[slot] = val;
+                            SharedState::gcWriteBarrier(this, val);
+                            return false;
+                        }
+                    }
+                    else
+                    {
+                        next = m_shape->transition(name, ftyp);
+                        if(next != nullptr)
+                        {
+                            /* the name now lives in the shape tree of the class */
+                            SharedState::gcWriteBarrier(m_instanceclass, name);
+                            ensureSlots(next->m_slotcount);
+                            m_slots[next->m_slotcount - 1] = val;
+                            SharedState::gcWriteBarrier(this, val);
+                            m_shape = next;
+                            return true;
+                        }
+                    }
+                    toDictionary();
+                }
+                return m_dictprops->setwithtype(Value::fromObject(name), val, ftyp, true);
+            }
+
+            bool defProperty(String* name, Value val)
+            {
+                return defPropertyWithType(name, val, Property::FTYP_VALUE);
+            }
+
+            /*
+            * returns a pointer to the value of the property name of this instance (not its superinstance),
+            * or nullptr. if ftyp is not nullptr, it receives the field type.
+            * the pointer is only valid until the next property is added.
+            */
+            Value* findProperty(String* name, Property::FieldType* ftyp)
+            {
+                int slot;
+                Property* field;
+                if(m_shape != nullptr)
+                {
+                    slot = m_shape->lookup(name);
+                    if(slot < 0)
+                    {
+                        return nullptr;
+                    }
+                    if(ftyp != nullptr)
+                    {
+                        *ftyp = (Property::FieldType)m_shape->m_fieldtypes[slot];
+                    }
+                    return &m_slots[slot];
+                }
+                field = m_dictprops->getfieldbyostr(name);
+                if(field == nullptr)
+                {
+                    return nullptr;
+                }
+                if(ftyp != nullptr)
+                {
+                    *ftyp = field->m_fieldtype;
+                }
+                return &field->value;
+            }
+
+            Value* getProperty(String* name, Property::FieldType* ftyp)
+            {
+                Value* val;
+                val = findProperty(name, ftyp);
+                if(val == nullptr)
+                {
+                    if(m_instancesuperinstance != nullptr)
+                    {
+                        return m_instancesuperinstance->getProperty(name, ftyp);
+                    }
+                }
+                return val;
+            }
+
+            Property* getMethod(String* name)
+            {
+                Property* field;
+                field = m_instanceclass->getMethodField(name);
+                if(field == nullptr)
+                {
+                    if(m_instancesuperinstance != nullptr)
+                    {
+                        return m_instancesuperinstance->getMethod(name);
+                    }
+                }
+                return field;
+            }
+    };
+
+    class File : public Object
+    {
+        public:
+            static bool fileExists(const char* path)
+            {
+                return Util::nn_util_fsfileexists(path);
+            }
+
+            static bool pathIsFile(const char* path)
+            {
+                return Util::nn_util_fsfileisfile(path);
+            }
+
+            static bool pathIsDirectory(const char* path)
+            {
+                return Util::nn_util_fsfileisdirectory(path);
+            }
+
+            static char* getBasename(const char* path)
+            {
+                return Util::nn_util_fsgetbasename(path);
+            }
+
+            static char* readFromHandle(FILE* hnd, size_t* dlen, bool havemaxsz, size_t maxsize)
+            {
+                long rawtold;
+                /*
+                 * the value returned by ftell() may not necessarily be the same as
+                 * the amount that can be read.
+                 * since we only ever read a maximum of $toldlen, there will
+                 * be no memory trashing.
+                 */
+                size_t toldlen;
+                size_t actuallen;
+                char* buf;
+                if(fseek(hnd, 0, SEEK_END) == -1)
+                {
+                    return nullptr;
+                }
+                if((rawtold = ftell(hnd)) == -1)
+                {
+                    return nullptr;
+                }
+                toldlen = rawtold;
+                if(fseek(hnd, 0, SEEK_SET) == -1)
+                {
+                    return nullptr;
+                }
+                if(havemaxsz)
+                {
+                    if(toldlen > maxsize)
+                    {
+                        toldlen = maxsize;
+                    }
+                }
+                buf = (char*)Memory::sysMalloc(sizeof(char) * (toldlen + 1));
+                memset(buf, 0, toldlen + 1);
+                if(buf != nullptr)
+                {
+                    actuallen = fread(buf, sizeof(char), toldlen, hnd);
+                    /*
+                    // optionally, read remainder:
+                    size_t tmplen;
+                    if(actuallen < toldlen)
+                    {
+                        tmplen = actuallen;
+                        actuallen += fread(buf+tmplen, sizeof(char), actuallen-toldlen, hnd);
+                        ...
+                    }
+                    // unlikely to be necessary, so not implemented.
+                    */
+                    if(dlen != nullptr)
+                    {
+                        *dlen = actuallen;
+                    }
+                    return buf;
+                }
+                return nullptr;
+            }
+
+            static char* readFile(const char* filename, size_t* dlen, bool havemaxsz, size_t maxsize)
+            {
+                char* b;
+                FILE* fh;
+                fh = fopen(filename, "rb");
+                if(fh == nullptr)
+                {
+                    return nullptr;
+                }
+            #if defined(NEON_PLAT_ISWINDOWS)
+                _setmode(fileno(fh), _O_BINARY);
+            #endif
+                b = readFromHandle(fh, dlen, havemaxsz, maxsize);
+                fclose(fh);
+                return b;
+            }
+
+            static char* fileHandleGets(char* s, int size, FILE* f, size_t* lendest)
+            {
+                int c;
+                char* p;
+                p = s;
+                (*lendest) = 0;
+                if(size > 0)
+                {
+                    while(--size > 0)
+                    {
+                        if((c = getc(f)) == -1)
+                        {
+                            if(ferror(f) == EINTR)
+                            {
+                                continue;
+                            }
+                            break;
+                        }
+                        *p++ = c & 0xff;
+                        (*lendest) += 1;
+                        if(c == '\n')
+                        {
+                            break;
+                        }
+                    }
+                    *p = '\0';
+                }
+                if(p > s)
+                {
+                    return s;
+                }
+                return nullptr;
+            }
+
+            static int readLineFromHandle(char** lineptr, size_t* destlen, FILE* hnd)
+            {
+                enum
+                {
+                    kInitialStrBufSize = 256
+                };
+                static char stackbuf[kInitialStrBufSize];
+                char* heapbuf;
+                size_t getlen;
+                unsigned int linelen;
+                getlen = 0;
+                if(lineptr == nullptr || destlen == nullptr)
+                {
+                    errno = EINVAL;
+                    return -1;
+                }
+                if(ferror(hnd))
+                {
+                    return -1;
+                }
+                if(feof(hnd))
+                {
+                    return -1;
+                }
+                fileHandleGets(stackbuf, kInitialStrBufSize, hnd, &getlen);
+                heapbuf = strchr(stackbuf, '\n');
+                if(heapbuf)
+                {
+                    *heapbuf = '\0';
+                }
+                linelen = getlen;
+                if((linelen + 1) < kInitialStrBufSize)
+                {
+                    heapbuf = (char*)Memory::sysRealloc(*lineptr, kInitialStrBufSize);
+                    if(heapbuf == nullptr)
+                    {
+                        return -1;
+                    }
+                    *lineptr = heapbuf;
+                    *destlen = kInitialStrBufSize;
+                }
+                strcpy(*lineptr, stackbuf);
+                *destlen = linelen;
+                return linelen;
+            }
+
+        public:
+            static File* make(FILE* handle, bool isstd, const char* path, const char* mode)
+            {
+                File* file;
+                auto gcs = SharedState::get();
+                file = SharedState::gcMakeObject<File>(Object::OTYP_FILE, false);
+                file->m_isopen = false;
+                file->m_mode = nullptr;
+                file->m_path = nullptr;
+                gcs->vmStackPush(Value::fromObject(file));
+                file->m_mode = String::copy(mode);
+                SharedState::gcWriteBarrier(file, file->m_mode);
+                file->m_path = String::copy(path);
+                SharedState::gcWriteBarrier(file, file->m_path);
+                gcs->vmStackPop();
+                file->m_isstd = isstd;
+                file->m_handle = handle;
+                file->m_istty = false;
+                file->m_number = -1;
+                if(file->m_handle != nullptr)
+                {
+                    file->m_isopen = true;
+                }
+                return file;
+            }
+
+            static void destroy(File* file)
+            {
+                auto gcs = SharedState::get();
+                file->closeFile();
+                gcs->gcReleaseObj(file);
+            }
+
+            static void mark(File* file)
+            {
+                Object::markObject((Object*)file->m_mode);
+                Object::markObject((Object*)file->m_path);
+            }
+
+        public:
+            bool m_isopen;
+            bool m_isstd;
+            bool m_istty;
+            int m_number;
+            FILE* m_handle;
+            String* m_mode;
+            String* m_path;
+
+        public:
+            bool readData(size_t readhowmuch, IOResult* dest)
+            {
+                size_t filesizereal;
+                struct stat stats;
+                filesizereal = -1;
+                dest->success = false;
+                dest->length = 0;
+                dest->data = nullptr;
+                if(!m_isstd)
+                {
+                    if(!File::fileExists(m_path->data()))
+                    {
+                        return false;
+                    }
+                    /* file is in write only mode */
+                    /*
+                    else if(strstr(m_mode->data(), "w") != nullptr && strstr(m_mode->data(), "+") == nullptr)
+                    {
+                        NEON_RETURNERROR(scfn, "Unsupported -> %s" , "cannot read file in write mode");
+                    }
+                    */
+                    if(!m_isopen)
+                    {
+                        /* open the file if it isn't open */
+                        openWithoutParams();
+                    }
+                    else if(m_handle == nullptr)
+                    {
+                        return false;
+                    }
+                    if(Util::osfn_lstat(m_path->data(), &stats) == 0)
+                    {
+                        filesizereal = (size_t)stats.st_size;
+                    }
+                    else
+                    {
+                        /* fallback */
+                        fseek(m_handle, 0L, SEEK_END);
+                        filesizereal = ftell(m_handle);
+                        rewind(m_handle);
+                    }
+                    if(readhowmuch == (size_t)-1 || readhowmuch > filesizereal)
+                    {
+                        readhowmuch = filesizereal;
+                    }
+                }
+                else
+                {
+                    /*
+                    // for non-file objects such as stdin
+                    // minimum read bytes should be 1
+                    */
+                    if(readhowmuch == (size_t)-1)
+                    {
+                        readhowmuch = 1;
+                    }
+                }
+                /* +1 for terminator '\0' */
+                dest->data = (char*)Memory::sysMalloc(sizeof(char) * (readhowmuch + 1));
+                if(dest->data == nullptr && readhowmuch != 0)
+                {
+                    return false;
+                }
+                dest->length = fread(dest->data, sizeof(char), readhowmuch, m_handle);
+                if(dest->length == 0 && readhowmuch != 0 && readhowmuch == filesizereal)
+                {
+                    return false;
+                }
+                /* we made use of +1 so we can terminate the string. */
+                if(dest->data != nullptr)
+                {
+                    dest->data[dest->length] = '\0';
+                }
+                return true;
+            }
+
+            int closeFile()
+            {
+                int result;
+                if(m_handle != nullptr && !m_isstd)
+                {
+                    fflush(m_handle);
+                    result = fclose(m_handle);
+                    m_handle = nullptr;
+                    m_isopen = false;
+                    m_number = -1;
+                    m_istty = false;
+                    return result;
+                }
+                return -1;
+            }
+
+            bool openWithoutParams()
+            {
+                if(m_handle != nullptr)
+                {
+                    return true;
+                }
+                if(m_handle == nullptr && !m_isstd)
+                {
+                    m_handle = fopen(m_path->data(), m_mode->data());
+                    if(m_handle != nullptr)
+                    {
+                        m_isopen = true;
+                        m_number = fileno(m_handle);
+                        m_istty = Util::osfn_isatty(m_number);
+                        return true;
+                    }
+                    else
+                    {
+                        m_number = -1;
+                        m_istty = false;
+                    }
+                    return false;
+                }
+                return false;
+            }
+
+    };
+
+    class Module : public Object
+    {
+        public:
+            using ModLoaderFN = void(*)();
+
+        public:
+            static Module* make(String* name, const char* file, bool imported, bool retain)
+            {
+                Module* module;
+                auto gcs = SharedState::get();
+                module = SharedState::gcMakeObject<Module>(Object::OTYP_MODULE, retain);
+                module->m_deftable.initTable(module);
+                module->m_modname = name;
+                module->m_physicalpath = nullptr;
+                gcs->vmStackPush(Value::fromObject(module));
+                module->m_physicalpath = String::copy(file);
+                SharedState::gcWriteBarrier(module, module->m_physicalpath);
+                gcs->vmStackPop();
+                module->m_fnunloaderptr = nullptr;
+                module->m_fnpreloaderptr = nullptr;
+                module->m_handle = nullptr;
+                module->m_imported = imported;
+                return module;
+            }
+
+            static bool addSearchPathObj(String* os)
+            {
+                auto gcs = SharedState::get();
+                gcs->m_importpath.push(Value::fromObject(os));
+                return true;
+            }
+
+            static void closeImportHandle(void* hnd)
+            {
+                (void)hnd;
+            }
+
+            static bool addSearchPath(const char* path)
+            {
+                return addSearchPathObj(String::copy(path));
+            }
+
+            static void destroy(Module* module)
+            {
+                module->m_deftable.deInit();
+                /*
+                Memory::sysFree(module->m_modname);
+                Memory::sysFree(module->m_physicalpath);
+                */
+                if(module->m_fnunloaderptr != nullptr && module->m_imported)
+                {
+                    auto asfn = module->m_fnunloaderptr;
+                    asfn();
+                }
+                if(module->m_handle != nullptr)
+                {
+                    Module::closeImportHandle(module->m_handle);
+                }
+            }
+
+            static StrBuffer* resolvePath(String* modulename, const char* currentfile, char* rootfile, bool isrelative)
+            {
+                size_t i;
+                size_t mlen;
+                size_t splen;
+                char* path1;
+                char* path2;
+                const char* cstrpath;
+                struct stat stroot;
+                struct stat stmod;
+                String* pitem;
+                StrBuffer* pathbuf;
+                (void)rootfile;
+                (void)isrelative;
+                (void)stroot;
+                (void)stmod;
+                path1 = nullptr;
+                path2 = nullptr;
+                auto gcs = SharedState::get();
+                // a full path was supplied, i.e., require("some/path.nn")
+                if(File::fileExists(modulename->data()))
+                {
+                    pathbuf = Memory::make<StrBuffer>();
+                    pathbuf->append(modulename->data(), modulename->length());
+                    return pathbuf;
+                }
+                mlen = modulename->length();
+                splen = gcs->m_importpath.count();
+                for(i = 0; i < splen; i++)
+                {
+                    auto pobj = gcs->m_importpath.get(i);
+                    pitem = pobj.asString();
+                    pathbuf = Memory::make<StrBuffer>();
+                    pathbuf->append(pitem->data(), pitem->length());
+                    if(pathbuf->contains('@'))
+                    {
+                        pathbuf->replace('@', modulename->data(), mlen);
+                    }
+                    else
+                    {
+                        pathbuf->append("/");
+                        pathbuf->append(modulename->data(), modulename->length());
+                        pathbuf->append(NEON_CONFIG_FILEEXT);
+                    }
+                    cstrpath = pathbuf->data();
+                    fprintf(stderr, "import: trying '%s' ... ", cstrpath);
+                    if(File::fileExists(cstrpath))
+                    {
+                        path1 = Util::osfn_realpath(cstrpath, nullptr);
+                        fprintf(stderr, "found!\n");
+                        /* stop a core library from importing itself */
+                        if(currentfile != nullptr)
+                        {
+                            if(stat(currentfile, &stroot) == -1)
+                            {
+                                fprintf(stderr, "resolvepath: failed to stat current file '%s'\n", currentfile);
+                                return nullptr;
+                            }
+                            if(stat(cstrpath, &stmod) == -1)
+                            {
+                                fprintf(stderr, "resolvepath: failed to stat module file '%s'\n", cstrpath);
+                                return nullptr;
+                            }
+                            if(stroot.st_ino == stmod.st_ino)
+                            {
+                                fprintf(stderr, "resolvepath: refusing to import itself\n");
+                                return nullptr;
+                            }
+                            path2 = Util::osfn_realpath(currentfile, nullptr);
+                            if(path1 != nullptr && path2 != nullptr)
+                            {
+                                if(memcmp(path1, path2, (int)strlen(path2)) == 0)
+                                {
+                                    Memory::sysFree(path1);
+                                    Memory::sysFree(path2);
+                                    path1 = nullptr;
+                                    path2 = nullptr;
+                                    fprintf(stderr, "resolvepath: refusing to import itself\n");
+                                    return nullptr;
+                                }
+                            }
+                        }
+                        if(path2 != nullptr)
+                        {
+                            Memory::sysFree(path2);
+                        }
+                        if(path1 != nullptr)
+                        {
+                            Memory::sysFree(path1);
+                        }
+                        return pathbuf;
+                    }
+                    else
+                    {
+                        fprintf(stderr, "does not exist\n");
+                    }
+                    Memory::destroy(pathbuf);
+                }
+                return nullptr;
+            }
+
+            static Module* loadScriptModule(String* modulename)
+            {
+                fprintf(stderr, "in loadScriptModule(): modulename=%.*s\n", (int)modulename->length(), modulename->data());
+                size_t fsz;
+                char* source;
+                StrBuffer* physpath;
+                Blob blob;
+                Value retv;
+                Value callable;
+                Property* field;
+                String* os;
+                Module* module;
+                Function* closure;
+                Function* function;
+                (void)os;
+                auto gcs = SharedState::get();
+                field = gcs->m_openedmodules.getfieldbyostr(modulename);
+                if(field != nullptr)
+                {
+                    Blob::destroy(&blob);
+                    return field->value.asModule();
+                }
+                physpath = resolvePath(modulename, nullptr, nullptr, false);
+                if(physpath == nullptr)
+                {
+                    Blob::destroy(&blob);
+                    NEON_THROWCLASSWITHSOURCEINFO(gcs->m_exceptions.importerror, "module not found: '%s'", modulename->data());
+                    return nullptr;
+                }
+                fprintf(stderr, "loading module from '%s'\n", physpath->data());
+                source = neon::File::readFile(physpath->data(), &fsz, false, 0);
+                if(source == nullptr)
+                {
+                    Memory::destroy(physpath);
+                    NEON_THROWCLASSWITHSOURCEINFO(gcs->m_exceptions.importerror, "could not read import file %s", physpath);
+                    Blob::destroy(&blob);
+                    return nullptr;
+                }
+                module = Module::make(modulename, physpath->data(), true, true);
+                Memory::destroy(physpath);
+                gcs->vmStackPush(Value::fromObject(module));
+                function = compileSourceIntern(module, source, &blob, false);
+                Memory::sysFree(source);
+                gcs->vmStackPush(Value::fromObject(function));
+                closure = Function::makeFuncClosure(function, Value::makeNull());
+                gcs->vmStackPop(2);
+                callable = Value::fromObject(closure);
+                gcs->vmNestCallPrepare(callable, Value::makeNull(), nullptr, 0);
+                if(!gcs->vmNestCallFunction(callable, Value::makeNull(), nullptr, 0, &retv, false))
+                {
+                    Blob::destroy(&blob);
+                    NEON_THROWCLASSWITHSOURCEINFO(gcs->m_exceptions.importerror, "failed to call compiled import closure");
+                    return nullptr;
+                }
+                Blob::destroy(&blob);
+                return module;
+            }
+
+        public:
+            /* was this module imported? */
+            bool m_imported;
+            /* named exports */
+            HashTable<Value, Value> m_deftable;
+            /* the name of this module */
+            String* m_modname;
+            /* physsical location of this module, or nullptr if some other non-physical location */
+            String* m_physicalpath;
+            /* callback to call BEFORE this module is loaded */
+            ModLoaderFN m_fnpreloaderptr;
+            /* callbac to call AFTER this module is unloaded */
+            ModLoaderFN m_fnunloaderptr;
+            /* pointer that is based to preloader/unloader */
+            void* m_handle;
+
+        public:
+            void setInternFileField()
+            {
+                return;
+                m_deftable.set(Value::fromObject(String::intern("__file__")), Value::fromObject(String::copyObject(m_physicalpath)));
+            }
+    };
+
+    class Range : public Object
+    {
+        public:
+            static Range* make(int lower, int upper)
+            {
+                Range* range;
+                range = SharedState::gcMakeObject<Range>(Object::OTYP_RANGE, false);
+                range->m_lower = lower;
+                range->m_upper = upper;
+                if(upper > lower)
+                {
+                    range->m_range = upper - lower;
+                }
+                else
+                {
+                    range->m_range = lower - upper;
+                }
+                return range;
+            }
+
+        public:
+            int m_lower;
+            int m_upper;
+            int m_range;
+    };
+
+    class Switch : public Object
+    {
+        public:
+            static Switch* make()
+            {
+                Switch* sw;
+                sw = SharedState::gcMakeObject<Switch>(Object::OTYP_SWITCH, false);
+                sw->m_table.initTable(sw);
+                sw->m_defaultjump = -1;
+                sw->m_exitjump = -1;
+                return sw;
+            }
+
+        public:
+            int m_defaultjump;
+            int m_exitjump;
+            HashTable<Value, Value> m_table;
+    };
+
+    class Userdata : public Object
+    {
+        public:
+            using PtrFreeFN = void(*)(void*);
+
+        public:
+            static Userdata* make(void* pointer, const char* name)
+            {
+                Userdata* ptr;
+                ptr = SharedState::gcMakeObject<Userdata>(Object::OTYP_USERDATA, false);
+                ptr->m_pointer = pointer;
+                ptr->m_udname = Util::stringDup(name);
+                ptr->m_ondestroyfn = nullptr;
+                return ptr;
+            }
+
+        public:
+            void* m_pointer;
+            char* m_udname;
+            PtrFreeFN m_ondestroyfn;
+    };
+
+    class ValPrinter
+    {
+        public:
+            ValPrinter(IOStream* pr) = delete;
+
+            static void printValue(IOStream* pr, Value value, bool fixstring, bool invmethod)
+            {
+                if(value.isNull())
+                {
+                    pr->writeString("null");
+                }
+                else if(value.isBool())
+                {
+                    pr->writeString(value.asBool() ? "true" : "false");
+                }
+                else if(value.isNumber())
+                {
+                    printNumber(pr, value);
+                }
+                else
+                {
+                    printObject(pr, value, fixstring, invmethod);
+                }
+            }
+
+            static void printObject(IOStream* pr, Value value, bool fixstring, bool invmethod)
+            {
+                Object* obj;
+                obj = value.asObject();
+                switch(obj->m_objtype)
+                {
+                    case Object::OTYP_INVALID:
+                        {
+                        }
+                        break;
+                    case Object::OTYP_SWITCH:
+                        {
+                            pr->writeString("<switch>");
+                        }
+                        break;
+                    case Object::OTYP_USERDATA:
+                        {
+                            pr->format("<userdata %s>", value.asUserdata()->m_udname);
+                        }
+                        break;
+                    case Object::OTYP_RANGE:
+                        {
+                            Range* range;
+                            range = value.asRange();
+                            pr->format("<range %d .. %d>", range->m_lower, range->m_upper);
+                        }
+                        break;
+                    case Object::OTYP_FILE:
+                        {
+                            printFile(pr, value.asFile());
+                        }
+                        break;
+                    case Object::OTYP_DICT:
+                        {
+                            printDict(pr, value.asDict());
+                        }
+                        break;
+                    case Object::OTYP_ARRAY:
+                        {
+                            printArray(pr, value.asArray());
+                        }
+                        break;
+                    case Object::OTYP_FUNCBOUND:
+                        {
+                            Function* bn;
+                            bn = value.asFunction();
+                            printFunction(pr, bn->m_fnvals.fnmethod.method->m_fnvals.fnclosure.scriptfunc);
+                        }
+                        break;
+                    case Object::OTYP_MODULE:
+                        {
+                            Module* mod;
+                            mod = value.asModule();
+                            pr->format("<module '%.*s' at '%s'>", (int)mod->m_modname->length(), mod->m_modname->data(), mod->m_physicalpath->data());
+                        }
+                        break;
+                    case Object::OTYP_CLASS:
+                        {
+                            printClass(pr, value, fixstring, invmethod);
+                        }
+                        break;
+                    case Object::OTYP_FUNCCLOSURE:
+                        {
+                            Function* cls;
+                            cls = value.asFunction();
+                            printFunction(pr, cls->m_fnvals.fnclosure.scriptfunc);
+                        }
+                        break;
+                    case Object::OTYP_FUNCSCRIPT:
+                        {
+                            Function* fn;
+                            fn = value.asFunction();
+                            printFunction(pr, fn);
+                        }
+                        break;
+                    case Object::OTYP_INSTANCE:
+                        {
+                            /* @TODO: support the toString() override */
+                            Instance* instance;
+                            instance = value.asInstance();
+                            printInstance(pr, instance, invmethod);
+                        }
+                        break;
+                    case Object::OTYP_FUNCNATIVE:
+                        {
+                            Function* native;
+                            native = value.asFunction();
+                            pr->format("<function %s(native) at %p>", native->m_funcname->data(), (void*)native);
+                        }
+                        break;
+                    case Object::OTYP_UPVALUE:
+                        {
+                            pr->format("<upvalue>");
+                        }
+                        break;
+                    case Object::OTYP_STRING:
+                        {
+                            String* string;
+                            string = value.asString();
+                            if(fixstring)
+                            {
+                                pr->writeQuotedString(string->rawData(), string->length(), true);
+                            }
+                            else
+                            {
+                                pr->writeString(string->rawData(), string->length());
+                            }
+                        }
+                        break;
+                }
+            }
+
+            static void printNumber(IOStream* pr, Value value)
+            {
+                double dn;
+                dn = value.asNumber();
+                pr->format("%.16g", dn);
+            }
+
+            static void printFunction(IOStream* pr, Function* func)
+            {
+                if(func->m_funcname == nullptr)
+                {
+                    pr->format("<script at %p>", (void*)func);
+                }
+                else
+                {
+                    if(func->m_fnvals.fnscriptfunc.isvariadic)
+                    {
+                        pr->format("<function %s(%d...) at %p>", func->m_funcname->data(), func->m_fnvals.fnscriptfunc.arity, (void*)func);
+                    }
+                    else
+                    {
+                        pr->format("<function %s(%d) at %p>", func->m_funcname->data(), func->m_fnvals.fnscriptfunc.arity, (void*)func);
+                    }
+                }
+            }
+
+            static void printArray(IOStream* pr, Array* list)
+            {
+                size_t i;
+                size_t vsz;
+                bool isrecur;
+                Value val;
+                Array* subarr;
+                vsz = list->count();
+                pr->format("[");
+                for(i = 0; i < vsz; i++)
+                {
+                    isrecur = false;
+                    val = list->get(i);
+                    if(val.isArray())
+                    {
+                        subarr = val.asArray();
+                        if(subarr == list)
+                        {
+                            isrecur = true;
+                        }
+                    }
+                    if(isrecur)
+                    {
+                        pr->format("<recursion>");
+                    }
+                    else
+                    {
+                        printValue(pr, val, true, true);
+                    }
+                    if(i != vsz - 1)
+                    {
+                        pr->format(",");
+                    }
+                    if(pr->m_shortenvalues && (i >= pr->m_maxvallength))
+                    {
+                        pr->format(" [%zd items]", vsz);
+                        break;
+                    }
+                }
+                pr->format("]");
+            }
+
+            static void printDict(IOStream* pr, Dict* dict)
+            {
+                size_t i;
+                size_t dsz;
+                bool keyisrecur;
+                bool valisrecur;
+                Value val;
+                Dict* subdict;
+                dsz = dict->m_htkeys.count();
+                pr->format("{");
+                for(i = 0; i < dsz; i++)
+                {
+                    valisrecur = false;
+                    keyisrecur = false;
+                    val = dict->m_htkeys.get(i);
+                    if(val.isDict())
+                    {
+                        subdict = val.asDict();
+                        if(subdict == dict)
+                        {
+                            valisrecur = true;
+                        }
+                    }
+                    if(valisrecur)
+                    {
+                        pr->format("<recursion>");
+                    }
+                    else
+                    {
+                        printValue(pr, val, true, true);
+                    }
+                    pr->format(": ");
+                    auto field = dict->m_htvalues.getfield(dict->m_htkeys.get(i));
+                    if(field != nullptr)
+                    {
+                        if(field->value.isDict())
+                        {
+                            subdict = field->value.asDict();
+                            if(subdict == dict)
+                            {
+                                keyisrecur = true;
+                            }
+                        }
+                        if(keyisrecur)
+                        {
+                            pr->format("<recursion>");
+                        }
+                        else
+                        {
+                            printValue(pr, field->value, true, true);
+                        }
+                    }
+                    if(i != dsz - 1)
+                    {
+                        pr->format(", ");
+                    }
+                    if(pr->m_shortenvalues && (pr->m_maxvallength >= i))
+                    {
+                        pr->format(" [%zd items]", dsz);
+                        break;
+                    }
+                }
+                pr->format("}");
+            }
+
+            static void printFile(IOStream* pr, File* file)
+            {
+                pr->format("<file at %s in mode %s>", file->m_path->data(), file->m_mode->data());
+            }
+
+            static void printInstance(IOStream* pr, Instance* instance, bool invmethod)
+            {
+                (void)invmethod;
+                pr->format("<instance of %s at %p>", instance->m_instanceclass->m_classname->data(), (void*)instance);
+            }
+
+            static void printTable(IOStream* pr, HashTable<Value, Value>* table)
+            {
+                size_t i;
+                size_t hcap;
+                hcap = table->capacity();
+                pr->format("{");
+                for(i = 0; i < (size_t)hcap; i++)
+                {
+                    auto entry = table->entryatindex(i);
+                    if(entry->key.isNull())
+                    {
+                        continue;
+                    }
+                    printValue(pr, entry->key, true, false);
+                    pr->format(":");
+                    printValue(pr, entry->value.value, true, false);
+                    auto nextentry = table->entryatindex(i + 1);
+                    if((nextentry != nullptr) && !nextentry->key.isNull())
+                    {
+                        if((i + 1) < (size_t)hcap)
+                        {
+                            pr->format(",");
+                        }
+                    }
+                }
+                pr->format("}");
+            }
+
+            static void printClass(IOStream* pr, Value value, bool fixstring, bool invmethod)
+            {
+                bool oldexp;
+                Class* klass;
+                (void)fixstring;
+                (void)invmethod;
+                klass = value.asClass();
+                if(pr->m_jsonmode)
+                {
+                    pr->format("{");
+                    {
+                        {
+                            pr->format("name: ");
+                            ValPrinter::printValue(pr, Value::fromObject(klass->m_classname), true, false);
+                            pr->format(",");
+                        }
+                        {
+                            pr->format("superclass: ");
+                            oldexp = pr->m_jsonmode;
+                            pr->m_jsonmode = false;
+                            printValue(pr, Value::fromObject(klass->m_superclass), true, false);
+                            pr->m_jsonmode = oldexp;
+                            pr->format(",");
+                        }
+                        {
+                            pr->format("constructor: ");
+                            printValue(pr, klass->m_constructor, true, false);
+                            pr->format(",");
+                        }
+                        {
+                            pr->format("instanceproperties:");
+                            printTable(pr, &klass->m_instproperties);
+                            pr->format(",");
+                        }
+                        {
+                            pr->format("staticproperties:");
+                            printTable(pr, &klass->m_staticproperties);
+                            pr->format(",");
+                        }
+                        {
+                            pr->format("instancemethods:");
+                            printTable(pr, &klass->m_instmethods);
+                            pr->format(",");
+                        }
+                        {
+                            pr->format("staticmethods:");
+                            printTable(pr, &klass->m_staticmethods);
+                        }
+                    }
+                    pr->format("}");
+                }
+                else
+                {
+                    pr->format("<class %s at %p>", klass->m_classname->data(), (void*)klass);
+                }
+            }
+    };
+
+    class FormatInfo
+    {
+        public:
+            /* length of the format string */
+            size_t m_fmtlen;
+            /* the actual format string */
+            const char* m_fmtstr;
+            IOStream* m_writer;
+
+        public:
+            FormatInfo(IOStream* writer, const char* fmtstr, size_t fmtlen)
+            {
+                m_fmtstr = fmtstr;
+                m_fmtlen = fmtlen;
+                m_writer = writer;
+            }
+
+            bool formatWithArgs(size_t argc, size_t argbegin, Value* argv)
+            {
+                int ch;
+                int ival;
+                int nextch;
+                bool ok;
+                size_t i;
+                size_t argpos;
+                Value cval;
+                i = 0;
+                auto gcs = SharedState::get();
+                argpos = argbegin;
+                ok = true;
+                while(i < m_fmtlen)
+                {
+                    ch = m_fmtstr[i];
+                    nextch = -1;
+                    if((i + 1) < m_fmtlen)
+                    {
+                        nextch = m_fmtstr[i + 1];
+                    }
+                    i++;
+                    if(ch == '%')
+                    {
+                        if(nextch == '%')
+                        {
+                            m_writer->writeChar('%');
+                        }
+                        else
+                        {
+                            i++;
+                            if(argpos > argc)
+                            {
+                                NEON_THROWCLASSWITHSOURCEINFO(gcs->m_exceptions.argumenterror, "too few arguments");
+                                ok = false;
+                                cval = Value::makeNull();
+                            }
+                            else
+                            {
+                                cval = argv[argpos];
+                            }
+                            argpos++;
+                            switch(nextch)
+                            {
+                                case 'q':
+                                case 'p':
+                                {
+                                    ValPrinter::printValue(m_writer, cval, true, true);
+                                }
+                                break;
+                                case 'c':
+                                {
+                                    ival = (int)cval.asNumber();
+                                    m_writer->format("%c", ival);
+                                }
+                                break;
+                                /* TODO: implement actual field formatting */
+                                case 's':
+                                case 'd':
+                                case 'i':
+                                case 'g':
+                                {
+                                    ValPrinter::printValue(m_writer, cval, false, true);
+                                }
+                                break;
+                                default:
+                                {
+                                    NEON_THROWCLASSWITHSOURCEINFO(gcs->m_exceptions.argumenterror, "unknown/invalid format flag '%%c'", nextch);
+                                }
+                                break;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        m_writer->writeChar(ch);
+                    }
+                }
+                return ok;
+            }
+    };
+
+    class AstToken
+    {
+        public:
+            enum Type
+            {
+                T_NEWLINE,
+                T_PARENOPEN,
+                T_PARENCLOSE,
+                T_BRACKETOPEN,
+                T_BRACKETCLOSE,
+                T_BRACEOPEN,
+                T_BRACECLOSE,
+                T_SEMICOLON,
+                T_COMMA,
+                T_BACKSLASH,
+                T_EXCLMARK,
+                T_NOTEQUAL,
+                T_COLON,
+                T_AT,
+                T_DOT,
+                T_DOUBLEDOT,
+                T_TRIPLEDOT,
+                T_PLUS,
+                T_PLUSASSIGN,
+                T_INCREMENT,
+                T_MINUS,
+                T_MINUSASSIGN,
+                T_DECREMENT,
+                T_MULTIPLY,
+                T_MULTASSIGN,
+                T_POWEROF,
+                T_POWASSIGN,
+                T_DIVIDE,
+                T_DIVASSIGN,
+                T_ASSIGN,
+                T_EQUAL,
+                T_LESSTHAN,
+                T_LESSEQUAL,
+                T_LEFTSHIFT,
+                T_LEFTSHIFTASSIGN,
+                T_GREATERTHAN,
+                T_GREATER_EQ,
+                T_RIGHTSHIFT,
+                T_RIGHTSHIFTASSIGN,
+                T_MODULO,
+                T_PERCENT_EQ,
+                T_AMP,
+                T_AMP_EQ,
+                T_BAR,
+                T_BAR_EQ,
+                T_TILDE,
+                T_TILDE_EQ,
+                T_XOR,
+                T_XOR_EQ,
+                T_QUESTION,
+                T_KWAND,
+                T_KWAS,
+                T_KWASSERT,
+                T_KWBREAK,
+                T_KWCATCH,
+                T_KWCLASS,
+                T_KWCONTINUE,
+                T_KWFUNCTION,
+                T_KWDEFAULT,
+                T_KWTHROW,
+                T_KWDO,
+                T_KWECHO,
+                T_KWELSE,
+                T_KWFALSE,
+                T_KWFINALLY,
+                T_KWFOREACH,
+                T_KWIF,
+                T_KWIN,
+                T_KWINSTANCEOF,
+                T_KWFOR,
+                T_KWNULL,
+                T_KWNEW,
+                T_KWOR,
+                T_KWSUPER,
+                T_KWRETURN,
+                T_KWTHIS,
+                T_KWSTATIC,
+                T_KWTRUE,
+                T_KWTRY,
+                T_KWTYPEOF,
+                T_KWSWITCH,
+                T_KWVAR,
+                T_KWCONST,
+                T_KWCASE,
+                T_KWWHILE,
+                T_KWEXTENDS,
+                T_LITERALSTRING,
+                T_LITERALRAWSTRING,
+                T_LITNUMREG,
+                T_LITNUMBIN,
+                T_LITNUMOCT,
+                T_LITNUMHEX,
+                T_IDENTNORMAL,
+                T_DECORATOR,
+                T_INTERPOLATION,
+                T_EOF,
+                T_ERROR,
+                T_KWEMPTY,
+                T_UNDEFINED,
+                T_TOKCOUNT
+            };
+
+        public:
+            bool isglobal;
+            Type m_toktype;
+            const char* m_start;
+            int length;
+            int m_line;
+    };
+
+    class AstLexer
+    {
+        public:
+            enum
+            {
+                /* how deep template strings can be nested (i.e., "foo${getBar("quux${getBonk("...")}")}") */
+                MaxStrTplDepth = 8,
+            };
+
+        public:
+            static bool lexUtilIsDigit(char c)
+            {
+                return c >= '0' && c <= '9';
+            }
+
+            static bool lexUtilIsBinary(char c)
+            {
+                return c == '0' || c == '1';
+            }
+
+            static bool lexUtilIsAlpha(char c)
+            {
+                return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+            }
+
+            static bool lexUtilIsOctal(char c)
+            {
+                return c >= '0' && c <= '7';
+            }
+
+            static bool lexUtilIsHexadecimal(char c)
+            {
+                return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+            }
+
+            static const char* tokTypeToString(int t)
+            {
+                switch(t)
+                {
+                    case AstToken::T_NEWLINE:
+                        return "AstToken::T_NEWLINE";
+                    case AstToken::T_PARENOPEN:
+                        return "AstToken::T_PARENOPEN";
+                    case AstToken::T_PARENCLOSE:
+                        return "AstToken::T_PARENCLOSE";
+                    case AstToken::T_BRACKETOPEN:
+                        return "AstToken::T_BRACKETOPEN";
+                    case AstToken::T_BRACKETCLOSE:
+                        return "AstToken::T_BRACKETCLOSE";
+                    case AstToken::T_BRACEOPEN:
+                        return "AstToken::T_BRACEOPEN";
+                    case AstToken::T_BRACECLOSE:
+                        return "AstToken::T_BRACECLOSE";
+                    case AstToken::T_SEMICOLON:
+                        return "AstToken::T_SEMICOLON";
+                    case AstToken::T_COMMA:
+                        return "AstToken::T_COMMA";
+                    case AstToken::T_BACKSLASH:
+                        return "AstToken::T_BACKSLASH";
+                    case AstToken::T_EXCLMARK:
+                        return "AstToken::T_EXCLMARK";
+                    case AstToken::T_NOTEQUAL:
+                        return "AstToken::T_NOTEQUAL";
+                    case AstToken::T_COLON:
+                        return "AstToken::T_COLON";
+                    case AstToken::T_AT:
+                        return "AstToken::T_AT";
+                    case AstToken::T_DOT:
+                        return "AstToken::T_DOT";
+                    case AstToken::T_DOUBLEDOT:
+                        return "AstToken::T_DOUBLEDOT";
+                    case AstToken::T_TRIPLEDOT:
+                        return "AstToken::T_TRIPLEDOT";
+                    case AstToken::T_PLUS:
+                        return "AstToken::T_PLUS";
+                    case AstToken::T_PLUSASSIGN:
+                        return "AstToken::T_PLUSASSIGN";
+                    case AstToken::T_INCREMENT:
+                        return "AstToken::T_INCREMENT";
+                    case AstToken::T_MINUS:
+                        return "AstToken::T_MINUS";
+                    case AstToken::T_MINUSASSIGN:
+                        return "AstToken::T_MINUSASSIGN";
+                    case AstToken::T_DECREMENT:
+                        return "AstToken::T_DECREMENT";
+                    case AstToken::T_MULTIPLY:
+                        return "AstToken::T_MULTIPLY";
+                    case AstToken::T_MULTASSIGN:
+                        return "AstToken::T_MULTASSIGN";
+                    case AstToken::T_POWEROF:
+                        return "AstToken::T_POWEROF";
+                    case AstToken::T_POWASSIGN:
+                        return "AstToken::T_POWASSIGN";
+                    case AstToken::T_DIVIDE:
+                        return "AstToken::T_DIVIDE";
+                    case AstToken::T_DIVASSIGN:
+                        return "AstToken::T_DIVASSIGN";
+                    case AstToken::T_ASSIGN:
+                        return "AstToken::T_ASSIGN";
+                    case AstToken::T_EQUAL:
+                        return "AstToken::T_EQUAL";
+                    case AstToken::T_LESSTHAN:
+                        return "AstToken::T_LESSTHAN";
+                    case AstToken::T_LESSEQUAL:
+                        return "AstToken::T_LESSEQUAL";
+                    case AstToken::T_LEFTSHIFT:
+                        return "AstToken::T_LEFTSHIFT";
+                    case AstToken::T_LEFTSHIFTASSIGN:
+                        return "AstToken::T_LEFTSHIFTASSIGN";
+                    case AstToken::T_GREATERTHAN:
+                        return "AstToken::T_GREATERTHAN";
+                    case AstToken::T_GREATER_EQ:
+                        return "AstToken::T_GREATER_EQ";
+                    case AstToken::T_RIGHTSHIFT:
+                        return "AstToken::T_RIGHTSHIFT";
+                    case AstToken::T_RIGHTSHIFTASSIGN:
+                        return "AstToken::T_RIGHTSHIFTASSIGN";
+                    case AstToken::T_MODULO:
+                        return "AstToken::T_MODULO";
+                    case AstToken::T_PERCENT_EQ:
+                        return "AstToken::T_PERCENT_EQ";
+                    case AstToken::T_AMP:
+                        return "AstToken::T_AMP";
+                    case AstToken::T_AMP_EQ:
+                        return "AstToken::T_AMP_EQ";
+                    case AstToken::T_BAR:
+                        return "AstToken::T_BAR";
+                    case AstToken::T_BAR_EQ:
+                        return "AstToken::T_BAR_EQ";
+                    case AstToken::T_TILDE:
+                        return "AstToken::T_TILDE";
+                    case AstToken::T_TILDE_EQ:
+                        return "AstToken::T_TILDE_EQ";
+                    case AstToken::T_XOR:
+                        return "AstToken::T_XOR";
+                    case AstToken::T_XOR_EQ:
+                        return "AstToken::T_XOR_EQ";
+                    case AstToken::T_QUESTION:
+                        return "AstToken::T_QUESTION";
+                    case AstToken::T_KWAND:
+                        return "AstToken::T_KWAND";
+                    case AstToken::T_KWAS:
+                        return "AstToken::T_KWAS";
+                    case AstToken::T_KWASSERT:
+                        return "AstToken::T_KWASSERT";
+                    case AstToken::T_KWBREAK:
+                        return "AstToken::T_KWBREAK";
+                    case AstToken::T_KWCATCH:
+                        return "AstToken::T_KWCATCH";
+                    case AstToken::T_KWCLASS:
+                        return "AstToken::T_KWCLASS";
+                    case AstToken::T_KWCONTINUE:
+                        return "AstToken::T_KWCONTINUE";
+                    case AstToken::T_KWFUNCTION:
+                        return "AstToken::T_KWFUNCTION";
+                    case AstToken::T_KWDEFAULT:
+                        return "AstToken::T_KWDEFAULT";
+                    case AstToken::T_KWTHROW:
+                        return "AstToken::T_KWTHROW";
+                    case AstToken::T_KWDO:
+                        return "AstToken::T_KWDO";
+                    case AstToken::T_KWECHO:
+                        return "AstToken::T_KWECHO";
+                    case AstToken::T_KWELSE:
+                        return "AstToken::T_KWELSE";
+                    case AstToken::T_KWFALSE:
+                        return "AstToken::T_KWFALSE";
+                    case AstToken::T_KWFINALLY:
+                        return "AstToken::T_KWFINALLY";
+                    case AstToken::T_KWFOREACH:
+                        return "AstToken::T_KWFOREACH";
+                    case AstToken::T_KWIF:
+                        return "AstToken::T_KWIF";
+                    case AstToken::T_KWIN:
+                        return "AstToken::T_KWIN";
+                    case AstToken::T_KWFOR:
+                        return "AstToken::T_KWFOR";
+                    case AstToken::T_KWNULL:
+                        return "AstToken::T_KWNULL";
+                    case AstToken::T_KWNEW:
+                        return "AstToken::T_KWNEW";
+                    case AstToken::T_KWOR:
+                        return "AstToken::T_KWOR";
+                    case AstToken::T_KWSUPER:
+                        return "AstToken::T_KWSUPER";
+                    case AstToken::T_KWRETURN:
+                        return "AstToken::T_KWRETURN";
+                    case AstToken::T_KWTHIS:
+                        return "AstToken::T_KWTHIS";
+                    case AstToken::T_KWSTATIC:
+                        return "AstToken::T_KWSTATIC";
+                    case AstToken::T_KWTRUE:
+                        return "AstToken::T_KWTRUE";
+                    case AstToken::T_KWTRY:
+                        return "AstToken::T_KWTRY";
+                    case AstToken::T_KWSWITCH:
+                        return "AstToken::T_KWSWITCH";
+                    case AstToken::T_KWVAR:
+                        return "AstToken::T_KWVAR";
+                    case AstToken::T_KWCONST:
+                        return "AstToken::T_KWCONST";
+                    case AstToken::T_KWCASE:
+                        return "AstToken::T_KWCASE";
+                    case AstToken::T_KWWHILE:
+                        return "AstToken::T_KWWHILE";
+                    case AstToken::T_KWINSTANCEOF:
+                        return "AstToken::T_KWINSTANCEOF";
+                    case AstToken::T_KWEXTENDS:
+                        return "AstToken::T_KWEXTENDS";
+                    case AstToken::T_LITERALSTRING:
+                        return "AstToken::T_LITERALSTRING";
+                    case AstToken::T_LITERALRAWSTRING:
+                        return "AstToken::T_LITERALRAWSTRING";
+                    case AstToken::T_LITNUMREG:
+                        return "AstToken::T_LITNUMREG";
+                    case AstToken::T_LITNUMBIN:
+                        return "AstToken::T_LITNUMBIN";
+                    case AstToken::T_LITNUMOCT:
+                        return "AstToken::T_LITNUMOCT";
+                    case AstToken::T_LITNUMHEX:
+                        return "AstToken::T_LITNUMHEX";
+                    case AstToken::T_IDENTNORMAL:
+                        return "AstToken::T_IDENTNORMAL";
+                    case AstToken::T_DECORATOR:
+                        return "AstToken::T_DECORATOR";
+                    case AstToken::T_INTERPOLATION:
+                        return "AstToken::T_INTERPOLATION";
+                    case AstToken::T_EOF:
+                        return "AstToken::T_EOF";
+                    case AstToken::T_ERROR:
+                        return "AstToken::T_ERROR";
+                    case AstToken::T_KWEMPTY:
+                        return "AstToken::T_KWEMPTY";
+                    case AstToken::T_UNDEFINED:
+                        return "AstToken::T_UNDEFINED";
+                    case AstToken::T_TOKCOUNT:
+                        return "AstToken::T_TOKCOUNT";
+                }
+                return "?invalid?";
+            }
+
+            static AstLexer* make(const char* source)
+            {
+                AstLexer* lex;
+                lex = Memory::make<AstLexer>();
+                lex->init(source);
+                lex->m_onstack = false;
+                return lex;
+            }
+
+            static void destroy(AstLexer* lex)
+            {
+                if(!lex->m_onstack)
+                {
+                    Memory::sysFree(lex);
+                }
+            }
+
+        public:
+            bool m_onstack;
+            const char* m_start;
+            const char* m_sourceptr;
+            int m_line;
+            int m_tplstringcount;
+            int m_tplstringbuffer[MaxStrTplDepth];
+
+        public:
+            /*
+             * allows for the lexer to created on the stack.
+             */
+            void init(const char* source)
+            {
+                m_sourceptr = source;
+                m_start = source;
+                m_sourceptr = m_start;
+                m_line = 1;
+                m_tplstringcount = -1;
+                m_onstack = true;
+            }
+
+            bool isatend()
+            {
+                return *m_sourceptr == '\0';
+            }
+
+            AstToken createtoken(AstToken::Type type)
+            {
+                AstToken t;
+                t.isglobal = false;
+                t.m_toktype = type;
+                t.m_start = m_start;
+                t.length = (int)(m_sourceptr - m_start);
+                t.m_line = m_line;
+                return t;
+            }
+
+            template<typename... ArgsT>
+            AstToken errortoken(const char* fmt, ArgsT&&... args)
+            {
+                constexpr static auto tmpsprintf = sprintf;
+                int length;
+                char* buf;
+                AstToken t;
+                buf = (char*)Memory::sysMalloc(sizeof(char) * 1024);
+                /* TODO: used to be vasprintf. need to check how much to actually allocate! */
+                length = tmpsprintf(buf, fmt, args...);
+                t.m_toktype = AstToken::T_ERROR;
+                t.m_start = buf;
+                t.isglobal = false;
+                if(buf != nullptr)
+                {
+                    t.length = length;
+                }
+                else
+                {
+                    t.length = 0;
+                }
+                t.m_line = m_line;
+                return t;
+            }
+
+            char advance()
+            {
+                m_sourceptr++;
+                if(m_sourceptr[-1] == '\n')
+                {
+                    m_line++;
+                }
+                return m_sourceptr[-1];
+            }
+
+            bool match(char expected)
+            {
+                if(isatend())
+                {
+                    return false;
+                }
+                if(*m_sourceptr != expected)
+                {
+                    return false;
+                }
+                m_sourceptr++;
+                if(m_sourceptr[-1] == '\n')
+                {
+                    m_line++;
+                }
+                return true;
+            }
+
+            char peekcurr()
+            {
+                return *m_sourceptr;
+            }
+
+            char peekprev()
+            {
+                if(m_sourceptr == m_start)
+                {
+                    return -1;
+                }
+                return m_sourceptr[-1];
+            }
+
+            char peeknext()
+            {
+                if(isatend())
+                {
+                    return '\0';
+                }
+                return m_sourceptr[1];
+            }
+
+            AstToken skipblockcomments()
+            {
+                int nesting;
+                nesting = 1;
+                while(nesting > 0)
+                {
+                    if(isatend())
+                    {
+                        return errortoken("unclosed block comment");
+                    }
+                    /* internal comment open */
+                    if(peekcurr() == '/' && peeknext() == '*')
+                    {
+                        advance();
+                        advance();
+                        nesting++;
+                        continue;
+                    }
+                    /* comment close */
+                    if(peekcurr() == '*' && peeknext() == '/')
+                    {
+                        advance();
+                        advance();
+                        nesting--;
+                        continue;
+                    }
+                    /* regular comment body */
+                    advance();
+                }
+                return createtoken(AstToken::T_UNDEFINED);
+            }
+
+            AstToken skipspace()
+            {
+                char c;
+                AstToken result;
+                result.isglobal = false;
+                for(;;)
+                {
+                    c = peekcurr();
+                    switch(c)
+                    {
+                        case ' ':
+                        case '\r':
+                        case '\t':
+                            {
+                                advance();
+                            }
+                            break;
+                        case '/':
+                            {
+                                if(peeknext() == '/')
+                                {
+                                    while(peekcurr() != '\n' && !isatend())
+                                    {
+                                        advance();
+                                    }
+                                    return createtoken(AstToken::T_UNDEFINED);
+                                }
+                                else if(peeknext() == '*')
+                                {
+                                    advance();
+                                    advance();
+                                    result = skipblockcomments();
+                                    if(result.m_toktype != AstToken::T_UNDEFINED)
+                                    {
+                                        return result;
+                                    }
+                                    break;
+                                }
+                                else
+                                {
+                                    return createtoken(AstToken::T_UNDEFINED);
+                                }
+                            }
+                            break;
+                        /* exit as soon as we see a non-whitespace... */
+                        default:
+                            goto finished;
+                            break;
+                    }
+                }
+            finished:
+                return createtoken(AstToken::T_UNDEFINED);
+            }
+
+            AstToken scanstring(char quote, bool withtemplate, bool permitescapes)
+            {
+                AstToken tkn;
+                while(peekcurr() != quote && !isatend())
+                {
+                    if(withtemplate)
+                    {
+                        /* interpolation started */
+                        if(peekcurr() == '$' && peeknext() == '{' && peekprev() != '\\')
+                        {
+                            if(m_tplstringcount - 1 < MaxStrTplDepth)
+                            {
+                                m_tplstringcount++;
+                                m_tplstringbuffer[m_tplstringcount] = (int)quote;
+                                m_sourceptr++;
+                                tkn = createtoken(AstToken::T_INTERPOLATION);
+                                m_sourceptr++;
+                                return tkn;
+                            }
+                            return errortoken("maximum interpolation nesting of %d exceeded by %d", MaxStrTplDepth, MaxStrTplDepth - m_tplstringcount + 1);
+                        }
+                    }
+                    if(peekcurr() == '\\' && (peeknext() == quote || peeknext() == '\\'))
+                    {
+                        advance();
+                    }
+                    advance();
+                }
+                if(isatend())
+                {
+                    return errortoken("unterminated string (opening quote not matched)");
+                }
+                /* the closing quote */
+                match(quote);
+                if(permitescapes)
+                {
+                    return createtoken(AstToken::T_LITERALSTRING);
+                }
+                return createtoken(AstToken::T_LITERALRAWSTRING);
+            }
+
+            AstToken scannumber()
+            {
+                /* handle binary, octal and hexadecimals */
+                if(peekprev() == '0')
+                {
+                    /* binary number */
+                    if(match('b'))
+                    {
+                        while(lexUtilIsBinary(peekcurr()))
+                        {
+                            advance();
+                        }
+                        return createtoken(AstToken::T_LITNUMBIN);
+                    }
+                    else if(match('c'))
+                    {
+                        while(lexUtilIsOctal(peekcurr()))
+                        {
+                            advance();
+                        }
+                        return createtoken(AstToken::T_LITNUMOCT);
+                    }
+                    else if(match('x'))
+                    {
+                        while(lexUtilIsHexadecimal(peekcurr()))
+                        {
+                            advance();
+                        }
+                        return createtoken(AstToken::T_LITNUMHEX);
+                    }
+                }
+                while(lexUtilIsDigit(peekcurr()))
+                {
+                    advance();
+                }
+                /* dots(.) are only valid here when followed by a digit */
+                if(peekcurr() == '.' && lexUtilIsDigit(peeknext()))
+                {
+                    advance();
+                    while(lexUtilIsDigit(peekcurr()))
+                    {
+                        advance();
+                    }
+                    /*
+                    // E or e are only valid here when followed by a digit and occurring after a dot
+                    */
+                    if((peekcurr() == 'e' || peekcurr() == 'E') && (peeknext() == '+' || peeknext() == '-'))
+                    {
+                        advance();
+                        advance();
+                        while(lexUtilIsDigit(peekcurr()))
+                        {
+                            advance();
+                        }
+                    }
+                }
+                return createtoken(AstToken::T_LITNUMREG);
+            }
+
+            AstToken::Type getidenttype()
+            {
+                /* clang-format off */
+                static const struct
+                {
+                    const char* str;
+                    int tokid;
+                } keywords[] = {
+                    { "and", AstToken::T_KWAND },
+                    { "assert", AstToken::T_KWASSERT },
+                    { "as", AstToken::T_KWAS },
+                    { "break", AstToken::T_KWBREAK },
+                    { "catch", AstToken::T_KWCATCH },
+                    { "class", AstToken::T_KWCLASS },
+                    { "continue", AstToken::T_KWCONTINUE },
+                    { "default", AstToken::T_KWDEFAULT },
+                    { "def", AstToken::T_KWFUNCTION },
+                    { "function", AstToken::T_KWFUNCTION },
+                    { "throw", AstToken::T_KWTHROW },
+                    { "do", AstToken::T_KWDO },
+                    { "echo", AstToken::T_KWECHO },
+                    { "else", AstToken::T_KWELSE },
+                    { "empty", AstToken::T_KWEMPTY },
+                    { "extends", AstToken::T_KWEXTENDS },
+                    { "false", AstToken::T_KWFALSE },
+                    { "finally", AstToken::T_KWFINALLY },
+                    { "foreach", AstToken::T_KWFOREACH },
+                    { "if", AstToken::T_KWIF },
+                    { "in", AstToken::T_KWIN },
+                    { "instanceof", AstToken::T_KWINSTANCEOF },
+                    { "for", AstToken::T_KWFOR },
+                    { "null", AstToken::T_KWNULL },
+                    { "new", AstToken::T_KWNEW },
+                    { "or", AstToken::T_KWOR },
+                    { "super", AstToken::T_KWSUPER },
+                    { "return", AstToken::T_KWRETURN },
+                    { "this", AstToken::T_KWTHIS },
+                    { "static", AstToken::T_KWSTATIC },
+                    { "true", AstToken::T_KWTRUE },
+                    { "try", AstToken::T_KWTRY },
+                    { "typeof", AstToken::T_KWTYPEOF },
+                    { "switch", AstToken::T_KWSWITCH },
+                    { "case", AstToken::T_KWCASE },
+                    { "var", AstToken::T_KWVAR },
+                    { "let", AstToken::T_KWVAR },
+                    { "const", AstToken::T_KWCONST },
+                    { "while", AstToken::T_KWWHILE },
+                    { nullptr, (AstToken::Type)0 }
+                };
+                /* clang-format on */
+                size_t i;
+                size_t kwlen;
+                size_t ofs;
+                const char* kwtext;
+                for(i = 0; keywords[i].str != nullptr; i++)
+                {
+                    kwtext = keywords[i].str;
+                    kwlen = strlen(kwtext);
+                    ofs = (m_sourceptr - m_start);
+                    if(ofs == kwlen)
+                    {
+                        if(memcmp(m_start, kwtext, kwlen) == 0)
+                        {
+                            return (AstToken::Type)keywords[i].tokid;
+                        }
+                    }
+                }
+                return AstToken::T_IDENTNORMAL;
+            }
+
+            AstToken scanident(bool isdollar)
+            {
+                int cur;
+                AstToken tok;
+                cur = peekcurr();
+                if(cur == '$')
+                {
+                    advance();
+                }
+                while(true)
+                {
+                    cur = peekcurr();
+                    if(lexUtilIsAlpha(cur) || lexUtilIsDigit(cur))
+                    {
+                        advance();
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+                tok = createtoken(getidenttype());
+                tok.isglobal = isdollar;
+                return tok;
+            }
+
+            AstToken scandecorator()
+            {
+                while(lexUtilIsAlpha(peekcurr()) || lexUtilIsDigit(peekcurr()))
+                {
+                    advance();
+                }
+                return createtoken(AstToken::T_DECORATOR);
+            }
+
+            AstToken scantoken()
+            {
+                char c;
+                bool isdollar;
+                AstToken tk;
+                AstToken token;
+                tk = skipspace();
+                if(tk.m_toktype != AstToken::T_UNDEFINED)
+                {
+                    return tk;
+                }
+                m_start = m_sourceptr;
+                if(isatend())
+                {
+                    return createtoken(AstToken::T_EOF);
+                }
+                c = advance();
+                if(lexUtilIsDigit(c))
+                {
+                    return scannumber();
+                }
+                else if(lexUtilIsAlpha(c) || (c == '$'))
+                {
+                    isdollar = (c == '$');
+                    return scanident(isdollar);
+                }
+                switch(c)
+                {
+                    case '(':
+                        {
+                            return createtoken(AstToken::T_PARENOPEN);
+                        }
+                        break;
+                    case ')':
+                        {
+                            return createtoken(AstToken::T_PARENCLOSE);
+                        }
+                        break;
+                    case '[':
+                        {
+                            return createtoken(AstToken::T_BRACKETOPEN);
+                        }
+                        break;
+                    case ']':
+                        {
+                            return createtoken(AstToken::T_BRACKETCLOSE);
+                        }
+                        break;
+                    case '{':
+                        {
+                            return createtoken(AstToken::T_BRACEOPEN);
+                        }
+                        break;
+                    case '}':
+                        {
+                            if(m_tplstringcount > -1)
+                            {
+                                token = scanstring((char)m_tplstringbuffer[m_tplstringcount], true, true);
+                                m_tplstringcount--;
+                                return token;
+                            }
+                            return createtoken(AstToken::T_BRACECLOSE);
+                        }
+                        break;
+                    case ';':
                         {
                             return createtoken(AstToken::T_SEMICOLON);
                         }
@@ -9820,9 +14286,10 @@ namespace neon
                             }
                             else
                             {
-                                fname = String::copy(m_sharedprs->m_prevtoken.m_start, m_sharedprs->m_prevtoken.length);
+                                fname = String::internCopy(m_sharedprs->m_prevtoken.m_start, m_sharedprs->m_prevtoken.length);
                             }
                             m_sharedprs->m_currentfunccompiler->m_targetfunc->m_funcname = fname;
+                            SharedState::gcWriteBarrier(m_sharedprs->m_currentfunccompiler->m_targetfunc, fname);
                             gcs->vmStackPop();
                         }
                         /* claiming slot zero for use in class methods */
@@ -10069,20 +14536,20 @@ namespace neon
                 if(type == AstToken::T_LITNUMBIN)
                 {
                     llval = strtoll(source + 2, nullptr, 2);
-                    return Value::makeNumber(llval);
+                    return Value::makeNumberFromInt(llval);
                 }
                 else if(type == AstToken::T_LITNUMOCT)
                 {
                     longval = strtol(source + 2, nullptr, 8);
-                    return Value::makeNumber(longval);
+                    return Value::makeNumberFromInt(longval);
                 }
                 else if(type == AstToken::T_LITNUMHEX)
                 {
                     longval = strtol(source, nullptr, 16);
-                    return Value::makeNumber(longval);
+                    return Value::makeNumberFromInt(longval);
                 }
                 dbval = strtod(source, nullptr);
-                return Value::makeNumber(dbval);
+                return Value::makeNumberOrInt(dbval);
             }
 
             static AstToken utilMakeSynthToken(const char* name)
@@ -10268,6 +14735,7 @@ namespace neon
                         prs->emitbyteandshort(Instruction::OPC_CALLMETHOD, name);
                     }
                     prs->emit1byte(argcount);
+                    prs->emitinlinecache();
                 }
                 else
                 {
@@ -10332,7 +14800,7 @@ namespace neon
                             if(prs->check(AstToken::T_IDENTNORMAL))
                             {
                                 prs->consume(AstToken::T_IDENTNORMAL, "");
-                                prs->emitconst(Value::fromObject(String::copy(prs->m_prevtoken.m_start, prs->m_prevtoken.length)));
+                                prs->emitconst(Value::fromObject(String::internCopy(prs->m_prevtoken.m_start, prs->m_prevtoken.length)));
                             }
                             else
                             {
@@ -10520,7 +14988,7 @@ namespace neon
                 char* str;
                 (void)canassign;
                 str = prs->compilestring(&length, true);
-                prs->emitconst(Value::fromObject(String::take(str, length)));
+                prs->emitconst(Value::fromObject(String::internTake(str, length)));
                 return true;
             }
 
@@ -10530,7 +14998,7 @@ namespace neon
                 char* str;
                 (void)canassign;
                 str = prs->compilestring(&length, false);
-                prs->emitconst(Value::fromObject(String::take(str, length)));
+                prs->emitconst(Value::fromObject(String::internTake(str, length)));
                 return true;
             }
 
@@ -11132,12 +15600,12 @@ namespace neon
                 }
             }
 
-            int getcodeargscount(const Instruction* bytecode, const Value* constants, int ip)
+            static int getcodeargscount(const uint8_t* bytecode, const Value* constants, int ip)
             {
                 int constant;
                 Instruction::OpCode code;
                 Function* fn;
-                code = (Instruction::OpCode)bytecode[ip].code;
+                code = (Instruction::OpCode)bytecode[ip];
                 switch(code)
                 {
                     case Instruction::OPC_EQUAL:
@@ -11179,6 +15647,10 @@ namespace neon
                     case Instruction::OPC_EXPUBLISHTRY:
                     case Instruction::OPC_CLASSGETTHIS:
                     case Instruction::OPC_HALT:
+                    case Instruction::OPC_PRIMADDNUM:
+                    case Instruction::OPC_PRIMADDSTR:
+                    case Instruction::OPC_PRIMSUBTRACTNUM:
+                    case Instruction::OPC_PRIMLESSTHANNUM:
                         return 0;
                     case Instruction::OPC_CALLFUNCTION:
                     case Instruction::OPC_CLASSINVOKESUPERSELF:
@@ -11202,27 +15674,32 @@ namespace neon
                     case Instruction::OPC_PUSHCONSTANT:
                     case Instruction::OPC_POPN:
                     case Instruction::OPC_MAKECLASS:
-                    case Instruction::OPC_PROPERTYGET:
-                    case Instruction::OPC_PROPERTYGETSELF:
-                    case Instruction::OPC_PROPERTYSET:
                     case Instruction::OPC_MAKEARRAY:
                     case Instruction::OPC_MAKEDICT:
                     case Instruction::OPC_SWITCH:
                     case Instruction::OPC_MAKEMETHOD:
+                    case Instruction::OPC_SUPLOCALLOCALADD:
+                    case Instruction::OPC_SUPCONSTLESSJUMP:
+                    case Instruction::OPC_SUPLOCALPROPERTYGET:
             #if 0
                     case Instruction::OPC_FUNCOPTARG:
             #endif
                         return 2;
-                    case Instruction::OPC_CALLMETHOD:
-                    case Instruction::OPC_CLASSINVOKETHIS:
                     case Instruction::OPC_CLASSINVOKESUPER:
                     case Instruction::OPC_CLASSPROPERTYDEFINE:
                         return 3;
+                    case Instruction::OPC_PROPERTYGET:
+                    case Instruction::OPC_PROPERTYGETSELF:
+                    case Instruction::OPC_PROPERTYSET:
+                        return 4;
+                    case Instruction::OPC_CALLMETHOD:
+                    case Instruction::OPC_CLASSINVOKETHIS:
+                        return 5;
                     case Instruction::OPC_EXTRY:
                         return 6;
                     case Instruction::OPC_MAKECLOSURE:
                     {
-                        constant = (bytecode[ip + 1].code << 8) | bytecode[ip + 2].code;
+                        constant = (bytecode[ip + 1] << 8) | bytecode[ip + 2];
                         fn = constants[constant].asFunction();
                         /* There is two byte for the constant, then three for each up value. */
                         return 2 + (fn->m_upvalcount * 3);
@@ -11234,47 +15711,65 @@ namespace neon
                 return 0;
             }
 
-            void emit(uint16_t byte, int line, bool isop)
+            void emit(uint16_t byte, int line)
             {
-                Instruction ins;
-                ins.code = byte;
-                ins.fromsourceline = line;
-                ins.isop = isop;
-                currentblob()->push(ins);
+                currentblob()->push(byte & 0xff, line);
             }
 
             void patchat(size_t idx, uint16_t byte)
             {
-                currentblob()->m_instrucs[idx].code = byte;
+                currentblob()->m_instrucs[idx] = byte & 0xff;
             }
 
             void emitinstruc(uint16_t byte)
             {
-                emit(byte, m_prevtoken.m_line, true);
+                emit(byte, m_prevtoken.m_line);
             }
 
             void emit1byte(uint16_t byte)
             {
-                emit(byte, m_prevtoken.m_line, false);
+                emit(byte, m_prevtoken.m_line);
             }
 
             void emit1short(uint16_t byte)
             {
-                emit((byte >> 8) & 0xff, m_prevtoken.m_line, false);
-                emit(byte & 0xff, m_prevtoken.m_line, false);
+                emit((byte >> 8) & 0xff, m_prevtoken.m_line);
+                emit(byte & 0xff, m_prevtoken.m_line);
             }
 
             void emit2byte(uint16_t byte, uint16_t byte2)
             {
-                emit(byte, m_prevtoken.m_line, false);
-                emit(byte2, m_prevtoken.m_line, false);
+                emit(byte, m_prevtoken.m_line);
+                emit(byte2, m_prevtoken.m_line);
             }
 
             void emitbyteandshort(uint16_t byte, uint16_t byte2)
             {
-                emit(byte, m_prevtoken.m_line, false);
-                emit((byte2 >> 8) & 0xff, m_prevtoken.m_line, false);
-                emit(byte2 & 0xff, m_prevtoken.m_line, false);
+                emit(byte, m_prevtoken.m_line);
+                emit((byte2 >> 8) & 0xff, m_prevtoken.m_line);
+                emit(byte2 & 0xff, m_prevtoken.m_line);
+            }
+
+            /* emits a fresh InlineCache index as operand */
+            void emitinlinecache()
+            {
+                int ic;
+                ic = currentblob()->addInlineCache();
+                if(ic > UINT16_MAX)
+                {
+                    raiseerror("too many property accesses in function");
+                }
+                emit1short(ic);
+            }
+
+            /* emits a variable/property access; property instructions also take an inline cache */
+            void emitvarop(uint16_t op, uint16_t arg)
+            {
+                emitbyteandshort(op, arg);
+                if((op == Instruction::OPC_PROPERTYGET) || (op == Instruction::OPC_PROPERTYGETSELF) || (op == Instruction::OPC_PROPERTYSET))
+                {
+                    emitinlinecache();
+                }
             }
 
             void emitloop(int loopstart)
@@ -11314,6 +15809,7 @@ namespace neon
             {
                 int constant;
                 constant = currentblob()->addConstant(value);
+                SharedState::gcWriteBarrier(m_currentfunccompiler->m_targetfunc, value);
                 return constant;
             }
 
@@ -11407,7 +15903,7 @@ namespace neon
                     
                 }
             #endif
-                str = String::copy(rawstr, rawlen);
+                str = String::internCopy(rawstr, rawlen);
                 return pushconst(Value::fromObject(str));
             }
 
@@ -11488,9 +15984,384 @@ namespace neon
                 emitbyteandshort(Instruction::OPC_GLOBALDEFINE, global);
             }
 
+            /*
+            * if the instruction at ip can be read as a register operand, returns its length, and
+            * stores kind and index of the operand. otherwise returns 0.
+            */
+            int matchregoperand(Blob* blob, int ip, int* kind, int* index)
+            {
+                const uint8_t* code;
+                code = blob->m_instrucs.data();
+                if(ip >= blob->m_count)
+                {
+                    return 0;
+                }
+                switch(code[ip])
+                {
+                    case Instruction::OPC_LOCALGET:
+                    case Instruction::OPC_FUNCARGGET:
+                    {
+                        *kind = Instruction::REGOPND_SLOT;
+                        *index = (code[ip + 1] << 8) | code[ip + 2];
+                        return 3;
+                    }
+                    break;
+                    case Instruction::OPC_PUSHCONSTANT:
+                    {
+                        *kind = Instruction::REGOPND_CONST;
+                        *index = (code[ip + 1] << 8) | code[ip + 2];
+                        if(blob->m_constants.get(*index).isNumber())
+                        {
+                            return 3;
+                        }
+                    }
+                    break;
+                    case Instruction::OPC_PUSHONE:
+                    {
+                        *kind = Instruction::REGOPND_ONE;
+                        *index = 0;
+                        return 1;
+                    }
+                    break;
+                    default:
+                        break;
+                }
+                return 0;
+            }
+
+            /* matches 'LOCALSET|FUNCARGSET <dst>; POPONE' at ip */
+            bool matchregstore(Blob* blob, const uint8_t* istarget, int ip, int* dst)
+            {
+                const uint8_t* code;
+                code = blob->m_instrucs.data();
+                if(((ip + 4) > blob->m_count) || istarget[ip] || istarget[ip + 3])
+                {
+                    return false;
+                }
+                if((code[ip] != Instruction::OPC_LOCALSET) && (code[ip] != Instruction::OPC_FUNCARGSET))
+                {
+                    return false;
+                }
+                if(code[ip + 3] != Instruction::OPC_POPONE)
+                {
+                    return false;
+                }
+                *dst = (code[ip + 1] << 8) | code[ip + 2];
+                return true;
+            }
+
+            /* collects every offset that is the destination of a jump, loop, switch case or exception handler */
+            void markregjumptargets(Blob* blob, uint8_t* istarget)
+            {
+                int i;
+                int ip;
+                int start;
+                int target;
+                const uint8_t* code;
+                Switch* sw;
+                code = blob->m_instrucs.data();
+                ip = 0;
+                while(ip < blob->m_count)
+                {
+                    target = -1;
+                    switch(code[ip])
+                    {
+                        case Instruction::OPC_JUMPIFFALSE:
+                        case Instruction::OPC_JUMPNOW:
+                        case Instruction::OPC_BREAK_PL:
+                            target = ip + 3 + ((code[ip + 1] << 8) | code[ip + 2]);
+                            break;
+                        case Instruction::OPC_LOOP:
+                            target = ip + 3 - ((code[ip + 1] << 8) | code[ip + 2]);
+                            break;
+                        case Instruction::OPC_EXTRY:
+                            {
+                                /* handlers always resume in m_instrucs, but mark them anyway */
+                                istarget[(code[ip + 3] << 8) | code[ip + 4]] = 1;
+                                target = (code[ip + 5] << 8) | code[ip + 6];
+                            }
+                            break;
+                        case Instruction::OPC_SWITCH:
+                            {
+                                sw = blob->m_constants.get((code[ip + 1] << 8) | code[ip + 2]).asSwitch();
+                                start = ip + 3;
+                                for(i = 0; i < sw->m_table.m_htcapacity; i++)
+                                {
+                                    if(!sw->m_table.m_htentries[i].key.isNull())
+                                    {
+                                        istarget[start + (int)sw->m_table.m_htentries[i].value.value.asNumber()] = 1;
+                                    }
+                                }
+                                if(sw->m_defaultjump != -1)
+                                {
+                                    istarget[start + sw->m_defaultjump] = 1;
+                                }
+                                target = start + sw->m_exitjump;
+                            }
+                            break;
+                        default:
+                            break;
+                    }
+                    if((target >= 0) && (target <= blob->m_count))
+                    {
+                        istarget[target] = 1;
+                    }
+                    ip += 1 + getcodeargscount(code, blob->m_constants.data(), ip);
+                }
+            }
+
+            static void putregshort(uint8_t* at, int val)
+            {
+                at[0] = (val >> 8) & 0xff;
+                at[1] = val & 0xff;
+            }
+
+            /*
+            * tries to fuse the stack sequence starting at ip into a single register instruction in m_regcode.
+            * recognized sequences (A and B being register operands, see matchregoperand):
+            *   A; B; PRIMADD|PRIMSUBTRACT|PRIMMULTIPLY|PRIMDIVIDE; LOCALSET d; POPONE -> REGADD.. d, A, B
+            *   A; B; PRIMLESSTHAN|PRIMGREATER; JUMPIFFALSE x; POPONE                -> REGJUMPIFNOT.. A, B, x
+            *   A; LOCALSET d; POPONE                                                -> REGMOVE d, A
+            * none of the instructions after the first may be a jump target, and the encoded instruction
+            * must not be longer than the sequence it replaces.
+            * returns the length of the fused sequence, or 0.
+            */
+            int lowerregisterat(Blob* blob, const uint8_t* istarget, int ip)
+            {
+                int la;
+                int lb;
+                int pos;
+                int dst;
+                int aidx;
+                int bidx;
+                int akind;
+                int bkind;
+                int target;
+                int seqlen;
+                int regop;
+                const uint8_t* code;
+                uint8_t* out;
+                code = blob->m_instrucs.data();
+                out = blob->m_regcode.data() + ip;
+                la = matchregoperand(blob, ip, &akind, &aidx);
+                if(la == 0)
+                {
+                    return 0;
+                }
+                pos = ip + la;
+                /* REGMOVE is 6 bytes, so only operands that take 3 bytes leave enough room */
+                if((la == 3) && matchregstore(blob, istarget, pos, &dst))
+                {
+                    seqlen = (pos + 4) - ip;
+                    out[0] = Instruction::OPC_REGMOVE;
+                    out[1] = akind | ((seqlen - 6) << 4);
+                    putregshort(&out[2], dst);
+                    putregshort(&out[4], aidx);
+                    return seqlen;
+                }
+                if(istarget[pos])
+                {
+                    return 0;
+                }
+                lb = matchregoperand(blob, pos, &bkind, &bidx);
+                if(lb == 0)
+                {
+                    return 0;
+                }
+                pos += lb;
+                if((pos >= blob->m_count) || istarget[pos])
+                {
+                    return 0;
+                }
+                switch(code[pos])
+                {
+                    case Instruction::OPC_PRIMADD:
+                        regop = Instruction::OPC_REGADD;
+                        break;
+                    case Instruction::OPC_PRIMSUBTRACT:
+                        regop = Instruction::OPC_REGSUBTRACT;
+                        break;
+                    case Instruction::OPC_PRIMMULTIPLY:
+                        regop = Instruction::OPC_REGMULTIPLY;
+                        break;
+                    case Instruction::OPC_PRIMDIVIDE:
+                        regop = Instruction::OPC_REGDIVIDE;
+                        break;
+                    case Instruction::OPC_PRIMLESSTHAN:
+                        regop = Instruction::OPC_REGJUMPIFNOTLESS;
+                        break;
+                    case Instruction::OPC_PRIMGREATER:
+                        regop = Instruction::OPC_REGJUMPIFNOTGREATER;
+                        break;
+                    default:
+                        return 0;
+                }
+                pos++;
+                if((regop == Instruction::OPC_REGJUMPIFNOTLESS) || (regop == Instruction::OPC_REGJUMPIFNOTGREATER))
+                {
+                    if(((pos + 4) > blob->m_count) || istarget[pos] || istarget[pos + 3])
+                    {
+                        return 0;
+                    }
+                    if((code[pos] != Instruction::OPC_JUMPIFFALSE) || (code[pos + 3] != Instruction::OPC_POPONE))
+                    {
+                        return 0;
+                    }
+                    target = pos + 3 + ((code[pos + 1] << 8) | code[pos + 2]);
+                    seqlen = (pos + 4) - ip;
+                    if((seqlen < 8) || (target < (ip + seqlen)))
+                    {
+                        return 0;
+                    }
+                    out[0] = regop;
+                    out[1] = akind | (bkind << 2) | ((seqlen - 8) << 4);
+                    putregshort(&out[2], aidx);
+                    putregshort(&out[4], bidx);
+                    putregshort(&out[6], target - (ip + seqlen));
+                    return seqlen;
+                }
+                if(!matchregstore(blob, istarget, pos, &dst))
+                {
+                    return 0;
+                }
+                seqlen = (pos + 4) - ip;
+                if(seqlen < 8)
+                {
+                    return 0;
+                }
+                out[0] = regop;
+                out[1] = akind | (bkind << 2) | ((seqlen - 8) << 4);
+                putregshort(&out[2], dst);
+                putregshort(&out[4], aidx);
+                putregshort(&out[6], bidx);
+                return seqlen;
+            }
+
+            /*
+            * lowers the stack code of the current function into m_regcode: operands that come straight from
+            * locals or numeric constants are read in place, instead of being pushed and popped.
+            * anything that does not match a pattern is copied verbatim.
+            */
+            void lowerregisters()
+            {
+                int ip;
+                int seqlen;
+                uint8_t* istarget;
+                Blob* blob;
+                blob = currentblob();
+                istarget = (uint8_t*)Memory::sysCalloc(blob->m_count + 1, sizeof(uint8_t));
+                if(istarget == nullptr)
+                {
+                    return;
+                }
+                markregjumptargets(blob, istarget);
+                blob->m_regcode.clear();
+                for(ip = 0; ip < blob->m_count; ip++)
+                {
+                    blob->m_regcode.push(blob->m_instrucs[ip]);
+                }
+                ip = 0;
+                while(ip < blob->m_count)
+                {
+                    seqlen = lowerregisterat(blob, istarget, ip);
+                    if(seqlen == 0)
+                    {
+                        seqlen = 1 + getcodeargscount(blob->m_instrucs.data(), blob->m_constants.data(), ip);
+                    }
+                    ip += seqlen;
+                }
+                Memory::sysFree(istarget);
+            }
+
+            static bool islocalgetinstruction(int instruction)
+            {
+                return ((instruction == Instruction::OPC_LOCALGET) || (instruction == Instruction::OPC_FUNCARGGET));
+            }
+
+            /*
+            * returns the superinstruction for the sequence starting at ip (and stores its length), or -1.
+            * since only the first opcode is ever replaced, jump targets within the sequence need no special care.
+            */
+            int matchsuperinstruction(Blob* blob, int ip, int* seqlen)
+            {
+                int count;
+                const uint8_t* code;
+                code = blob->m_instrucs.data();
+                count = blob->m_count;
+                if(islocalgetinstruction(code[ip]))
+                {
+                    if(((ip + 7) <= count) && islocalgetinstruction(code[ip + 3]) && (code[ip + 6] == Instruction::OPC_PRIMADD))
+                    {
+                        *seqlen = 7;
+                        return Instruction::OPC_SUPLOCALLOCALADD;
+                    }
+                    if(((ip + 8) <= count) && (code[ip + 3] == Instruction::OPC_PROPERTYGET))
+                    {
+                        *seqlen = 8;
+                        return Instruction::OPC_SUPLOCALPROPERTYGET;
+                    }
+                }
+                else if(code[ip] == Instruction::OPC_PUSHCONSTANT)
+                {
+                    if(((ip + 7) <= count) && (code[ip + 3] == Instruction::OPC_PRIMLESSTHAN) && (code[ip + 4] == Instruction::OPC_JUMPIFFALSE))
+                    {
+                        if(blob->m_constants.get((code[ip + 1] << 8) | code[ip + 2]).isNumber())
+                        {
+                            *seqlen = 7;
+                            return Instruction::OPC_SUPCONSTLESSJUMP;
+                        }
+                    }
+                }
+                return -1;
+            }
+
+            /*
+            * peephole pass over the current function: replaces the first opcode of common sequences with a
+            * superinstruction (see Instruction::OPC_SUPLOCALLOCALADD). the same is done for m_regcode,
+            * wherever it still holds the unlowered sequence.
+            */
+            void fusesuperinstructions()
+            {
+                int ip;
+                int op;
+                int seqlen;
+                uint8_t* code;
+                uint8_t* regcode;
+                Blob* blob;
+                blob = currentblob();
+                code = blob->m_instrucs.data();
+                regcode = nullptr;
+                if(blob->m_regcode.count() > 0)
+                {
+                    regcode = blob->m_regcode.data();
+                }
+                ip = 0;
+                while(ip < blob->m_count)
+                {
+                    op = matchsuperinstruction(blob, ip, &seqlen);
+                    if(op != -1)
+                    {
+                        if((regcode != nullptr) && (memcmp(&regcode[ip], &code[ip], seqlen) == 0))
+                        {
+                            regcode[ip] = op;
+                        }
+                        code[ip] = op;
+                    }
+                    ip += 1 + getcodeargscount(code, blob->m_constants.data(), ip);
+                }
+            }
+
             Function* endcompiler(bool istoplevel)
             {
+                auto gcs = SharedState::get();
                 emitreturn();
+                if(gcs->m_conf.useregistervm)
+                {
+                    lowerregisters();
+                }
+            #if defined(NEON_CONFIG_USESUPERINSTRUCTIONS) && (NEON_CONFIG_USESUPERINSTRUCTIONS == 1)
+                fusesuperinstructions();
+            #endif
                 if(istoplevel)
                 {
                 }
@@ -11579,7 +16450,7 @@ namespace neon
             void endloop()
             {
                 int i;
-                Instruction* bcode;
+                uint8_t* bcode;
                 Value* cvals;
                 /*
                 // find all Instruction::OPC_BREAK_PL placeholder and replace with the appropriate jump...
@@ -11587,9 +16458,9 @@ namespace neon
                 i = m_innermostloopstart;
                 while(i < m_currentfunccompiler->m_targetfunc->m_fnvals.fnscriptfunc.blob->m_count)
                 {
-                    if(m_currentfunccompiler->m_targetfunc->m_fnvals.fnscriptfunc.blob->m_instrucs[i].code == Instruction::OPC_BREAK_PL)
+                    if(m_currentfunccompiler->m_targetfunc->m_fnvals.fnscriptfunc.blob->m_instrucs[i] == Instruction::OPC_BREAK_PL)
                     {
-                        m_currentfunccompiler->m_targetfunc->m_fnvals.fnscriptfunc.blob->m_instrucs[i].code = Instruction::OPC_JUMPNOW;
+                        m_currentfunccompiler->m_targetfunc->m_fnvals.fnscriptfunc.blob->m_instrucs[i] = Instruction::OPC_JUMPNOW;
                         patchjump(i + 1);
                         i += 3;
                     }
@@ -11611,7 +16482,7 @@ namespace neon
                 }
                 if(arg != -1)
                 {
-                    emitbyteandshort(getop, arg);
+                    emitvarop(getop, (uint16_t)arg);
                 }
                 else
                 {
@@ -11621,7 +16492,7 @@ namespace neon
                 emitinstruc(realop);
                 if(arg != -1)
                 {
-                    emitbyteandshort(setop, (uint16_t)arg);
+                    emitvarop(setop, (uint16_t)arg);
                 }
                 else
                 {
@@ -11637,7 +16508,7 @@ namespace neon
                     parseexpression();
                     if(arg != -1)
                     {
-                        emitbyteandshort(setop, (uint16_t)arg);
+                        emitvarop(setop, (uint16_t)arg);
                     }
                     else
                     {
@@ -11701,14 +16572,22 @@ namespace neon
                     }
                     if(arg != -1)
                     {
-                        emitbyteandshort(getop, arg);
+                        emitvarop(getop, (uint16_t)arg);
                     }
                     else
                     {
                         emit2byte(getop, 1);
                     }
-                    emit2byte(Instruction::OPC_PUSHONE, Instruction::OPC_PRIMADD);
-                    emitbyteandshort(setop, (uint16_t)arg);
+                    emitinstruc(Instruction::OPC_PUSHONE);
+                    emitinstruc(Instruction::OPC_PRIMADD);
+                    if(arg != -1)
+                    {
+                        emitvarop(setop, (uint16_t)arg);
+                    }
+                    else
+                    {
+                        emitinstruc(setop);
+                    }
                 }
                 else if(canassign && match(AstToken::T_DECREMENT))
                 {
@@ -11720,15 +16599,23 @@ namespace neon
 
                     if(arg != -1)
                     {
-                        emitbyteandshort(getop, arg);
+                        emitvarop(getop, (uint16_t)arg);
                     }
                     else
                     {
                         emit2byte(getop, 1);
                     }
 
-                    emit2byte(Instruction::OPC_PUSHONE, Instruction::OPC_PRIMSUBTRACT);
-                    emitbyteandshort(setop, (uint16_t)arg);
+                    emitinstruc(Instruction::OPC_PUSHONE);
+                    emitinstruc(Instruction::OPC_PRIMSUBTRACT);
+                    if(arg != -1)
+                    {
+                        emitvarop(setop, (uint16_t)arg);
+                    }
+                    else
+                    {
+                        emitinstruc(setop);
+                    }
                 }
                 else
                 {
@@ -11740,7 +16627,7 @@ namespace neon
                         }
                         else
                         {
-                            emitbyteandshort(getop, (uint16_t)arg);
+                            emitvarop(getop, (uint16_t)arg);
                         }
                     }
                     else
@@ -12714,6 +17601,7 @@ namespace neon
                 emitbyteandshort(Instruction::OPC_LOCALGET, keyslot);
                 emitbyteandshort(Instruction::OPC_CALLMETHOD, citern);
                 emit1byte(1);
+                emitinlinecache();
                 emitbyteandshort(Instruction::OPC_LOCALSET, keyslot);
                 falsejump = emitjump(Instruction::OPC_JUMPIFFALSE);
                 emitinstruc(Instruction::OPC_POPONE);
@@ -12722,6 +17610,7 @@ namespace neon
                 emitbyteandshort(Instruction::OPC_LOCALGET, keyslot);
                 emitbyteandshort(Instruction::OPC_CALLMETHOD, citer);
                 emit1byte(1);
+                emitinlinecache();
                 /*
                 // Bind the loop value in its own scope. This ensures we get a fresh
                 // variable each iteration so that closures for it don't all see the same one.
@@ -13218,12 +18107,12 @@ namespace neon
 
     uint32_t Wrappers::wrapStrGetHash(String* os)
     {
-        return os->m_hashvalue;
+        return os->hash();
     }
 
     const char* Wrappers::wrapStrGetData(String* os)
     {
-        return os->data();
+        return os->rawData();
     }
 
     size_t Wrappers::wrapStrGetLength(String* os)
@@ -13231,7 +18120,7 @@ namespace neon
         return os->length();
     }
 
-    String* Wrappers::wrapMakeFromStrBuf(const StrBuffer& buf, uint32_t hsv, size_t length)
+    String* Wrappers::wrapMakeFromStrBuf(StrBuffer& buf, uint32_t hsv, size_t length)
     {
         return String::makeFromStrbuf(buf, hsv, length);
     }
@@ -13283,6 +18172,11 @@ namespace neon
         return inst->m_instanceclass->m_classname->data();
     }
 
+    void Wrappers::wrapGCWriteBarrier(Object* owner, Value val)
+    {
+        SharedState::gcWriteBarrier(owner, val);
+    }
+
     String* Value::toString(Value value)
     {
         IOStream pr;
@@ -13299,14 +18193,90 @@ namespace neon
         Value::markValTable(&dict->m_htvalues);
     }
 
-    void Value::markValArray(ValList<Value>* list)
+    void Value::markValArray(ValList<Value>* list)
+    {
+        size_t i;
+        NN_NULLPTRCHECK_RETURN(list);
+        for(i = 0; i < list->count(); i++)
+        {
+            SharedState::markValue(list->get(i));
+        }
+    }
+
+    void SharedState::StringTable::removeWhites()
+    {
+        size_t i;
+        for(i = 0; i < m_capacity; i++)
+        {
+            removeWhitesAt(i);
+        }
+    }
+
+    void SharedState::StringTable::removeWhitesAt(size_t i)
+    {
+        auto gcs = SharedState::get();
+        while((m_slots[i].string != nullptr) && !gcs->gcIsMarked(m_slots[i].string))
+        {
+            removeAt(i);
+        }
+    }
+
+    /* gives every slice of $parent a copy of its bytes; for when $parent is about to change */
+    void SharedState::gcUnshareSlicesOf(String* parent)
+    {
+        int64_t i;
+        String* slice;
+        for(i = 0; i < m_gcstate.slicecount; i++)
+        {
+            slice = m_gcstate.slices[i];
+            if(slice->m_sliceparent == parent)
+            {
+                slice->unshare();
+            }
+        }
+    }
+
+    /*
+    * slices do not keep their parent alive. once marking is done, a slice whose parent was not marked
+    * gets a copy of its bytes, while the buffer of the parent is still there. dead slices, and those
+    * that have a copy already, are dropped from the list.
+    * whatever is kept survives the collection, and so becomes old along with its parent; a minor
+    * collection only looks at the slices made since.
+    */
+    void SharedState::gcPruneSlices()
+    {
+        int64_t i;
+        int64_t kept;
+        kept = 0;
+        if(m_gcstate.inminor)
+        {
+            kept = m_gcstate.oldslicecount;
+        }
+        for(i = kept; i < m_gcstate.slicecount; i++)
+        {
+            if(gcPruneSlice(m_gcstate.slices[i]))
+            {
+                m_gcstate.slices[kept++] = m_gcstate.slices[i];
+            }
+        }
+        m_gcstate.slicecount = kept;
+        m_gcstate.oldslicecount = kept;
+    }
+
+    /* whether $slice stays on the list; it gets a copy of its bytes if its parent was not marked */
+    bool SharedState::gcPruneSlice(String* slice)
     {
-        size_t i;
-        NN_NULLPTRCHECK_RETURN(list);
-        for(i = 0; i < list->count(); i++)
+        if(!gcIsMarked(slice) || (slice->m_sliceparent == nullptr))
         {
-            SharedState::markValue(list->get(i));
+            return false;
+        }
+        if(!gcIsMarked(slice->m_sliceparent))
+        {
+            slice->unshare();
+            m_gcstate.stats.unsharedslices++;
+            return false;
         }
+        return true;
     }
 
     void Value::valtabRemoveWhites(HashTable<Value, Value>* table)
@@ -13316,7 +18286,7 @@ namespace neon
         for(i = 0; i < table->m_htcapacity; i++)
         {
             auto entry = &table->m_htentries[i];
-            if(entry->key.isObject() && entry->key.asObject()->m_objmark != gcs->markvalue)
+            if(entry->key.isObject() && !gcs->gcIsMarked(entry->key.asObject()))
             {
                 table->remove(entry->key);
             }
@@ -13428,9 +18398,14 @@ namespace neon
         {
             return false;
         }
-        adata = stra->data();
-        bdata = strb->data();
-        return (memcmp(adata, bdata, alen) == 0);
+        /* hashes are only compared if both are known already */
+        if((stra->m_hashvalue != 0) && (strb->m_hashvalue != 0) && (stra->m_hashvalue != strb->m_hashvalue))
+        {
+            return false;
+        }
+        adata = stra->rawData();
+        bdata = strb->rawData();
+        return Util::bytesEqual(adata, bdata, alen);
     }
 
     bool Value::compareDicts(Object* oa, Object* ob)
@@ -13516,6 +18491,17 @@ namespace neon
             return false;
         }
         */
+    #if defined(NEON_CONFIG_USENANTAGGING) && (NEON_CONFIG_USENANTAGGING == 1)
+        if(a.m_valbits == b.m_valbits)
+        {
+            /* identical bits are identical values - except for NaN, which never equals itself */
+            if(!a.isNumber())
+            {
+                return true;
+            }
+            return (a.asNumber() == a.asNumber());
+        }
+    #endif
         if(a.isNull())
         {
             return true;
@@ -13526,6 +18512,13 @@ namespace neon
         }
         else if(a.isNumber())
         {
+        #if defined(NEON_CONFIG_USENANTAGGING) && (NEON_CONFIG_USENANTAGGING == 1)
+            if(!b.isNumber())
+            {
+                /* the tagged union read null and false as 0.0 here; keep that behaviour */
+                return ((a.asNumber() == 0) && (b.isNull() || (b.isBool() && !b.asBool())));
+            }
+        #endif
             return (a.asNumber() == b.asNumber());
         }
         else
@@ -13762,8 +18755,23 @@ namespace neon
         {
             return;
         }
+        if(NEON_UNLIKELY(HeapSnapshot::s_active != nullptr))
+        {
+            HeapSnapshot::s_active->addRef(object);
+            return;
+        }
+    #if defined(NEON_CONFIG_USEPARALLELMARK) && (NEON_CONFIG_USEPARALLELMARK == 1)
+        if(ParallelMarker::t_worker != nullptr)
+        {
+            if(HeapPage::trySetMarkedAtomic(object))
+            {
+                ParallelMarker::push(ParallelMarker::t_worker, object);
+            }
+            return;
+        }
+    #endif
         auto gcs = SharedState::get();
-        if(object->m_objmark == gcs->markvalue)
+        if(gcs->gcIsMarked(object))
         {
             return;
         }
@@ -13772,7 +18780,7 @@ namespace neon
         ValPrinter::printValue(gcs->m_debugwriter, Value::fromObject(object), false);
         gcs->m_debugwriter->format("\n");
     #endif
-        object->m_objmark = gcs->markvalue;
+        HeapPage::setMarked(object);
         if(gcs->m_gcstate.graycapacity < gcs->m_gcstate.graycount + 1)
         {
             gcs->m_gcstate.graycapacity = Memory::getNextCapacity(gcs->m_gcstate.graycapacity);
@@ -13806,6 +18814,8 @@ namespace neon
                     Module* module;
                     module = (Module*)object;
                     Value::markValTable(&module->m_deftable);
+                    Object::markObject((Object*)module->m_modname);
+                    Object::markObject((Object*)module->m_physicalpath);
                 }
                 break;
             case Object::OTYP_SWITCH:
@@ -13852,8 +18862,11 @@ namespace neon
                     Value::markValTable(&klass->m_instmethods);
                     Value::markValTable(&klass->m_staticmethods);
                     Value::markValTable(&klass->m_staticproperties);
+                    Value::markValTable(&klass->m_instproperties);
                     SharedState::markValue(klass->m_constructor);
                     SharedState::markValue(klass->m_destructor);
+                    /* property names that instances of this class are laid out by */
+                    Shape::markTree(klass->m_rootshape);
                     if(klass->m_superclass != nullptr)
                     {
                         Object::markObject((Object*)klass->m_superclass);
@@ -13892,14 +18905,90 @@ namespace neon
                 {
                     auto upv = (Upvalue*)object;
                     SharedState::markValue(upv->m_closed);
+                    /* OPC_UPVALUESET writes here, not to $closed */
+                    SharedState::markValue(upv->m_location);
+                }
+                break;
+            case Object::OTYP_STRING:
+                {
+                    String* string;
+                    string = (String*)object;
+                    if(string->isRope())
+                    {
+                        Object::markObject((Object*)string->m_ropeleft);
+                        Object::markObject((Object*)string->m_roperight);
+                    }
                 }
                 break;
-            case Object::OTYP_RANGE:
             case Object::OTYP_FUNCNATIVE:
+                {
+                    Function* native;
+                    native = (Function*)object;
+                    /* usually a key of the table the function is in, but not always, e.g. "constructor" */
+                    Object::markObject((Object*)native->m_funcname);
+                }
+                break;
+            case Object::OTYP_RANGE:
             case Object::OTYP_USERDATA:
+                break;
+        }
+    }
+
+    /* the size that destroyObject() takes off SharedState::m_gcstate.bytesallocated */
+    size_t Object::objectSize(Object* object)
+    {
+        switch(object->m_objtype)
+        {
+            case Object::OTYP_MODULE:
+                return sizeof(Module);
+            case Object::OTYP_FILE:
+                return sizeof(File);
+            case Object::OTYP_DICT:
+                return sizeof(Dict);
+            case Object::OTYP_ARRAY:
+                return sizeof(Array);
+            case Object::OTYP_FUNCBOUND:
+            case Object::OTYP_FUNCCLOSURE:
+            case Object::OTYP_FUNCSCRIPT:
+            case Object::OTYP_FUNCNATIVE:
+                return sizeof(Function);
+            case Object::OTYP_CLASS:
+                return sizeof(Class);
+            case Object::OTYP_INSTANCE:
+                return sizeof(Instance);
+            case Object::OTYP_UPVALUE:
+                return sizeof(Upvalue);
+            case Object::OTYP_RANGE:
+                return sizeof(Range);
             case Object::OTYP_STRING:
+                return sizeof(String);
+            case Object::OTYP_SWITCH:
+                return sizeof(Switch);
+            case Object::OTYP_USERDATA:
+                return sizeof(Userdata);
+            default:
+                break;
+        }
+        return 0;
+    }
+
+    /*
+    * whether destroying $object has effects beyond freeing memory, that may only happen on the main thread:
+    * closing file handles, unloading modules, user-supplied finalizers, and invalidating inline caches.
+    */
+    bool Object::finalizesOnMainThread(Object* object)
+    {
+        switch(object->m_objtype)
+        {
+            case Object::OTYP_MODULE:
+            case Object::OTYP_FILE:
+            case Object::OTYP_CLASS:
+            case Object::OTYP_USERDATA:
+                return true;
+            default:
                 break;
         }
+        return false;
     }
 
     void Object::destroyObject(Object* object)
@@ -14037,7 +19126,11 @@ namespace neon
         }
     }
 
-    void SharedState::gcMarkRoots()
+    /*
+    * with $defer, the stack and the tables of globals and modules are only handed to gcDeferValues()
+    * and gcDeferTable(), so that an incremental collection starts without marking them in one go.
+    */
+    void SharedState::gcMarkRoots(bool defer)
     {
         int i;
         int j;
@@ -14045,9 +19138,16 @@ namespace neon
         Upvalue* upvalue;
         CallFrame::ExceptionInfo* handler;
         (void)handler;
-        for(slot = m_vmstate.stackvalues.data(); slot < m_vmstate.stackvalues.getp(m_vmstate.stackidx); slot++)
+        if(defer)
+        {
+            gcDeferValues(m_vmstate.stackvalues.data(), m_vmstate.stackidx);
+        }
+        else
         {
-            SharedState::markValue(*slot);
+            for(slot = m_vmstate.stackvalues.data(); slot < m_vmstate.stackvalues.getp(m_vmstate.stackidx); slot++)
+            {
+                SharedState::markValue(*slot);
+            }
         }
         for(i = 0; i < (int)m_vmstate.framecount; i++)
         {
@@ -14061,16 +19161,249 @@ namespace neon
         {
             Object::markObject((Object*)upvalue);
         }
-        Value::markValTable(&m_declaredglobals);
-        Value::markValTable(&m_openedmodules);
+        if(defer)
+        {
+            gcDeferTable(&m_declaredglobals);
+            gcDeferTable(&m_openedmodules);
+            gcDeferValues(m_importpath.data(), m_importpath.count());
+        }
+        else
+        {
+            Value::markValTable(&m_declaredglobals);
+            Value::markValTable(&m_openedmodules);
+            Value::markValArray(&m_importpath);
+        }
+        Object::markObject((Object*)m_topmodule);
+        if(m_processinfo != nullptr)
+        {
+            Object::markObject((Object*)m_processinfo->cliargv);
+            Object::markObject((Object*)m_processinfo->cliexedirectory);
+            Object::markObject((Object*)m_processinfo->cliscriptfile);
+            Object::markObject((Object*)m_processinfo->cliscriptdirectory);
+            Object::markObject((Object*)m_processinfo->filestdout);
+            Object::markObject((Object*)m_processinfo->filestderr);
+            Object::markObject((Object*)m_processinfo->filestdin);
+        }
         // Object::markObject((Object*)m_exceptions.stdexception);
         gcMarkCompilerRoots();
     }
 
+    void SharedState::gcDeferTable(HashTable<Value, Value>* table)
+    {
+        GCTableScan* scan;
+        if(m_gcstate.tablescancapacity < m_gcstate.tablescancount + 1)
+        {
+            m_gcstate.tablescancapacity = Memory::getNextCapacity(m_gcstate.tablescancapacity);
+            m_gcstate.tablescans = (GCTableScan*)Memory::sysRealloc(m_gcstate.tablescans, sizeof(GCTableScan) * m_gcstate.tablescancapacity);
+            if(m_gcstate.tablescans == nullptr)
+            {
+                fflush(stdout);
+                fprintf(stderr, "GC encountered an error");
+                abort();
+            }
+        }
+        scan = &m_gcstate.tablescans[m_gcstate.tablescancount++];
+        scan->table = table;
+        scan->entries = table->m_htentries;
+        scan->capacity = table->m_htcapacity;
+        scan->next = 0;
+    }
+
+    NEON_INLINE bool SharedState::gcDeferLargeObject(Object* object)
+    {
+        Dict* dict;
+        Array* array;
+        switch(object->m_objtype)
+        {
+            case Object::OTYP_ARRAY:
+                {
+                    array = (Array*)object;
+                    if(array->m_objvarray.count() < CONF_GCDEFERVALUES)
+                    {
+                        return false;
+                    }
+                    gcDeferValues(array->m_objvarray.data(), array->m_objvarray.count());
+                }
+                return true;
+            case Object::OTYP_DICT:
+                {
+                    dict = (Dict*)object;
+                    if(dict->m_htkeys.count() < CONF_GCDEFERVALUES)
+                    {
+                        return false;
+                    }
+                    gcDeferTable(&dict->m_htvalues);
+                }
+                return true;
+            default:
+                break;
+        }
+        return false;
+    }
+
+    /* the name that identifies what $object is an instance of, or what it is called */
+    static String* heapSnapshotName(Object* object)
+    {
+        Function* fn;
+        switch(object->m_objtype)
+        {
+            case Object::OTYP_INSTANCE:
+                return ((Instance*)object)->m_instanceclass->m_classname;
+            case Object::OTYP_CLASS:
+                return ((Class*)object)->m_classname;
+            case Object::OTYP_MODULE:
+                return ((Module*)object)->m_modname;
+            case Object::OTYP_FILE:
+                return ((File*)object)->m_path;
+            case Object::OTYP_FUNCCLOSURE:
+                return ((Function*)object)->m_fnvals.fnclosure.scriptfunc->m_funcname;
+            case Object::OTYP_FUNCBOUND:
+                fn = ((Function*)object)->m_fnvals.fnmethod.method;
+                if(fn != nullptr)
+                {
+                    return heapSnapshotName(fn);
+                }
+                break;
+            case Object::OTYP_FUNCSCRIPT:
+            case Object::OTYP_FUNCNATIVE:
+                return ((Function*)object)->m_funcname;
+            default:
+                break;
+        }
+        return nullptr;
+    }
+
+    /* the size of $object, plus the memory it owns outside of its cell, as far as it is easily known */
+    static size_t heapSnapshotSize(Object* object)
+    {
+        size_t size;
+        size = Object::objectSize(object);
+        switch(object->m_objtype)
+        {
+            case Object::OTYP_STRING:
+                /* a rope has no buffer, and a slice borrows one; the parts and the parent are objects of their own */
+                if(!((String*)object)->isRope() && !((String*)object)->isSlice())
+                {
+                    size += ((String*)object)->length() + 1;
+                }
+                break;
+            case Object::OTYP_ARRAY:
+                size += ((Array*)object)->m_objvarray.capacity() * sizeof(Value);
+                break;
+            case Object::OTYP_DICT:
+                {
+                    Dict* dict;
+                    dict = (Dict*)object;
+                    size += dict->m_htkeys.capacity() * sizeof(Value);
+                    size += dict->m_htvalues.m_htcapacity * sizeof(*dict->m_htvalues.m_htentries);
+                }
+                break;
+            case Object::OTYP_INSTANCE:
+                {
+                    Instance* instance;
+                    instance = (Instance*)object;
+                    if(instance->m_shape != nullptr)
+                    {
+                        size += instance->m_shape->m_slotcount * sizeof(Value);
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+        return size;
+    }
+
+    void HeapSnapshot::putObject(Object* object)
+    {
+        String* name;
+        putInt<uint64_t>((uintptr_t)object);
+        putInt<uint8_t>(object->m_objtype);
+        putInt<uint32_t>(heapSnapshotSize(object));
+        name = heapSnapshotName(object);
+        if(name != nullptr)
+        {
+            putString(name->rawData(), name->length());
+        }
+        else
+        {
+            putString("", 0);
+        }
+        /* ropes are not flattened for a preview, since that would change the references being written */
+        if((object->m_objtype == Object::OTYP_STRING) && !((String*)object)->isRope())
+        {
+            name = (String*)object;
+            putString(name->rawData(), (name->length() < CONF_PREVIEWLENGTH) ? name->length() : (size_t)CONF_PREVIEWLENGTH);
+        }
+        else
+        {
+            putString("", 0);
+        }
+        m_refs.clear();
+        s_active = this;
+        Object::blackenObject(object);
+        s_active = nullptr;
+        putRefs();
+    }
+
+    /*
+    * runs a full collection first, so that every allocated cell holds a live object.
+    * returns how many objects were written, or -1 if $path could not be opened.
+    */
+    int64_t HeapSnapshot::write(const char* path)
+    {
+        size_t w;
+        size_t nwords;
+        uint64_t bits;
+        uint64_t count;
+        HeapPage* page;
+        HeapSnapshot snap;
+        auto gcs = SharedState::get();
+        snap.m_handle = fopen(path, "wb");
+        if(snap.m_handle == nullptr)
+        {
+            return -1;
+        }
+        gcs->gcCollectGarbage();
+        count = 0;
+        for(page = gcs->m_gcstate.heap.m_pages; page != nullptr; page = page->m_nextpage)
+        {
+            count += page->m_livecount;
+        }
+        s_active = &snap;
+        gcs->gcMarkRoots();
+        s_active = nullptr;
+        snap.putBytes("NEONHEAP", 8);
+        snap.putInt<uint32_t>(CONF_VERSION);
+        snap.putInt<uint32_t>(0);
+        snap.putInt<uint64_t>(count);
+        snap.putInt<uint64_t>(snap.m_refs.count());
+        for(w = 0; w < snap.m_refs.count(); w++)
+        {
+            snap.putInt<uint64_t>((uintptr_t)snap.m_refs.get(w));
+        }
+        for(page = gcs->m_gcstate.heap.m_pages; page != nullptr; page = page->m_nextpage)
+        {
+            nwords = page->bitmapWords();
+            for(w = 0; w < nwords; w++)
+            {
+                bits = page->m_allocbits[w];
+                while(bits != 0)
+                {
+                    snap.putObject(page->cellAt((w * 64) + HeapPage::lowestBit(bits)));
+                    bits &= (bits - 1);
+                }
+            }
+        }
+        snap.m_refs.deInit();
+        fclose(snap.m_handle);
+        return count;
+    }
+
     template<typename HTKeyT, typename HTValT>
     Property* HashTable<HTKeyT, HTValT>::getfieldbyostr(String* str) const
     {
-        return getfieldbystr(Value::makeNull(), str->data(), str->length(), str->m_hashvalue);
+        return getfieldbystr(Value::makeNull(), str->rawData(), str->length(), str->hash());
     }
 
     template<typename HTKeyT, typename HTValT>
@@ -14090,7 +19423,7 @@ namespace neon
         if(key.isString())
         {
             oskey = key.asString();
-            return getfieldbystr(key, oskey->data(), oskey->length(), oskey->m_hashvalue);
+            return getfieldbystr(key, oskey->rawData(), oskey->length(), oskey->hash());
         }
         return getfieldbyvalue(key);
     }
@@ -14171,8 +19504,8 @@ namespace neon
         auto gcs = SharedState::get();
         frame = &gcs->m_vmstate.framevalues[gcs->m_vmstate.framecount - 1];
         function = frame->closure->m_fnvals.fnclosure.scriptfunc;
-        instruction = frame->inscode - function->m_fnvals.fnscriptfunc.blob->m_instrucs.data() - 1;
-        line = function->m_fnvals.fnscriptfunc.blob->m_instrucs[instruction].fromsourceline;
+        instruction = function->m_fnvals.fnscriptfunc.blob->codeOffset(frame->inscode) - 1;
+        line = function->m_fnvals.fnscriptfunc.blob->getLine(instruction);
         fprintf(stderr, "RuntimeError: ");
         tmpfprintf(stderr, format, args...);
         fprintf(stderr, " -> %s:%d ", function->m_fnvals.fnscriptfunc.module->m_physicalpath->data(), line);
@@ -14185,8 +19518,8 @@ namespace neon
                 frame = &gcs->m_vmstate.framevalues[i];
                 function = frame->closure->m_fnvals.fnclosure.scriptfunc;
                 /* -1 because the IP is sitting on the next instruction to be executed */
-                instruction = frame->inscode - function->m_fnvals.fnscriptfunc.blob->m_instrucs.data() - 1;
-                fprintf(stderr, "    %s:%d -> ", function->m_fnvals.fnscriptfunc.module->m_physicalpath->data(), function->m_fnvals.fnscriptfunc.blob->m_instrucs[instruction].fromsourceline);
+                instruction = function->m_fnvals.fnscriptfunc.blob->codeOffset(frame->inscode) - 1;
+                fprintf(stderr, "    %s:%d -> ", function->m_fnvals.fnscriptfunc.module->m_physicalpath->data(), function->m_fnvals.fnscriptfunc.blob->getLine(instruction));
                 if(function->m_funcname == nullptr)
                 {
                     fprintf(stderr, "<script>");
@@ -14356,28 +19689,177 @@ namespace neon
                         return "OPC_OPINSTANCEOF";
                     case Instruction::OPC_HALT:
                         return "OPC_HALT";
+                    case Instruction::OPC_REGMOVE:
+                        return "OPC_REGMOVE";
+                    case Instruction::OPC_REGADD:
+                        return "OPC_REGADD";
+                    case Instruction::OPC_REGSUBTRACT:
+                        return "OPC_REGSUBTRACT";
+                    case Instruction::OPC_REGMULTIPLY:
+                        return "OPC_REGMULTIPLY";
+                    case Instruction::OPC_REGDIVIDE:
+                        return "OPC_REGDIVIDE";
+                    case Instruction::OPC_REGJUMPIFNOTLESS:
+                        return "OPC_REGJUMPIFNOTLESS";
+                    case Instruction::OPC_REGJUMPIFNOTGREATER:
+                        return "OPC_REGJUMPIFNOTGREATER";
+                    case Instruction::OPC_SUPLOCALLOCALADD:
+                        return "OPC_SUPLOCALLOCALADD";
+                    case Instruction::OPC_SUPCONSTLESSJUMP:
+                        return "OPC_SUPCONSTLESSJUMP";
+                    case Instruction::OPC_SUPLOCALPROPERTYGET:
+                        return "OPC_SUPLOCALPROPERTYGET";
+                    case Instruction::OPC_PRIMADDNUM:
+                        return "OPC_PRIMADDNUM";
+                    case Instruction::OPC_PRIMADDSTR:
+                        return "OPC_PRIMADDSTR";
+                    case Instruction::OPC_PRIMSUBTRACTNUM:
+                        return "OPC_PRIMSUBTRACTNUM";
+                    case Instruction::OPC_PRIMLESSTHANNUM:
+                        return "OPC_PRIMLESSTHANNUM";
+                }
+                return "<?unknown?>";
+            }
+
+        public:
+            IOStream* m_outstream;
+
+        public:
+            Debug(IOStream* pr)
+            {
+                m_outstream = pr;
+            }
+
+            void disasmBlob(Blob* blob, const char* name)
+            {
+                int offset;
+                m_outstream->format("== compiled '%s' [[\n", name);
+                for(offset = 0; offset < blob->m_count;)
+                {
+                    offset = printInstructionAt(blob, offset);
+                }
+                m_outstream->format("]]\n");
+                if(blob->m_regcode.count() > 0)
+                {
+                    m_outstream->format("== lowered '%s' [[\n", name);
+                    for(offset = 0; offset < blob->m_count;)
+                    {
+                        offset = printRegisterInstructionAt(blob, offset);
+                    }
+                    m_outstream->format("]]\n");
+                }
+            }
+
+            /*
+            * disassembles function, and every function defined within it (i.e., found among its constants).
+            * used for --dump-quickened, after the script has run, to show which instructions were rewritten.
+            */
+            void disasmFunctionTree(Function* function)
+            {
+                size_t i;
+                Value constant;
+                Blob* blob;
+                blob = function->m_fnvals.fnscriptfunc.blob;
+                disasmBlob(blob, (function->m_funcname != nullptr) ? function->m_funcname->data() : "<file>");
+                for(i = 0; i < blob->m_constants.count(); i++)
+                {
+                    constant = blob->m_constants.get(i);
+                    if(constant.isFuncscript())
+                    {
+                        disasmFunctionTree(constant.asFunction());
+                    }
+                }
+            }
+
+            static bool isRegisterInstruction(int instruction)
+            {
+                return ((instruction >= Instruction::OPC_REGMOVE) && (instruction <= Instruction::OPC_REGJUMPIFNOTGREATER));
+            }
+
+            /* prints the instruction that ip points at, which may be in either m_instrucs or m_regcode */
+            int printCurrentInstruction(Blob* blob, const uint8_t* ip)
+            {
+                int offset;
+                offset = blob->codeOffset(ip);
+                if((blob->m_regcode.count() > 0) && (ip == &blob->m_regcode[offset]))
+                {
+                    return printRegisterInstructionAt(blob, offset);
                 }
-                return "<?unknown?>";
+                return printInstructionAt(blob, offset);
             }
 
-        public:
-            IOStream* m_outstream;
-
-        public:
-            Debug(IOStream* pr)
+            int printRegOperand(const uint8_t* code, Blob* blob, int kind)
             {
-                m_outstream = pr;
+                uint16_t index;
+                index = (code[0] << 8) | code[1];
+                if(kind == Instruction::REGOPND_SLOT)
+                {
+                    m_outstream->format("r%d", index);
+                }
+                else if(kind == Instruction::REGOPND_CONST)
+                {
+                    m_outstream->format("k%d(", index);
+                    ValPrinter::printValue(m_outstream, blob->m_constants.get(index), true, false);
+                    m_outstream->format(")");
+                }
+                else
+                {
+                    m_outstream->format("#1");
+                }
+                return 2;
             }
 
-            void disasmBlob(Blob* blob, const char* name)
+            /* like printInstructionAt, but for m_regcode: anything that was not lowered is printed from m_instrucs */
+            int printRegisterInstructionAt(Blob* blob, int offset)
             {
-                int offset;
-                m_outstream->format("== compiled '%s' [[\n", name);
-                for(offset = 0; offset < blob->m_count;)
+                int info;
+                int pos;
+                uint16_t dst;
+                uint16_t jump;
+                const uint8_t* code;
+                uint8_t instruction;
+                instruction = blob->m_regcode[offset];
+                if(!isRegisterInstruction(instruction))
+                {
+                    return printInstructionAt(blob, offset);
+                }
+                code = blob->m_regcode.data();
+                m_outstream->format("%08d %8d ", offset, blob->getLine(offset));
+                printInstructionName(Debug::opcodeToString(instruction));
+                info = code[offset + 1];
+                pos = offset + 2;
+                switch(instruction)
                 {
-                    offset = printInstructionAt(blob, offset);
+                    case Instruction::OPC_REGMOVE:
+                    case Instruction::OPC_REGADD:
+                    case Instruction::OPC_REGSUBTRACT:
+                    case Instruction::OPC_REGMULTIPLY:
+                    case Instruction::OPC_REGDIVIDE:
+                    {
+                        dst = (code[pos] << 8) | code[pos + 1];
+                        pos += 2;
+                        m_outstream->format("r%d <- ", dst);
+                        pos += printRegOperand(&code[pos], blob, info & 3);
+                        if(instruction != Instruction::OPC_REGMOVE)
+                        {
+                            m_outstream->format(", ");
+                            pos += printRegOperand(&code[pos], blob, (info >> 2) & 3);
+                        }
+                        m_outstream->format("\n");
+                    }
+                    break;
+                    default:
+                    {
+                        pos += printRegOperand(&code[pos], blob, info & 3);
+                        m_outstream->format(", ");
+                        pos += printRegOperand(&code[pos], blob, (info >> 2) & 3);
+                        jump = (code[pos] << 8) | code[pos + 1];
+                        pos += 2;
+                        m_outstream->format(" -> %d\n", pos + (info >> 4) + jump);
+                    }
+                    break;
                 }
-                m_outstream->format("]]\n");
+                return pos + (info >> 4);
             }
 
             void printInstructionName(const char* name)
@@ -14395,7 +19877,7 @@ namespace neon
             int printConstInstruction(const char* name, Blob* blob, int offset)
             {
                 uint16_t constant;
-                constant = (blob->m_instrucs[offset + 1].code << 8) | blob->m_instrucs[offset + 2].code;
+                constant = (blob->m_instrucs[offset + 1] << 8) | blob->m_instrucs[offset + 2];
                 printInstructionName(name);
                 m_outstream->format("%8d ", constant);
                 ValPrinter::printValue(m_outstream, blob->m_constants.get(constant), true, false);
@@ -14407,12 +19889,12 @@ namespace neon
             {
                 const char* proptn;
                 uint16_t constant;
-                constant = (blob->m_instrucs[offset + 1].code << 8) | blob->m_instrucs[offset + 2].code;
+                constant = (blob->m_instrucs[offset + 1] << 8) | blob->m_instrucs[offset + 2];
                 printInstructionName(name);
                 m_outstream->format("%8d ", constant);
                 ValPrinter::printValue(m_outstream, blob->m_constants.get(constant), true, false);
                 proptn = "";
-                if(blob->m_instrucs[offset + 3].code == 1)
+                if(blob->m_instrucs[offset + 3] == 1)
                 {
                     proptn = "static";
                 }
@@ -14424,7 +19906,7 @@ namespace neon
             int printShortInstruction(const char* name, Blob* blob, int offset)
             {
                 uint16_t slot;
-                slot = (blob->m_instrucs[offset + 1].code << 8) | blob->m_instrucs[offset + 2].code;
+                slot = (blob->m_instrucs[offset + 1] << 8) | blob->m_instrucs[offset + 2];
                 printInstructionName(name);
                 m_outstream->format("%8d\n", slot);
                 return offset + 3;
@@ -14433,7 +19915,7 @@ namespace neon
             int printByteInstruction(const char* name, Blob* blob, int offset)
             {
                 uint16_t slot;
-                slot = blob->m_instrucs[offset + 1].code;
+                slot = blob->m_instrucs[offset + 1];
                 printInstructionName(name);
                 m_outstream->format("%8d\n", slot);
                 return offset + 2;
@@ -14442,8 +19924,8 @@ namespace neon
             int printJumpInstruction(const char* name, int sign, Blob* blob, int offset)
             {
                 uint16_t jump;
-                jump = (uint16_t)(blob->m_instrucs[offset + 1].code << 8);
-                jump |= blob->m_instrucs[offset + 2].code;
+                jump = (uint16_t)(blob->m_instrucs[offset + 1] << 8);
+                jump |= blob->m_instrucs[offset + 2];
                 printInstructionName(name);
                 m_outstream->format("%8d -> %d\n", offset, offset + 3 + sign * jump);
                 return offset + 3;
@@ -14454,12 +19936,12 @@ namespace neon
                 uint16_t finally;
                 uint16_t type;
                 uint16_t address;
-                type = (uint16_t)(blob->m_instrucs[offset + 1].code << 8);
-                type |= blob->m_instrucs[offset + 2].code;
-                address = (uint16_t)(blob->m_instrucs[offset + 3].code << 8);
-                address |= blob->m_instrucs[offset + 4].code;
-                finally = (uint16_t)(blob->m_instrucs[offset + 5].code << 8);
-                finally |= blob->m_instrucs[offset + 6].code;
+                type = (uint16_t)(blob->m_instrucs[offset + 1] << 8);
+                type |= blob->m_instrucs[offset + 2];
+                address = (uint16_t)(blob->m_instrucs[offset + 3] << 8);
+                address |= blob->m_instrucs[offset + 4];
+                finally = (uint16_t)(blob->m_instrucs[offset + 5] << 8);
+                finally |= blob->m_instrucs[offset + 6];
                 printInstructionName(name);
                 m_outstream->format("%8d -> %d, %d\n", type, address, finally);
                 return offset + 7;
@@ -14469,9 +19951,9 @@ namespace neon
             {
                 uint16_t constant;
                 uint16_t argcount;
-                constant = (uint16_t)(blob->m_instrucs[offset + 1].code << 8);
-                constant |= blob->m_instrucs[offset + 2].code;
-                argcount = blob->m_instrucs[offset + 3].code;
+                constant = (uint16_t)(blob->m_instrucs[offset + 1] << 8);
+                constant |= blob->m_instrucs[offset + 2];
+                argcount = blob->m_instrucs[offset + 3];
                 printInstructionName(name);
                 m_outstream->format("(%d args) %8d ", argcount, constant);
                 ValPrinter::printValue(m_outstream, blob->m_constants.get(constant), true, false);
@@ -14479,6 +19961,34 @@ namespace neon
                 return offset + 4;
             }
 
+            int printCachedPropertyInstruction(const char* name, Blob* blob, int offset)
+            {
+                uint16_t constant;
+                uint16_t cacheidx;
+                constant = (blob->m_instrucs[offset + 1] << 8) | blob->m_instrucs[offset + 2];
+                cacheidx = (blob->m_instrucs[offset + 3] << 8) | blob->m_instrucs[offset + 4];
+                printInstructionName(name);
+                m_outstream->format("%8d ", constant);
+                ValPrinter::printValue(m_outstream, blob->m_constants.get(constant), true, false);
+                m_outstream->format(" (cache %d)\n", cacheidx);
+                return offset + 5;
+            }
+
+            int printCachedInvokeInstruction(const char* name, Blob* blob, int offset)
+            {
+                uint16_t constant;
+                uint16_t argcount;
+                uint16_t cacheidx;
+                constant = (blob->m_instrucs[offset + 1] << 8) | blob->m_instrucs[offset + 2];
+                argcount = blob->m_instrucs[offset + 3];
+                cacheidx = (blob->m_instrucs[offset + 4] << 8) | blob->m_instrucs[offset + 5];
+                printInstructionName(name);
+                m_outstream->format("(%d args) %8d ", argcount, constant);
+                ValPrinter::printValue(m_outstream, blob->m_constants.get(constant), true, false);
+                m_outstream->format(" (cache %d)\n", cacheidx);
+                return offset + 6;
+            }
+
             int printClosureInstruction(const char* name, Blob* blob, int offset)
             {
                 int j;
@@ -14488,17 +19998,17 @@ namespace neon
                 const char* locn;
                 Function* function;
                 offset++;
-                constant = blob->m_instrucs[offset++].code << 8;
-                constant |= blob->m_instrucs[offset++].code;
+                constant = blob->m_instrucs[offset++] << 8;
+                constant |= blob->m_instrucs[offset++];
                 m_outstream->format("%-16s %8d ", name, constant);
                 ValPrinter::printValue(m_outstream, blob->m_constants.get(constant), true, false);
                 m_outstream->format("\n");
                 function = blob->m_constants.get(constant).asFunction();
                 for(j = 0; j < function->m_upvalcount; j++)
                 {
-                    islocal = blob->m_instrucs[offset++].code;
-                    index = blob->m_instrucs[offset++].code << 8;
-                    index |= blob->m_instrucs[offset++].code;
+                    islocal = blob->m_instrucs[offset++];
+                    index = blob->m_instrucs[offset++] << 8;
+                    index |= blob->m_instrucs[offset++];
                     locn = "upvalue";
                     if(islocal)
                     {
@@ -14514,15 +20024,15 @@ namespace neon
                 uint16_t instruction;
                 const char* opname;
                 m_outstream->format("%08d ", offset);
-                if(offset > 0 && blob->m_instrucs[offset].fromsourceline == blob->m_instrucs[offset - 1].fromsourceline)
+                if(offset > 0 && blob->getLine(offset) == blob->getLine(offset - 1))
                 {
                     m_outstream->format("       | ");
                 }
                 else
                 {
-                    m_outstream->format("%8d ", blob->m_instrucs[offset].fromsourceline);
+                    m_outstream->format("%8d ", blob->getLine(offset));
                 }
-                instruction = blob->m_instrucs[offset].code;
+                instruction = blob->m_instrucs[offset];
                 opname = Debug::opcodeToString(instruction);
                 switch(instruction)
                 {
@@ -14551,11 +20061,11 @@ namespace neon
                     case Instruction::OPC_FUNCARGSET:
                         return printShortInstruction(opname, blob, offset);
                     case Instruction::OPC_PROPERTYGET:
-                        return printConstInstruction(opname, blob, offset);
+                        return printCachedPropertyInstruction(opname, blob, offset);
                     case Instruction::OPC_PROPERTYGETSELF:
-                        return printConstInstruction(opname, blob, offset);
+                        return printCachedPropertyInstruction(opname, blob, offset);
                     case Instruction::OPC_PROPERTYSET:
-                        return printConstInstruction(opname, blob, offset);
+                        return printCachedPropertyInstruction(opname, blob, offset);
                     case Instruction::OPC_UPVALUEGET:
                         return printShortInstruction(opname, blob, offset);
                     case Instruction::OPC_UPVALUESET:
@@ -14651,9 +20161,9 @@ namespace neon
                     case Instruction::OPC_CALLFUNCTION:
                         return printByteInstruction(opname, blob, offset);
                     case Instruction::OPC_CALLMETHOD:
-                        return printInvokeInstruction(opname, blob, offset);
+                        return printCachedInvokeInstruction(opname, blob, offset);
                     case Instruction::OPC_CLASSINVOKETHIS:
-                        return printInvokeInstruction(opname, blob, offset);
+                        return printCachedInvokeInstruction(opname, blob, offset);
                     case Instruction::OPC_RETURN:
                         return printSimpleInstruction(opname, offset);
                     case Instruction::OPC_CLASSGETTHIS:
@@ -14670,6 +20180,21 @@ namespace neon
                         return printSimpleInstruction(opname, offset);
                     case Instruction::OPC_CLASSINVOKESUPER:
                         return printInvokeInstruction(opname, blob, offset);
+                    /* superinstructions print like their first instruction; the rest of the sequence follows as usual */
+                    case Instruction::OPC_SUPLOCALLOCALADD:
+                        return printShortInstruction(opname, blob, offset);
+                    case Instruction::OPC_SUPCONSTLESSJUMP:
+                        return printConstInstruction(opname, blob, offset);
+                    case Instruction::OPC_SUPLOCALPROPERTYGET:
+                        return printShortInstruction(opname, blob, offset);
+                    case Instruction::OPC_PRIMADDNUM:
+                        return printSimpleInstruction(opname, offset);
+                    case Instruction::OPC_PRIMADDSTR:
+                        return printSimpleInstruction(opname, offset);
+                    case Instruction::OPC_PRIMSUBTRACTNUM:
+                        return printSimpleInstruction(opname, offset);
+                    case Instruction::OPC_PRIMLESSTHANNUM:
+                        return printSimpleInstruction(opname, offset);
                     case Instruction::OPC_CLASSINVOKESUPERSELF:
                         return printByteInstruction(opname, blob, offset);
                     case Instruction::OPC_HALT:
@@ -14696,6 +20221,7 @@ namespace neon
         installObjDirectory();
         installObjRange();
         installModMath();
+        installModGC();
     }
 
     /**
@@ -14715,6 +20241,8 @@ namespace neon
         Array* oa;
         IOStream pr;
         oa = Array::make();
+        /* the strings below may collect */
+        vmStackPush(Value::fromObject(oa));
         {
             for(i = 0; i < m_vmstate.framecount; i++)
             {
@@ -14722,8 +20250,8 @@ namespace neon
                 frame = &m_vmstate.framevalues[i];
                 function = frame->closure->m_fnvals.fnclosure.scriptfunc;
                 /* -1 because the IP is sitting on the next instruction to be executed */
-                instruction = frame->inscode - function->m_fnvals.fnscriptfunc.blob->m_instrucs.data() - 1;
-                line = function->m_fnvals.fnscriptfunc.blob->m_instrucs[instruction].fromsourceline;
+                instruction = function->m_fnvals.fnscriptfunc.blob->codeOffset(frame->inscode) - 1;
+                line = function->m_fnvals.fnscriptfunc.blob->getLine(instruction);
                 physfile = "(unknown)";
                 if(function->m_fnvals.fnscriptfunc.module->m_physicalpath != nullptr)
                 {
@@ -14748,6 +20276,7 @@ namespace neon
                     break;
                 }
             }
+            vmStackPop();
             return Value::fromObject(oa);
         }
         return Value::fromObject(String::intern("", 0));
@@ -14773,7 +20302,7 @@ namespace neon
         String* emsg;
         String* tmp;
         Instance* exception;
-        Property* field;
+        Value* field;
         exception = vmStackPeek(0).asInstance();
         /* look for a handler .... */
         while(m_vmstate.framecount > 0)
@@ -14785,6 +20314,14 @@ namespace neon
                 function = m_vmstate.currentframe->closure->m_fnvals.fnclosure.scriptfunc;
                 if(handler->address != 0 /*&& Class::isInstanceOf(exception->m_instanceclass, handler->handlerklass)*/)
                 {
+                    /*
+                    * whatever the try block, and the frames it called, left on the stack is dropped, so that it
+                    * does not stay reachable (think of MemoryError); the catch block finds just the exception.
+                    */
+                    m_vmstate.stackidx = handler->stackdepth;
+                    m_vmstate.currentframe->gcprotcount = 0;
+                    vmStackPush(Value::fromObject(exception));
+                    m_vmstate.unwindcount++;
                     m_vmstate.currentframe->inscode = &function->m_fnvals.fnscriptfunc.blob->m_instrucs[handler->address];
                     return true;
                 }
@@ -14798,6 +20335,8 @@ namespace neon
             }
             m_vmstate.framecount--;
         }
+        m_vmstate.haltframe.inscode = haltCode();
+        m_vmstate.currentframe = &m_vmstate.haltframe;
         m_vmstate.m_unhandledexceptionstate = true;
         /* at this point, the exception is unhandled; so, print it out. */
         colred = Util::termColor(NEON_COLOR_RED);
@@ -14807,29 +20346,29 @@ namespace neon
         m_debugwriter->format("%sunhandled %s%s", colred, exception->m_instanceclass->m_classname->data(), colreset);
         srcfile = "none";
         srcline = 0;
-        field = exception->m_instanceprops.getfieldbycstr("srcline");
+        field = exception->findProperty(String::intern("srcline"), nullptr);
         if(field != nullptr)
         {
             /* why does this happen? */
-            if(field->value.isNumber())
+            if(field->isNumber())
             {
-                srcline = field->value.asNumber();
+                srcline = field->asNumber();
             }
         }
-        field = exception->m_instanceprops.getfieldbycstr("srcfile");
+        field = exception->findProperty(String::intern("srcfile"), nullptr);
         if(field != nullptr)
         {
-            if(field->value.isString())
+            if(field->isString())
             {
-                tmp = field->value.asString();
+                tmp = field->asString();
                 srcfile = tmp->data();
             }
         }
         m_debugwriter->format(" [from native %s%s:%d%s]", colyellow, srcfile, srcline, colreset);
-        field = exception->m_instanceprops.getfieldbycstr("message");
+        field = exception->findProperty(String::intern("message"), nullptr);
         if(field != nullptr)
         {
-            emsg = Value::toString(field->value);
+            emsg = Value::toString(*field);
             if(emsg->length() > 0)
             {
                 m_debugwriter->format( ": %s", emsg->data());
@@ -14840,11 +20379,11 @@ namespace neon
             }
         }
         m_debugwriter->format("\n");
-        field = exception->m_instanceprops.getfieldbycstr("stacktrace");
+        field = exception->findProperty(String::intern("stacktrace"), nullptr);
         if(field != nullptr)
         {
             m_debugwriter->format("%sstacktrace%s:\n", colblue, colreset);
-            oa = field->value.asArray();
+            oa = field->asArray();
             cnt = oa->count();
             i = cnt - 1;
             if(cnt > 0)
@@ -14882,6 +20421,7 @@ namespace neon
         }
         frame->handlers[frame->m_handlercount].address = address;
         frame->handlers[frame->m_handlercount].finallyaddress = finallyaddress;
+        frame->handlers[frame->m_handlercount].stackdepth = m_vmstate.stackidx;
         /*frame->handlers[frame->m_handlercount].handlerklass = type;*/
         frame->m_handlercount++;
         return true;
@@ -14895,14 +20435,16 @@ namespace neon
         Instance* instance;
         String* osfile;
         auto gcs = SharedState::get();
+        gcs->vmStackPush(Value::fromObject(message));
         instance = Instance::make(exklass);
-        osfile = String::copy(srcfile);
         gcs->vmStackPush(Value::fromObject(instance));
+        osfile = String::copy(srcfile);
+        gcs->vmStackPush(Value::fromObject(osfile));
         instance->defProperty(String::intern("class"), Value::fromObject(exklass));
         instance->defProperty(String::intern("message"), Value::fromObject(message));
         instance->defProperty(String::intern("srcfile"), Value::fromObject(osfile));
         instance->defProperty(String::intern("srcline"), Value::makeNumber(srcline));
-        gcs->vmStackPop();
+        gcs->vmStackPop(3);
         return instance;
     }
 
@@ -14940,6 +20482,8 @@ namespace neon
         Function* function;
         (void)blob;
         auto gcs = SharedState::get();
+        /* nothing the compiler makes is reachable until it is done */
+        gcs->m_gcstate.blockcount++;
         lexer = AstLexer::make(source);
         parser = AstParser::make(lexer, module, keeplast);
         AstParser::FuncCompiler fnc(parser, Function::CTXTYPE_SCRIPT, true);
@@ -14950,7 +20494,7 @@ namespace neon
             if(gcs->m_conf.dumpbytecode)
             {
                 Debug dbg(gcs->m_debugwriter);
-                dbg.disasmBlob(parser->currentblob(), "<file>");
+                dbg.disasmBlob(function->m_fnvals.fnscriptfunc.blob, "<file>");
             }
         }
         else
@@ -14959,6 +20503,7 @@ namespace neon
         }
         AstLexer::destroy(lexer);
         AstParser::destroy(parser);
+        gcs->m_gcstate.blockcount--;
         return function;
     }
 
@@ -15020,7 +20565,7 @@ namespace neon
             ValPrinter::printValue(&pr, list[i], false, true);
             if((havejoinee && (joinee != nullptr)) && ((i + 1) < count))
             {
-                pr.writeString(joinee->data(), joinee->length());
+                pr.writeString(joinee->rawData(), joinee->length());
             }
         }
         ret = Value::fromObject(pr.takeString());
@@ -15033,7 +20578,7 @@ namespace neon
         Array* selfarr;
         ArgCheck check("length", scfn);
         selfarr = scfn.thisval.asArray();
-        return Value::makeNumber(selfarr->count());
+        return Value::makeNumberFromInt(selfarr->count());
     }
 
     static Value objfnarray_append(const FuncContext& scfn)
@@ -15110,16 +20655,16 @@ namespace neon
         if(scfn.argc == 2)
         {
             NEON_ARGS_CHECKTYPE(check, 1, &Value::isNumber);
-            i = scfn.argv[1].asNumber();
+            i = Value::valToInt(scfn.argv[1]);
         }
         for(; i < list->count(); i++)
         {
             if(Value::compareValues(list->get(i), scfn.argv[0]))
             {
-                return Value::makeNumber(i);
+                return Value::makeNumberFromInt(i);
             }
         }
-        return Value::makeNumber(-1);
+        return Value::makeInt(-1);
     }
 
     static Value objfnarray_insert(const FuncContext& scfn)
@@ -15569,7 +21114,7 @@ namespace neon
         NEON_ARGS_CHECKCOUNT(check, 1);
         NEON_ARGS_CHECKTYPE(check, 0, &Value::isNumber);
         list = scfn.thisval.asArray();
-        index = scfn.argv[0].asNumber();
+        index = Value::valToInt(scfn.argv[0]);
         if(((int)index > -1) && index < list->count())
         {
             return list->get(index);
@@ -15590,16 +21135,16 @@ namespace neon
             {
                 return Value::makeBool(false);
             }
-            return Value::makeNumber(0);
+            return Value::makeInt(0);
         }
         if(!scfn.argv[0].isNumber())
         {
             NEON_RETURNERROR(scfn, "lists are numerically indexed");
         }
-        index = scfn.argv[0].asNumber();
+        index = Value::valToInt(scfn.argv[0]);
         if(index < list->count() - 1)
         {
-            return Value::makeNumber((double)index + 1);
+            return Value::makeNumberFromInt(index + 1);
         }
         return Value::makeNull();
     }
@@ -15970,7 +21515,7 @@ namespace neon
     {
         ArgCheck check("length", scfn);
         NEON_ARGS_CHECKCOUNT(check, 0);
-        return Value::makeNumber(scfn.thisval.asDict()->m_htkeys.count());
+        return Value::makeNumberFromInt(scfn.thisval.asDict()->m_htkeys.count());
     }
 
     static Value objfndict_add(const FuncContext& scfn)
@@ -17429,7 +22974,7 @@ namespace neon
 
     static Value objfnnumber_tohexstring(const FuncContext& scfn)
     {
-        return Value::fromObject(String::utilNumberToHexString(scfn.thisval.asNumber(), false));
+        return Value::fromObject(String::utilNumberToHexString(Value::valToInt(scfn.thisval), false));
     }
 
     static Value objfnmath_hypot(const FuncContext& scfn)
@@ -17555,6 +23100,138 @@ namespace neon
         klass->defStaticNativeMethod(String::intern("pow"), objfnmath_pow);
     }
 
+    /* runs a full collection, and returns how many bytes it freed */
+    static Value objfngc_collect(const FuncContext& scfn)
+    {
+        int64_t before;
+        ArgCheck check("collect", scfn);
+        NEON_ARGS_CHECKCOUNT(check, 0);
+        auto gcs = SharedState::get();
+        gcs->gcWaitForSweeper();
+        before = gcs->m_gcstate.bytesallocated;
+        gcs->gcCollectGarbage();
+        gcs->gcWaitForSweeper();
+        return Value::makeNumber(before - gcs->m_gcstate.bytesallocated);
+    }
+
+    static Value objfngc_stats(const FuncContext& scfn)
+    {
+        int i;
+        Dict* dict;
+        Dict* types;
+        Dict* entry;
+        SharedState::GCStats* st;
+        ArgCheck check("stats", scfn);
+        NEON_ARGS_CHECKCOUNT(check, 0);
+        auto gcs = SharedState::get();
+        gcs->gcTakeSweptBytes();
+        st = &gcs->m_gcstate.stats;
+        dict = SharedState::gcProtect(Dict::make());
+        dict->addStr(String::intern("collections"), Value::makeNumber(st->fullcollections));
+        dict->addStr(String::intern("minorcollections"), Value::makeNumber(st->minorcollections));
+        dict->addStr(String::intern("incrementalcollections"), Value::makeNumber(st->incrementalcollections));
+        dict->addStr(String::intern("marktime"), Value::makeNumber(st->marktime));
+        dict->addStr(String::intern("sweeptime"), Value::makeNumber(st->sweeptime));
+        dict->addStr(String::intern("prunetime"), Value::makeNumber(st->prunetime));
+        dict->addStr(String::intern("bytesallocated"), Value::makeNumber(gcs->m_gcstate.bytesallocated));
+        dict->addStr(String::intern("nextgc"), Value::makeNumber(gcs->m_gcstate.nextgc));
+        dict->addStr(String::intern("growthfactor"), Value::makeNumber(gcs->m_gcstate.growthfactor));
+        dict->addStr(String::intern("cputarget"), Value::makeNumber(gcs->m_gcstate.cputarget));
+        dict->addStr(String::intern("softlimit"), Value::makeNumber(gcs->m_gcstate.softlimit));
+        dict->addStr(String::intern("pages"), Value::makeNumber(gcs->m_gcstate.heap.m_pagecount));
+        dict->addStr(String::intern("trimmedpages"), Value::makeNumber(st->trimmedpages));
+        dict->addStr(String::intern("unsharedslices"), Value::makeNumber(st->unsharedslices));
+        types = SharedState::gcProtect(Dict::make());
+        dict->addStr(String::intern("types"), Value::fromObject(types));
+        for(i = 0; i < SharedState::CONF_OBJTYPECOUNT; i++)
+        {
+            if(st->alloccount[i] == 0)
+            {
+                continue;
+            }
+            entry = SharedState::gcProtect(Dict::make());
+            types->addStr(String::intern(Object::typeName((Object::Type)i)), Value::fromObject(entry));
+            entry->addStr(String::intern("allocbytes"), Value::makeNumber(st->allocbytes[i]));
+            entry->addStr(String::intern("freedbytes"), Value::makeNumber(st->freedbytes[i]));
+            entry->addStr(String::intern("allocated"), Value::makeNumber(st->alloccount[i]));
+            entry->addStr(String::intern("freed"), Value::makeNumber(st->freedcount[i]));
+            entry->addStr(String::intern("live"), Value::makeNumber(gcs->gcLiveCount(i)));
+        }
+        return Value::fromObject(dict);
+    }
+
+    /* sets the growth factor, and returns the previous one */
+    static Value objfngc_setgrowthfactor(const FuncContext& scfn)
+    {
+        double prev;
+        double factor;
+        ArgCheck check("setGrowthFactor", scfn);
+        NEON_ARGS_CHECKCOUNT(check, 1);
+        NEON_ARGS_CHECKTYPE(check, 0, &Value::isNumber);
+        auto gcs = SharedState::get();
+        factor = scfn.argv[0].asNumber();
+        if(!(factor > 1.0))
+        {
+            NEON_RETURNERROR(scfn, "setGrowthFactor() expects a factor greater than 1, %g given", factor);
+        }
+        prev = gcs->m_gcstate.growthfactor;
+        gcs->m_gcstate.growthfactor = factor;
+        return Value::makeNumber(prev);
+    }
+
+    /*
+    * sets the share of the run time, from 0 to 1, that the growth factor is adapted to after each
+    * collection; 0 keeps it fixed. returns the previous share.
+    */
+    static Value objfngc_setcputarget(const FuncContext& scfn)
+    {
+        double prev;
+        double target;
+        ArgCheck check("setCpuTarget", scfn);
+        NEON_ARGS_CHECKCOUNT(check, 1);
+        NEON_ARGS_CHECKTYPE(check, 0, &Value::isNumber);
+        auto gcs = SharedState::get();
+        target = scfn.argv[0].asNumber();
+        if(!((target >= 0.0) && (target < 1.0)))
+        {
+            NEON_RETURNERROR(scfn, "setCpuTarget() expects a share from 0 to below 1, %g given", target);
+        }
+        prev = gcs->m_gcstate.cputarget;
+        gcs->m_gcstate.cputarget = target;
+        return Value::makeNumber(prev);
+    }
+
+    /* writes a heap snapshot to the given path, and returns how many objects it holds */
+    static Value objfngc_dumpheap(const FuncContext& scfn)
+    {
+        int64_t count;
+        String* path;
+        ArgCheck check("dumpHeap", scfn);
+        NEON_ARGS_CHECKCOUNT(check, 1);
+        NEON_ARGS_CHECKTYPE(check, 0, &Value::isString);
+        auto gcs = SharedState::get();
+        path = scfn.argv[0].asString();
+        count = HeapSnapshot::write(path->data());
+        if(count < 0)
+        {
+            NEON_THROWCLASSWITHSOURCEINFO(gcs->m_exceptions.ioerror, "%s: %s", path->data(), strerror(errno));
+            return Value::makeNull();
+        }
+        return Value::makeNumber(count);
+    }
+
+    void installModGC()
+    {
+        Class* klass;
+        auto gcs = SharedState::get();
+        klass = Class::makeScriptClass(String::intern("gc"), gcs->m_classprimobject);
+        klass->defStaticNativeMethod(String::intern("collect"), objfngc_collect);
+        klass->defStaticNativeMethod(String::intern("stats"), objfngc_stats);
+        klass->defStaticNativeMethod(String::intern("setGrowthFactor"), objfngc_setgrowthfactor);
+        klass->defStaticNativeMethod(String::intern("setCpuTarget"), objfngc_setcputarget);
+        klass->defStaticNativeMethod(String::intern("dumpHeap"), objfngc_dumpheap);
+    }
+
     static Value objfnobject_dumpself(const FuncContext& scfn)
     {
         Value v;
@@ -17880,21 +23557,21 @@ namespace neon
     {
         ArgCheck check("lower", scfn);
         NEON_ARGS_CHECKCOUNT(check, 0);
-        return Value::makeNumber(scfn.thisval.asRange()->m_lower);
+        return Value::makeInt(scfn.thisval.asRange()->m_lower);
     }
 
     static Value objfnrange_upper(const FuncContext& scfn)
     {
         ArgCheck check("upper", scfn);
         NEON_ARGS_CHECKCOUNT(check, 0);
-        return Value::makeNumber(scfn.thisval.asRange()->m_upper);
+        return Value::makeInt(scfn.thisval.asRange()->m_upper);
     }
 
     static Value objfnrange_range(const FuncContext& scfn)
     {
         ArgCheck check("range", scfn);
         NEON_ARGS_CHECKCOUNT(check, 0);
-        return Value::makeNumber(scfn.thisval.asRange()->m_range);
+        return Value::makeInt(scfn.thisval.asRange()->m_range);
     }
 
     static Value objfnrange_iter(const FuncContext& scfn)
@@ -17906,12 +23583,12 @@ namespace neon
         NEON_ARGS_CHECKCOUNT(check, 1);
         NEON_ARGS_CHECKTYPE(check, 0, &Value::isNumber);
         range = scfn.thisval.asRange();
-        index = scfn.argv[0].asNumber();
+        index = Value::valToInt(scfn.argv[0]);
         if(index >= 0 && index < range->m_range)
         {
             if(index == 0)
             {
-                return Value::makeNumber(range->m_lower);
+                return Value::makeInt(range->m_lower);
             }
             if(range->m_lower > range->m_upper)
             {
@@ -17921,7 +23598,7 @@ namespace neon
             {
                 val = ++range->m_lower;
             }
-            return Value::makeNumber(val);
+            return Value::makeInt(val);
         }
         return Value::makeNull();
     }
@@ -17939,16 +23616,16 @@ namespace neon
             {
                 return Value::makeNull();
             }
-            return Value::makeNumber(0);
+            return Value::makeInt(0);
         }
         if(!scfn.argv[0].isNumber())
         {
             NEON_RETURNERROR(scfn, "ranges are numerically indexed");
         }
-        index = (int)scfn.argv[0].asNumber() + 1;
+        index = (int)Value::valToInt(scfn.argv[0]) + 1;
         if(index < range->m_range)
         {
-            return Value::makeNumber(index);
+            return Value::makeInt(index);
         }
         return Value::makeNull();
     }
@@ -17963,7 +23640,7 @@ namespace neon
         oa = Array::make();
         for(i = 0; i < range->m_range; i++)
         {
-            val = Value::makeNumber(i);
+            val = Value::makeInt(i);
             oa->push(val);
         }
         return Value::fromObject(oa);
@@ -18101,7 +23778,7 @@ namespace neon
         ArgCheck check("fromCharCode", scfn);
         NEON_ARGS_CHECKCOUNT(check, 1);
         NEON_ARGS_CHECKTYPE(check, 0, &Value::isNumber);
-        ch = scfn.argv[0].asNumber();
+        ch = Value::valToInt(scfn.argv[0]);
         os = String::copy(&ch, 1);
         return Value::fromObject(os);
     }
@@ -18121,7 +23798,7 @@ namespace neon
         ArgCheck check("length", scfn);
         NEON_ARGS_CHECKCOUNT(check, 0);
         selfstr = scfn.thisval.asString();
-        return Value::makeNumber(selfstr->length());
+        return Value::makeNumberFromInt(selfstr->length());
     }
 
     static Value objfnstring_substring(const FuncContext& scfn)
@@ -18156,7 +23833,7 @@ namespace neon
         NEON_ARGS_CHECKCOUNT(check, 1);
         NEON_ARGS_CHECKTYPE(check, 0, &Value::isNumber);
         selfstr = scfn.thisval.asString();
-        idx = scfn.argv[0].asNumber();
+        idx = Value::valToInt(scfn.argv[0]);
         selflen = (int)selfstr->length();
         if((idx < 0) || (idx >= selflen))
         {
@@ -18166,7 +23843,7 @@ namespace neon
         {
             ch = selfstr->get(idx);
         }
-        return Value::makeNumber(ch);
+        return Value::makeInt(ch);
     }
 
     static Value objfnstring_charat(const FuncContext& scfn)
@@ -18179,7 +23856,7 @@ namespace neon
         NEON_ARGS_CHECKCOUNT(check, 1);
         NEON_ARGS_CHECKTYPE(check, 0, &Value::isNumber);
         selfstr = scfn.thisval.asString();
-        idx = scfn.argv[0].asNumber();
+        idx = Value::valToInt(scfn.argv[0]);
         selflen = (int)selfstr->length();
         if((idx < 0) || (idx >= selflen))
         {
@@ -18373,69 +24050,25 @@ namespace neon
         return Value::makeBool(selfstr->length() != 0);
     }
 
-    static Value objfnstring_trim(const FuncContext& scfn)
+    /* whether trim() and friends drop $ch: whitespace if no $trimmer was given, else $trimmer */
+    static NEON_INLINE bool stringIsTrimmed(int ch, char trimmer)
     {
-        char trimmer;
-        char* end;
-        char* string;
-        String* selfstr;
-        ArgCheck check("trim", scfn);
-        NEON_ARGS_CHECKCOUNTRANGE(check, 0, 1);
-        trimmer = '\0';
-        if(scfn.argc == 1)
-        {
-            trimmer = (char)scfn.argv[0].asString()->get(0);
-        }
-        selfstr = scfn.thisval.asString();
-        string = selfstr->mutdata();
-        end = nullptr;
-        /* Trim leading space*/
-        if(trimmer == '\0')
-        {
-            while(isspace((unsigned char)*string))
-            {
-                string++;
-            }
-        }
-        else
-        {
-            while(trimmer == *string)
-            {
-                string++;
-            }
-        }
-        /* All spaces? */
-        if(*string == 0)
-        {
-            return Value::fromObject(String::intern("", 0));
-        }
-        /* Trim trailing space */
-        end = string + strlen(string) - 1;
         if(trimmer == '\0')
         {
-            while(end > string && isspace((unsigned char)*end))
-            {
-                end--;
-            }
-        }
-        else
-        {
-            while(end > string && trimmer == *end)
-            {
-                end--;
-            }
+            return isspace((unsigned char)ch);
         }
-        end[1] = '\0';
-        return Value::fromObject(String::copy(string));
+        return (ch == trimmer);
     }
 
-    static Value objfnstring_ltrim(const FuncContext& scfn)
+    /* the part of the string that trim(), ltrim() or rtrim() keep, as a slice of it */
+    static Value stringTrimmed(const FuncContext& scfn, const char* name, bool left, bool right)
     {
         char trimmer;
-        char* end;
-        char* string;
+        size_t end;
+        size_t start;
+        const char* string;
         String* selfstr;
-        ArgCheck check("ltrim", scfn);
+        ArgCheck check(name, scfn);
         NEON_ARGS_CHECKCOUNTRANGE(check, 0, 1);
         trimmer = '\0';
         if(scfn.argc == 1)
@@ -18443,78 +24076,45 @@ namespace neon
             trimmer = (char)scfn.argv[0].asString()->get(0);
         }
         selfstr = scfn.thisval.asString();
-        string = selfstr->mutdata();
-        end = nullptr;
-        /* Trim leading space */
-        if(trimmer == '\0')
+        string = selfstr->rawData();
+        start = 0;
+        end = selfstr->length();
+        if(left)
         {
-            while(isspace((unsigned char)*string))
+            while((start < end) && stringIsTrimmed(string[start], trimmer))
             {
-                string++;
+                start++;
             }
         }
-        else
+        if(right)
         {
-            while(trimmer == *string)
+            while((end > start) && stringIsTrimmed(string[end - 1], trimmer))
             {
-                string++;
+                end--;
             }
         }
-        /* All spaces? */
-        if(*string == 0)
-        {
-            return Value::fromObject(String::intern("", 0));
-        }
-        end = string + strlen(string) - 1;
-        end[1] = '\0';
-        return Value::fromObject(String::copy(string));
+        return Value::fromObject(String::slice(selfstr, start, end - start));
+    }
+
+    static Value objfnstring_trim(const FuncContext& scfn)
+    {
+        return stringTrimmed(scfn, "trim", true, true);
+    }
+
+    static Value objfnstring_ltrim(const FuncContext& scfn)
+    {
+        return stringTrimmed(scfn, "ltrim", true, false);
     }
 
     static Value objfnstring_rtrim(const FuncContext& scfn)
     {
-        char trimmer;
-        char* end;
-        char* string;
-        String* selfstr;
-        ArgCheck check("rtrim", scfn);
-        NEON_ARGS_CHECKCOUNTRANGE(check, 0, 1);
-        trimmer = '\0';
-        if(scfn.argc == 1)
-        {
-            trimmer = (char)scfn.argv[0].asString()->get(0);
-        }
-        selfstr = scfn.thisval.asString();
-        string = selfstr->mutdata();
-        end = nullptr;
-        /* All spaces? */
-        if(*string == 0)
-        {
-            return Value::fromObject(String::intern("", 0));
-        }
-        end = string + strlen(string) - 1;
-        if(trimmer == '\0')
-        {
-            while(end > string && isspace((unsigned char)*end))
-            {
-                end--;
-            }
-        }
-        else
-        {
-            while(end > string && trimmer == *end)
-            {
-                end--;
-            }
-        }
-        /* Write new null terminator character */
-        end[1] = '\0';
-        return Value::fromObject(String::copy(string));
+        return stringTrimmed(scfn, "rtrim", false, true);
     }
 
     static Value objfnstring_indexof(const FuncContext& scfn)
     {
         int startindex;
-        char* result;
+        const char* result;
         const char* haystack;
         String* string;
         String* needle;
@@ -18527,18 +24127,22 @@ namespace neon
         if(scfn.argc == 2)
         {
             NEON_ARGS_CHECKTYPE(check, 1, &Value::isNumber);
-            startindex = scfn.argv[1].asNumber();
+            startindex = Value::valToInt(scfn.argv[1]);
+            if(startindex < 0)
+            {
+                startindex = 0;
+            }
         }
-        if(string->length() > 0 && needle->length() > 0)
+        if(string->length() > 0 && needle->length() > 0 && ((size_t)startindex < string->length()))
         {
-            haystack = string->data();
-            result = (char*)strstr(haystack + startindex, needle->data());
+            haystack = string->rawData();
+            result = Util::findBytes(haystack + startindex, string->length() - startindex, needle->rawData(), needle->length());
             if(result != nullptr)
             {
-                return Value::makeNumber((int)(result - haystack));
+                return Value::makeInt((int)(result - haystack));
             }
         }
-        return Value::makeNumber(-1);
+        return Value::makeInt(-1);
     }
 
     static Value objfnstring_startswith(const FuncContext& scfn)
@@ -18554,7 +24158,7 @@ namespace neon
         {
             return Value::makeBool(false);
         }
-        return Value::makeBool(memcmp(substr->data(), string->data(), substr->length()) == 0);
+        return Value::makeBool(memcmp(substr->rawData(), string->rawData(), substr->length()) == 0);
     }
 
     static Value objfnstring_endswith(const FuncContext& scfn)
@@ -18572,7 +24176,7 @@ namespace neon
             return Value::makeBool(false);
         }
         difference = string->length() - substr->length();
-        return Value::makeBool(memcmp(substr->data(), string->data() + difference, substr->length()) == 0);
+        return Value::makeBool(memcmp(substr->rawData(), string->rawData() + difference, substr->length()) == 0);
     }
 
     static Value objfnstring_matchcapture(const FuncContext& scfn)
@@ -18603,8 +24207,11 @@ namespace neon
     {
         int count;
         const char* tmp;
+        const char* end;
+        const char* haystack;
         String* substr;
         String* string;
+        Util::SearchNeedle sn;
         ArgCheck check("count", scfn);
         NEON_ARGS_CHECKCOUNT(check, 1);
         NEON_ARGS_CHECKTYPE(check, 0, &Value::isString);
@@ -18615,8 +24222,12 @@ namespace neon
             return Value::makeNumber(0);
         }
         count = 0;
-        tmp = string->data();
-        while((tmp = Util::utf8Strstr(tmp, substr->data())))
+        /* overlapping matches count, too */
+        haystack = string->rawData();
+        end = haystack + string->length();
+        tmp = haystack;
+        Util::searchPrepare(&sn, substr->rawData(), substr->length());
+        while((tmp = Util::findPrepared(tmp, end - tmp, &sn)) != nullptr)
         {
             count++;
             tmp++;
@@ -18665,7 +24276,7 @@ namespace neon
             {
                 start = i;
                 end = i + 1;
-                list->push(Value::fromObject(String::copy(string->data() + start, (int)(end - start))));
+                list->push(Value::fromObject(String::copy(string->rawData() + start, (int)(end - start))));
             }
         }
         return Value::fromObject(list);
@@ -18728,7 +24339,7 @@ namespace neon
         }
         str = (char*)Memory::sysMalloc(sizeof(char) * ((size_t)finalsize + 1));
         memcpy(str, fill, fillsize);
-        memcpy(str + fillsize, string->data(), string->length());
+        memcpy(str + fillsize, string->rawData(), string->length());
         str[finalsize] = '\0';
         Memory::sysFree(fill);
         result = String::take(str, finalsize);
@@ -18771,7 +24382,7 @@ namespace neon
             fill[i] = fillchar;
         }
         str = (char*)Memory::sysMalloc(sizeof(char) * ((size_t)finalsize + 1));
-        memcpy(str, string->data(), string->length());
+        memcpy(str, string->rawData(), string->length());
         memcpy(str + string->length(), fill, fillsize);
         str[finalsize] = '\0';
         Memory::sysFree(fill);
@@ -18785,7 +24396,9 @@ namespace neon
         size_t i;
         size_t end;
         size_t start;
+        size_t count;
         size_t length;
+        size_t* positions;
         Array* list;
         String* string;
         String* delimeter;
@@ -18802,17 +24415,19 @@ namespace neon
         list = SharedState::gcProtect(Array::make());
         if(delimeter->length() > 0)
         {
+            /* the delimiters are found first, so that the list is made at its final size */
+            length = string->length();
+            count = Util::findAllBytes(string->rawData(), length, delimeter->rawData(), delimeter->length(), &positions);
+            list->m_objvarray.ensureCapacity(count + 1);
             start = 0;
-            for(i = 0; i <= string->length(); i++)
+            for(i = 0; i <= count; i++)
             {
-                /* match found. */
-                if(memcmp(string->data() + i, delimeter->data(), delimeter->length()) == 0 || i == string->length())
-                {
-                    list->push(Value::fromObject(String::copy(string->data() + start, i - start)));
-                    i += delimeter->length() - 1;
-                    start = i + 1;
-                }
+                end = (i < count) ? positions[i] : length;
+                /* the pieces are slices of $string; see String::slice() */
+                list->push(Value::fromObject(String::slice(string, start, end - start)));
+                start = end + delimeter->length();
             }
+            Memory::sysFree(positions);
         }
         else
         {
@@ -18821,7 +24436,7 @@ namespace neon
             {
                 start = i;
                 end = i + 1;
-                list->push(Value::fromObject(String::copy(string->data() + start, (int)(end - start))));
+                list->push(Value::fromObject(String::copy(string->rawData() + start, (int)(end - start))));
             }
         }
         return Value::fromObject(list);
@@ -18843,11 +24458,12 @@ namespace neon
         findme = scfn.argv[0].asString();
         repwith = scfn.argv[1].asString();
         StrBuffer::fromPtr(&result, 0);
-        ok = string->m_sbuf.replace(&result, findme->data(), findme->length(), repwith->data(), repwith->length());
+        string->ensureFlat();
+        ok = string->m_sbuf.replace(&result, findme->rawData(), findme->length(), repwith->rawData(), repwith->length());
         if(ok)
         {
             xlen = result.length();
-            return Value::fromObject(String::makeFromStrbuf(result, Util::hashString(result.data(), xlen), xlen));
+            return Value::fromObject(String::makeFromStrbuf(result, 0, xlen));
         }
         StrBuffer::destroyFromPtr(&result);
         return Value::makeNull();
@@ -18864,10 +24480,10 @@ namespace neon
         NEON_ARGS_CHECKTYPE(check, 0, &Value::isNumber);
         string = scfn.thisval.asString();
         length = string->length();
-        index = scfn.argv[0].asNumber();
+        index = Value::valToInt(scfn.argv[0]);
         if(((int)index > -1) && (index < length))
         {
-            result = String::copy(&string->data()[index], 1);
+            result = String::copy(&string->rawData()[index], 1);
             return Value::fromObject(result);
         }
         return Value::makeNull();
@@ -18888,16 +24504,16 @@ namespace neon
             {
                 return Value::makeBool(false);
             }
-            return Value::makeNumber(0);
+            return Value::makeInt(0);
         }
         if(!scfn.argv[0].isNumber())
         {
             NEON_RETURNERROR(scfn, "strings are numerically indexed");
         }
-        index = scfn.argv[0].asNumber();
+        index = Value::valToInt(scfn.argv[0]);
         if(index < length - 1)
         {
-            return Value::makeNumber((double)index + 1);
+            return Value::makeNumberFromInt(index + 1);
         }
         return Value::makeNull();
     }
@@ -18924,7 +24540,7 @@ namespace neon
             if(arity > 0)
             {
                 passi++;
-                nestargs[0] = Value::fromObject(String::copy(string->data() + i, 1));
+                nestargs[0] = Value::fromObject(String::copy(string->rawData() + i, 1));
                 if(arity > 1)
                 {
                     passi++;
@@ -19057,7 +24673,7 @@ namespace neon
         ArgCheck check("microtime", scfn);
         NEON_ARGS_CHECKCOUNT(check, 0);
         Util::osfn_gettimeofday(&tv, nullptr);
-        return Value::makeNumber((1000000 * (double)tv.tv_sec) + ((double)tv.tv_usec / 10));
+        return Value::makeNumber((1000000 * (double)tv.tv_sec) + (double)tv.tv_usec);
     }
 
     static Value nativefn_id(const FuncContext& scfn)
@@ -19113,7 +24729,7 @@ namespace neon
         {
             ord += 256;
         }
-        return Value::makeNumber(ord);
+        return Value::makeInt(ord);
     }
 
     static Value nativefn_srand(const FuncContext& scfn)
@@ -19297,6 +24913,7 @@ namespace neon
     {
         int i;
         int startva;
+        Blob* blob;
         CallFrame* frame;
         Array* argslist;
         // closure->m_clsthisval = thisval;
@@ -19347,7 +24964,12 @@ namespace neon
         }
         frame = &m_vmstate.framevalues[m_vmstate.framecount++];
         frame->closure = closure;
-        frame->inscode = closure->m_fnvals.fnclosure.scriptfunc->m_fnvals.fnscriptfunc.blob->m_instrucs.data();
+        blob = closure->m_fnvals.fnclosure.scriptfunc->m_fnvals.fnscriptfunc.blob;
+        frame->inscode = blob->m_instrucs.data();
+        if(blob->m_regcode.count() > 0)
+        {
+            frame->inscode = blob->m_regcode.data();
+        }
         frame->stackslotpos = m_vmstate.stackidx + (-argcount - 1);
         return true;
     }
@@ -19355,12 +24977,19 @@ namespace neon
     NEON_INLINE bool SharedState::vmDoCallNative(Function* native, Value thisval, size_t argcount)
     {
         int64_t spos;
+        int64_t unwinds;
         Value r;
         Value* vargs;
         NEON_APIDEBUG("thisval.m_valtype=%s, argcount=%d", Value::typeName(thisval, true), argcount);
         spos = m_vmstate.stackidx + (-argcount);
         vargs = m_vmstate.stackvalues.getp(spos);
+        unwinds = m_vmstate.unwindcount;
         r = native->m_fnvals.fnnativefunc.natfunc(FuncContext{thisval, vargs, argcount});
+        if(NEON_UNLIKELY(m_vmstate.unwindcount != unwinds))
+        {
+            /* it raised an exception that was caught, and the stack is already laid out for the catch block */
+            return true;
+        }
         {
             m_vmstate.stackvalues[spos - 1] = r;
             m_vmstate.stackidx -= argcount;
@@ -19530,25 +25159,157 @@ namespace neon
                 break;
             }
         }
-        return nullptr;
+        return nullptr;
+    }
+
+    /*
+     * this macro cannot (rather, should not) be used outside of runVM().
+     * if you need to halt the vm, throw an exception instead.
+     * this macro is EXCLUSIVELY for non-recoverable errors!
+     */
+    #define VMMAC_EXITVM()                               \
+        {                                                   \
+            (void)you_are_calling_exit_vm_outside_of_runvm; \
+            return Status::RuntimeFail;                 \
+        }
+
+    #define VMMAC_TRYRAISE(rtval, ...) \
+        if(!NEON_THROWEXCEPTION(__VA_ARGS__)) \
+        {                                 \
+            return rtval;                 \
+        }
+
+    NEON_INLINE InlineCache* SharedState::vmReadInlineCache()
+    {
+        uint16_t idx;
+        idx = vmReadShort();
+        auto blob = Wrappers::wrapGetBlobOfClosure(m_vmstate.currentframe->closure);
+        return blob->m_inlinecaches.getp(idx);
+    }
+
+    /*
+    * looks up name in the properties of instance, and returns a pointer to its value (see Instance::findProperty).
+    * on a hit, the slot is taken from ic, provided the instance still has the shape it was cached for; otherwise the
+    * shape is searched, and the slot is remembered for it. instances in dictionary mode are never cached.
+    * private names are only resolved if allowprivate is set, so that the caller can take the slow path (and raise).
+    */
+    NEON_INLINE Value* SharedState::vmUtilCachedInstanceProperty(InlineCache* ic, Instance* instance, String* name, bool allowprivate, Property::FieldType* ftyp)
+    {
+        int slot;
+        Shape* shape;
+        InlineCache::Entry* ent;
+        shape = instance->m_shape;
+        if(shape != nullptr)
+        {
+            ent = ic->find(shape);
+            if((ent != nullptr) && (ent->epoch == m_vmstate.cacheepoch) && (ent->slot >= 0) && (ent->nextshape == nullptr))
+            {
+                *ftyp = (Property::FieldType)shape->m_fieldtypes[ent->slot];
+                return &instance->m_slots[ent->slot];
+            }
+        }
+        if(!allowprivate && Class::methodNameIsPrivate(name))
+        {
+            return nullptr;
+        }
+        if(shape == nullptr)
+        {
+            return instance->findProperty(name, ftyp);
+        }
+        slot = shape->lookup(name);
+        if(slot < 0)
+        {
+            return nullptr;
+        }
+        ent = ic->find(shape);
+        if(ent == nullptr)
+        {
+            ent = ic->add(shape);
+        }
+        ent->epoch = m_vmstate.cacheepoch;
+        ent->slot = slot;
+        ent->nextshape = nullptr;
+        *ftyp = (Property::FieldType)shape->m_fieldtypes[slot];
+        return &instance->m_slots[slot];
     }
 
     /*
-     * this macro cannot (rather, should not) be used outside of runVM().
-     * if you need to halt the vm, throw an exception instead.
-     * this macro is EXCLUSIVELY for non-recoverable errors!
-     */
-    #define VMMAC_EXITVM()                               \
-        {                                                   \
-            (void)you_are_calling_exit_vm_outside_of_runvm; \
-            return Status::RuntimeFail;                 \
+    * adds name to instance (or changes its field type), for a property set site whose lookup missed.
+    * the shape transition is remembered in ic, so that the next instance that arrives here with the same shape
+    * skips the search for the transition.
+    */
+    NEON_INLINE void SharedState::vmUtilAddInstanceProperty(InlineCache* ic, Instance* instance, String* name, Value val)
+    {
+        Shape* oldshape;
+        InlineCache::Entry* ent;
+        oldshape = instance->m_shape;
+        if(oldshape != nullptr)
+        {
+            ent = ic->find(oldshape);
+            if((ent != nullptr) && (ent->epoch == m_vmstate.cacheepoch) && (ent->nextshape != nullptr))
+            {
+                instance->ensureSlots(ent->nextshape->m_slotcount);
+                instance->m_slots[ent->slot] = val;
+                SharedState::gcWriteBarrier(instance, val);
+                instance->m_shape = ent->nextshape;
+                return;
+            }
+        }
+        instance->defProperty(name, val);
+        if((oldshape != nullptr) && (instance->m_shape != nullptr) && (instance->m_shape->m_parent == oldshape))
+        {
+            ent = ic->find(oldshape);
+            if(ent == nullptr)
+            {
+                ent = ic->add(oldshape);
+            }
+            ent->epoch = m_vmstate.cacheepoch;
+            ent->slot = oldshape->m_slotcount;
+            ent->nextshape = instance->m_shape;
         }
+    }
 
-    #define VMMAC_TRYRAISE(rtval, ...) \
-        if(!NEON_THROWEXCEPTION(__VA_ARGS__)) \
-        {                                 \
-            return rtval;                 \
+    /*
+    * resolves the method name of klass, either from ic, or by looking it up in klass (and its
+    * superclasses, if walkchain is set). entries stay valid until the next invalidateInlineCaches().
+    * the entry is made for key, which is usually klass itself (see InlineCache::Entry).
+    * private methods are not resolved unless allowprivate is set.
+    */
+    NEON_INLINE bool SharedState::vmUtilCachedMethod(InlineCache* ic, const void* key, Class* klass, String* name, bool walkchain, bool allowprivate, Value* dest)
+    {
+        Property* field;
+        InlineCache::Entry* ent;
+        ent = ic->find(key);
+        if((ent != nullptr) && (ent->epoch == m_vmstate.cacheepoch))
+        {
+            *dest = ent->method;
+            return true;
         }
+        if(walkchain)
+        {
+            field = klass->getMethodField(name);
+        }
+        else
+        {
+            field = klass->m_instmethods.getfieldbyostr(name);
+        }
+        if(field == nullptr)
+        {
+            return false;
+        }
+        if(!allowprivate && (Function::getMethodType(field->value) == Function::CTXTYPE_PRIVATE))
+        {
+            return false;
+        }
+        if(ent == nullptr)
+        {
+            ent = ic->add(key);
+        }
+        ent->epoch = m_vmstate.cacheepoch;
+        ent->method = field->value;
+        *dest = field->value;
+        return true;
+    }
 
     NEON_INLINE bool SharedState::vmUtilInvokeMethodFromClass(Class* klass, String* name, size_t argcount)
     {
@@ -19566,28 +25327,34 @@ namespace neon
         return NEON_THROWEXCEPTION("undefined method '%s' in %s", name->data(), klass->m_classname->data());
     }
 
-    NEON_INLINE bool SharedState::vmUtilInvokeMethodSelf(String* name, size_t argcount)
+    NEON_INLINE bool SharedState::vmUtilInvokeMethodSelf(String* name, size_t argcount, InlineCache* ic)
     {
         int64_t spos;
+        Value method;
         Value receiver;
         Instance* instance;
         Property* field;
+        Value* propval;
         NEON_APIDEBUG("argcount=%d", argcount);
         receiver = vmStackPeek(argcount);
         if(receiver.isInstance())
         {
             instance = receiver.asInstance();
+            if(vmUtilCachedMethod(ic, instance->m_instanceclass, instance->m_instanceclass, name, false, true, &method))
+            {
+                return vmCallWithObject(method, receiver, argcount, false);
+            }
             field = instance->m_instanceclass->m_instmethods.getfieldbyostr(name);
             if(field != nullptr)
             {
                 return vmCallWithObject(field->value, receiver, argcount, false);
             }
-            field = instance->m_instanceprops.getfieldbyostr(name);
-            if(field != nullptr)
+            propval = instance->findProperty(name, nullptr);
+            if(propval != nullptr)
             {
                 spos = (m_vmstate.stackidx + (-argcount - 1));
                 m_vmstate.stackvalues[spos] = receiver;
-                return vmCallWithObject(field->value, receiver, argcount, false);
+                return vmCallWithObject(*propval, receiver, argcount, false);
             }
         }
         else if(receiver.isClass())
@@ -19605,10 +25372,11 @@ namespace neon
         return NEON_THROWEXCEPTION("cannot call method '%s' on object of type '%s'", name->data(), Value::typeName(receiver, false));
     }
 
-    NEON_INLINE bool SharedState::vmUtilInvokeMethodNormal(String* name, size_t argcount)
+    NEON_INLINE bool SharedState::vmUtilInvokeMethodNormal(String* name, size_t argcount, InlineCache* ic)
     {
         size_t spos;
         Object::Type rectype;
+        Value method;
         Value receiver;
         Property* field;
         Class* klass;
@@ -19679,15 +25447,35 @@ namespace neon
                 }
                 case Object::OTYP_INSTANCE:
                 {
+                    Shape* shape;
+                    Value* propval;
                     Instance* instance;
+                    InlineCache::Entry* ent;
                     NEON_APIDEBUG("receiver is an instance");
                     instance = receiver.asInstance();
-                    field = instance->m_instanceprops.getfieldbyostr(name);
-                    if(field != nullptr)
+                    /*
+                    * an entry for the shape of instance means that name is not one of its properties;
+                    * otherwise, properties (which may hold functions) take precedence over methods.
+                    */
+                    shape = instance->m_shape;
+                    if(shape != nullptr)
+                    {
+                        ent = ic->find(shape);
+                        if((ent != nullptr) && (ent->epoch == m_vmstate.cacheepoch))
+                        {
+                            return vmCallWithObject(ent->method, Value::fromObject(instance->m_instanceclass), argcount, false);
+                        }
+                    }
+                    propval = instance->findProperty(name, nullptr);
+                    if(propval != nullptr)
                     {
                         spos = (m_vmstate.stackidx + (-argcount - 1));
                         m_vmstate.stackvalues[spos] = receiver;
-                        return vmCallWithObject(field->value, receiver, argcount, false);
+                        return vmCallWithObject(*propval, receiver, argcount, false);
+                    }
+                    if(vmUtilCachedMethod(ic, (shape != nullptr) ? (const void*)shape : (const void*)instance->m_instanceclass, instance->m_instanceclass, name, false, false, &method))
+                    {
+                        return vmCallWithObject(method, Value::fromObject(instance->m_instanceclass), argcount, false);
                     }
                     return vmUtilInvokeMethodFromClass(instance->m_instanceclass, name, argcount);
                 }
@@ -19695,6 +25483,10 @@ namespace neon
                 case Object::OTYP_DICT:
                 {
                     NEON_APIDEBUG("receiver is a dictionary");
+                    if(vmUtilCachedMethod(ic, m_classprimdict, m_classprimdict, name, true, true, &method))
+                    {
+                        return vmDoCallNative(method.asFunction(), receiver, argcount);
+                    }
                     field = m_classprimdict->getMethodField(name);
                     if(field != nullptr)
                     {
@@ -19726,6 +25518,10 @@ namespace neon
             /* @TODO: have methods for non objects as well. */
             return NEON_THROWEXCEPTION("non-object %s has no method named '%s'", Value::typeName(receiver, false), name->data());
         }
+        if(vmUtilCachedMethod(ic, klass, klass, name, true, true, &method))
+        {
+            return vmCallWithObject(method, receiver, argcount, false);
+        }
         field = klass->getMethodField(name);
         if(field != nullptr)
         {
@@ -19803,9 +25599,11 @@ namespace neon
         method = vmStackPeek(0);
         klass = vmStackPeek(1).asClass();
         klass->m_instmethods.set(Value::fromObject(name), method);
+        invalidateInlineCaches();
         if(Function::getMethodType(method) == Function::CTXTYPE_INITIALIZER)
         {
             klass->m_constructor = method;
+            SharedState::gcWriteBarrier(klass, method);
         }
         vmStackPop();
     }
@@ -19852,7 +25650,7 @@ namespace neon
         IOStream::makeStackString(&pr);
         for(i = 0; i < times; i++)
         {
-            pr.writeString(str->data(), str->length());
+            pr.writeString(str->rawData(), str->length());
         }
         os = pr.takeString();
         IOStream::destroy(&pr);
@@ -19961,6 +25759,7 @@ namespace neon
         int length;
         int idxupper;
         int idxlower;
+        String* result;
         Value valupper;
         Value vallower;
         valupper = vmStackPeek(0);
@@ -20005,12 +25804,18 @@ namespace neon
         }
         start = idxlower;
         end = idxupper;
+        if(end < start)
+        {
+            end = start;
+        }
+        /* made while $string is still on the stack, since the slice does not keep it alive */
+        result = String::slice(string, start, end - start);
         if(!willassign)
         {
             /* +1 for the string itself */
             vmStackPop(3);
         }
-        vmStackPush(Value::fromObject(String::copy(string->data() + start, end - start)));
+        vmStackPush(Value::fromObject(result));
         return true;
     }
 
@@ -20119,14 +25924,14 @@ namespace neon
             {
                 rng = vindex.asRange();
                 vmStackPop();
-                vmStackPush(Value::makeNumber(rng->m_lower));
-                vmStackPush(Value::makeNumber(rng->m_upper));
+                vmStackPush(Value::makeInt(rng->m_lower));
+                vmStackPush(Value::makeInt(rng->m_upper));
                 return vmUtilDoGetRangedIndexOfString(string, willassign);
             }
             vmStackPop(1);
             return NEON_THROWEXCEPTION("strings are numerically indexed");
         }
-        index = vindex.asNumber();
+        index = Value::valToInt(vindex);
         maxlength = string->length();
         realindex = index;
         if(index < 0)
@@ -20149,7 +25954,7 @@ namespace neon
         }
         if(okindex)
         {
-            vmStackPush(Value::fromObject(String::copy(string->data() + start, end - start)));
+            vmStackPush(Value::fromObject(String::copy(string->rawData() + start, end - start)));
         }
         else
         {
@@ -20179,14 +25984,14 @@ namespace neon
             {
                 rng = vindex.asRange();
                 vmStackPop();
-                vmStackPush(Value::makeNumber(rng->m_lower));
-                vmStackPush(Value::makeNumber(rng->m_upper));
+                vmStackPush(Value::makeInt(rng->m_lower));
+                vmStackPush(Value::makeInt(rng->m_upper));
                 return vmUtilDoGetRangedIndexOfArray(list, willassign);
             }
             vmStackPop();
             return NEON_THROWEXCEPTION("list are numerically indexed");
         }
-        index = vindex.asNumber();
+        index = Value::valToInt(vindex);
         /*
         if(NEON_UNLIKELY(index < 0))
         {
@@ -20385,7 +26190,7 @@ namespace neon
             /* pop the value, index and list out */
             return NEON_THROWEXCEPTION("list are numerically indexed");
         }
-        rawpos = index.asNumber();
+        rawpos = Value::valToInt(index);
         position = rawpos;
         list->set(position, value);
         /* pop the value, index and list out */
@@ -20511,19 +26316,54 @@ namespace neon
         return true;
     }
 
+    /* whether $val is a string long enough that appending to it should make a rope (see String::concat) */
+    static NEON_INLINE bool vmUtilIsLongString(Value val)
+    {
+        return (val.isString() && (val.asString()->length() >= String::CONF_MINROPELENGTH));
+    }
+
+    /*
+    * strings are joined by String::concat(), without the printer. otherwise both operands are printed to a
+    * new string, unless one is a long string: then the other one is printed to a string of its own, which
+    * replaces it on the stack, and both are joined as strings, so that appending a number to a rope does not
+    * flatten it. operands stay on the stack until the result is made, so they are safe from a collection.
+    */
     NEON_INLINE bool SharedState::vmUtilConcatenate()
     {
+        int i;
+        Value val;
         Value vleft;
         Value vright;
         IOStream pr;
         String* result;
         vright = vmStackPeek(0);
         vleft = vmStackPeek(1);
-        IOStream::makeStackString(&pr);
-        ValPrinter::printValue(&pr, vleft, false, true);
-        ValPrinter::printValue(&pr, vright, false, true);
-        result = pr.takeString();
-        IOStream::destroy(&pr);
+        if(!vleft.isString() || !vright.isString())
+        {
+            if(!vmUtilIsLongString(vleft) && !vmUtilIsLongString(vright))
+            {
+                IOStream::makeStackString(&pr);
+                ValPrinter::printValue(&pr, vleft, false, true);
+                ValPrinter::printValue(&pr, vright, false, true);
+                result = pr.takeString();
+                IOStream::destroy(&pr);
+                vmStackPop(2);
+                vmStackPush(Value::fromObject(result));
+                return true;
+            }
+            for(i = 0; i < 2; i++)
+            {
+                val = vmStackPeek(i);
+                if(!val.isString())
+                {
+                    IOStream::makeStackString(&pr);
+                    ValPrinter::printValue(&pr, val, false, true);
+                    m_vmstate.stackvalues[m_vmstate.stackidx - 1 - i] = Value::fromObject(pr.takeString());
+                    IOStream::destroy(&pr);
+                }
+            }
+        }
+        result = String::concat(vmStackPeek(1).asString(), vmStackPeek(0).asString());
         vmStackPop(2);
         vmStackPush(Value::fromObject(result));
         return true;
@@ -20597,6 +26437,28 @@ namespace neon
         return nullptr;
     }
 
+    /*
+    * the instance on top of the stack has no readable property $name, so it is replaced by its method $name,
+    * bound to it. returns false when an exception was raised instead.
+    */
+    NEON_INLINE bool SharedState::vmUtilGetInstanceMethod(Instance* instance, String* name)
+    {
+        /* properties that may be read are resolved by vmUtilCachedInstanceProperty() already */
+        if(instance->findProperty(name, nullptr) != nullptr)
+        {
+            return NEON_THROWEXCEPTION("cannot call private property '%s' from instance of %s", name->data(), instance->m_instanceclass->m_classname->data());
+        }
+        if(Class::methodNameIsPrivate(name))
+        {
+            return NEON_THROWEXCEPTION("cannot bind private property '%s' to instance of %s", name->data(), instance->m_instanceclass->m_classname->data());
+        }
+        if(instance->m_instanceclass->m_instmethods.getfieldbyostr(name) == nullptr)
+        {
+            return NEON_THROWEXCEPTION("instance of class %s does not have a property or method named '%s'", instance->m_instanceclass->m_classname->data(), name->data());
+        }
+        return vmUtilBindMethod(instance->m_instanceclass, name);
+    }
+
     NEON_INLINE Property* SharedState::vmUtilGetProperty(Value peeked, String* name)
     {
         Property* field;
@@ -20634,28 +26496,8 @@ namespace neon
             break;
             case Object::OTYP_INSTANCE:
             {
-                Instance* instance;
-                instance = peeked.asInstance();
-                field = instance->m_instanceprops.getfieldbyostr(name);
-                if(field != nullptr)
-                {
-                    if(Class::methodNameIsPrivate(name))
-                    {
-                        NEON_THROWEXCEPTION("cannot call private property '%s' from instance of %s", name->data(), instance->m_instanceclass->m_classname->data());
-                        return nullptr;
-                    }
-                    return field;
-                }
-                if(Class::methodNameIsPrivate(name))
-                {
-                    NEON_THROWEXCEPTION("cannot bind private property '%s' to instance of %s", name->data(), instance->m_instanceclass->m_classname->data());
-                    return nullptr;
-                }
-                if(vmUtilBindMethod(instance->m_instanceclass, name))
-                {
-                    return field;
-                }
-                NEON_THROWEXCEPTION("instance of class %s does not have a property or method named '%s'", peeked.asInstance()->m_instanceclass->m_classname->data(), name->data());
+                /* instances have no Property to return; see vmUtilGetInstanceMethod() */
+                vmUtilGetInstanceMethod(peeked.asInstance(), name);
                 return nullptr;
             }
             break;
@@ -20769,12 +26611,34 @@ namespace neon
     NEON_INLINE bool SharedState::vmDoPropertyGetNormal()
     {
         Value peeked;
+        Value* propval;
         Property* field;
         String* name;
+        InlineCache* ic;
+        Property::FieldType ftyp;
         name = vmReadString();
+        ic = vmReadInlineCache();
         peeked = vmStackPeek(0);
         if(peeked.isObject())
         {
+            if(peeked.isInstance())
+            {
+                propval = vmUtilCachedInstanceProperty(ic, peeked.asInstance(), name, false, &ftyp);
+                if(propval != nullptr)
+                {
+                    if(ftyp == Property::FTYP_FUNCTION)
+                    {
+                        vmCallWithObject(*propval, peeked, 0, false);
+                    }
+                    else
+                    {
+                        vmStackPop();
+                        vmStackPush(*propval);
+                    }
+                    return true;
+                }
+                return vmUtilGetInstanceMethod(peeked.asInstance(), name);
+            }
             field = vmUtilGetProperty(peeked, name);
             if(field == nullptr)
             {
@@ -20808,18 +26672,22 @@ namespace neon
         Class* klass;
         Instance* instance;
         Module* module;
+        Value* propval;
         Property* field;
+        InlineCache* ic;
+        Property::FieldType ftyp;
         name = vmReadString();
+        ic = vmReadInlineCache();
         peeked = vmStackPeek(0);
         if(peeked.isInstance())
         {
             instance = peeked.asInstance();
-            field = instance->m_instanceprops.getfieldbyostr(name);
-            if(field != nullptr)
+            propval = vmUtilCachedInstanceProperty(ic, instance, name, true, &ftyp);
+            if(propval != nullptr)
             {
                 /* pop the instance... */
                 vmStackPop();
-                vmStackPush(field->value);
+                vmStackPush(*propval);
                 return true;
             }
             if(vmUtilBindMethod(instance->m_instanceclass, name))
@@ -20884,13 +26752,26 @@ namespace neon
         String* name;
         Dict* dict;
         Instance* instance;
+        Value* propval;
+        InlineCache* ic;
+        Property::FieldType ftyp;
         vtarget = vmStackPeek(1);
         name = vmReadString();
+        ic = vmReadInlineCache();
         vpeek = vmStackPeek(0);
         if(vtarget.isInstance())
         {
             instance = vtarget.asInstance();
-            instance->defProperty(name, vpeek);
+            propval = vmUtilCachedInstanceProperty(ic, instance, name, true, &ftyp);
+            if((propval != nullptr) && (ftyp == Property::FTYP_VALUE))
+            {
+                *propval = vpeek;
+                SharedState::gcWriteBarrier(instance, vpeek);
+            }
+            else
+            {
+                vmUtilAddInstanceProperty(ic, instance, name, vpeek);
+            }
             value = vmStackPop();
             /* removing the instance object */
             vmStackPop();
@@ -20959,7 +26840,7 @@ namespace neon
         Value binvalleft;
         Value binvalright;
         willassign = false;
-        instruction = (Instruction::OpCode)m_vmstate.currentinstr.code;
+        instruction = (Instruction::OpCode)m_vmstate.currentinstr;
         binvalright = vmStackPeek(0);
         binvalleft = vmStackPeek(1);
         if(NEON_UNLIKELY(binvalleft.isInstance()))
@@ -21034,8 +26915,6 @@ namespace neon
             VMMAC_TRYRAISE(false, "unsupported operand %s for %s and %s", Debug::opcodeToString(instruction), Value::typeName(binvalleft, false), Value::typeName(binvalright, false));
             return false;
         }
-        binvalright = vmStackPop();
-        binvalleft = vmStackPop();
         res = Value::makeNull();
         switch(instruction)
         {
@@ -21071,21 +26950,21 @@ namespace neon
             {
                 ibinright = Value::valToInt(binvalright);
                 ibinleft = Value::valToInt(binvalleft);
-                res = Value::makeNumber(ibinleft & ibinright);
+                res = Value::makeNumberFromInt(ibinleft & ibinright);
             }
             break;
             case Instruction::OPC_PRIMOR:
             {
                 ibinright = Value::valToInt(binvalright);
                 ibinleft = Value::valToInt(binvalleft);
-                res = Value::makeNumber(ibinleft | ibinright);
+                res = Value::makeNumberFromInt(ibinleft | ibinright);
             }
             break;
             case Instruction::OPC_PRIMBITXOR:
             {
                 ibinright = Value::valToInt(binvalright);
                 ibinleft = Value::valToInt(binvalleft);
-                res = Value::makeNumber(ibinleft ^ ibinright);
+                res = Value::makeNumberFromInt(ibinleft ^ ibinright);
             }
             break;
             case Instruction::OPC_PRIMSHIFTLEFT:
@@ -21102,7 +26981,7 @@ namespace neon
                 ubinright = Value::valToUint(binvalright);
                 ubinleft = Value::valToUint(binvalleft);
                 ubinright &= 0x1f;
-                res = Value::makeNumber(ubinleft << ubinright);
+                res = Value::makeNumberFromInt(ubinleft << ubinright);
             }
             break;
             case Instruction::OPC_PRIMSHIFTRIGHT:
@@ -21116,7 +26995,7 @@ namespace neon
                 ubinright = Value::valToUint(binvalright);
                 ubinleft = Value::valToUint(binvalleft);
                 ubinright &= 0x1f;
-                res = Value::makeNumber(ubinleft >> ubinright);
+                res = Value::makeNumberFromInt(ubinleft >> ubinright);
             }
             break;
             case Instruction::OPC_PRIMGREATER:
@@ -21131,16 +27010,187 @@ namespace neon
                 dbinright = Value::valToNumber(binvalright);
                 dbinleft = Value::valToNumber(binvalleft);
                 res = Value::makeBool(dbinleft < dbinright);
-            }
-            break;
+            }
+            break;
+            default:
+            {
+                fprintf(stderr, "unhandled instruction %d (%s)!\n", instruction, Debug::opcodeToString(instruction));
+                return false;
+            }
+            break;
+        }
+        /* the result replaces the left operand */
+        m_vmstate.stackvalues[m_vmstate.stackidx - 2] = res;
+        m_vmstate.stackidx--;
+        return true;
+    }
+
+    /*
+    * the integer/integer case of vmDoBinaryNumbers(): writes the result over $top[-2].
+    * returns false when the result cannot be an integer (overflow, inexact division, -0),
+    * in which case the operation is redone with doubles.
+    */
+    NEON_INLINE bool SharedState::vmDoBinaryInts(int instruction, Value* top)
+    {
+        int64_t ibinright;
+        int64_t ibinleft;
+        int64_t ires;
+        uint32_t ubinright;
+        ibinright = top[-1].asInt();
+        ibinleft = top[-2].asInt();
+        switch(instruction)
+        {
+            case Instruction::OPC_PRIMADD:
+                ires = ibinleft + ibinright;
+                break;
+            case Instruction::OPC_PRIMSUBTRACT:
+                ires = ibinleft - ibinright;
+                break;
+            case Instruction::OPC_PRIMMULTIPLY:
+                if(__builtin_mul_overflow(ibinleft, ibinright, &ires) || ((ires == 0) && ((ibinleft < 0) || (ibinright < 0))))
+                {
+                    return false;
+                }
+                break;
+            case Instruction::OPC_PRIMDIVIDE:
+                if((ibinright == 0) || ((ibinleft % ibinright) != 0) || ((ibinleft == 0) && (ibinright < 0)))
+                {
+                    return false;
+                }
+                ires = ibinleft / ibinright;
+                break;
+            case Instruction::OPC_PRIMMODULO:
+                if(ibinright == 0)
+                {
+                    return false;
+                }
+                /* same sign rules as vmCallbackModulo() */
+                ires = ibinleft % ibinright;
+                if((ires == 0) && (ibinleft < 0))
+                {
+                    return false;
+                }
+                if((ires != 0) && ((ires < 0) != (ibinright < 0)))
+                {
+                    ires += ibinright;
+                }
+                break;
+            case Instruction::OPC_PRIMAND:
+                ires = ibinleft & ibinright;
+                break;
+            case Instruction::OPC_PRIMOR:
+                ires = ibinleft | ibinright;
+                break;
+            case Instruction::OPC_PRIMBITXOR:
+                ires = ibinleft ^ ibinright;
+                break;
+            case Instruction::OPC_PRIMSHIFTLEFT:
+                ubinright = ((uint32_t)ibinright) & 0x1f;
+                ires = ((uint32_t)ibinleft) << ubinright;
+                break;
+            case Instruction::OPC_PRIMSHIFTRIGHT:
+                ubinright = ((uint32_t)ibinright) & 0x1f;
+                ires = ((uint32_t)ibinleft) >> ubinright;
+                break;
+            case Instruction::OPC_PRIMGREATER:
+                top[-2] = Value::makeBool(ibinleft > ibinright);
+                return true;
+            case Instruction::OPC_PRIMLESSTHAN:
+                top[-2] = Value::makeBool(ibinleft < ibinright);
+                return true;
+            case Instruction::OPC_EQUAL:
+                top[-2] = Value::makeBool(ibinleft == ibinright);
+                return true;
+            default:
+                return false;
+        }
+        if(NEON_UNLIKELY(!Value::fitsInt(ires)))
+        {
+            return false;
+        }
+        top[-2] = Value::makeInt(ires);
+        return true;
+    }
+
+    /*
+    * the number/number case of the binary instructions, done in place: the result overwrites the left operand.
+    * returns false, without touching the stack, unless both operands are numbers; the caller then falls back
+    * to vmDoBinaryDirect() (or vmDoBinaryFunc()), which deal with bools, null and overloaded operators.
+    * every caller passes a constant, so only one case of the switch is left after inlining.
+    */
+    NEON_INLINE bool SharedState::vmDoBinaryNumbers(int instruction)
+    {
+        double dbinright;
+        double dbinleft;
+        uint32_t ubinright;
+        Value res;
+        Value* top;
+        top = m_vmstate.stackvalues.data() + m_vmstate.stackidx;
+        if(top[-1].isInt() && top[-2].isInt())
+        {
+            if(vmDoBinaryInts(instruction, top))
+            {
+                m_vmstate.stackidx--;
+                return true;
+            }
+        }
+        else if(NEON_UNLIKELY(!top[-1].isNumber() || !top[-2].isNumber()))
+        {
+            return false;
+        }
+        dbinright = top[-1].asNumber();
+        dbinleft = top[-2].asNumber();
+        switch(instruction)
+        {
+            case Instruction::OPC_PRIMADD:
+                res = Value::makeNumber(dbinleft + dbinright);
+                break;
+            case Instruction::OPC_PRIMSUBTRACT:
+                res = Value::makeNumber(dbinleft - dbinright);
+                break;
+            case Instruction::OPC_PRIMMULTIPLY:
+                res = Value::makeNumber(dbinleft * dbinright);
+                break;
+            case Instruction::OPC_PRIMDIVIDE:
+                res = Value::makeNumber(dbinleft / dbinright);
+                break;
+            case Instruction::OPC_PRIMMODULO:
+                res = vmCallbackModulo(dbinleft, dbinright);
+                break;
+            case Instruction::OPC_PRIMPOW:
+                res = vmCallbackPow(dbinleft, dbinright);
+                break;
+            case Instruction::OPC_PRIMAND:
+                res = Value::makeNumberFromInt((long)dbinleft & (long)dbinright);
+                break;
+            case Instruction::OPC_PRIMOR:
+                res = Value::makeNumberFromInt((long)dbinleft | (long)dbinright);
+                break;
+            case Instruction::OPC_PRIMBITXOR:
+                res = Value::makeNumberFromInt((long)dbinleft ^ (long)dbinright);
+                break;
+            case Instruction::OPC_PRIMSHIFTLEFT:
+                ubinright = ((uint32_t)(int64_t)dbinright) & 0x1f;
+                res = Value::makeNumberFromInt(((uint32_t)(int64_t)dbinleft) << ubinright);
+                break;
+            case Instruction::OPC_PRIMSHIFTRIGHT:
+                ubinright = ((uint32_t)(int64_t)dbinright) & 0x1f;
+                res = Value::makeNumberFromInt(((uint32_t)(int64_t)dbinleft) >> ubinright);
+                break;
+            case Instruction::OPC_PRIMGREATER:
+                res = Value::makeBool(dbinleft > dbinright);
+                break;
+            case Instruction::OPC_PRIMLESSTHAN:
+                res = Value::makeBool(dbinleft < dbinright);
+                break;
+            case Instruction::OPC_EQUAL:
+                res = Value::makeBool(dbinleft == dbinright);
+                break;
             default:
-            {
-                fprintf(stderr, "unhandled instruction %d (%s)!\n", instruction, Debug::opcodeToString(instruction));
                 return false;
-            }
-            break;
         }
-        vmStackPush(res);
+        top[-2] = res;
+        m_vmstate.stackidx--;
         return true;
     }
 
@@ -21294,6 +27344,154 @@ namespace neon
         return true;
     }
 
+    /* reads a source operand of a register instruction (see Instruction::RegOperand) */
+    NEON_INLINE Value SharedState::vmReadRegOperand(int kind)
+    {
+        uint16_t idx;
+        idx = vmReadShort();
+        if(kind == Instruction::REGOPND_SLOT)
+        {
+            return m_vmstate.stackvalues[m_vmstate.currentframe->stackslotpos + idx];
+        }
+        if(kind == Instruction::REGOPND_CONST)
+        {
+            return Wrappers::wrapGetBlobOfClosure(m_vmstate.currentframe->closure)->m_constants.get(idx);
+        }
+        return Value::makeInt(1);
+    }
+
+    /*
+    * leaves register code: the frame continues at the same offset in m_instrucs, where the
+    * original stack sequence deals with anything that is not a plain number (strings, overloads, errors).
+    * register instructions have no side effects before they deopt.
+    */
+    NEON_INLINE void SharedState::vmRegisterDeopt(uint8_t* ip)
+    {
+        auto blob = Wrappers::wrapGetBlobOfClosure(m_vmstate.currentframe->closure);
+        m_vmstate.currentframe->inscode = blob->m_instrucs.data() + (ip - blob->m_regcode.data());
+    }
+
+    /*Instruction::OPC_REGMOVE*/
+    NEON_INLINE bool SharedState::vmDoRegisterMove()
+    {
+        int info;
+        uint16_t dst;
+        Value val;
+        info = vmReadByte();
+        dst = vmReadShort();
+        val = vmReadRegOperand(info & 3);
+        m_vmstate.stackvalues[m_vmstate.currentframe->stackslotpos + dst] = val;
+        m_vmstate.currentframe->inscode += (info >> 4);
+        return true;
+    }
+
+    /*Instruction::OPC_REGADD, OPC_REGSUBTRACT, OPC_REGMULTIPLY, OPC_REGDIVIDE*/
+    NEON_INLINE bool SharedState::vmDoRegisterArith()
+    {
+        int info;
+        uint16_t dst;
+        int64_t ires;
+        double dleft;
+        double dright;
+        double res;
+        uint8_t* start;
+        Value valleft;
+        Value valright;
+        start = m_vmstate.currentframe->inscode - 1;
+        info = vmReadByte();
+        dst = vmReadShort();
+        valleft = vmReadRegOperand(info & 3);
+        valright = vmReadRegOperand((info >> 2) & 3);
+        if(NEON_UNLIKELY(!valleft.isNumber() || !valright.isNumber()))
+        {
+            vmRegisterDeopt(start);
+            return true;
+        }
+        if(valleft.isInt() && valright.isInt() && (m_vmstate.currentinstr != Instruction::OPC_REGMULTIPLY) && (m_vmstate.currentinstr != Instruction::OPC_REGDIVIDE))
+        {
+            /* a sum or difference of two integers is always exact, even if it does not fit anymore */
+            if(m_vmstate.currentinstr == Instruction::OPC_REGADD)
+            {
+                ires = valleft.asInt() + valright.asInt();
+            }
+            else
+            {
+                ires = valleft.asInt() - valright.asInt();
+            }
+            m_vmstate.stackvalues[m_vmstate.currentframe->stackslotpos + dst] = Value::makeNumberFromInt(ires);
+            m_vmstate.currentframe->inscode += (info >> 4);
+            return true;
+        }
+        dleft = valleft.asNumber();
+        dright = valright.asNumber();
+        switch(m_vmstate.currentinstr)
+        {
+            case Instruction::OPC_REGADD:
+                res = dleft + dright;
+                break;
+            case Instruction::OPC_REGSUBTRACT:
+                res = dleft - dright;
+                break;
+            case Instruction::OPC_REGMULTIPLY:
+                res = dleft * dright;
+                break;
+            default:
+                res = dleft / dright;
+                break;
+        }
+        m_vmstate.stackvalues[m_vmstate.currentframe->stackslotpos + dst] = Value::makeNumber(res);
+        m_vmstate.currentframe->inscode += (info >> 4);
+        return true;
+    }
+
+    /*Instruction::OPC_REGJUMPIFNOTLESS, OPC_REGJUMPIFNOTGREATER*/
+    NEON_INLINE bool SharedState::vmDoRegisterJumpCompare()
+    {
+        int info;
+        bool istrue;
+        uint16_t jump;
+        uint8_t* start;
+        Value valleft;
+        Value valright;
+        start = m_vmstate.currentframe->inscode - 1;
+        info = vmReadByte();
+        valleft = vmReadRegOperand(info & 3);
+        valright = vmReadRegOperand((info >> 2) & 3);
+        jump = vmReadShort();
+        if(NEON_UNLIKELY(!valleft.isNumber() || !valright.isNumber()))
+        {
+            vmRegisterDeopt(start);
+            return true;
+        }
+        if(valleft.isInt() && valright.isInt())
+        {
+            if(m_vmstate.currentinstr == Instruction::OPC_REGJUMPIFNOTLESS)
+            {
+                istrue = (valleft.asInt() < valright.asInt());
+            }
+            else
+            {
+                istrue = (valleft.asInt() > valright.asInt());
+            }
+        }
+        else if(m_vmstate.currentinstr == Instruction::OPC_REGJUMPIFNOTLESS)
+        {
+            istrue = (valleft.asNumber() < valright.asNumber());
+        }
+        else
+        {
+            istrue = (valleft.asNumber() > valright.asNumber());
+        }
+        m_vmstate.currentframe->inscode += (info >> 4);
+        if(!istrue)
+        {
+            /* the jump target expects the (false) condition on the stack, just like after OPC_JUMPIFFALSE */
+            vmStackPush(Value::makeBool(false));
+            m_vmstate.currentframe->inscode += jump;
+        }
+        return true;
+    }
+
     NEON_INLINE bool SharedState::vmDoMakeClosure()
     {
         size_t i;
@@ -21326,6 +27524,8 @@ namespace neon
             {
                 closure->m_fnvals.fnclosure.m_upvalues[i] = m_vmstate.currentframe->closure->m_fnvals.fnclosure.m_upvalues[upvidx];
             }
+            /* capturing may have collected, and promoted the closure */
+            SharedState::gcWriteBarrier(closure, closure->m_fnvals.fnclosure.m_upvalues[i]);
         }
         return true;
     }
@@ -21387,55 +27587,157 @@ namespace neon
             VMMAC_TRYRAISE(false, "unsupported operand %s for %s and %s", opname, Value::typeName(binvalleft, false), Value::typeName(binvalright, false));
             return false;
         }
-        binvalright = vmStackPop();
         dbinright = binvalright.isBool() ? (binvalright.asBool() ? 1 : 0) : binvalright.asNumber();
-        binvalleft = vmStackPop();
         dbinleft = binvalleft.isBool() ? (binvalleft.asBool() ? 1 : 0) : binvalleft.asNumber();
-        vmStackPush(opfn(dbinleft, dbinright));
+        m_vmstate.stackvalues[m_vmstate.stackidx - 2] = opfn(dbinleft, dbinright);
+        m_vmstate.stackidx--;
         return true;
     }
 
-    /*
-     * something about using computed goto is currently breaking some scripts, specifically
-     * code generated for things like `somevar[idx]++`
-     * no issue with switch/case, though.
-     */
+    /* see Instruction::OPC_SUPLOCALPROPERTYGET */
+    NEON_INLINE bool SharedState::vmDoSuperLocalPropertyGet()
+    {
+        vmDoLocalGet();
+        /* skip the opcode of PROPERTYGET; its operands are read by vmDoPropertyGetNormal */
+        m_vmstate.currentframe->inscode++;
+        m_vmstate.currentinstr = Instruction::OPC_PROPERTYGET;
+        return vmDoPropertyGetNormal();
+    }
 
-    #define NEON_CONFIG_USECOMPUTEDGOTO 0
     /*
-    #if defined(__GNUC__)
-        #if defined(NEON_CONFIG_USECOMPUTEDGOTO)
-            #undef NEON_CONFIG_USECOMPUTEDGOTO
+     * computed goto (threaded dispatch) is used by default where supported (GCC, Clang).
+     * every handler jumps straight to the next handler through the dispatch table, instead
+     * of going back through the top of the loop; stack dumping and singlestep get their own
+     * tables, so nothing is checked per instruction.
+     * define NEON_CONFIG_USECOMPUTEDGOTO to 0 to use switch/case instead, which checks both
+     * at the top of the loop.
+     */
+    #if !defined(NEON_CONFIG_USECOMPUTEDGOTO)
+        #if defined(__GNUC__) || defined(__clang__)
             #define NEON_CONFIG_USECOMPUTEDGOTO 1
+        #else
+            #define NEON_CONFIG_USECOMPUTEDGOTO 0
         #endif
     #endif
+
+    /*
+    * runVM keeps the instruction pointer of the current frame in its local $ip, and the frame in $frame.
+    * VM_CASE handlers call code that reads and moves currentframe->inscode, or switches frames; so $ip
+    * is stored into the frame when they start, and VMMAC_DISPATCH() loads both again.
+    * VM_FASTCASE handlers only read their operands and use the stack, so they work on $ip alone, and
+    * go on with VMMAC_FASTDISPATCH(), which loads nothing.
     */
+    #define VMMAC_SAVEIP() \
+        frame->inscode = ip;
+
+    #define VMMAC_LOADIP() \
+        { \
+            frame = m_vmstate.currentframe; \
+            ip = frame->inscode; \
+        }
+
+    #define VMMAC_READSHORT() \
+        (ip += 2, (uint16_t)((ip[-2] << 8) | ip[-1]))
+
+    #define VMMAC_READCONST() \
+        (Wrappers::wrapGetBlobOfClosure(frame->closure)->m_constants.get(VMMAC_READSHORT()))
+
     #if defined(NEON_CONFIG_USECOMPUTEDGOTO) && (NEON_CONFIG_USECOMPUTEDGOTO == 1)
         #define NEON_SETDISPATCHIDX(idx, val) [Instruction::idx] = val
         #define VM_MAKELABEL(op) LABEL_##op
-        #define VM_CASE(op) VM_MAKELABEL(op) :
-        #if 1
-            #define VMMAC_DISPATCH() goto readnextinstruction
-        #else
-            #define VMMAC_DISPATCH() continue
-        #endif
+        #define VM_CASE(op) VM_MAKELABEL(op) : VMMAC_SAVEIP()
+        #define VM_FASTCASE(op) VM_MAKELABEL(op) :
+        /*
+        * activetable is either dispatchtable, or (when dumping the stack) debugtable, which
+        * routes every instruction through the dumping code first.
+        */
+        #define VMMAC_FASTDISPATCH() \
+            { \
+                currinstr = *ip++; \
+                m_vmstate.currentinstr = currinstr; \
+                goto* activetable[currinstr]; \
+            }
+        #define VMMAC_DISPATCH() \
+            { \
+                VMMAC_LOADIP(); \
+                VMMAC_FASTDISPATCH(); \
+            }
+    #else
+        #define VM_CASE(op) case Instruction::op: VMMAC_SAVEIP()
+        #define VM_FASTCASE(op) case Instruction::op:
+        #define VMMAC_FASTDISPATCH() break
+        #define VMMAC_DISPATCH() \
+            { \
+                VMMAC_LOADIP(); \
+                break; \
+            }
+    #endif
+
+    /*
+     * re-reads the current frame after a call or return.
+     * an unhandled exception may have unwound every frame, in which case there is nothing left to run.
+     */
+    #define VMMAC_SYNCFRAME() \
+        { \
+            if(NEON_UNLIKELY(m_vmstate.framecount == 0)) \
+            { \
+                return Status::RuntimeFail; \
+            } \
+            m_vmstate.currentframe = &m_vmstate.framevalues[m_vmstate.framecount - 1]; \
+        }
+
+    /*
+     * hands the current frame over to its native code, if it has any (or just got hot enough to get some).
+     * used wherever the current frame may have changed (calls, returns), and on loop back-edges.
+     * $weight is added to the hotness of the function.
+     */
+    #if defined(NEON_CONFIG_USEJIT) && (NEON_CONFIG_USEJIT == 1)
+        #define VMMAC_JITHOOK(weight) \
+            if(NEON_UNLIKELY(m_conf.usejit && !singlestep)) \
+            { \
+                if(!vmJitMaybeRun(weight)) \
+                { \
+                    return Status::RuntimeFail; \
+                } \
+            }
     #else
-        #define VM_CASE(op) case Instruction::op:
-        #define VMMAC_DISPATCH() break
+        #define VMMAC_JITHOOK(weight)
     #endif
 
-    Status SharedState::runVM(int exitframe, Value* rv)
+    /*
+     * enforces --max-heap (see SharedState::gcEnforceHeapLimit).
+     * allocations cannot raise MemoryError themselves, as they happen halfway through instructions,
+     * so it is raised at calls and loop back-edges instead.
+     */
+    #define VMMAC_HEAPCHECK() \
+        if(NEON_UNLIKELY(m_gcstate.overlimit)) \
+        { \
+            if(!gcEnforceHeapLimit()) \
+            { \
+                return Status::RuntimeFail; \
+            } \
+        }
+
+    /*
+     * if $singlestep is true, only the instruction at currentframe->inscode is run; used by JitCompiler
+     * for the instructions it has no template for.
+     */
+    Status SharedState::runVM(int exitframe, Value* rv, bool singlestep)
     {
         int iterpos;
         int printpos;
-        int ofs;
         /*
          * this variable is a NOP; it only exists to ensure that functions outside of the
          * switch tree are not calling VMMAC_EXITVM(), as its behavior could be undefined.
          */
         bool you_are_calling_exit_vm_outside_of_runvm;
         Value* dbgslot;
-        Instruction currinstr;
+        uint8_t currinstr;
+        uint8_t* ip;
+        CallFrame* frame;
+    #if (NEON_CONFIG_USEJIT == 1) && (NEON_CONFIG_USECOMPUTEDGOTO != 1)
+        bool stepped;
+    #endif
     #if defined(NEON_CONFIG_USECOMPUTEDGOTO) && (NEON_CONFIG_USECOMPUTEDGOTO == 1)
         static void* dispatchtable[] = {
             NEON_SETDISPATCHIDX(OPC_GLOBALDEFINE, &&VM_MAKELABEL(OPC_GLOBALDEFINE)),
@@ -21511,903 +27813,2623 @@ namespace neon
             NEON_SETDISPATCHIDX(OPC_TYPEOF, &&VM_MAKELABEL(OPC_TYPEOF)),
             NEON_SETDISPATCHIDX(OPC_OPINSTANCEOF, &&VM_MAKELABEL(OPC_OPINSTANCEOF)),
             NEON_SETDISPATCHIDX(OPC_HALT, &&VM_MAKELABEL(OPC_HALT)),
+            NEON_SETDISPATCHIDX(OPC_REGMOVE, &&VM_MAKELABEL(OPC_REGMOVE)),
+            NEON_SETDISPATCHIDX(OPC_REGADD, &&VM_MAKELABEL(OPC_REGADD)),
+            NEON_SETDISPATCHIDX(OPC_REGSUBTRACT, &&VM_MAKELABEL(OPC_REGSUBTRACT)),
+            NEON_SETDISPATCHIDX(OPC_REGMULTIPLY, &&VM_MAKELABEL(OPC_REGMULTIPLY)),
+            NEON_SETDISPATCHIDX(OPC_REGDIVIDE, &&VM_MAKELABEL(OPC_REGDIVIDE)),
+            NEON_SETDISPATCHIDX(OPC_REGJUMPIFNOTLESS, &&VM_MAKELABEL(OPC_REGJUMPIFNOTLESS)),
+            NEON_SETDISPATCHIDX(OPC_REGJUMPIFNOTGREATER, &&VM_MAKELABEL(OPC_REGJUMPIFNOTGREATER)),
+            NEON_SETDISPATCHIDX(OPC_SUPLOCALLOCALADD, &&VM_MAKELABEL(OPC_SUPLOCALLOCALADD)),
+            NEON_SETDISPATCHIDX(OPC_SUPCONSTLESSJUMP, &&VM_MAKELABEL(OPC_SUPCONSTLESSJUMP)),
+            NEON_SETDISPATCHIDX(OPC_SUPLOCALPROPERTYGET, &&VM_MAKELABEL(OPC_SUPLOCALPROPERTYGET)),
+            NEON_SETDISPATCHIDX(OPC_PRIMADDNUM, &&VM_MAKELABEL(OPC_PRIMADDNUM)),
+            NEON_SETDISPATCHIDX(OPC_PRIMADDSTR, &&VM_MAKELABEL(OPC_PRIMADDSTR)),
+            NEON_SETDISPATCHIDX(OPC_PRIMSUBTRACTNUM, &&VM_MAKELABEL(OPC_PRIMSUBTRACTNUM)),
+            NEON_SETDISPATCHIDX(OPC_PRIMLESSTHANNUM, &&VM_MAKELABEL(OPC_PRIMLESSTHANNUM)),
         };
+    #endif
+    #if defined(NEON_CONFIG_USECOMPUTEDGOTO) && (NEON_CONFIG_USECOMPUTEDGOTO == 1)
+        size_t i;
+        void** activetable;
+        void* debugtable[sizeof(dispatchtable) / sizeof(dispatchtable[0])];
+    #endif
+    #if (NEON_CONFIG_USEJIT == 1) && (NEON_CONFIG_USECOMPUTEDGOTO == 1)
+        static bool stepready = false;
+        static void* steptable[sizeof(dispatchtable) / sizeof(dispatchtable[0])];
     #endif
         you_are_calling_exit_vm_outside_of_runvm = false;
+        /*
+        // try...finally... (i.e. try without a catch but finally
+        // whose try body raises an exception)
+        // can cause us to go into an invalid mode where frame count == 0.
+        // vmExceptionPropagate() then points currentframe at haltframe, so
+        // this is not checked for every instruction.
+        */
+        if(m_vmstate.framecount == 0)
+        {
+            return Status::RuntimeFail;
+        }
         m_vmstate.currentframe = &m_vmstate.framevalues[m_vmstate.framecount - 1];
+        VMMAC_LOADIP();
         Debug vmdbg(m_debugwriter);
+    #if defined(NEON_CONFIG_USECOMPUTEDGOTO) && (NEON_CONFIG_USECOMPUTEDGOTO == 1)
+        activetable = dispatchtable;
+        if(NEON_UNLIKELY(m_conf.shoulddumpstack))
+        {
+            for(i = 0; i < (sizeof(debugtable) / sizeof(debugtable[0])); i++)
+            {
+                debugtable[i] = &&debugdispatch;
+            }
+            activetable = debugtable;
+        }
+    #if defined(NEON_CONFIG_USEJIT) && (NEON_CONFIG_USEJIT == 1)
+        if(NEON_UNLIKELY(singlestep))
+        {
+            if(!stepready)
+            {
+                for(i = 0; i < (sizeof(steptable) / sizeof(steptable[0])); i++)
+                {
+                    steptable[i] = &&stepfinished;
+                }
+                stepready = true;
+            }
+            /* the instruction itself goes through dispatchtable, whatever follows it lands on stepfinished */
+            activetable = steptable;
+            currinstr = *ip++;
+            m_vmstate.currentinstr = currinstr;
+            goto* dispatchtable[currinstr];
+        }
+    #endif
+        VMMAC_JITHOOK(1);
+        VMMAC_DISPATCH();
+    #elif defined(NEON_CONFIG_USEJIT) && (NEON_CONFIG_USEJIT == 1)
+        stepped = false;
+    #else
+        (void)singlestep;
+    #endif
         while(true)
         {
     #if defined(NEON_CONFIG_USECOMPUTEDGOTO) && (NEON_CONFIG_USECOMPUTEDGOTO == 1)
-        readnextinstruction:
-    #endif
-            /*
-            // try...finally... (i.e. try without a catch but finally
-            // whose try body raises an exception)
-            // can cause us to go into an invalid mode where frame count == 0
-            // to fix this, we need to exit with an appropriate mode here.
-            */
-            if(m_vmstate.framecount == 0)
+        debugdispatch:
+            /* only reached through debugtable: step back, so the instruction is printed before it is executed */
+            ip--;
+    #elif defined(NEON_CONFIG_USEJIT) && (NEON_CONFIG_USEJIT == 1)
+            /* singlestep: back at the top after one instruction, same as stepfinished */
+            if(NEON_UNLIKELY(singlestep))
             {
-                return Status::RuntimeFail;
+                if(stepped)
+                {
+                    VMMAC_SAVEIP();
+                    return Status::Ok;
+                }
+                stepped = true;
             }
+    #endif
             if(NEON_UNLIKELY(m_conf.shoulddumpstack))
             {
-                ofs = (int)(m_vmstate.currentframe->inscode - m_vmstate.currentframe->closure->m_fnvals.fnclosure.scriptfunc->m_fnvals.fnscriptfunc.blob->m_instrucs.data());
-                vmdbg.printInstructionAt(m_vmstate.currentframe->closure->m_fnvals.fnclosure.scriptfunc->m_fnvals.fnscriptfunc.blob, ofs);
+                VMMAC_SAVEIP();
+                vmdbg.printCurrentInstruction(m_vmstate.currentframe->closure->m_fnvals.fnclosure.scriptfunc->m_fnvals.fnscriptfunc.blob, m_vmstate.currentframe->inscode);
                 fprintf(stderr, "stack (before)=[\n");
                 iterpos = 0;
                 dbgslot = m_vmstate.stackvalues.data();
                 while(dbgslot < m_vmstate.stackvalues.getp(m_vmstate.stackidx))
                 {
-                    printpos = iterpos + 1;
-                    iterpos++;
-                    fprintf(stderr, "  [%s%d%s] ", Util::termColor(NEON_COLOR_YELLOW), printpos, Util::termColor(NEON_COLOR_RESET));
-                    m_debugwriter->format("%s", Util::termColor(NEON_COLOR_YELLOW));
-                    ValPrinter::printValue(m_debugwriter, *dbgslot, true, false);
-                    m_debugwriter->format("%s", Util::termColor(NEON_COLOR_RESET));
-                    fprintf(stderr, "\n");
-                    dbgslot++;
+                    printpos = iterpos + 1;
+                    iterpos++;
+                    fprintf(stderr, "  [%s%d%s] ", Util::termColor(NEON_COLOR_YELLOW), printpos, Util::termColor(NEON_COLOR_RESET));
+                    m_debugwriter->format("%s", Util::termColor(NEON_COLOR_YELLOW));
+                    ValPrinter::printValue(m_debugwriter, *dbgslot, true, false);
+                    m_debugwriter->format("%s", Util::termColor(NEON_COLOR_RESET));
+                    fprintf(stderr, "\n");
+                    dbgslot++;
+                }
+                fprintf(stderr, "]\n");
+            }
+            currinstr = *ip++;
+            m_vmstate.currentinstr = currinstr;
+    #if defined(NEON_CONFIG_USECOMPUTEDGOTO) && (NEON_CONFIG_USECOMPUTEDGOTO == 1)
+            goto* dispatchtable[currinstr];
+    #else
+            switch(currinstr)
+    #endif
+            {
+                VM_CASE(OPC_RETURN)
+                {
+                    size_t ssp;
+                    Value result;
+                    result = vmStackPop();
+                    if(rv != nullptr)
+                    {
+                        *rv = result;
+                    }
+                    ssp = m_vmstate.currentframe->stackslotpos;
+                    vmUtilUpvaluesClose(m_vmstate.stackvalues.getp(ssp));
+                    m_vmstate.framecount--;
+                    if(m_vmstate.framecount == 0)
+                    {
+                        vmStackPop();
+                        return Status::Ok;
+                    }
+                    ssp = m_vmstate.currentframe->stackslotpos;
+                    m_vmstate.stackidx = ssp;
+                    vmStackPush(result);
+                    m_vmstate.currentframe = &m_vmstate.framevalues[m_vmstate.framecount - 1];
+                    if(m_vmstate.framecount == (int64_t)exitframe)
+                    {
+                        return Status::Ok;
+                    }
+                    VMMAC_JITHOOK(0);
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_HALT)
+                {
+                    /* see haltframe */
+                    if(m_vmstate.framecount == 0)
+                    {
+                        return Status::RuntimeFail;
+                    }
+                    printf("**halting vm**\n");
+                }
+                goto finished;
+                VM_FASTCASE(OPC_PUSHCONSTANT)
+                {
+                    Value constant;
+                    constant = VMMAC_READCONST();
+                    vmStackPush(constant);
+                }
+                VMMAC_FASTDISPATCH();
+                VM_CASE(OPC_PRIMADD)
+                {
+                    Value valright;
+                    Value valleft;
+                    Value result;
+                    if(vmDoBinaryNumbers(Instruction::OPC_PRIMADD))
+                    {
+                        vmQuickenInstruction(Instruction::OPC_PRIMADDNUM);
+                        VMMAC_DISPATCH();
+                    }
+                    valright = vmStackPeek(0);
+                    valleft = vmStackPeek(1);
+                    if(valright.isString() || valleft.isString())
+                    {
+                        if(valright.isString() && valleft.isString())
+                        {
+                            vmQuickenInstruction(Instruction::OPC_PRIMADDSTR);
+                        }
+                        if(NEON_UNLIKELY(!vmUtilConcatenate()))
+                        {
+                            VMMAC_TRYRAISE(Status::RuntimeFail, "unsupported operand + for %s and %s", Value::typeName(valleft, false), Value::typeName(valright, false));
+                            VMMAC_DISPATCH();
+                        }
+                    }
+                    else if(valleft.isArray() && valright.isArray())
+                    {
+                        result = Value::fromObject(vmUtilCombineArrays(valleft.asArray(), valright.asArray()));
+                        vmStackPop(2);
+                        vmStackPush(result);
+                    }
+                    else
+                    {
+                        vmDoBinaryDirect();
+                    }
+                }
+                VMMAC_DISPATCH();
+                VM_FASTCASE(OPC_PRIMADDNUM)
+                {
+                    Value valright;
+                    Value valleft;
+                    valright = vmStackPeek(0);
+                    valleft = vmStackPeek(1);
+                    if(NEON_UNLIKELY(!valright.isNumber() || !valleft.isNumber()))
+                    {
+                        /* see vmDeoptInstruction() */
+                        ip--;
+                        ip[0] = Instruction::OPC_PRIMADD;
+                        VMMAC_FASTDISPATCH();
+                    }
+                    m_vmstate.stackidx--;
+                    if(valleft.isInt() && valright.isInt())
+                    {
+                        m_vmstate.stackvalues[m_vmstate.stackidx - 1] = Value::makeNumberFromInt(valleft.asInt() + valright.asInt());
+                        VMMAC_FASTDISPATCH();
+                    }
+                    m_vmstate.stackvalues[m_vmstate.stackidx - 1] = Value::makeNumber(valleft.asNumber() + valright.asNumber());
+                }
+                VMMAC_FASTDISPATCH();
+                VM_CASE(OPC_PRIMADDSTR)
+                {
+                    if(NEON_UNLIKELY(!vmStackPeek(0).isString() || !vmStackPeek(1).isString()))
+                    {
+                        vmDeoptInstruction(Instruction::OPC_PRIMADD);
+                        VMMAC_DISPATCH();
+                    }
+                    vmUtilConcatenate();
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_PRIMSUBTRACT)
+                {
+                    if(vmDoBinaryNumbers(Instruction::OPC_PRIMSUBTRACT))
+                    {
+                        vmQuickenInstruction(Instruction::OPC_PRIMSUBTRACTNUM);
+                        VMMAC_DISPATCH();
+                    }
+                    vmDoBinaryDirect();
                 }
-                fprintf(stderr, "]\n");
-            }
-    #if defined(NEON_CONFIG_USECOMPUTEDGOTO) && (NEON_CONFIG_USECOMPUTEDGOTO == 1)
-        #if 0
-                    trynext:
-        #endif
-    #endif
-            currinstr = vmReadInstruction();
-            m_vmstate.currentinstr = currinstr;
-    #if defined(NEON_CONFIG_USECOMPUTEDGOTO) && (NEON_CONFIG_USECOMPUTEDGOTO == 1)
-            auto address = dispatchtable[currinstr.code];
-            fprintf(stderr, "gotoaddress=%p (for %s (%d))\n", address, Debug::opcodeToString(currinstr.code), currinstr.code);
-            goto* address;
-    #else
-            switch(currinstr.code)
-    #endif
-            {
-                VM_CASE(OPC_RETURN)
+                VMMAC_DISPATCH();
+                VM_FASTCASE(OPC_PRIMSUBTRACTNUM)
+                {
+                    Value valright;
+                    Value valleft;
+                    valright = vmStackPeek(0);
+                    valleft = vmStackPeek(1);
+                    if(NEON_UNLIKELY(!valright.isNumber() || !valleft.isNumber()))
+                    {
+                        /* see vmDeoptInstruction() */
+                        ip--;
+                        ip[0] = Instruction::OPC_PRIMSUBTRACT;
+                        VMMAC_FASTDISPATCH();
+                    }
+                    m_vmstate.stackidx--;
+                    if(valleft.isInt() && valright.isInt())
+                    {
+                        m_vmstate.stackvalues[m_vmstate.stackidx - 1] = Value::makeNumberFromInt(valleft.asInt() - valright.asInt());
+                        VMMAC_FASTDISPATCH();
+                    }
+                    m_vmstate.stackvalues[m_vmstate.stackidx - 1] = Value::makeNumber(valleft.asNumber() - valright.asNumber());
+                }
+                VMMAC_FASTDISPATCH();
+                VM_CASE(OPC_PRIMMULTIPLY)
+                {
+                    int intnum;
+                    double dbnum;
+                    Value peekleft;
+                    Value peekright;
+                    Value result;
+                    String* string;
+                    Array* list;
+                    Array* newlist;
+                    if(vmDoBinaryNumbers(Instruction::OPC_PRIMMULTIPLY))
+                    {
+                        VMMAC_DISPATCH();
+                    }
+                    peekright = vmStackPeek(0);
+                    peekleft = vmStackPeek(1);
+                    if(peekleft.isString() && peekright.isNumber())
+                    {
+                        dbnum = peekright.asNumber();
+                        string = peekleft.asString();
+                        result = Value::fromObject(vmUtilMultString(string, dbnum));
+                        vmStackPop(2);
+                        vmStackPush(result);
+                        VMMAC_DISPATCH();
+                    }
+                    else if(peekleft.isArray() && peekright.isNumber())
+                    {
+                        intnum = (int)peekright.asNumber();
+                        vmStackPop();
+                        list = peekleft.asArray();
+                        newlist = Array::make();
+                        vmStackPush(Value::fromObject(newlist));
+                        vmUtilMultArray(list, newlist, intnum);
+                        vmStackPop(2);
+                        vmStackPush(Value::fromObject(newlist));
+                        VMMAC_DISPATCH();
+                    }
+                    else
+                    {
+                        vmDoBinaryDirect();
+                    }
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_PRIMDIVIDE)
+                {
+                    if(vmDoBinaryNumbers(Instruction::OPC_PRIMDIVIDE))
+                    {
+                        VMMAC_DISPATCH();
+                    }
+                    vmDoBinaryDirect();
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_PRIMMODULO)
+                {
+                    if(vmDoBinaryNumbers(Instruction::OPC_PRIMMODULO))
+                    {
+                        VMMAC_DISPATCH();
+                    }
+                    if(vmDoBinaryFunc("%", (BinOpFuncFN)vmCallbackModulo))
+                    {
+                    }
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_PRIMPOW)
+                {
+                    if(vmDoBinaryNumbers(Instruction::OPC_PRIMPOW))
+                    {
+                        VMMAC_DISPATCH();
+                    }
+                    if(vmDoBinaryFunc("**", (BinOpFuncFN)vmCallbackPow))
+                    {
+                    }
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_PRIMNEGATE)
+                {
+                    Value peeked;
+                    peeked = vmStackPeek(0);
+                    if(!peeked.isNumber())
+                    {
+                        VMMAC_TRYRAISE(Status::RuntimeFail, "operator - not defined for object of type %s", Value::typeName(peeked, false));
+                        VMMAC_DISPATCH();
+                    }
+                    peeked = vmStackPop();
+                    /* -0 has to stay a double */
+                    if(peeked.isInt() && (peeked.asInt() != 0))
+                    {
+                        vmStackPush(Value::makeNumberFromInt(-peeked.asInt()));
+                        VMMAC_DISPATCH();
+                    }
+                    vmStackPush(Value::makeNumber(-peeked.asNumber()));
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_PRIMBITNOT)
+                {
+                    Value peeked;
+                    peeked = vmStackPeek(0);
+                    if(!peeked.isNumber())
+                    {
+                        VMMAC_TRYRAISE(Status::RuntimeFail, "operator ~ not defined for object of type %s", Value::typeName(peeked, false));
+                        VMMAC_DISPATCH();
+                    }
+                    peeked = vmStackPop();
+                    vmStackPush(Value::makeInt(~((int)Value::valToInt(peeked))));
+                    VMMAC_DISPATCH();
+                }
+                VM_CASE(OPC_PRIMAND)
+                {
+                    if(vmDoBinaryNumbers(Instruction::OPC_PRIMAND))
+                    {
+                        VMMAC_DISPATCH();
+                    }
+                    vmDoBinaryDirect();
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_PRIMOR)
+                {
+                    if(vmDoBinaryNumbers(Instruction::OPC_PRIMOR))
+                    {
+                        VMMAC_DISPATCH();
+                    }
+                    vmDoBinaryDirect();
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_PRIMBITXOR)
+                {
+                    if(vmDoBinaryNumbers(Instruction::OPC_PRIMBITXOR))
+                    {
+                        VMMAC_DISPATCH();
+                    }
+                    vmDoBinaryDirect();
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_PRIMSHIFTLEFT)
+                {
+                    if(vmDoBinaryNumbers(Instruction::OPC_PRIMSHIFTLEFT))
+                    {
+                        VMMAC_DISPATCH();
+                    }
+                    vmDoBinaryDirect();
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_PRIMSHIFTRIGHT)
+                {
+                    if(vmDoBinaryNumbers(Instruction::OPC_PRIMSHIFTRIGHT))
+                    {
+                        VMMAC_DISPATCH();
+                    }
+                    vmDoBinaryDirect();
+                }
+                VMMAC_DISPATCH();
+                VM_FASTCASE(OPC_PUSHONE)
+                {
+                    vmStackPush(Value::makeInt(1));
+                }
+                VMMAC_FASTDISPATCH();
+                /* comparisons */
+                VM_CASE(OPC_EQUAL)
+                {
+                    Value a;
+                    Value b;
+                    if(vmDoBinaryNumbers(Instruction::OPC_EQUAL))
+                    {
+                        VMMAC_DISPATCH();
+                    }
+                    b = vmStackPop();
+                    a = vmStackPop();
+                    vmStackPush(Value::makeBool(Value::compareValues(a, b)));
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_PRIMGREATER)
+                {
+                    if(vmDoBinaryNumbers(Instruction::OPC_PRIMGREATER))
+                    {
+                        VMMAC_DISPATCH();
+                    }
+                    vmDoBinaryDirect();
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_PRIMLESSTHAN)
+                {
+                    if(vmDoBinaryNumbers(Instruction::OPC_PRIMLESSTHAN))
+                    {
+                        vmQuickenInstruction(Instruction::OPC_PRIMLESSTHANNUM);
+                        VMMAC_DISPATCH();
+                    }
+                    vmDoBinaryDirect();
+                }
+                VMMAC_DISPATCH();
+                VM_FASTCASE(OPC_PRIMLESSTHANNUM)
+                {
+                    Value valright;
+                    Value valleft;
+                    valright = vmStackPeek(0);
+                    valleft = vmStackPeek(1);
+                    if(NEON_UNLIKELY(!valright.isNumber() || !valleft.isNumber()))
+                    {
+                        /* see vmDeoptInstruction() */
+                        ip--;
+                        ip[0] = Instruction::OPC_PRIMLESSTHAN;
+                        VMMAC_FASTDISPATCH();
+                    }
+                    m_vmstate.stackidx--;
+                    if(valleft.isInt() && valright.isInt())
+                    {
+                        m_vmstate.stackvalues[m_vmstate.stackidx - 1] = Value::makeBool(valleft.asInt() < valright.asInt());
+                        VMMAC_FASTDISPATCH();
+                    }
+                    m_vmstate.stackvalues[m_vmstate.stackidx - 1] = Value::makeBool(valleft.asNumber() < valright.asNumber());
+                }
+                VMMAC_FASTDISPATCH();
+                /* unless both locals are numbers, only the first get is done */
+                VM_FASTCASE(OPC_SUPLOCALLOCALADD)
+                {
+                    size_t ssp;
+                    Value left;
+                    Value right;
+                    ssp = frame->stackslotpos;
+                    left = m_vmstate.stackvalues[ssp + ((ip[0] << 8) | ip[1])];
+                    right = m_vmstate.stackvalues[ssp + ((ip[3] << 8) | ip[4])];
+                    if(left.isInt() && right.isInt())
+                    {
+                        vmStackPush(Value::makeNumberFromInt(left.asInt() + right.asInt()));
+                        ip += 6;
+                        VMMAC_FASTDISPATCH();
+                    }
+                    if(NEON_LIKELY(left.isNumber() && right.isNumber()))
+                    {
+                        vmStackPush(Value::makeNumber(left.asNumber() + right.asNumber()));
+                        ip += 6;
+                        VMMAC_FASTDISPATCH();
+                    }
+                    vmStackPush(left);
+                    ip += 2;
+                }
+                VMMAC_FASTDISPATCH();
+                /* unless the left operand is a number, only the constant is pushed */
+                VM_FASTCASE(OPC_SUPCONSTLESSJUMP)
+                {
+                    bool isless;
+                    uint16_t offset;
+                    Value left;
+                    Value constant;
+                    constant = VMMAC_READCONST();
+                    left = vmStackPeek(0);
+                    if(NEON_LIKELY(left.isNumber() && constant.isNumber()))
+                    {
+                        if(left.isInt() && constant.isInt())
+                        {
+                            isless = (left.asInt() < constant.asInt());
+                        }
+                        else
+                        {
+                            isless = (left.asNumber() < constant.asNumber());
+                        }
+                        /* the condition stays on the stack, just like JUMPIFFALSE leaves it */
+                        m_vmstate.stackvalues[m_vmstate.stackidx - 1] = Value::makeBool(isless);
+                        /* PRIMLESSTHAN, and JUMPIFFALSE with its operand */
+                        offset = (ip[2] << 8) | ip[3];
+                        ip += 4;
+                        if(!isless)
+                        {
+                            ip += offset;
+                        }
+                        VMMAC_FASTDISPATCH();
+                    }
+                    vmStackPush(constant);
+                }
+                VMMAC_FASTDISPATCH();
+                VM_CASE(OPC_SUPLOCALPROPERTYGET)
+                {
+                    if(!vmDoSuperLocalPropertyGet())
+                    {
+                        VMMAC_EXITVM();
+                    }
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_PRIMNOT)
+                {
+                    Value val;
+                    val = vmStackPop();
+                    vmStackPush(Value::makeBool(val.isFalse()));
+                }
+                VMMAC_DISPATCH();
+                VM_FASTCASE(OPC_PUSHNULL)
+                {
+                    vmStackPush(Value::makeNull());
+                }
+                VMMAC_FASTDISPATCH();
+                VM_FASTCASE(OPC_PUSHEMPTY)
+                {
+                    vmStackPush(Value::makeNull());
+                }
+                VMMAC_FASTDISPATCH();
+                VM_FASTCASE(OPC_PUSHTRUE)
+                {
+                    vmStackPush(Value::makeBool(true));
+                }
+                VMMAC_FASTDISPATCH();
+                VM_FASTCASE(OPC_PUSHFALSE)
                 {
-                    size_t ssp;
-                    Value result;
-                    result = vmStackPop();
-                    if(rv != nullptr)
+                    vmStackPush(Value::makeBool(false));
+                }
+                VMMAC_FASTDISPATCH();
+
+                VM_FASTCASE(OPC_JUMPNOW)
+                {
+                    uint16_t offset;
+                    offset = VMMAC_READSHORT();
+                    ip += offset;
+                }
+                VMMAC_FASTDISPATCH();
+                VM_FASTCASE(OPC_JUMPIFFALSE)
+                {
+                    uint16_t offset;
+                    Value val;
+                    offset = VMMAC_READSHORT();
+                    val = vmStackPeek(0);
+                    if(val.isFalse())
                     {
-                        *rv = result;
+                        ip += offset;
                     }
-                    ssp = m_vmstate.currentframe->stackslotpos;
-                    vmUtilUpvaluesClose(m_vmstate.stackvalues.getp(ssp));
-                    m_vmstate.framecount--;
-                    if(m_vmstate.framecount == 0)
+                }
+                VMMAC_FASTDISPATCH();
+                /* the checks below may raise, or run native code; that needs the frame up to date */
+                VM_FASTCASE(OPC_LOOP)
+                {
+                    uint16_t offset;
+                    offset = VMMAC_READSHORT();
+                    ip -= offset;
+                    VMMAC_SAVEIP();
+                    VMMAC_HEAPCHECK();
+                    VMMAC_JITHOOK(1);
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_ECHO)
+                {
+                    Value val;
+                    val = vmStackPeek(0);
+                    ValPrinter::printValue(m_stdoutprinter, val, m_isrepl, true);
+                    if(!val.isNull())
                     {
-                        vmStackPop();
-                        return Status::Ok;
+                        m_stdoutprinter->writeString("\n");
                     }
-                    ssp = m_vmstate.currentframe->stackslotpos;
-                    m_vmstate.stackidx = ssp;
-                    vmStackPush(result);
-                    m_vmstate.currentframe = &m_vmstate.framevalues[m_vmstate.framecount - 1];
-                    if(m_vmstate.framecount == (int64_t)exitframe)
+                    vmStackPop();
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_STRINGIFY)
+                {
+                    Value peeked;
+                    Value popped;
+                    String* os;
+                    peeked = vmStackPeek(0);
+                    if(!peeked.isString() && !peeked.isNull())
                     {
-                        return Status::Ok;
+                        popped = vmStackPop();
+                        os = Value::toString(popped);
+                        if(os->length() != 0)
+                        {
+                            vmStackPush(Value::fromObject(os));
+                        }
+                        else
+                        {
+                            vmStackPush(Value::makeNull());
+                        }
                     }
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_HALT)
+                VM_FASTCASE(OPC_DUPONE)
                 {
-                    printf("**halting vm**\n");
+                    Value val;
+                    val = vmStackPeek(0);
+                    vmStackPush(val);
                 }
-                goto finished;
-                VM_CASE(OPC_PUSHCONSTANT)
+                VMMAC_FASTDISPATCH();
+                VM_FASTCASE(OPC_POPONE)
                 {
-                    Value constant;
-                    constant = vmReadConst();
-                    vmStackPush(constant);
+                    vmStackPop();
+                }
+                VMMAC_FASTDISPATCH();
+                VM_FASTCASE(OPC_POPN)
+                {
+                    vmStackPop(VMMAC_READSHORT());
+                }
+                VMMAC_FASTDISPATCH();
+                VM_CASE(OPC_UPVALUECLOSE)
+                {
+                    vmUtilUpvaluesClose(m_vmstate.stackvalues.getp(m_vmstate.stackidx - 1));
+                    vmStackPop();
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PRIMADD)
+                VM_CASE(OPC_OPINSTANCEOF)
                 {
-                    Value valright;
-                    Value valleft;
-                    Value result;
-                    valright = vmStackPeek(0);
-                    valleft = vmStackPeek(1);
-                    if(valright.isString() || valleft.isString())
+                    bool rt;
+                    Value first;
+                    Value second;
+                    Class* vclass;
+                    Class* checkclass;
+                    rt = false;
+                    first = vmStackPop();
+                    second = vmStackPop();
+                    #if 0
+                        vmDebugPrintVal(first, "first value");
+                        vmDebugPrintVal(second, "second value");
+                    #endif
+                    if(!first.isClass())
                     {
-                        if(NEON_UNLIKELY(!vmUtilConcatenate()))
-                        {
-                            VMMAC_TRYRAISE(Status::RuntimeFail, "unsupported operand + for %s and %s", Value::typeName(valleft, false), Value::typeName(valright, false));
-                            VMMAC_DISPATCH();
-                        }
+                        VMMAC_TRYRAISE(Status::RuntimeFail, "invalid use of 'is' on non-class");
                     }
-                    else if(valleft.isArray() && valright.isArray())
+                    checkclass = first.asClass();
+                    vclass = getClassFor(second);
+                    if(vclass)
                     {
-                        result = Value::fromObject(vmUtilCombineArrays(valleft.asArray(), valright.asArray()));
-                        vmStackPop(2);
-                        vmStackPush(result);
+                        rt = Class::isInstanceOf(vclass, checkclass);
                     }
-                    else
+                    vmStackPush(Value::makeBool(rt));
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_GLOBALDEFINE)
+                {
+                    if(!vmDoGlobalDefine())
                     {
-                        vmDoBinaryDirect();
+                        VMMAC_EXITVM();
                     }
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PRIMSUBTRACT)
+                VM_CASE(OPC_GLOBALGET)
                 {
-                    vmDoBinaryDirect();
+                    if(!vmDoGlobalGet())
+                    {
+                        VMMAC_EXITVM();
+                    }
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PRIMMULTIPLY)
+                VM_CASE(OPC_GLOBALSET)
                 {
-                    int intnum;
-                    double dbnum;
-                    Value peekleft;
-                    Value peekright;
-                    Value result;
-                    String* string;
-                    Array* list;
-                    Array* newlist;
-                    peekright = vmStackPeek(0);
-                    peekleft = vmStackPeek(1);
-                    if(peekleft.isString() && peekright.isNumber())
+                    if(!vmDoGlobalSet())
                     {
-                        dbnum = peekright.asNumber();
-                        string = peekleft.asString();
-                        result = Value::fromObject(vmUtilMultString(string, dbnum));
-                        vmStackPop(2);
-                        vmStackPush(result);
-                        VMMAC_DISPATCH();
+                        VMMAC_EXITVM();
                     }
-                    else if(peekleft.isArray() && peekright.isNumber())
+                }
+                VMMAC_DISPATCH();
+                VM_FASTCASE(OPC_LOCALGET)
+                {
+                    vmStackPush(m_vmstate.stackvalues[frame->stackslotpos + VMMAC_READSHORT()]);
+                }
+                VMMAC_FASTDISPATCH();
+                VM_FASTCASE(OPC_LOCALSET)
+                {
+                    m_vmstate.stackvalues[frame->stackslotpos + VMMAC_READSHORT()] = vmStackPeek(0);
+                }
+                VMMAC_FASTDISPATCH();
+                VM_FASTCASE(OPC_FUNCARGGET)
+                {
+                    vmStackPush(m_vmstate.stackvalues[frame->stackslotpos + VMMAC_READSHORT()]);
+                }
+                VMMAC_FASTDISPATCH();
+                VM_CASE(OPC_FUNCARGOPTIONAL)
+                {
+                    if(!vmDoFuncArgOptional())
                     {
-                        intnum = (int)peekright.asNumber();
-                        vmStackPop();
-                        list = peekleft.asArray();
-                        newlist = Array::make();
-                        vmStackPush(Value::fromObject(newlist));
-                        vmUtilMultArray(list, newlist, intnum);
-                        vmStackPop(2);
-                        vmStackPush(Value::fromObject(newlist));
-                        VMMAC_DISPATCH();
+                        VMMAC_EXITVM();
                     }
-                    else
+                }
+                VMMAC_DISPATCH();
+                VM_FASTCASE(OPC_FUNCARGSET)
+                {
+                    m_vmstate.stackvalues[frame->stackslotpos + VMMAC_READSHORT()] = vmStackPeek(0);
+                }
+                VMMAC_FASTDISPATCH();
+
+                VM_CASE(OPC_PROPERTYGET)
+                {
+                    if(!vmDoPropertyGetNormal())
                     {
-                        vmDoBinaryDirect();
+                        VMMAC_EXITVM();
                     }
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PRIMDIVIDE)
+                VM_CASE(OPC_PROPERTYSET)
                 {
-                    vmDoBinaryDirect();
+                    if(!vmDoPropertySet())
+                    {
+                        VMMAC_EXITVM();
+                    }
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PRIMMODULO)
+                VM_CASE(OPC_PROPERTYGETSELF)
                 {
-                    if(vmDoBinaryFunc("%", (BinOpFuncFN)vmCallbackModulo))
+                    if(!vmDoPropertyGetSelf())
                     {
+                        VMMAC_EXITVM();
                     }
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PRIMPOW)
+                VM_CASE(OPC_MAKECLOSURE)
                 {
-                    if(vmDoBinaryFunc("**", (BinOpFuncFN)vmCallbackPow))
+                    if(!vmDoMakeClosure())
                     {
+                        VMMAC_EXITVM();
                     }
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PRIMNEGATE)
+                VM_CASE(OPC_UPVALUEGET)
                 {
-                    Value peeked;
-                    peeked = vmStackPeek(0);
-                    if(!peeked.isNumber())
+                    int upvidx;
+                    Function* closure;
+                    upvidx = vmReadShort();
+                    closure = m_vmstate.currentframe->closure;
+                    if(upvidx < closure->m_upvalcount)
                     {
-                        VMMAC_TRYRAISE(Status::RuntimeFail, "operator - not defined for object of type %s", Value::typeName(peeked, false));
-                        VMMAC_DISPATCH();
+                        vmStackPush((closure->m_fnvals.fnclosure.m_upvalues[upvidx]->m_location));
+                    }
+                    else
+                    {
+                        vmStackPush(closure->m_clsthisval);
                     }
-                    peeked = vmStackPop();
-                    vmStackPush(Value::makeNumber(-peeked.asNumber()));
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PRIMBITNOT)
+                VM_CASE(OPC_UPVALUESET)
                 {
-                    Value peeked;
-                    peeked = vmStackPeek(0);
-                    if(!peeked.isNumber())
+                    int upvidx;
+                    Value val;
+                    upvidx = vmReadShort();
+                    val = vmStackPeek(0);
+                    m_vmstate.currentframe->closure->m_fnvals.fnclosure.m_upvalues[upvidx]->m_location = val;
+                    SharedState::gcWriteBarrier(m_vmstate.currentframe->closure->m_fnvals.fnclosure.m_upvalues[upvidx], val);
+                }
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_CALLFUNCTION)
+                {
+                    size_t argcount;
+                    Value callee;
+                    Value thisval;
+                    thisval = Value::makeNull();
+                    argcount = vmReadByte();
+                    callee = vmStackPeek(argcount);
+                    if(callee.isFuncclosure())
                     {
-                        VMMAC_TRYRAISE(Status::RuntimeFail, "operator ~ not defined for object of type %s", Value::typeName(peeked, false));
-                        VMMAC_DISPATCH();
+                        thisval = (callee.asFunction()->m_clsthisval);
                     }
-                    peeked = vmStackPop();
-                    vmStackPush(Value::makeNumber(~((int)peeked.asNumber())));
-                    VMMAC_DISPATCH();
+                    if(!vmCallValue(callee, thisval, argcount, false))
+                    {
+                        VMMAC_EXITVM();
+                    }
+                    VMMAC_SYNCFRAME();
+                    VMMAC_HEAPCHECK();
+                    VMMAC_JITHOOK(1);
                 }
-                VM_CASE(OPC_PRIMAND)
+                VMMAC_DISPATCH();
+                VM_CASE(OPC_CALLMETHOD)
                 {
-                    vmDoBinaryDirect();
+                    size_t argcount;
+                    String* method;
+                    method = vmReadString();
+                    argcount = vmReadByte();
+                    if(!vmUtilInvokeMethodNormal(method, argcount, vmReadInlineCache()))
+                    {
+                        VMMAC_EXITVM();
+                    }
+                    VMMAC_SYNCFRAME();
+                    VMMAC_HEAPCHECK();
+                    VMMAC_JITHOOK(1);
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PRIMOR)
+                VM_CASE(OPC_CLASSGETTHIS)
                 {
-                    vmDoBinaryDirect();
+                    Value thisval;
+                    thisval = vmStackPeek(3);
+                    m_debugwriter->format("CLASSGETTHIS: thisval=");
+                    ValPrinter::printValue(m_debugwriter, thisval, true, false);
+                    m_debugwriter->format("\n");
+                    vmStackPush(thisval);
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PRIMBITXOR)
+                VM_CASE(OPC_CLASSINVOKETHIS)
                 {
-                    vmDoBinaryDirect();
+                    size_t argcount;
+                    String* method;
+                    method = vmReadString();
+                    argcount = vmReadByte();
+                    if(!vmUtilInvokeMethodSelf(method, argcount, vmReadInlineCache()))
+                    {
+                        VMMAC_EXITVM();
+                    }
+                    VMMAC_SYNCFRAME();
+                    VMMAC_HEAPCHECK();
+                    VMMAC_JITHOOK(1);
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PRIMSHIFTLEFT)
+                VM_CASE(OPC_MAKECLASS)
                 {
-                    vmDoBinaryDirect();
+                    bool haveval;
+                    Value pushme;
+                    String* name;
+                    Class* klass;
+                    Property* field;
+                    haveval = false;
+                    name = vmReadString();
+                    field = m_vmstate.currentframe->closure->m_fnvals.fnclosure.scriptfunc->m_fnvals.fnscriptfunc.module->m_deftable.getfieldbyostr(name);
+                    if(field != nullptr)
+                    {
+                        if(field->value.isClass())
+                        {
+                            haveval = true;
+                            pushme = field->value;
+                        }
+                    }
+                    field = m_declaredglobals.getfieldbyostr(name);
+                    if(field != nullptr)
+                    {
+                        if(field->value.isClass())
+                        {
+                            haveval = true;
+                            pushme = field->value;
+                        }
+                    }
+                    if(!haveval)
+                    {
+                        klass = Class::make(name, m_classprimobject);
+                        pushme = Value::fromObject(klass);
+                    }
+                    vmStackPush(pushme);
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PRIMSHIFTRIGHT)
+                VM_CASE(OPC_MAKEMETHOD)
                 {
-                    vmDoBinaryDirect();
+                    String* name;
+                    name = vmReadString();
+                    vmUtilDefineMethod(name);
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PUSHONE)
+                VM_CASE(OPC_CLASSPROPERTYDEFINE)
                 {
-                    vmStackPush(Value::makeNumber(1));
+                    int isstatic;
+                    String* name;
+                    name = vmReadString();
+                    isstatic = vmReadByte();
+                    vmUtilDefineProperty(name, isstatic == 1);
                 }
                 VMMAC_DISPATCH();
-                /* comparisons */
-                VM_CASE(OPC_EQUAL)
+                VM_CASE(OPC_CLASSINHERIT)
                 {
-                    Value a;
-                    Value b;
-                    b = vmStackPop();
-                    a = vmStackPop();
-                    vmStackPush(Value::makeBool(Value::compareValues(a, b)));
+                    Value vclass;
+                    Value vsuper;
+                    Class* superclass;
+                    Class* subclass;
+                    vsuper = vmStackPeek(1);
+                    if(!vsuper.isClass())
+                    {
+                        VMMAC_TRYRAISE(Status::RuntimeFail, "cannot inherit from non-class object");
+                        VMMAC_DISPATCH();
+                    }
+                    vclass = vmStackPeek(0);
+                    superclass = vsuper.asClass();
+                    subclass = vclass.asClass();
+                    subclass->inheritFrom(superclass);
+                    /* pop the subclass */
+                    vmStackPop();
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PRIMGREATER)
+                VM_CASE(OPC_CLASSGETSUPER)
                 {
-                    vmDoBinaryDirect();
+                    Value vclass;
+                    Class* klass;
+                    String* name;
+                    name = vmReadString();
+                    vclass = vmStackPeek(0);
+                    klass = vclass.asClass();
+                    if(!vmUtilBindMethod(klass->m_superclass, name))
+                    {
+                        VMMAC_TRYRAISE(Status::RuntimeFail, "class '%s' does not have a function '%s'", klass->m_classname->data(), name->data());
+                    }
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PRIMLESSTHAN)
+                VM_CASE(OPC_CLASSINVOKESUPER)
                 {
-                    vmDoBinaryDirect();
+                    size_t argcount;
+                    Value vclass;
+                    Class* klass;
+                    String* method;
+                    method = vmReadString();
+                    argcount = vmReadByte();
+                    vclass = vmStackPop();
+                    klass = vclass.asClass();
+                    if(!vmUtilInvokeMethodFromClass(klass, method, argcount))
+                    {
+                        VMMAC_EXITVM();
+                    }
+                    VMMAC_SYNCFRAME();
+                    VMMAC_HEAPCHECK();
+                    VMMAC_JITHOOK(1);
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PRIMNOT)
+                VM_CASE(OPC_CLASSINVOKESUPERSELF)
                 {
-                    Value val;
-                    val = vmStackPop();
-                    vmStackPush(Value::makeBool(val.isFalse()));
+                    size_t argcount;
+                    Value vclass;
+                    Class* klass;
+                    argcount = vmReadByte();
+                    vclass = vmStackPop();
+                    klass = vclass.asClass();
+                    if(!vmUtilInvokeMethodFromClass(klass, m_defaultstrings.nmconstructor, argcount))
+                    {
+                        VMMAC_EXITVM();
+                    }
+                    VMMAC_SYNCFRAME();
+                    VMMAC_HEAPCHECK();
+                    VMMAC_JITHOOK(1);
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PUSHNULL)
+                VM_CASE(OPC_MAKEARRAY)
                 {
-                    vmStackPush(Value::makeNull());
+                    if(!vmDoMakeArray())
+                    {
+                        VMMAC_EXITVM();
+                    }
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PUSHEMPTY)
+
+                VM_CASE(OPC_MAKERANGE)
                 {
-                    vmStackPush(Value::makeNull());
+                    double lower;
+                    double upper;
+                    Value vupper;
+                    Value vlower;
+                    vupper = vmStackPeek(0);
+                    vlower = vmStackPeek(1);
+                    if(!vupper.isNumber() || !vlower.isNumber())
+                    {
+                        VMMAC_TRYRAISE(Status::RuntimeFail, "invalid range boundaries");
+                        VMMAC_DISPATCH();
+                    }
+                    lower = vlower.asNumber();
+                    upper = vupper.asNumber();
+                    vmStackPop(2);
+                    vmStackPush(Value::fromObject(Range::make(lower, upper)));
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PUSHTRUE)
+                VM_CASE(OPC_MAKEDICT)
                 {
-                    vmStackPush(Value::makeBool(true));
+                    if(!vmDoMakeDict())
+                    {
+                        VMMAC_EXITVM();
+                    }
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_PUSHFALSE)
+                VM_CASE(OPC_INDEXGETRANGED)
                 {
-                    vmStackPush(Value::makeBool(false));
+                    if(!vmDoGetRangedIndex())
+                    {
+                        VMMAC_EXITVM();
+                    }
                 }
                 VMMAC_DISPATCH();
-
-                VM_CASE(OPC_JUMPNOW)
+                VM_CASE(OPC_INDEXGET)
                 {
-                    uint16_t offset;
-                    offset = vmReadShort();
-                    m_vmstate.currentframe->inscode += offset;
+                    if(!vmDoIndexGet())
+                    {
+                        VMMAC_EXITVM();
+                    }
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_JUMPIFFALSE)
+                VM_CASE(OPC_INDEXSET)
                 {
-                    uint16_t offset;
-                    Value val;
-                    offset = vmReadShort();
-                    val = vmStackPeek(0);
-                    if(val.isFalse())
+                    if(!vmDoIndexSet())
                     {
-                        m_vmstate.currentframe->inscode += offset;
+                        VMMAC_EXITVM();
                     }
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_LOOP)
+                VM_CASE(OPC_TYPEOF)
                 {
-                    uint16_t offset;
-                    offset = vmReadShort();
-                    m_vmstate.currentframe->inscode -= offset;
+                    Value res;
+                    Value thing;
+                    const char* result;
+                    thing = vmStackPop();
+                    result = Value::typeName(thing, false);
+                    res = Value::fromObject(String::copy(result));
+                    vmStackPush(res);
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_ECHO)
+                VM_CASE(OPC_ASSERT)
                 {
-                    Value val;
-                    val = vmStackPeek(0);
-                    ValPrinter::printValue(m_stdoutprinter, val, m_isrepl, true);
-                    if(!val.isNull())
+                    Value message;
+                    Value expression;
+                    message = vmStackPop();
+                    expression = vmStackPop();
+                    if(expression.isFalse())
                     {
-                        m_stdoutprinter->writeString("\n");
+                        if(!message.isNull())
+                        {
+                            NEON_THROWCLASSWITHSOURCEINFO(m_exceptions.asserterror, Value::toString(message)->data());
+                        }
+                        else
+                        {
+                            NEON_THROWCLASSWITHSOURCEINFO(m_exceptions.asserterror, "assertion failed");
+                        }
                     }
-                    vmStackPop();
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_STRINGIFY)
+                VM_CASE(OPC_EXTHROW)
                 {
+                    bool isok;
                     Value peeked;
-                    Value popped;
-                    String* os;
+                    Value stacktrace;
+                    Instance* instance;
                     peeked = vmStackPeek(0);
-                    if(!peeked.isString() && !peeked.isNull())
+                    isok = (peeked.isInstance() || Class::isInstanceOf(peeked.asInstance()->m_instanceclass, m_exceptions.stdexception));
+                    if(!isok)
                     {
-                        popped = vmStackPop();
-                        os = Value::toString(popped);
-                        if(os->length() != 0)
+                        VMMAC_TRYRAISE(Status::RuntimeFail, "instance of Exception expected");
+                        VMMAC_DISPATCH();
+                    }
+                    stacktrace = vmExceptionGetStackTrace();
+                    instance = peeked.asInstance();
+                    instance->defProperty(String::intern("stacktrace"), stacktrace);
+                    if(vmExceptionPropagate())
+                    {
+                        m_vmstate.currentframe = &m_vmstate.framevalues[m_vmstate.framecount - 1];
+                        VMMAC_DISPATCH();
+                    }
+                    VMMAC_EXITVM();
+                }
+                VM_CASE(OPC_EXTRY)
+                {
+                    bool haveclass;
+                    uint16_t addr;
+                    uint16_t finaddr;
+                    Value value;
+                    String* type;
+                    Class* exclass;
+                    haveclass = false;
+                    exclass = nullptr;
+                    type = vmReadString();
+                    addr = vmReadShort();
+                    finaddr = vmReadShort();
+                    if(addr != 0)
+                    {
+                        value = Value::makeNull();
+                        if(!m_declaredglobals.get(Value::fromObject(type), &value))
                         {
-                            vmStackPush(Value::fromObject(os));
+                            if(value.isClass())
+                            {
+                                haveclass = true;
+                                exclass = value.asClass();
+                            }
                         }
-                        else
+                        if(!haveclass)
                         {
-                            vmStackPush(Value::makeNull());
+                            /*
+                            if(!m_vmstate.currentframe->closure->m_fnvals.fnclosure.scriptfunc->m_fnvals.fnscriptfunc.module->m_deftable.get(Value::fromObject(type), &value) || !value.isClass())
+                            {
+                                VMMAC_TRYRAISE(Status::RuntimeFail, "object of type '%s' is not an exception", type->data());
+                                VMMAC_DISPATCH();
+                            }
+                            */
+                            exclass = m_exceptions.stdexception;
                         }
+                        vmExceptionPushHandler(exclass, addr, finaddr);
+                    }
+                    else
+                    {
+                        vmExceptionPushHandler(nullptr, addr, finaddr);
                     }
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_DUPONE)
-                {
-                    Value val;
-                    val = vmStackPeek(0);
-                    vmStackPush(val);
-                }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_POPONE)
+                VM_CASE(OPC_EXPOPTRY)
                 {
-                    vmStackPop();
+                    m_vmstate.currentframe->m_handlercount--;
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_POPN)
+                VM_CASE(OPC_EXPUBLISHTRY)
                 {
-                    vmStackPop(vmReadShort());
+                    m_vmstate.currentframe->m_handlercount--;
+                    if(vmExceptionPropagate())
+                    {
+                        m_vmstate.currentframe = &m_vmstate.framevalues[m_vmstate.framecount - 1];
+                        VMMAC_DISPATCH();
+                    }
+                    VMMAC_EXITVM();
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_UPVALUECLOSE)
+                VM_CASE(OPC_REGMOVE)
                 {
-                    vmUtilUpvaluesClose(m_vmstate.stackvalues.getp(m_vmstate.stackidx - 1));
-                    vmStackPop();
+                    vmDoRegisterMove();
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_OPINSTANCEOF)
+                VM_FASTCASE(OPC_REGADD)
+                VM_FASTCASE(OPC_REGSUBTRACT)
+                VM_FASTCASE(OPC_REGMULTIPLY)
+                VM_CASE(OPC_REGDIVIDE)
                 {
-                    bool rt;
-                    Value first;
-                    Value second;
-                    Class* vclass;
-                    Class* checkclass;
-                    rt = false;
-                    first = vmStackPop();
-                    second = vmStackPop();
-                    #if 0
-                        vmDebugPrintVal(first, "first value");
-                        vmDebugPrintVal(second, "second value");
-                    #endif
-                    if(!first.isClass())
-                    {
-                        VMMAC_TRYRAISE(Status::RuntimeFail, "invalid use of 'is' on non-class");
-                    }
-                    checkclass = first.asClass();
-                    vclass = getClassFor(second);
-                    if(vclass)
-                    {
-                        rt = Class::isInstanceOf(vclass, checkclass);
-                    }
-                    vmStackPush(Value::makeBool(rt));
+                    vmDoRegisterArith();
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_GLOBALDEFINE)
+                VM_FASTCASE(OPC_REGJUMPIFNOTLESS)
+                VM_CASE(OPC_REGJUMPIFNOTGREATER)
                 {
-                    if(!vmDoGlobalDefine())
-                    {
-                        VMMAC_EXITVM();
-                    }
+                    vmDoRegisterJumpCompare();
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_GLOBALGET)
+                VM_CASE(OPC_SWITCH)
                 {
-                    if(!vmDoGlobalGet())
+                    Value expr;
+                    Value value;
+                    Switch* sw;
+                    sw = vmReadConst().asSwitch();
+                    expr = vmStackPeek(0);
+                    if(sw->m_table.get(expr, &value))
                     {
-                        VMMAC_EXITVM();
+                        m_vmstate.currentframe->inscode += (int)value.asNumber();
                     }
-                }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_GLOBALSET)
-                {
-                    if(!vmDoGlobalSet())
+                    else if(sw->m_defaultjump != -1)
                     {
-                        VMMAC_EXITVM();
+                        m_vmstate.currentframe->inscode += sw->m_defaultjump;
                     }
-                }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_LOCALGET)
-                {
-                    if(!vmDoLocalGet())
+                    else
                     {
-                        VMMAC_EXITVM();
+                        m_vmstate.currentframe->inscode += sw->m_exitjump;
                     }
+                    vmStackPop();
                 }
                 VMMAC_DISPATCH();
-                VM_CASE(OPC_LOCALSET)
-                {
-                    if(!vmDoLocalSet())
+    #if 0
+                default:
                     {
-                        VMMAC_EXITVM();
+                        fprintf(stderr, "UNHANDLED OPCODE %d\n", currinstr);
                     }
-                }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_FUNCARGGET)
+                    break;
+    #endif
+            }
+        }
+    #if (NEON_CONFIG_USEJIT == 1) && (NEON_CONFIG_USECOMPUTEDGOTO == 1)
+    stepfinished:
+        /* only reached through steptable: un-read the instruction that follows the one that was run */
+        ip--;
+        VMMAC_SAVEIP();
+        return Status::Ok;
+    #endif
+    finished:
+        return Status::Ok;
+    }
+
+#if defined(NEON_CONFIG_USEJIT) && (NEON_CONFIG_USEJIT == 1)
+    /*
+    * baseline template JIT for x86-64.
+    * a Blob is translated one instruction at a time, by stitching together a fixed template per opcode.
+    * there is no register allocation, and nothing is kept in registers from one instruction to the next:
+    * every template reads and writes the VM stack just like the interpreter does, so that control can be
+    * handed back and forth at any instruction boundary.
+    *
+    * - locals, constants, jumps and number arithmetic are done inline.
+    * - slow paths, and instructions that look things up or may raise, call the helpers the interpreter uses.
+    * - any other instruction is run by the interpreter itself (runVM(..., true), which runs exactly one).
+    * - returns, calls that push a frame, and anything that leaves the straight path (exceptions, switch)
+    *   go back to the interpreter, which then decides where to continue (see SharedState::vmJitMaybeRun).
+    *
+    * registers, while in native code:
+    *   rbx: the SharedState
+    *   r12: the current CallFrame
+    *   r13: the first slot of the current frame (&stackvalues[stackslotpos])
+    *   r14: the frame count at entry; once a helper changes it, the native code returns
+    *   r15: stackvalues.data()
+    * r12, r13 and r15 are re-read after any helper that may have grown the stack or the frame list.
+    */
+    class JitCompiler
+    {
+        private:
+            enum Register
+            {
+                RAX = 0,
+                RCX = 1,
+                RDX = 2,
+                RBX = 3,
+                RSP = 4,
+                RBP = 5,
+                RSI = 6,
+                RDI = 7,
+                R12 = 12,
+                R13 = 13,
+                R14 = 14,
+                R15 = 15,
+            };
+
+            enum Condition
+            {
+                CC_O = 0x0,
+                CC_B = 0x2,
+                CC_E = 0x4,
+                CC_NE = 0x5,
+                CC_A = 0x7,
+                CC_NP = 0xB,
+                CC_L = 0xC,
+                CC_G = 0xF,
+            };
+
+            /* opcodes of the two-operand ALU instructions (r/m64, r64), and the /digit of their immediate forms */
+            enum AluOp
+            {
+                ALU_ADD = 0x01,
+                ALU_OR = 0x09,
+                ALU_AND = 0x21,
+                ALU_SUB = 0x29,
+                ALU_XOR = 0x31,
+                ALU_CMP = 0x39,
+                ALU_TEST = 0x85,
+                ALUIMM_ADD = 0,
+                ALUIMM_OR = 1,
+                ALUIMM_SUB = 5,
+                ALUIMM_CMP = 7,
+            };
+
+            /* the /digit of the shift-by-immediate instructions (C1 /digit ib) */
+            enum ShiftOp
+            {
+                SHIFT_SHL = 4,
+                SHIFT_SHR = 5,
+                SHIFT_SAR = 7,
+            };
+
+            /* the scalar double instructions (F2 0F xx) */
+            enum SseOp
+            {
+                SSE_ADDSD = 0x58,
+                SSE_MULSD = 0x59,
+                SSE_SUBSD = 0x5C,
+                SSE_DIVSD = 0x5E,
+            };
+
+            /* jump targets that are not instructions */
+            enum
+            {
+                LABEL_EXITINTERPRET = -1,
+                LABEL_EXITFAILED = -2,
+                LABEL_EXITFRAMECHANGED = -3,
+            };
+
+            /* a rel32 at m_buf[at], that jumps to the instruction at offset target (or to one of the LABEL_* stubs) */
+            struct Fixup
+            {
+                size_t at;
+                int target;
+            };
+
+        private:
+            Blob* m_blob;
+            const uint8_t* m_code;
+            ValList<uint8_t> m_buf;
+            ValList<Fixup> m_fixups;
+            int32_t* m_nativeoffsets;
+            /* offsets from rbx (SharedState) */
+            int32_t m_offstackidx;
+            int32_t m_offstackcapacity;
+            int32_t m_offstackdata;
+            int32_t m_offframecount;
+            int32_t m_offcurrentframe;
+            int32_t m_offcurrentinstr;
+            int32_t m_offoverlimit;
+            /* offsets from r12 (CallFrame) */
+            int32_t m_offinscode;
+            int32_t m_offstackslotpos;
+
+        public:
+            /* returns nullptr if the blob cannot be compiled; the interpreter then keeps running it */
+            static JitCode* compile(SharedState* gcs, Blob* blob)
+            {
+                JitCode* jc;
+                JitCompiler jit(gcs, blob);
+                jc = jit.run();
+                jit.m_buf.deInit();
+                jit.m_fixups.deInit();
+                Memory::sysFree(jit.m_nativeoffsets);
+                return jc;
+            }
+
+        private:
+            /* helpers called from native code; each returns 0 if the instruction failed */
+            template<bool (SharedState::*fn)()>
+            static int helperDo(SharedState* gcs)
+            {
+                return (gcs->*fn)() ? 1 : 0;
+            }
+
+            static int helperStep(SharedState* gcs)
+            {
+                return (gcs->runVM(0, nullptr, true) == Status::Ok) ? 1 : 0;
+            }
+
+            static void helperGrowStack(SharedState* gcs)
+            {
+                gcs->checkMaybeResizeStack();
+            }
+
+            static int helperHeapCheck(SharedState* gcs)
+            {
+                return gcs->gcEnforceHeapLimit() ? 1 : 0;
+            }
+
+            static int helperIsFalse(uint64_t bits)
+            {
+                return Value::fromBits(bits).isFalse() ? 1 : 0;
+            }
+
+            /* the generic part of OPC_PRIMADD: strings, arrays, and everything vmDoBinaryDirect handles */
+            static int helperAdd(SharedState* gcs)
+            {
+                Value valright;
+                Value valleft;
+                Value result;
+                valright = gcs->vmStackPeek(0);
+                valleft = gcs->vmStackPeek(1);
+                if(valright.isString() || valleft.isString())
                 {
-                    if(!vmDoFuncArgGet())
+                    if(NEON_UNLIKELY(!gcs->vmUtilConcatenate()))
                     {
-                        VMMAC_EXITVM();
+                        return NEON_THROWEXCEPTION("unsupported operand + for %s and %s", Value::typeName(valleft, false), Value::typeName(valright, false)) ? 1 : 0;
                     }
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_FUNCARGOPTIONAL)
+                else if(valleft.isArray() && valright.isArray())
                 {
-                    if(!vmDoFuncArgOptional())
-                    {
-                        VMMAC_EXITVM();
-                    }
+                    result = Value::fromObject(gcs->vmUtilCombineArrays(valleft.asArray(), valright.asArray()));
+                    gcs->vmStackPop(2);
+                    gcs->vmStackPush(result);
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_FUNCARGSET)
+                else
                 {
-                    if(!vmDoFuncArgSet())
-                    {
-                        VMMAC_EXITVM();
-                    }
+                    gcs->vmDoBinaryDirect();
                 }
-                VMMAC_DISPATCH();
+                return 1;
+            }
 
-                VM_CASE(OPC_PROPERTYGET)
+            static int helperEqual(SharedState* gcs)
+            {
+                Value a;
+                Value b;
+                b = gcs->vmStackPop();
+                a = gcs->vmStackPop();
+                gcs->vmStackPush(Value::makeBool(Value::compareValues(a, b)));
+                return 1;
+            }
+
+            static int helperCallFunction(SharedState* gcs)
+            {
+                size_t argcount;
+                Value callee;
+                Value thisval;
+                thisval = Value::makeNull();
+                argcount = gcs->vmReadByte();
+                callee = gcs->vmStackPeek(argcount);
+                if(callee.isFuncclosure())
                 {
-                    if(!vmDoPropertyGetNormal())
-                    {
-                        VMMAC_EXITVM();
-                    }
+                    thisval = (callee.asFunction()->m_clsthisval);
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_PROPERTYSET)
+                return gcs->vmCallValue(callee, thisval, argcount, false) ? 1 : 0;
+            }
+
+            static int helperCallMethod(SharedState* gcs)
+            {
+                size_t argcount;
+                String* method;
+                method = gcs->vmReadString();
+                argcount = gcs->vmReadByte();
+                return gcs->vmUtilInvokeMethodNormal(method, argcount, gcs->vmReadInlineCache()) ? 1 : 0;
+            }
+
+            static int helperInvokeThis(SharedState* gcs)
+            {
+                size_t argcount;
+                String* method;
+                method = gcs->vmReadString();
+                argcount = gcs->vmReadByte();
+                return gcs->vmUtilInvokeMethodSelf(method, argcount, gcs->vmReadInlineCache()) ? 1 : 0;
+            }
+
+            /* superinstructions and quickened instructions leave the bytes after their first instruction intact */
+            static int baseOpcode(int op)
+            {
+                switch(op)
                 {
-                    if(!vmDoPropertySet())
-                    {
-                        VMMAC_EXITVM();
-                    }
+                    case Instruction::OPC_SUPLOCALLOCALADD:
+                    case Instruction::OPC_SUPLOCALPROPERTYGET:
+                        return Instruction::OPC_LOCALGET;
+                    case Instruction::OPC_SUPCONSTLESSJUMP:
+                        return Instruction::OPC_PUSHCONSTANT;
+                    case Instruction::OPC_PRIMADDNUM:
+                    case Instruction::OPC_PRIMADDSTR:
+                        return Instruction::OPC_PRIMADD;
+                    case Instruction::OPC_PRIMSUBTRACTNUM:
+                        return Instruction::OPC_PRIMSUBTRACT;
+                    case Instruction::OPC_PRIMLESSTHANNUM:
+                        return Instruction::OPC_PRIMLESSTHAN;
+                    default:
+                        break;
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_PROPERTYGETSELF)
+                return op;
+            }
+
+            /* instructions that never appear in m_instrucs of a finished function */
+            static bool isCompilable(int op)
+            {
+                switch(op)
                 {
-                    if(!vmDoPropertyGetSelf())
-                    {
-                        VMMAC_EXITVM();
-                    }
+                    case Instruction::OPC_BREAK_PL:
+                    case Instruction::OPC_REGMOVE:
+                    case Instruction::OPC_REGADD:
+                    case Instruction::OPC_REGSUBTRACT:
+                    case Instruction::OPC_REGMULTIPLY:
+                    case Instruction::OPC_REGDIVIDE:
+                    case Instruction::OPC_REGJUMPIFNOTLESS:
+                    case Instruction::OPC_REGJUMPIFNOTGREATER:
+                        return false;
+                    default:
+                        break;
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_MAKECLOSURE)
+                return (op < Instruction::OPC_BREAK_PL);
+            }
+
+        private:
+            JitCompiler(SharedState* gcs, Blob* blob)
+            {
+                CallFrame frame;
+                m_blob = blob;
+                m_code = blob->m_instrucs.data();
+                m_nativeoffsets = nullptr;
+                m_offstackidx = (int32_t)((char*)&gcs->m_vmstate.stackidx - (char*)gcs);
+                m_offstackcapacity = (int32_t)((char*)&gcs->m_vmstate.stackcapacity - (char*)gcs);
+                m_offstackdata = (int32_t)((char*)gcs->m_vmstate.stackvalues.dataAddress() - (char*)gcs);
+                m_offframecount = (int32_t)((char*)&gcs->m_vmstate.framecount - (char*)gcs);
+                m_offcurrentframe = (int32_t)((char*)&gcs->m_vmstate.currentframe - (char*)gcs);
+                m_offcurrentinstr = (int32_t)((char*)&gcs->m_vmstate.currentinstr - (char*)gcs);
+                m_offoverlimit = (int32_t)((char*)&gcs->m_gcstate.overlimit - (char*)gcs);
+                m_offinscode = (int32_t)((char*)&frame.inscode - (char*)&frame);
+                m_offstackslotpos = (int32_t)((char*)&frame.stackslotpos - (char*)&frame);
+            }
+
+            /*
+            * raw x86-64 encoding.
+            * memory operands are always encoded as [base + disp32] or [base + index*8 + disp32].
+            */
+            NEON_INLINE void emitByte(uint8_t b)
+            {
+                m_buf.push(b);
+            }
+
+            NEON_INLINE void emitDword(uint32_t v)
+            {
+                int i;
+                for(i = 0; i < 4; i++)
                 {
-                    if(!vmDoMakeClosure())
-                    {
-                        VMMAC_EXITVM();
-                    }
+                    emitByte((v >> (i * 8)) & 0xff);
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_UPVALUEGET)
-                {
-                    int upvidx;
-                    Function* closure;
-                    upvidx = vmReadShort();
-                    closure = m_vmstate.currentframe->closure;
-                    if(upvidx < closure->m_upvalcount)
-                    {
-                        vmStackPush((closure->m_fnvals.fnclosure.m_upvalues[upvidx]->m_location));
-                    }
-                    else
-                    {
-                        vmStackPush(closure->m_clsthisval);
-                    }
+            }
+
+            NEON_INLINE void emitQword(uint64_t v)
+            {
+                int i;
+                for(i = 0; i < 8; i++)
+                {
+                    emitByte((v >> (i * 8)) & 0xff);
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_UPVALUESET)
+            }
+
+            NEON_INLINE void emitRexW(int reg, int index, int base)
+            {
+                emitByte(0x48 | (((reg >> 3) & 1) << 2) | (((index >> 3) & 1) << 1) | ((base >> 3) & 1));
+            }
+
+            NEON_INLINE void emitModMem(int reg, int base, int32_t disp)
+            {
+                if((base & 7) == RSP)
                 {
-                    int upvidx;
-                    Value val;
-                    upvidx = vmReadShort();
-                    val = vmStackPeek(0);
-                    m_vmstate.currentframe->closure->m_fnvals.fnclosure.m_upvalues[upvidx]->m_location = val;
+                    emitByte(0x80 | ((reg & 7) << 3) | 4);
+                    emitByte(0x24);
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_CALLFUNCTION)
+                else
                 {
-                    size_t argcount;
-                    Value callee;
-                    Value thisval;
-                    thisval = Value::makeNull();
-                    argcount = vmReadByte();
-                    callee = vmStackPeek(argcount);
-                    if(callee.isFuncclosure())
-                    {
-                        thisval = (callee.asFunction()->m_clsthisval);
-                    }
-                    if(!vmCallValue(callee, thisval, argcount, false))
-                    {
-                        VMMAC_EXITVM();
-                    }
-                    m_vmstate.currentframe = &m_vmstate.framevalues[m_vmstate.framecount - 1];
+                    emitByte(0x80 | ((reg & 7) << 3) | (base & 7));
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_CALLMETHOD)
+                emitDword(disp);
+            }
+
+            NEON_INLINE void emitModMemIndex(int reg, int base, int index, int32_t disp)
+            {
+                emitByte(0x80 | ((reg & 7) << 3) | 4);
+                emitByte(0xC0 | ((index & 7) << 3) | (base & 7));
+                emitDword(disp);
+            }
+
+            NEON_INLINE void emitModReg(int reg, int rm)
+            {
+                emitByte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+            }
+
+            /* mov reg, imm64 */
+            void asmMovImm(int reg, uint64_t v)
+            {
+                emitRexW(0, 0, reg);
+                emitByte(0xB8 + (reg & 7));
+                emitQword(v);
+            }
+
+            /* mov dst, src */
+            void asmMov(int dst, int src)
+            {
+                emitRexW(src, 0, dst);
+                emitByte(0x89);
+                emitModReg(src, dst);
+            }
+
+            /* mov reg, [base + disp] */
+            void asmLoad(int reg, int base, int32_t disp)
+            {
+                emitRexW(reg, 0, base);
+                emitByte(0x8B);
+                emitModMem(reg, base, disp);
+            }
+
+            /* movsxd reg, dword [base + disp] */
+            void asmLoadInt32(int reg, int base, int32_t disp)
+            {
+                emitRexW(reg, 0, base);
+                emitByte(0x63);
+                emitModMem(reg, base, disp);
+            }
+
+            /* mov [base + disp], reg */
+            void asmStore(int base, int32_t disp, int reg)
+            {
+                emitRexW(reg, 0, base);
+                emitByte(0x89);
+                emitModMem(reg, base, disp);
+            }
+
+            /* mov byte [base + disp], imm8 */
+            void asmStoreByte(int base, int32_t disp, uint8_t v)
+            {
+                if(base >= 8)
                 {
-                    size_t argcount;
-                    String* method;
-                    method = vmReadString();
-                    argcount = vmReadByte();
-                    if(!vmUtilInvokeMethodNormal(method, argcount))
-                    {
-                        VMMAC_EXITVM();
-                    }
-                    m_vmstate.currentframe = &m_vmstate.framevalues[m_vmstate.framecount - 1];
+                    emitByte(0x41);
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_CLASSGETTHIS)
+                emitByte(0xC6);
+                emitModMem(0, base, disp);
+                emitByte(v);
+            }
+
+            /* cmp byte [base + disp], imm8 */
+            void asmCmpByteMem(int base, int32_t disp, uint8_t v)
+            {
+                if(base >= 8)
                 {
-                    Value thisval;
-                    thisval = vmStackPeek(3);
-                    m_debugwriter->format("CLASSGETTHIS: thisval=");
-                    ValPrinter::printValue(m_debugwriter, thisval, true, false);
-                    m_debugwriter->format("\n");
-                    vmStackPush(thisval);
+                    emitByte(0x41);
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_CLASSINVOKETHIS)
+                emitByte(0x80);
+                emitModMem(7, base, disp);
+                emitByte(v);
+            }
+
+            /* mov reg, [base + index*8 + disp] */
+            void asmLoadIndex(int reg, int base, int index, int32_t disp)
+            {
+                emitRexW(reg, index, base);
+                emitByte(0x8B);
+                emitModMemIndex(reg, base, index, disp);
+            }
+
+            /* mov [base + index*8 + disp], reg */
+            void asmStoreIndex(int base, int index, int32_t disp, int reg)
+            {
+                emitRexW(reg, index, base);
+                emitByte(0x89);
+                emitModMemIndex(reg, base, index, disp);
+            }
+
+            /* lea reg, [base + index*8 + disp] */
+            void asmLeaIndex(int reg, int base, int index, int32_t disp)
+            {
+                emitRexW(reg, index, base);
+                emitByte(0x8D);
+                emitModMemIndex(reg, base, index, disp);
+            }
+
+            /* add/or/sub/cmp/test dst, src */
+            void asmAlu(int op, int dst, int src)
+            {
+                emitRexW(src, 0, dst);
+                emitByte(op);
+                emitModReg(src, dst);
+            }
+
+            /* shl/shr/sar reg, imm8 */
+            void asmShiftImm(int digit, int reg, uint8_t v)
+            {
+                emitRexW(0, 0, reg);
+                emitByte(0xC1);
+                emitModReg(digit, reg);
+                emitByte(v);
+            }
+
+            /* imul dst, src */
+            void asmImul(int dst, int src)
+            {
+                emitRexW(dst, 0, src);
+                emitByte(0x0F);
+                emitByte(0xAF);
+                emitModReg(dst, src);
+            }
+
+            /* add/or/sub/cmp reg, imm32 */
+            void asmAluImm(int digit, int reg, int32_t v)
+            {
+                emitRexW(0, 0, reg);
+                emitByte(0x81);
+                emitModReg(digit, reg);
+                emitDword(v);
+            }
+
+            /* add/or/sub/cmp qword [base + disp], imm32 */
+            void asmAluMemImm(int digit, int base, int32_t disp, int32_t v)
+            {
+                emitRexW(0, 0, base);
+                emitByte(0x81);
+                emitModMem(digit, base, disp);
+                emitDword(v);
+            }
+
+            /* cmp reg, [base + disp] */
+            void asmCmpMem(int reg, int base, int32_t disp)
+            {
+                emitRexW(reg, 0, base);
+                emitByte(0x3B);
+                emitModMem(reg, base, disp);
+            }
+
+            /* test eax, eax; helpers return int, so the upper half of rax is undefined */
+            void asmTestEax()
+            {
+                emitByte(0x85);
+                emitByte(0xC0);
+            }
+
+            /* mov eax, imm32 */
+            void asmMovEax(uint32_t v)
+            {
+                emitByte(0xB8);
+                emitDword(v);
+            }
+
+            /* setcc al; movzx eax, al */
+            void asmSetEax(int cond)
+            {
+                emitByte(0x0F);
+                emitByte(0x90 | cond);
+                emitByte(0xC0);
+                emitByte(0x0F);
+                emitByte(0xB6);
+                emitByte(0xC0);
+            }
+
+            void asmPush(int reg)
+            {
+                if(reg >= 8)
                 {
-                    size_t argcount;
-                    String* method;
-                    method = vmReadString();
-                    argcount = vmReadByte();
-                    if(!vmUtilInvokeMethodSelf(method, argcount))
-                    {
-                        VMMAC_EXITVM();
-                    }
-                    m_vmstate.currentframe = &m_vmstate.framevalues[m_vmstate.framecount - 1];
+                    emitByte(0x41);
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_MAKECLASS)
+                emitByte(0x50 + (reg & 7));
+            }
+
+            void asmPop(int reg)
+            {
+                if(reg >= 8)
                 {
-                    bool haveval;
-                    Value pushme;
-                    String* name;
-                    Class* klass;
-                    Property* field;
-                    haveval = false;
-                    name = vmReadString();
-                    field = m_vmstate.currentframe->closure->m_fnvals.fnclosure.scriptfunc->m_fnvals.fnscriptfunc.module->m_deftable.getfieldbyostr(name);
-                    if(field != nullptr)
-                    {
-                        if(field->value.isClass())
-                        {
-                            haveval = true;
-                            pushme = field->value;
-                        }
-                    }
-                    field = m_declaredglobals.getfieldbyostr(name);
-                    if(field != nullptr)
-                    {
-                        if(field->value.isClass())
-                        {
-                            haveval = true;
-                            pushme = field->value;
-                        }
+                    emitByte(0x41);
+                }
+                emitByte(0x58 + (reg & 7));
+            }
+
+            /* movq xmm, reg */
+            void asmMovToXmm(int xmm, int reg)
+            {
+                emitByte(0x66);
+                emitRexW(xmm, 0, reg);
+                emitByte(0x0F);
+                emitByte(0x6E);
+                emitModReg(xmm, reg);
+            }
+
+            /* movq reg, xmm */
+            void asmMovFromXmm(int reg, int xmm)
+            {
+                emitByte(0x66);
+                emitRexW(xmm, 0, reg);
+                emitByte(0x0F);
+                emitByte(0x7E);
+                emitModReg(xmm, reg);
+            }
+
+            /* addsd/subsd/mulsd/divsd xmmdst, xmmsrc */
+            void asmSse(int op, int dst, int src)
+            {
+                emitByte(0xF2);
+                emitByte(0x0F);
+                emitByte(op);
+                emitModReg(dst, src);
+            }
+
+            /* cvtsi2sd xmm, reg */
+            void asmCvtsi2sd(int xmm, int reg)
+            {
+                emitByte(0xF2);
+                emitRexW(xmm, 0, reg);
+                emitByte(0x0F);
+                emitByte(0x2A);
+                emitModReg(xmm, reg);
+            }
+
+            /* ucomisd a, b */
+            void asmUcomisd(int a, int b)
+            {
+                emitByte(0x66);
+                emitByte(0x0F);
+                emitByte(0x2E);
+                emitModReg(a, b);
+            }
+
+            /* mov rax, fn; call rax */
+            void asmCall(const void* fn)
+            {
+                asmMovImm(RAX, (uint64_t)(uintptr_t)fn);
+                emitByte(0xFF);
+                emitByte(0xD0);
+            }
+
+            /* jcc rel32 to a place that is only known later; returns where to patch it (see asmBind) */
+            size_t asmJccForward(int cond)
+            {
+                emitByte(0x0F);
+                emitByte(0x80 | cond);
+                emitDword(0);
+                return m_buf.count() - 4;
+            }
+
+            size_t asmJmpForward()
+            {
+                emitByte(0xE9);
+                emitDword(0);
+                return m_buf.count() - 4;
+            }
+
+            /* points a forward jump at the current position */
+            void asmBind(size_t at)
+            {
+                int32_t rel;
+                rel = (int32_t)(m_buf.count() - (at + 4));
+                memcpy(m_buf.data() + at, &rel, sizeof(rel));
+            }
+
+            /* jumps to an instruction, or to a LABEL_* stub; resolved once everything is emitted */
+            void asmJccTo(int cond, int target)
+            {
+                Fixup fx;
+                fx.at = asmJccForward(cond);
+                fx.target = target;
+                m_fixups.push(fx);
+            }
+
+            void asmJmpTo(int target)
+            {
+                Fixup fx;
+                fx.at = asmJmpForward();
+                fx.target = target;
+                m_fixups.push(fx);
+            }
+
+        private:
+            /* r12, r15 and r13, see above */
+            void emitReloadState()
+            {
+                asmLoad(R12, RBX, m_offcurrentframe);
+                asmLoad(R15, RBX, m_offstackdata);
+                asmLoadInt32(RAX, R12, m_offstackslotpos);
+                asmLeaIndex(R13, R15, RAX, 0);
+            }
+
+            void emitSetInscode(int offset)
+            {
+                asmMovImm(RAX, (uint64_t)(uintptr_t)(m_code + offset));
+                asmStore(R12, m_offinscode, RAX);
+            }
+
+            /* the same check as vmStackPush() does, before anything is pushed */
+            void emitEnsureStack()
+            {
+                size_t skip;
+                asmLoad(RAX, RBX, m_offstackidx);
+                asmAluImm(ALUIMM_ADD, RAX, 1);
+                asmCmpMem(RAX, RBX, m_offstackcapacity);
+                skip = asmJccForward(CC_L);
+                asmMov(RDI, RBX);
+                asmCall((const void*)&helperGrowStack);
+                emitReloadState();
+                asmBind(skip);
+            }
+
+            /* pushes rdx; clobbers rcx */
+            void emitPushRdx()
+            {
+                asmLoad(RCX, RBX, m_offstackidx);
+                asmStoreIndex(R15, RCX, 0, RDX);
+                asmAluImm(ALUIMM_ADD, RCX, 1);
+                asmStore(RBX, m_offstackidx, RCX);
+            }
+
+            /*
+            * calls fn(gcs) with currentframe->inscode at $operandsat, which is what the helpers of the
+            * interpreter expect. native code only continues if fn succeeded, left the frame alone, and the
+            * instruction stream continues at $nextip.
+            */
+            void emitHelper(const void* fn, int op, int operandsat, int nextip)
+            {
+                emitSetInscode(operandsat);
+                asmStoreByte(RBX, m_offcurrentinstr, op);
+                asmMov(RDI, RBX);
+                asmCall(fn);
+                asmTestEax();
+                asmJccTo(CC_E, LABEL_EXITFAILED);
+                asmLoad(RAX, RBX, m_offframecount);
+                asmAlu(ALU_CMP, RAX, R14);
+                asmJccTo(CC_NE, LABEL_EXITFRAMECHANGED);
+                emitReloadState();
+                asmMovImm(RAX, (uint64_t)(uintptr_t)(m_code + nextip));
+                asmCmpMem(RAX, R12, m_offinscode);
+                asmJccTo(CC_NE, LABEL_EXITINTERPRET);
+            }
+
+            /* the VMMAC_HEAPCHECK() of the interpreter, for the instruction at $ip; see SharedState::gcEnforceHeapLimit() */
+            void emitHeapCheck(int op, int ip)
+            {
+                size_t skip;
+                asmCmpByteMem(RBX, m_offoverlimit, 0);
+                skip = asmJccForward(CC_E);
+                emitHelper((const void*)&helperHeapCheck, op, ip, ip);
+                asmBind(skip);
+            }
+
+            /* lets the interpreter run the instruction at $ip */
+            void emitStep(int op, int ip, int nextip)
+            {
+                emitHelper((const void*)&helperStep, op, ip, nextip);
+            }
+
+            /* hands the instruction at $ip to the interpreter, without coming back */
+            void emitExitAt(int ip)
+            {
+                emitSetInscode(ip);
+                asmJmpTo(LABEL_EXITINTERPRET);
+            }
+
+            /* dst = the sign-extended integer payload of src (see Value::asInt) */
+            void emitUnboxInt(int dst, int src)
+            {
+                asmMov(dst, src);
+                asmShiftImm(SHIFT_SHL, dst, 16);
+                asmShiftImm(SHIFT_SAR, dst, 16);
+            }
+
+            /*
+            * loads the two topmost values into rax (left) and rcx (right), with the stack index in rsi.
+            * the returned jump is taken unless both are integers; emitDoubleOperand() then has to sort them out.
+            */
+            size_t emitIntOperands()
+            {
+                size_t notints;
+                asmLoad(RSI, RBX, m_offstackidx);
+                asmLoadIndex(RAX, R15, RSI, -16);
+                asmLoadIndex(RCX, R15, RSI, -8);
+                /* both are integers iff their common bits still contain the whole tag */
+                asmMov(RDX, RAX);
+                asmAlu(ALU_AND, RDX, RCX);
+                asmMovImm(RDI, Value::NANBOX_INTTAG);
+                asmAlu(ALU_CMP, RDX, RDI);
+                notints = asmJccForward(CC_B);
+                return notints;
+            }
+
+            /*
+            * puts the payloads of the integers in rax and rcx into the upper 48 bits of rdx and rdi,
+            * so that the overflow flag of add/sub tells whether the result still fits, and comparisons still work.
+            */
+            void emitShiftedPayloads()
+            {
+                asmMov(RDX, RAX);
+                asmShiftImm(SHIFT_SHL, RDX, 16);
+                asmMov(RDI, RCX);
+                asmShiftImm(SHIFT_SHL, RDI, 16);
+            }
+
+            /*
+            * converts the number in $reg (an integer or a double) to a double in xmm$xmm, clobbering rdx and rdi.
+            * jumps to the returned position if it is not a number.
+            */
+            size_t emitDoubleOperand(int xmm, int reg)
+            {
+                size_t notint;
+                size_t notnum;
+                size_t done;
+                asmMovImm(RDX, Value::NANBOX_INTTAG);
+                asmAlu(ALU_CMP, reg, RDX);
+                notint = asmJccForward(CC_B);
+                emitUnboxInt(RDI, reg);
+                asmCvtsi2sd(xmm, RDI);
+                done = asmJmpForward();
+                asmBind(notint);
+                asmMovImm(RDX, Value::NANBOX_NUMBERTAG);
+                asmAlu(ALU_TEST, reg, RDX);
+                notnum = asmJccForward(CC_E);
+                asmMovImm(RDX, Value::NANBOX_DOUBLEOFFSET);
+                asmMov(RDI, reg);
+                asmAlu(ALU_SUB, RDI, RDX);
+                asmMovToXmm(xmm, RDI);
+                asmBind(done);
+                return notnum;
+            }
+
+            /* replaces the two topmost values with rax */
+            void emitReplaceTwo()
+            {
+                asmStoreIndex(R15, RSI, -16, RAX);
+                asmAluImm(ALUIMM_SUB, RSI, 1);
+                asmStore(RBX, m_offstackidx, RSI);
+            }
+
+            /*
+            * OPC_PRIMADD and friends; numbers inline, everything else through $slowfn (or the interpreter).
+            * integer add, subtract and multiply stay integers unless the result does not fit (or would be -0),
+            * in which case they are redone with doubles, just like SharedState::vmDoBinaryInts().
+            */
+            void emitArith(int op, int sseop, const void* slowfn, int ip, int nextip)
+            {
+                double nanval;
+                uint64_t nanbits;
+                size_t notints;
+                size_t overflow;
+                size_t iszero;
+                size_t notnum1;
+                size_t notnum2;
+                size_t isnum;
+                size_t intdone;
+                size_t done;
+                nanval = NAN;
+                memcpy(&nanbits, &nanval, sizeof(nanbits));
+                notints = emitIntOperands();
+                intdone = 0;
+                if(op != Instruction::OPC_PRIMDIVIDE)
+                {
+                    iszero = 0;
+                    emitShiftedPayloads();
+                    if(op == Instruction::OPC_PRIMADD)
+                    {
+                        asmAlu(ALU_ADD, RDX, RDI);
+                    }
+                    else if(op == Instruction::OPC_PRIMSUBTRACT)
+                    {
+                        asmAlu(ALU_SUB, RDX, RDI);
                     }
-                    if(!haveval)
+                    else
                     {
-                        klass = Class::make(name, m_classprimobject);
-                        pushme = Value::fromObject(klass);
-                    }
-                    vmStackPush(pushme);
+                        /* (a << 16) * b == (a * b) << 16 */
+                        asmShiftImm(SHIFT_SAR, RDI, 16);
+                        asmImul(RDX, RDI);
+                    }
+                    overflow = asmJccForward(CC_O);
+                    if(op == Instruction::OPC_PRIMMULTIPLY)
+                    {
+                        asmAlu(ALU_TEST, RDX, RDX);
+                        iszero = asmJccForward(CC_E);
+                    }
+                    asmShiftImm(SHIFT_SHR, RDX, 16);
+                    asmMovImm(RAX, Value::NANBOX_INTTAG);
+                    asmAlu(ALU_OR, RAX, RDX);
+                    emitReplaceTwo();
+                    intdone = asmJmpForward();
+                    asmBind(overflow);
+                    if(op == Instruction::OPC_PRIMMULTIPLY)
+                    {
+                        asmBind(iszero);
+                    }
+                }
+                asmBind(notints);
+                notnum1 = emitDoubleOperand(0, RAX);
+                notnum2 = emitDoubleOperand(1, RCX);
+                asmSse(sseop, 0, 1);
+                asmMovFromXmm(RAX, 0);
+                /* like Value::makeNumber, NaN is canonicalized first, keeping its sign */
+                asmUcomisd(0, 0);
+                isnum = asmJccForward(CC_NP);
+                asmMovImm(RDX, uint64_t(1) << 63);
+                asmAlu(ALU_AND, RAX, RDX);
+                asmMovImm(RDX, nanbits);
+                asmAlu(ALU_OR, RAX, RDX);
+                asmBind(isnum);
+                asmMovImm(RDX, Value::NANBOX_DOUBLEOFFSET);
+                asmAlu(ALU_ADD, RAX, RDX);
+                emitReplaceTwo();
+                done = asmJmpForward();
+                asmBind(notnum1);
+                asmBind(notnum2);
+                if(slowfn != nullptr)
+                {
+                    emitHelper(slowfn, op, ip + 1, nextip);
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_MAKEMETHOD)
+                else
                 {
-                    String* name;
-                    name = vmReadString();
-                    vmUtilDefineMethod(name);
+                    emitStep(op, ip, nextip);
+                }
+                asmBind(done);
+                if(op != Instruction::OPC_PRIMDIVIDE)
+                {
+                    asmBind(intdone);
+                }
+            }
+
+            /* OPC_PRIMLESSTHAN, OPC_PRIMGREATER and OPC_EQUAL */
+            void emitCompare(int op, const void* slowfn, int ip, int nextip)
+            {
+                size_t notints;
+                size_t notnum1;
+                size_t notnum2;
+                size_t intdone;
+                size_t done;
+                notints = emitIntOperands();
+                emitShiftedPayloads();
+                asmAlu(ALU_CMP, RDX, RDI);
+                if(op == Instruction::OPC_EQUAL)
+                {
+                    asmSetEax(CC_E);
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_CLASSPROPERTYDEFINE)
+                else if(op == Instruction::OPC_PRIMLESSTHAN)
                 {
-                    int isstatic;
-                    String* name;
-                    name = vmReadString();
-                    isstatic = vmReadByte();
-                    vmUtilDefineProperty(name, isstatic == 1);
+                    asmSetEax(CC_L);
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_CLASSINHERIT)
+                else
                 {
-                    Value vclass;
-                    Value vsuper;
-                    Class* superclass;
-                    Class* subclass;
-                    vsuper = vmStackPeek(1);
-                    if(!vsuper.isClass())
-                    {
-                        VMMAC_TRYRAISE(Status::RuntimeFail, "cannot inherit from non-class object");
-                        VMMAC_DISPATCH();
-                    }
-                    vclass = vmStackPeek(0);
-                    superclass = vsuper.asClass();
-                    subclass = vclass.asClass();
-                    subclass->inheritFrom(superclass);
-                    /* pop the subclass */
-                    vmStackPop();
+                    asmSetEax(CC_G);
+                }
+                asmAluImm(ALUIMM_OR, RAX, (int32_t)Value::NANBOX_VALFALSE);
+                emitReplaceTwo();
+                intdone = asmJmpForward();
+                asmBind(notints);
+                notnum1 = emitDoubleOperand(0, RAX);
+                notnum2 = emitDoubleOperand(1, RCX);
+                if(op == Instruction::OPC_EQUAL)
+                {
+                    /* equal, and not unordered: sete al; setnp cl; and al, cl */
+                    asmUcomisd(0, 1);
+                    emitByte(0x0F);
+                    emitByte(0x94);
+                    emitByte(0xC0);
+                    emitByte(0x0F);
+                    emitByte(0x9B);
+                    emitByte(0xC1);
+                    emitByte(0x20);
+                    emitByte(0xC8);
+                    emitByte(0x0F);
+                    emitByte(0xB6);
+                    emitByte(0xC0);
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_CLASSGETSUPER)
+                else
                 {
-                    Value vclass;
-                    Class* klass;
-                    String* name;
-                    name = vmReadString();
-                    vclass = vmStackPeek(0);
-                    klass = vclass.asClass();
-                    if(!vmUtilBindMethod(klass->m_superclass, name))
+                    /* 'above' is false for unordered operands, like the C comparison */
+                    if(op == Instruction::OPC_PRIMLESSTHAN)
                     {
-                        VMMAC_TRYRAISE(Status::RuntimeFail, "class '%s' does not have a function '%s'", klass->m_classname->data(), name->data());
+                        asmUcomisd(1, 0);
                     }
-                }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_CLASSINVOKESUPER)
-                {
-                    size_t argcount;
-                    Value vclass;
-                    Class* klass;
-                    String* method;
-                    method = vmReadString();
-                    argcount = vmReadByte();
-                    vclass = vmStackPop();
-                    klass = vclass.asClass();
-                    if(!vmUtilInvokeMethodFromClass(klass, method, argcount))
+                    else
                     {
-                        VMMAC_EXITVM();
+                        asmUcomisd(0, 1);
                     }
-                    m_vmstate.currentframe = &m_vmstate.framevalues[m_vmstate.framecount - 1];
+                    asmSetEax(CC_A);
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_CLASSINVOKESUPERSELF)
+                asmAluImm(ALUIMM_OR, RAX, (int32_t)Value::NANBOX_VALFALSE);
+                emitReplaceTwo();
+                done = asmJmpForward();
+                asmBind(notnum1);
+                asmBind(notnum2);
+                if(slowfn != nullptr)
                 {
-                    size_t argcount;
-                    Value vclass;
-                    Class* klass;
-                    argcount = vmReadByte();
-                    vclass = vmStackPop();
-                    klass = vclass.asClass();
-                    if(!vmUtilInvokeMethodFromClass(klass, m_defaultstrings.nmconstructor, argcount))
-                    {
-                        VMMAC_EXITVM();
-                    }
-                    m_vmstate.currentframe = &m_vmstate.framevalues[m_vmstate.framecount - 1];
+                    emitHelper(slowfn, op, ip + 1, nextip);
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_MAKEARRAY)
+                else
                 {
-                    if(!vmDoMakeArray())
-                    {
-                        VMMAC_EXITVM();
-                    }
+                    emitStep(op, ip, nextip);
                 }
-                VMMAC_DISPATCH();
+                asmBind(done);
+                asmBind(intdone);
+            }
 
-                VM_CASE(OPC_MAKERANGE)
+            /*
+            * OPC_PRIMAND, OPC_PRIMOR, OPC_PRIMBITXOR and the shifts, for two integers; anything else goes to the interpreter.
+            * and/or work on the tagged values as they are, since both carry the whole tag. the shifts work on the low
+            * 32 bits (and shift by cl & 31), so their uint32_t result always fits.
+            */
+            void emitBitwise(int op, int ip, int nextip)
+            {
+                size_t notints;
+                size_t done;
+                notints = emitIntOperands();
+                if(op == Instruction::OPC_PRIMAND)
                 {
-                    double lower;
-                    double upper;
-                    Value vupper;
-                    Value vlower;
-                    vupper = vmStackPeek(0);
-                    vlower = vmStackPeek(1);
-                    if(!vupper.isNumber() || !vlower.isNumber())
-                    {
-                        VMMAC_TRYRAISE(Status::RuntimeFail, "invalid range boundaries");
-                        VMMAC_DISPATCH();
-                    }
-                    lower = vlower.asNumber();
-                    upper = vupper.asNumber();
-                    vmStackPop(2);
-                    vmStackPush(Value::fromObject(Range::make(lower, upper)));
+                    asmAlu(ALU_AND, RAX, RCX);
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_MAKEDICT)
+                else if(op == Instruction::OPC_PRIMOR)
                 {
-                    if(!vmDoMakeDict())
+                    asmAlu(ALU_OR, RAX, RCX);
+                }
+                else
+                {
+                    if(op == Instruction::OPC_PRIMBITXOR)
                     {
-                        VMMAC_EXITVM();
+                        asmAlu(ALU_XOR, RAX, RCX);
+                    }
+                    else
+                    {
+                        /* mov eax, eax clears the tag; shl/shr eax, cl */
+                        emitByte(0x89);
+                        emitByte(0xC0);
+                        emitByte(0xD3);
+                        emitModReg((op == Instruction::OPC_PRIMSHIFTLEFT) ? SHIFT_SHL : SHIFT_SHR, RAX);
                     }
+                    asmMovImm(RDX, Value::NANBOX_INTTAG);
+                    asmAlu(ALU_OR, RAX, RDX);
+                }
+                emitReplaceTwo();
+                done = asmJmpForward();
+                asmBind(notints);
+                emitStep(op, ip, nextip);
+                asmBind(done);
+            }
+
+            void emitPushValue(Value val)
+            {
+                emitEnsureStack();
+                asmMovImm(RDX, val.m_valbits);
+                emitPushRdx();
+            }
+
+            void emitJumpIfFalse(int target)
+            {
+                size_t istrue;
+                asmLoad(RCX, RBX, m_offstackidx);
+                asmLoadIndex(RAX, R15, RCX, -8);
+                asmAluImm(ALUIMM_CMP, RAX, (int32_t)Value::NANBOX_VALFALSE);
+                asmJccTo(CC_E, target);
+                asmAluImm(ALUIMM_CMP, RAX, (int32_t)Value::NANBOX_VALNULL);
+                asmJccTo(CC_E, target);
+                asmAluImm(ALUIMM_CMP, RAX, (int32_t)Value::NANBOX_VALTRUE);
+                istrue = asmJccForward(CC_E);
+                asmMov(RDI, RAX);
+                asmCall((const void*)&helperIsFalse);
+                asmTestEax();
+                asmJccTo(CC_NE, target);
+                asmBind(istrue);
+            }
+
+            void emitInstruction(int op, int ip, int nextip)
+            {
+                uint16_t operand;
+                operand = 0;
+                if((nextip - ip) >= 3)
+                {
+                    operand = (m_code[ip + 1] << 8) | m_code[ip + 2];
+                }
+                switch(op)
+                {
+                    case Instruction::OPC_LOCALGET:
+                    case Instruction::OPC_FUNCARGGET:
+                        {
+                            emitEnsureStack();
+                            asmLoad(RDX, R13, operand * sizeof(Value));
+                            emitPushRdx();
+                        }
+                        break;
+                    case Instruction::OPC_LOCALSET:
+                    case Instruction::OPC_FUNCARGSET:
+                        {
+                            asmLoad(RCX, RBX, m_offstackidx);
+                            asmLoadIndex(RDX, R15, RCX, -8);
+                            asmStore(R13, operand * sizeof(Value), RDX);
+                        }
+                        break;
+                    case Instruction::OPC_PUSHCONSTANT:
+                        {
+                            emitPushValue(m_blob->m_constants.get(operand));
+                        }
+                        break;
+                    case Instruction::OPC_PUSHNULL:
+                    case Instruction::OPC_PUSHEMPTY:
+                        {
+                            emitPushValue(Value::makeNull());
+                        }
+                        break;
+                    case Instruction::OPC_PUSHTRUE:
+                        {
+                            emitPushValue(Value::makeBool(true));
+                        }
+                        break;
+                    case Instruction::OPC_PUSHFALSE:
+                        {
+                            emitPushValue(Value::makeBool(false));
+                        }
+                        break;
+                    case Instruction::OPC_PUSHONE:
+                        {
+                            emitPushValue(Value::makeInt(1));
+                        }
+                        break;
+                    case Instruction::OPC_POPONE:
+                        {
+                            asmAluMemImm(ALUIMM_SUB, RBX, m_offstackidx, 1);
+                        }
+                        break;
+                    case Instruction::OPC_POPN:
+                        {
+                            asmAluMemImm(ALUIMM_SUB, RBX, m_offstackidx, operand);
+                        }
+                        break;
+                    case Instruction::OPC_DUPONE:
+                        {
+                            emitEnsureStack();
+                            asmLoad(RCX, RBX, m_offstackidx);
+                            asmLoadIndex(RDX, R15, RCX, -8);
+                            emitPushRdx();
+                        }
+                        break;
+                    case Instruction::OPC_JUMPNOW:
+                        {
+                            asmJmpTo(nextip + operand);
+                        }
+                        break;
+                    case Instruction::OPC_LOOP:
+                        {
+                            emitHeapCheck(op, ip);
+                            asmJmpTo(nextip - operand);
+                        }
+                        break;
+                    case Instruction::OPC_JUMPIFFALSE:
+                        {
+                            emitJumpIfFalse(nextip + operand);
+                        }
+                        break;
+                    case Instruction::OPC_PRIMADD:
+                        {
+                            emitArith(op, SSE_ADDSD, (const void*)&helperAdd, ip, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_PRIMSUBTRACT:
+                        {
+                            emitArith(op, SSE_SUBSD, nullptr, ip, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_PRIMMULTIPLY:
+                        {
+                            emitArith(op, SSE_MULSD, nullptr, ip, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_PRIMDIVIDE:
+                        {
+                            emitArith(op, SSE_DIVSD, nullptr, ip, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_PRIMLESSTHAN:
+                    case Instruction::OPC_PRIMGREATER:
+                        {
+                            emitCompare(op, nullptr, ip, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_PRIMAND:
+                    case Instruction::OPC_PRIMOR:
+                    case Instruction::OPC_PRIMBITXOR:
+                    case Instruction::OPC_PRIMSHIFTLEFT:
+                    case Instruction::OPC_PRIMSHIFTRIGHT:
+                        {
+                            emitBitwise(op, ip, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_EQUAL:
+                        {
+                            emitCompare(op, (const void*)&helperEqual, ip, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_GLOBALDEFINE:
+                        {
+                            emitHelper((const void*)&helperDo<&SharedState::vmDoGlobalDefine>, op, ip + 1, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_GLOBALGET:
+                        {
+                            emitHelper((const void*)&helperDo<&SharedState::vmDoGlobalGet>, op, ip + 1, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_GLOBALSET:
+                        {
+                            emitHelper((const void*)&helperDo<&SharedState::vmDoGlobalSet>, op, ip + 1, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_FUNCARGOPTIONAL:
+                        {
+                            emitHelper((const void*)&helperDo<&SharedState::vmDoFuncArgOptional>, op, ip + 1, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_PROPERTYGET:
+                        {
+                            emitHelper((const void*)&helperDo<&SharedState::vmDoPropertyGetNormal>, op, ip + 1, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_PROPERTYGETSELF:
+                        {
+                            emitHelper((const void*)&helperDo<&SharedState::vmDoPropertyGetSelf>, op, ip + 1, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_PROPERTYSET:
+                        {
+                            emitHelper((const void*)&helperDo<&SharedState::vmDoPropertySet>, op, ip + 1, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_MAKEARRAY:
+                        {
+                            emitHelper((const void*)&helperDo<&SharedState::vmDoMakeArray>, op, ip + 1, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_MAKEDICT:
+                        {
+                            emitHelper((const void*)&helperDo<&SharedState::vmDoMakeDict>, op, ip + 1, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_MAKECLOSURE:
+                        {
+                            emitHelper((const void*)&helperDo<&SharedState::vmDoMakeClosure>, op, ip + 1, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_INDEXGET:
+                        {
+                            emitHelper((const void*)&helperDo<&SharedState::vmDoIndexGet>, op, ip + 1, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_INDEXSET:
+                        {
+                            emitHelper((const void*)&helperDo<&SharedState::vmDoIndexSet>, op, ip + 1, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_CALLFUNCTION:
+                        {
+                            emitHelper((const void*)&helperCallFunction, op, ip + 1, nextip);
+                            emitHeapCheck(op, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_CALLMETHOD:
+                        {
+                            emitHelper((const void*)&helperCallMethod, op, ip + 1, nextip);
+                            emitHeapCheck(op, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_CLASSINVOKETHIS:
+                        {
+                            emitHelper((const void*)&helperInvokeThis, op, ip + 1, nextip);
+                            emitHeapCheck(op, nextip);
+                        }
+                        break;
+                    case Instruction::OPC_RETURN:
+                    case Instruction::OPC_HALT:
+                        {
+                            emitExitAt(ip);
+                        }
+                        break;
+                    default:
+                        {
+                            emitStep(op, ip, nextip);
+                        }
+                        break;
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_INDEXGETRANGED)
-                {
-                    if(!vmDoGetRangedIndex())
+            }
+
+            JitCode* run()
+            {
+                int ip;
+                int op;
+                int count;
+                int nextip;
+                size_t i;
+                size_t mapsize;
+                size_t pagesize;
+                int32_t rel;
+                int32_t dest;
+                int32_t stubs[3];
+                size_t toepilogue[2];
+                uint8_t* mem;
+                JitCode* jc;
+                count = m_blob->m_count;
+                m_nativeoffsets = (int32_t*)Memory::sysMalloc(sizeof(int32_t) * (count + 1));
+                for(ip = 0; ip <= count; ip++)
+                {
+                    m_nativeoffsets[ip] = -1;
+                }
+                /* the entry: fn(gcs, address) */
+                asmPush(RBX);
+                asmPush(R12);
+                asmPush(R13);
+                asmPush(R14);
+                asmPush(R15);
+                asmMov(RBX, RDI);
+                asmLoad(R14, RBX, m_offframecount);
+                emitReloadState();
+                /* jmp rsi */
+                emitByte(0xFF);
+                emitByte(0xE6);
+                ip = 0;
+                while(ip < count)
+                {
+                    op = m_code[ip];
+                    if(!isCompilable(op))
                     {
-                        VMMAC_EXITVM();
+                        return nullptr;
                     }
-                }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_INDEXGET)
-                {
-                    if(!vmDoIndexGet())
+                    nextip = ip + 1 + AstParser::getcodeargscount(m_code, m_blob->m_constants.data(), ip);
+                    if(nextip > count)
                     {
-                        VMMAC_EXITVM();
+                        return nullptr;
                     }
-                }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_INDEXSET)
-                {
-                    if(!vmDoIndexSet())
-                    {
-                        VMMAC_EXITVM();
+                    m_nativeoffsets[ip] = m_buf.count();
+                    emitInstruction(baseOpcode(op), ip, nextip);
+                    ip = nextip;
+                }
+                /* compiled code always ends in OPC_RETURN, so this is never reached; but do not run off the end */
+                emitExitAt(count);
+                /* the exits, in the order of LABEL_*; eax is what JitCode::enter returns */
+                stubs[0] = m_buf.count();
+                asmMovEax(JitCode::EXIT_INTERPRET);
+                toepilogue[0] = asmJmpForward();
+                stubs[1] = m_buf.count();
+                asmMovEax(JitCode::EXIT_FAILED);
+                toepilogue[1] = asmJmpForward();
+                stubs[2] = m_buf.count();
+                asmMovEax(JitCode::EXIT_FRAMECHANGED);
+                asmBind(toepilogue[0]);
+                asmBind(toepilogue[1]);
+                asmPop(R15);
+                asmPop(R14);
+                asmPop(R13);
+                asmPop(R12);
+                asmPop(RBX);
+                emitByte(0xC3);
+                for(i = 0; i < m_fixups.count(); i++)
+                {
+                    auto fx = m_fixups.get(i);
+                    if(fx.target < 0)
+                    {
+                        dest = stubs[(-fx.target) - 1];
                     }
-                }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_TYPEOF)
-                {
-                    Value res;
-                    Value thing;
-                    const char* result;
-                    thing = vmStackPop();
-                    result = Value::typeName(thing, false);
-                    res = Value::fromObject(String::copy(result));
-                    vmStackPush(res);
-                }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_ASSERT)
-                {
-                    Value message;
-                    Value expression;
-                    message = vmStackPop();
-                    expression = vmStackPop();
-                    if(expression.isFalse())
+                    else
                     {
-                        if(!message.isNull())
+                        if(fx.target > count)
                         {
-                            NEON_THROWCLASSWITHSOURCEINFO(m_exceptions.asserterror, Value::toString(message)->data());
+                            return nullptr;
                         }
-                        else
+                        dest = m_nativeoffsets[fx.target];
+                        if(dest < 0)
                         {
-                            NEON_THROWCLASSWITHSOURCEINFO(m_exceptions.asserterror, "assertion failed");
+                            return nullptr;
                         }
                     }
+                    rel = dest - (int32_t)(fx.at + 4);
+                    memcpy(m_buf.data() + fx.at, &rel, sizeof(rel));
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_EXTHROW)
+                pagesize = (size_t)sysconf(_SC_PAGESIZE);
+                mapsize = ((m_buf.count() + pagesize - 1) / pagesize) * pagesize;
+                mem = (uint8_t*)mmap(nullptr, mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if(mem == MAP_FAILED)
                 {
-                    bool isok;
-                    Value peeked;
-                    Value stacktrace;
-                    Instance* instance;
-                    peeked = vmStackPeek(0);
-                    isok = (peeked.isInstance() || Class::isInstanceOf(peeked.asInstance()->m_instanceclass, m_exceptions.stdexception));
-                    if(!isok)
-                    {
-                        VMMAC_TRYRAISE(Status::RuntimeFail, "instance of Exception expected");
-                        VMMAC_DISPATCH();
-                    }
-                    stacktrace = vmExceptionGetStackTrace();
-                    instance = peeked.asInstance();
-                    instance->defProperty(String::intern("stacktrace"), stacktrace);
-                    if(vmExceptionPropagate())
-                    {
-                        m_vmstate.currentframe = &m_vmstate.framevalues[m_vmstate.framecount - 1];
-                        VMMAC_DISPATCH();
-                    }
-                    VMMAC_EXITVM();
+                    return nullptr;
                 }
-                VM_CASE(OPC_EXTRY)
+                memcpy(mem, m_buf.data(), m_buf.count());
+                if(mprotect(mem, mapsize, PROT_READ | PROT_EXEC) != 0)
                 {
-                    bool haveclass;
-                    uint16_t addr;
-                    uint16_t finaddr;
-                    Value value;
-                    String* type;
-                    Class* exclass;
-                    haveclass = false;
-                    exclass = nullptr;
-                    type = vmReadString();
-                    addr = vmReadShort();
-                    finaddr = vmReadShort();
-                    if(addr != 0)
-                    {
-                        value = Value::makeNull();
-                        if(!m_declaredglobals.get(Value::fromObject(type), &value))
-                        {
-                            if(value.isClass())
-                            {
-                                haveclass = true;
-                                exclass = value.asClass();
-                            }
-                        }
-                        if(!haveclass)
-                        {
-                            /*
-                            if(!m_vmstate.currentframe->closure->m_fnvals.fnclosure.scriptfunc->m_fnvals.fnscriptfunc.module->m_deftable.get(Value::fromObject(type), &value) || !value.isClass())
-                            {
-                                VMMAC_TRYRAISE(Status::RuntimeFail, "object of type '%s' is not an exception", type->data());
-                                VMMAC_DISPATCH();
-                            }
-                            */
-                            exclass = m_exceptions.stdexception;
-                        }
-                        vmExceptionPushHandler(exclass, addr, finaddr);
-                    }
-                    else
-                    {
-                        vmExceptionPushHandler(nullptr, addr, finaddr);
-                    }
+                    munmap(mem, mapsize);
+                    return nullptr;
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_EXPOPTRY)
+                jc = (JitCode*)Memory::sysMalloc(sizeof(JitCode));
+                jc->m_code = mem;
+                jc->m_mapsize = mapsize;
+                jc->m_entrycount = count;
+                jc->m_entries = m_nativeoffsets;
+                /* now owned by jc */
+                m_nativeoffsets = nullptr;
+                return jc;
+            }
+    };
+
+    bool SharedState::vmJitMaybeRun(int64_t weight)
+    {
+        int status;
+        void* address;
+        Blob* blob;
+        CallFrame* frame;
+        while(true)
+        {
+            frame = m_vmstate.currentframe;
+            blob = frame->closure->m_fnvals.fnclosure.scriptfunc->m_fnvals.fnscriptfunc.blob;
+            if(blob->m_jitcode == nullptr)
+            {
+                if(blob->m_jitfailed)
                 {
-                    m_vmstate.currentframe->m_handlercount--;
+                    return true;
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_EXPUBLISHTRY)
+                blob->m_jithotness += weight;
+                if(blob->m_jithotness < m_conf.jitthreshold)
                 {
-                    m_vmstate.currentframe->m_handlercount--;
-                    if(vmExceptionPropagate())
-                    {
-                        m_vmstate.currentframe = &m_vmstate.framevalues[m_vmstate.framecount - 1];
-                        VMMAC_DISPATCH();
-                    }
-                    VMMAC_EXITVM();
+                    return true;
                 }
-                VMMAC_DISPATCH();
-                VM_CASE(OPC_SWITCH)
+                blob->m_jitcode = JitCompiler::compile(this, blob);
+                if(blob->m_jitcode == nullptr)
                 {
-                    Value expr;
-                    Value value;
-                    Switch* sw;
-                    sw = vmReadConst().asSwitch();
-                    expr = vmStackPeek(0);
-                    if(sw->m_table.get(expr, &value))
-                    {
-                        m_vmstate.currentframe->inscode += (int)value.asNumber();
-                    }
-                    else if(sw->m_defaultjump != -1)
-                    {
-                        m_vmstate.currentframe->inscode += sw->m_defaultjump;
-                    }
-                    else
-                    {
-                        m_vmstate.currentframe->inscode += sw->m_exitjump;
-                    }
-                    vmStackPop();
+                    blob->m_jitfailed = true;
+                    return true;
                 }
-                VMMAC_DISPATCH();
-    #if 0
-                default:
-                    {
-                        fprintf(stderr, "UNHANDLED OPCODE %d\n", currinstr.code);
-                    }
-                    break;
-    #endif
             }
+            address = blob->m_jitcode->entryFor(blob->codeOffset(frame->inscode));
+            if(address == nullptr)
+            {
+                return true;
+            }
+            status = blob->m_jitcode->enter(this, address);
+            if(status == JitCode::EXIT_FAILED)
+            {
+                return false;
+            }
+            /* same as VMMAC_SYNCFRAME */
+            if(m_vmstate.framecount == 0)
+            {
+                return false;
+            }
+            m_vmstate.currentframe = &m_vmstate.framevalues[m_vmstate.framecount - 1];
+            if(status != JitCode::EXIT_FRAMECHANGED)
+            {
+                return true;
+            }
+            /* a call was made from native code; the callee may be hot, or compiled, itself */
+            weight = 1;
         }
-    finished:
-        return Status::Ok;
+        return true;
     }
+#endif
 
     void buildProcessInfo()
     {
@@ -22493,8 +30515,13 @@ namespace neon
             gcs->m_conf.enablewarnings = false;
             gcs->m_conf.dumpbytecode = false;
             gcs->m_conf.exitafterbytecode = false;
+            gcs->m_conf.dumpquickened = false;
             gcs->m_conf.showfullstack = false;
             gcs->m_conf.enableapidebug = false;
+            gcs->m_conf.useregistervm = false;
+            gcs->m_conf.usejit = false;
+            gcs->m_conf.jitthreshold = SharedState::CONF_DEFAULTJITTHRESHOLD;
+            gcs->m_conf.printgcstats = false;
             gcs->m_conf.maxsyntaxerrors = SharedState::CONF_MAXSYNTAXERRORS;
         }
         /*
@@ -22576,6 +30603,7 @@ namespace neon
             gcs->m_exceptions.argumenterror = Class::makeExceptionClass(gcs->m_classprimobject, nullptr, String::intern("ArgumentError"));
             gcs->m_exceptions.regexerror = Class::makeExceptionClass(gcs->m_classprimobject, nullptr, String::intern("RegexError"));
             gcs->m_exceptions.importerror = Class::makeExceptionClass(gcs->m_classprimobject, nullptr, String::intern("ImportError"));
+            gcs->m_exceptions.memoryerror = Class::makeExceptionClass(gcs->m_classprimobject, nullptr, String::intern("MemoryError"));
         }
         /* all the other bits .... */
         buildProcessInfo();
@@ -22602,6 +30630,14 @@ namespace neon
     void destroyState()
     {
         auto gcs = SharedState::get();
+        if(gcs->m_gcstate.pausebudget > 0)
+        {
+            gcs->gcPrintPauses(stderr);
+        }
+        if(gcs->m_conf.printgcstats)
+        {
+            gcs->gcPrintStats(stderr);
+        }
         destrdebug("destroying m_importpath...");
         gcs->m_importpath.deInit();
         destrdebug("destroying linked objects...");
@@ -22642,18 +30678,16 @@ namespace neon
             Blob::destroy(&blob);
             return nullptr;
         }
-        if(!fromeval)
-        {
-            vmStackPush(Value::fromObject(function));
-        }
-        else
+        vmStackPush(Value::fromObject(function));
+        if(fromeval)
         {
             function->m_funcname = String::intern("(evaledcode)");
+            SharedState::gcWriteBarrier(function, function->m_funcname);
         }
         closure = Function::makeFuncClosure(function, Value::makeNull());
+        vmStackPop();
         if(!fromeval)
         {
-            vmStackPop();
             vmStackPush(Value::fromObject(closure));
         }
         Blob::destroy(&blob);
@@ -22669,6 +30703,7 @@ namespace neon
         updateProcessInfo();
         rp = (char*)filename;
         m_topmodule->m_physicalpath = String::copy(rp);
+        SharedState::gcWriteBarrier(m_topmodule, m_topmodule->m_physicalpath);
         module->setInternFileField();
         closure = compileSourceToFunction(module, false, source, true);
         if(closure == nullptr)
@@ -22688,6 +30723,14 @@ namespace neon
             return Status::RuntimeFail;
         }
         status = runVM(0, dest);
+        if(m_conf.dumpquickened)
+        {
+            Debug dbg(m_debugwriter);
+            /* printing values may allocate */
+            vmStackPush(Value::fromObject(closure));
+            dbg.disasmFunctionTree(closure->m_fnvals.fnclosure.scriptfunc);
+            vmStackPop();
+        }
         fprintf(stderr, "m_vmstate.m_unhandledexceptionstate=%d\n", m_vmstate.m_unhandledexceptionstate);
         if(m_vmstate.m_unhandledexceptionstate)
         {
@@ -23058,6 +31101,32 @@ struct ConsoleProg
         fprintUsageFlags(out, flags);
     }
 
+    /* "64m" and the like; k, m and g multiply by 1024, 1024^2 and 1024^3 */
+    static int64_t parseByteSize(const char* str)
+    {
+        char* end;
+        int64_t val;
+        val = strtoll(str, &end, 10);
+        switch(*end)
+        {
+            case 'k':
+            case 'K':
+                val *= 1024;
+                break;
+            case 'm':
+            case 'M':
+                val *= (1024 * 1024);
+                break;
+            case 'g':
+            case 'G':
+                val *= (1024 * 1024 * 1024);
+                break;
+            default:
+                break;
+        }
+        return val;
+    }
+
     static int actualMain(int argc, char* argv[], char** envp)
     {
         int i;
@@ -23083,6 +31152,17 @@ struct ConsoleProg
             { "types", 't', OPTPARSE_NONE, "print sizeof() of types" },
             { "apidebug", 'a', OPTPARSE_NONE, "print calls to API (very verbose, very slow)" },
             { "gcstart", 'g', OPTPARSE_REQUIRED, "set minimum bytes at which the GC should kick in. 0 disables GC" },
+            { "gc-nursery", 'N', OPTPARSE_REQUIRED, "set bytes of new objects after which young objects are collected. 0 disables minor collections" },
+            { "gc-pause-us", 'P', OPTPARSE_REQUIRED, "collect incrementally, in slices of at most this many microseconds. prints a histogram of GC pauses at exit" },
+            { "gc-stats", 'S', OPTPARSE_NONE, "print GC statistics at exit" },
+            { "gc-mark-threads", 'M', OPTPARSE_REQUIRED, "set the number of threads that trace large heaps in a full collection. 1 traces on the main thread only" },
+            { "max-heap", 'H', OPTPARSE_REQUIRED, "raise MemoryError once the heap grows beyond this many bytes; accepts k, m and g suffixes. 0 means no limit" },
+            { "gc-cpu-target", 'C', OPTPARSE_REQUIRED, "adapt how much the heap grows between collections, so that the GC takes about this percentage of the run time. 0 keeps the growth factor fixed" },
+            { "regvm", 'r', OPTPARSE_NONE, "lower bytecode to register instructions where possible" },
+            { "dump-quickened", 'Q', OPTPARSE_NONE, "after running, print every function, including superinstructions and quickened instructions" },
+            { "jit", 'J', OPTPARSE_NONE, "compile hot functions to native code (x86-64 linux only)" },
+            { "jit-threshold", 'T', OPTPARSE_REQUIRED, "with --jit, compile a function once its calls plus loop iterations reach this number. 0 compiles every function when first run" },
+            { "search-kernel", 'K', OPTPARSE_REQUIRED, "use this kernel to find substrings: auto, avx2, sse2 or scalar. auto uses memchr on an uncommon byte of the needle, else the fastest vector kernel the CPU has; the others are for benchmarking" },
             { 0, 0, (optargtype_t)0, nullptr }
         };
     #if defined(NEON_PLAT_ISWINDOWS) || defined(_MSC_VER)
@@ -23115,6 +31195,30 @@ struct ConsoleProg
             {
                 nextgcstart = atol(options.optarg);
             }
+            else if(co == 'N')
+            {
+                gcs->m_gcstate.nurserysize = atol(options.optarg);
+            }
+            else if(co == 'P')
+            {
+                gcs->m_gcstate.pausebudget = atol(options.optarg);
+            }
+            else if(co == 'S')
+            {
+                gcs->m_conf.printgcstats = true;
+            }
+            else if(co == 'M')
+            {
+                gcs->gcSetMarkThreads(atoi(options.optarg));
+            }
+            else if(co == 'H')
+            {
+                gcs->m_conf.maxheap = parseByteSize(options.optarg);
+            }
+            else if(co == 'C')
+            {
+                gcs->m_gcstate.cputarget = std::min(std::max(atof(options.optarg) / 100.0, 0.0), 1.0);
+            }
             else if(co == 'h')
             {
                 fprintUsageText(argv, longopts, false);
@@ -23133,6 +31237,33 @@ struct ConsoleProg
             {
                 gcs->m_conf.enableapidebug = true;
             }
+            else if(co == 'r')
+            {
+                gcs->m_conf.useregistervm = true;
+            }
+            else if(co == 'Q')
+            {
+                gcs->m_conf.dumpquickened = true;
+            }
+            else if(co == 'J')
+            {
+            #if defined(NEON_CONFIG_USEJIT) && (NEON_CONFIG_USEJIT == 1)
+                gcs->m_conf.usejit = true;
+            #else
+                fprintf(stderr, "%s: --jit is not supported by this build\n", argv[0]);
+            #endif
+            }
+            else if(co == 'T')
+            {
+                gcs->m_conf.jitthreshold = atol(options.optarg);
+            }
+            else if(co == 'K')
+            {
+                if(!neon::Util::setSearchKernel(options.optarg))
+                {
+                    fprintf(stderr, "%s: search kernel '%s' is not available; this build and CPU have: %s\n", argv[0], options.optarg, neon::Util::searchKernelNames());
+                }
+            }
             else if(co == 's')
             {
                 gcs->m_conf.enablestrictmode = true;
@@ -23154,6 +31285,11 @@ struct ConsoleProg
         {
             goto cleanup;
         }
+        if(gcs->m_conf.shoulddumpstack)
+        {
+            /* native code does not go through the dumping code of runVM */
+            gcs->m_conf.usejit = false;
+        }
         parseEnv(envp);
         while(true)
         {
@@ -23174,6 +31310,7 @@ struct ConsoleProg
             gcs->m_declaredglobals.set(neon::Value::fromObject(neon::String::intern("ARGV")), neon::Value::fromObject(gcs->m_processinfo->cliargv));
         }
         gcs->m_gcstate.nextgc = nextgcstart;
+        gcs->gcSetSoftLimit();
         if(evalmesrc != nullptr)
         {
             ok = runCode(evalmesrc);
@@ -0,0 +1,432 @@
+/*
+* reads a heap snapshot, as written by gc.dumpHeap(), and prints which objects keep the most memory alive.
+*
+* the retained size of an object is the memory that would be freed if nothing referred to it anymore:
+* its own size, plus the retained sizes of the objects it dominates (those that are only reachable
+* through it). dominators are computed with the iterative algorithm of Cooper, Harvey and Kennedy
+* ("A Simple, Fast Dominance Algorithm"), over a graph with one synthetic node that refers to every root.
+*
+* build: make heapanalyze
+* usage: heapanalyze [-n count] <snapshotfile>
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+
+namespace heapanalyze
+{
+    /* must match Object::Type in main.cpp */
+    static const char* typeName(int type)
+    {
+        static const char* names[] =
+        {
+            "invalid", "string", "range", "array", "dict", "file", "upvalue", "funcbound",
+            "funcclosure", "funcscript", "instance", "funcnative", "class", "module", "switch", "userdata",
+        };
+        if((type < 0) || (type >= (int)(sizeof(names) / sizeof(names[0]))))
+        {
+            return "unknown";
+        }
+        return names[type];
+    }
+
+    struct Node
+    {
+        uint64_t address;
+        int type;
+        uint64_t size;
+        uint64_t retained;
+        std::string name;
+        std::string preview;
+        std::vector<uint64_t> refaddrs;
+        std::vector<size_t> succs;
+        std::vector<size_t> preds;
+        /* position in reverse postorder, or -1 when unreachable */
+        long rpo;
+        size_t idom;
+    };
+
+    class Reader
+    {
+        public:
+            FILE* m_handle;
+            bool m_failed;
+
+        public:
+            Reader(FILE* fh): m_handle(fh), m_failed(false)
+            {
+            }
+
+            template<typename IntT>
+            IntT getInt()
+            {
+                IntT val;
+                val = 0;
+                if(fread(&val, sizeof(IntT), 1, m_handle) != 1)
+                {
+                    m_failed = true;
+                }
+                return val;
+            }
+
+            std::string getString()
+            {
+                uint16_t len;
+                std::string str;
+                len = getInt<uint16_t>();
+                str.resize(len);
+                if((len > 0) && (fread(&str[0], 1, len, m_handle) != len))
+                {
+                    m_failed = true;
+                }
+                return str;
+            }
+    };
+
+    class Snapshot
+    {
+        public:
+            /* nodes[0] is the synthetic root */
+            std::vector<Node> m_nodes;
+            std::vector<size_t> m_order;
+            size_t m_rootcount;
+            size_t m_unreachable;
+
+        private:
+            /* walks the dominator tree upwards from both nodes until they meet */
+            size_t intersect(size_t a, size_t b) const
+            {
+                while(a != b)
+                {
+                    while(m_nodes[a].rpo > m_nodes[b].rpo)
+                    {
+                        a = m_nodes[a].idom;
+                    }
+                    while(m_nodes[b].rpo > m_nodes[a].rpo)
+                    {
+                        b = m_nodes[b].idom;
+                    }
+                }
+                return a;
+            }
+
+        public:
+            bool load(const char* path)
+            {
+                size_t i;
+                size_t j;
+                uint32_t version;
+                uint64_t count;
+                uint64_t nroots;
+                uint32_t nrefs;
+                char magic[8];
+                FILE* fh;
+                std::vector<uint64_t> roots;
+                std::unordered_map<uint64_t, size_t> byaddress;
+                fh = fopen(path, "rb");
+                if(fh == nullptr)
+                {
+                    fprintf(stderr, "heapanalyze: cannot open '%s': %s\n", path, strerror(errno));
+                    return false;
+                }
+                Reader rd(fh);
+                if((fread(magic, 1, 8, fh) != 8) || (memcmp(magic, "NEONHEAP", 8) != 0))
+                {
+                    fprintf(stderr, "heapanalyze: '%s' is not a heap snapshot\n", path);
+                    fclose(fh);
+                    return false;
+                }
+                version = rd.getInt<uint32_t>();
+                if(version != 1)
+                {
+                    fprintf(stderr, "heapanalyze: '%s' has unsupported version %u\n", path, (unsigned)version);
+                    fclose(fh);
+                    return false;
+                }
+                rd.getInt<uint32_t>();
+                count = rd.getInt<uint64_t>();
+                nroots = rd.getInt<uint64_t>();
+                for(i = 0; (i < nroots) && !rd.m_failed; i++)
+                {
+                    roots.push_back(rd.getInt<uint64_t>());
+                }
+                m_nodes.resize(1);
+                m_nodes[0].address = 0;
+                m_nodes[0].type = -1;
+                m_nodes[0].size = 0;
+                m_nodes[0].name = "(roots)";
+                m_nodes[0].refaddrs = roots;
+                for(i = 0; (i < count) && !rd.m_failed; i++)
+                {
+                    Node nd;
+                    nd.address = rd.getInt<uint64_t>();
+                    nd.type = rd.getInt<uint8_t>();
+                    nd.size = rd.getInt<uint32_t>();
+                    nd.name = rd.getString();
+                    nd.preview = rd.getString();
+                    nrefs = rd.getInt<uint32_t>();
+                    for(j = 0; (j < nrefs) && !rd.m_failed; j++)
+                    {
+                        nd.refaddrs.push_back(rd.getInt<uint64_t>());
+                    }
+                    byaddress[nd.address] = m_nodes.size();
+                    m_nodes.push_back(std::move(nd));
+                }
+                fclose(fh);
+                if(rd.m_failed)
+                {
+                    fprintf(stderr, "heapanalyze: '%s' is truncated\n", path);
+                    return false;
+                }
+                m_rootcount = roots.size();
+                for(i = 0; i < m_nodes.size(); i++)
+                {
+                    for(uint64_t addr: m_nodes[i].refaddrs)
+                    {
+                        auto it = byaddress.find(addr);
+                        if((it != byaddress.end()) && (it->second != i))
+                        {
+                            m_nodes[i].succs.push_back(it->second);
+                        }
+                    }
+                    m_nodes[i].refaddrs.clear();
+                    m_nodes[i].refaddrs.shrink_to_fit();
+                }
+                return true;
+            }
+
+            /* numbers the nodes reachable from the synthetic root in reverse postorder */
+            void order()
+            {
+                size_t i;
+                size_t at;
+                size_t next;
+                std::vector<char> seen;
+                std::vector<size_t> post;
+                std::vector<std::pair<size_t, size_t>> stack;
+                seen.assign(m_nodes.size(), 0);
+                for(i = 0; i < m_nodes.size(); i++)
+                {
+                    m_nodes[i].rpo = -1;
+                }
+                seen[0] = 1;
+                stack.push_back(std::make_pair((size_t)0, (size_t)0));
+                while(!stack.empty())
+                {
+                    at = stack.back().first;
+                    if(stack.back().second < m_nodes[at].succs.size())
+                    {
+                        next = m_nodes[at].succs[stack.back().second++];
+                        if(!seen[next])
+                        {
+                            seen[next] = 1;
+                            stack.push_back(std::make_pair(next, (size_t)0));
+                        }
+                        continue;
+                    }
+                    post.push_back(at);
+                    stack.pop_back();
+                }
+                m_order.assign(post.rbegin(), post.rend());
+                for(i = 0; i < m_order.size(); i++)
+                {
+                    m_nodes[m_order[i]].rpo = i;
+                }
+                m_unreachable = m_nodes.size() - m_order.size();
+                for(i = 0; i < m_order.size(); i++)
+                {
+                    for(size_t s: m_nodes[m_order[i]].succs)
+                    {
+                        m_nodes[s].preds.push_back(m_order[i]);
+                    }
+                }
+            }
+
+            void dominators()
+            {
+                size_t i;
+                size_t node;
+                size_t newidom;
+                bool changed;
+                bool first;
+                for(i = 0; i < m_nodes.size(); i++)
+                {
+                    m_nodes[i].idom = SIZE_MAX;
+                }
+                m_nodes[0].idom = 0;
+                changed = true;
+                while(changed)
+                {
+                    changed = false;
+                    for(i = 1; i < m_order.size(); i++)
+                    {
+                        node = m_order[i];
+                        newidom = 0;
+                        first = true;
+                        for(size_t p: m_nodes[node].preds)
+                        {
+                            if(m_nodes[p].idom == SIZE_MAX)
+                            {
+                                continue;
+                            }
+                            if(first)
+                            {
+                                newidom = p;
+                                first = false;
+                            }
+                            else
+                            {
+                                newidom = intersect(p, newidom);
+                            }
+                        }
+                        if(m_nodes[node].idom != newidom)
+                        {
+                            m_nodes[node].idom = newidom;
+                            changed = true;
+                        }
+                    }
+                }
+            }
+
+            /* children come after their dominator in reverse postorder, so going backwards adds them up */
+            void retainedSizes()
+            {
+                size_t i;
+                size_t node;
+                for(i = 0; i < m_nodes.size(); i++)
+                {
+                    m_nodes[i].retained = m_nodes[i].size;
+                }
+                i = m_order.size();
+                while(i > 1)
+                {
+                    i--;
+                    node = m_order[i];
+                    m_nodes[m_nodes[node].idom].retained += m_nodes[node].retained;
+                }
+            }
+
+            std::string describe(size_t idx) const
+            {
+                const Node* nd;
+                std::string str;
+                nd = &m_nodes[idx];
+                if(idx == 0)
+                {
+                    return nd->name;
+                }
+                str = typeName(nd->type);
+                if(!nd->name.empty())
+                {
+                    str += " " + nd->name;
+                }
+                if(nd->type == 1)
+                {
+                    str += " \"";
+                    for(char ch: nd->preview)
+                    {
+                        str += ((ch >= 32) && (ch < 127)) ? ch : '.';
+                    }
+                    str += "\"";
+                }
+                return str;
+            }
+
+            void print(FILE* out, size_t topn) const
+            {
+                size_t i;
+                size_t idx;
+                uint64_t total;
+                uint64_t counts[256];
+                uint64_t sizes[256];
+                std::vector<size_t> byretained;
+                total = 0;
+                memset(counts, 0, sizeof(counts));
+                memset(sizes, 0, sizeof(sizes));
+                for(i = 1; i < m_nodes.size(); i++)
+                {
+                    total += m_nodes[i].size;
+                    counts[m_nodes[i].type & 0xFF]++;
+                    sizes[m_nodes[i].type & 0xFF] += m_nodes[i].size;
+                }
+                fprintf(out, "objects: %zu  bytes: %llu  roots: %zu  unreachable: %zu\n\n",
+                    m_nodes.size() - 1, (unsigned long long)total, m_rootcount, m_unreachable);
+                fprintf(out, "%-12s %10s %14s\n", "type", "count", "bytes");
+                for(i = 0; i < 256; i++)
+                {
+                    if(counts[i] > 0)
+                    {
+                        fprintf(out, "%-12s %10llu %14llu\n", typeName(i), (unsigned long long)counts[i], (unsigned long long)sizes[i]);
+                    }
+                }
+                for(i = 1; i < m_order.size(); i++)
+                {
+                    byretained.push_back(m_order[i]);
+                }
+                std::sort(byretained.begin(), byretained.end(), [this](size_t a, size_t b)
+                {
+                    return m_nodes[a].retained > m_nodes[b].retained;
+                });
+                if(byretained.size() > topn)
+                {
+                    byretained.resize(topn);
+                }
+                fprintf(out, "\ntop %zu retainers:\n", byretained.size());
+                fprintf(out, "%4s %14s %10s  %s\n", "#", "retained", "self", "object");
+                for(i = 0; i < byretained.size(); i++)
+                {
+                    idx = byretained[i];
+                    fprintf(out, "%4zu %14llu %10llu  %s\n", i + 1, (unsigned long long)m_nodes[idx].retained,
+                        (unsigned long long)m_nodes[idx].size, describe(idx).c_str());
+                    fprintf(out, "%31s  held by %s\n", "", describe(m_nodes[idx].idom).c_str());
+                }
+            }
+    };
+}
+
+int main(int argc, char** argv)
+{
+    int i;
+    size_t topn;
+    const char* path;
+    topn = 20;
+    path = nullptr;
+    for(i = 1; i < argc; i++)
+    {
+        if((strcmp(argv[i], "-n") == 0) && ((i + 1) < argc))
+        {
+            topn = strtoul(argv[++i], nullptr, 10);
+        }
+        else if(path == nullptr)
+        {
+            path = argv[i];
+        }
+        else
+        {
+            path = nullptr;
+            break;
+        }
+    }
+    if(path == nullptr)
+    {
+        fprintf(stderr, "usage: %s [-n count] <snapshotfile>\n", argv[0]);
+        return 1;
+    }
+    heapanalyze::Snapshot snap;
+    if(!snap.load(path))
+    {
+        return 1;
+    }
+    snap.order();
+    snap.dominators();
+    snap.retainedSizes();
+    snap.print(stdout, topn);
+    return 0;
+}